@@ -0,0 +1,164 @@
+#include "benchmark.h"
+
+#include "../dedelib/bufferedMap.h"
+#include "../dedelib/funcTypes.h"
+#include "../dedelib/generators.h"
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <random>
+
+// Compares lookups of Monotonic<7> keys in the chained BufferedMap and BakedMap layouts and the SwissMap layout.
+// The chained layouts are run with the keys' own hash() and with swissHashOf, so the difference the layout makes is seen apart from the hash
+constexpr static unsigned int HASH_MAP_BENCH_VARIABLES = 7;
+constexpr static size_t HASH_MAP_BENCH_ITEMS = 200000;
+constexpr static size_t HASH_MAP_BENCH_LOOKUPS = 2000000;
+
+using BenchMBF = Monotonic<HASH_MAP_BENCH_VARIABLES>;
+
+struct HashMapBenchSet {
+	// Keys i is mapped to value i
+	std::vector<BenchMBF> keys;
+	// Three in four lookups are hits, in random order
+	std::vector<BenchMBF> lookups;
+};
+
+static const HashMapBenchSet& getHashMapBenchSet() {
+	static HashMapBenchSet benchSet;
+	if(benchSet.keys.empty()) {
+		SwissSet<BenchMBF> uniqueKeys(HASH_MAP_BENCH_ITEMS);
+		while(benchSet.keys.size() < HASH_MAP_BENCH_ITEMS) {
+			BenchMBF mbf = generateMonotonic<HASH_MAP_BENCH_VARIABLES>();
+			if(uniqueKeys.add(mbf)) {
+				benchSet.keys.push_back(mbf);
+			}
+		}
+		std::default_random_engine generator;
+		std::uniform_int_distribution<size_t> keyDistribution(0, HASH_MAP_BENCH_ITEMS - 1);
+		benchSet.lookups.reserve(HASH_MAP_BENCH_LOOKUPS);
+		while(benchSet.lookups.size() < HASH_MAP_BENCH_LOOKUPS) {
+			if(benchSet.lookups.size() % 4 == 3) {
+				BenchMBF mbf = generateMonotonic<HASH_MAP_BENCH_VARIABLES>();
+				if(!uniqueKeys.contains(mbf)) {
+					benchSet.lookups.push_back(mbf);
+				}
+			} else {
+				benchSet.lookups.push_back(benchSet.keys[keyDistribution(generator)]);
+			}
+		}
+	}
+	return benchSet;
+}
+
+class HashMapLookupBenchmark : public Benchmark {
+public:
+	uint64_t hits = 0;
+	uint64_t valueSum = 0;
+
+	HashMapLookupBenchmark(const char* name) : Benchmark(name) {}
+
+	virtual void printResults(double deltaTimeMS) override {
+		std::cout << "Took " << (deltaTimeMS * 1000000.0 / HASH_MAP_BENCH_LOOKUPS) << "ns per lookup, " << hits << " hits, value sum " << valueSum << std::endl;
+	}
+};
+
+// The hash() of a BitSet is the xor of its blocks, which collides for many MBFs. Keyed on this, the chained layouts use the same hash as SwissMap
+struct SwissHashedMBF {
+	BenchMBF mbf;
+
+	SwissHashedMBF() = default;
+	SwissHashedMBF(const BenchMBF& mbf) : mbf(mbf) {}
+
+	uint64_t hash() const {return swissHashOf(mbf);}
+	bool operator==(const SwissHashedMBF& other) const {return this->mbf == other.mbf;}
+};
+
+template<typename Key>
+class BufferedMapLookupBenchmark : public HashMapLookupBenchmark {
+public:
+	BufferedMap<Key, uint64_t> map;
+	std::vector<Key> lookups;
+
+	BufferedMapLookupBenchmark(const char* name) : HashMapLookupBenchmark(name) {}
+
+	virtual void init() override {
+		const HashMapBenchSet& benchSet = getHashMapBenchSet();
+		map = BufferedMap<Key, uint64_t>(benchSet.keys.size());
+		for(size_t i = 0; i < benchSet.keys.size(); i++) {
+			map.add(Key(benchSet.keys[i]), i);
+		}
+		lookups.assign(benchSet.lookups.begin(), benchSet.lookups.end());
+	}
+
+	virtual void run() override {
+		for(const Key& key : lookups) {
+			const KeyValue<Key, uint64_t>* found = map.find(key);
+			if(found != nullptr) {
+				hits++;
+				valueSum += found->value;
+			}
+		}
+	}
+};
+BufferedMapLookupBenchmark<BenchMBF> bufferedMapLookup("bufferedMapLookup");
+BufferedMapLookupBenchmark<SwissHashedMBF> bufferedMapSwissHashLookup("bufferedMapSwissHashLookup");
+
+template<typename Key>
+class BakedMapLookupBenchmark : public HashMapLookupBenchmark {
+public:
+	BakedMap<Key, uint64_t> map;
+	std::vector<KeyValue<Key, uint64_t>> mapData;
+	std::vector<Key> lookups;
+
+	BakedMapLookupBenchmark(const char* name) : HashMapLookupBenchmark(name) {}
+
+	virtual void init() override {
+		const HashMapBenchSet& benchSet = getHashMapBenchSet();
+		BufferedMap<Key, uint64_t> bufMap(benchSet.keys.size());
+		for(size_t i = 0; i < benchSet.keys.size(); i++) {
+			bufMap.add(Key(benchSet.keys[i]), i);
+		}
+		mapData.resize(bufMap.size());
+		map = BakedMap<Key, uint64_t>(bufMap, mapData.data());
+		lookups.assign(benchSet.lookups.begin(), benchSet.lookups.end());
+	}
+
+	virtual void run() override {
+		for(const Key& key : lookups) {
+			const uint64_t* found = map.find(key);
+			if(found != nullptr) {
+				hits++;
+				valueSum += *found;
+			}
+		}
+	}
+};
+BakedMapLookupBenchmark<BenchMBF> bakedMapLookup("bakedMapLookup");
+BakedMapLookupBenchmark<SwissHashedMBF> bakedMapSwissHashLookup("bakedMapSwissHashLookup");
+
+class SwissMapLookupBenchmark : public HashMapLookupBenchmark {
+public:
+	SwissMap<BenchMBF, uint64_t> map;
+
+	SwissMapLookupBenchmark() : HashMapLookupBenchmark("swissMapLookup") {}
+
+	virtual void init() override {
+		const HashMapBenchSet& benchSet = getHashMapBenchSet();
+		map = SwissMap<BenchMBF, uint64_t>(benchSet.keys.size());
+		for(size_t i = 0; i < benchSet.keys.size(); i++) {
+			map.add(benchSet.keys[i], i);
+		}
+	}
+
+	virtual void run() override {
+		for(const BenchMBF& key : getHashMapBenchSet().lookups) {
+			const KeyValue<BenchMBF, uint64_t>* found = map.find(key);
+			if(found != nullptr) {
+				hits++;
+				valueSum += found->value;
+			}
+		}
+	}
+};
+SwissMapLookupBenchmark swissMapLookup;
@@ -4,6 +4,9 @@
 #include <atomic>
 #include <mutex>
 #include <array>
+#include <memory>
+#include <vector>
+#include <iostream>
 #include <fstream>
 
 #include "booleanFunction.h"
@@ -155,6 +158,200 @@ std::pair<BufferedSet<Monotonic<Variables>>, size_t> generateAllMBFsFast() {
 	return std::make_pair(std::move(foundMBFs), numberOfLinks.load());
 }
 
+/*
+	One shard of an MBF layer for generateAllMBFsSharded. A chained hash set that any number of threads add to without locking:
+	a new MBF is written to a freshly claimed node, and then linked in with a compare-and-swap on its bucket's head.
+	If the CAS fails, only the nodes that were added in front of the old head have to be checked again.
+	Nodes live in blocks that are allocated on demand, so a shard never has to be resized while threads are adding to it.
+*/
+template<unsigned int Variables>
+class MBFLayerShard {
+	static constexpr unsigned int BLOCK_BITS = 14;
+	static constexpr size_t BLOCK_SIZE = size_t(1) << BLOCK_BITS;
+	static constexpr size_t MAX_BLOCKS = size_t(1) << 14;
+	static constexpr uint32_t EMPTY = ~uint32_t(0);
+
+	struct Node {
+		Monotonic<Variables> mbf;
+		std::atomic<uint32_t> next;
+		bool wasted; // Claimed, but the MBF turned out to be added by another thread. Only written by the claiming thread
+	};
+
+	std::unique_ptr<std::atomic<Node*>[]> blocks;
+	std::unique_ptr<std::atomic<uint32_t>[]> buckets;
+	size_t bucketMask = 0;
+	std::atomic<uint32_t> claimedNodes;
+
+	Node& getNode(uint32_t index) const {
+		return blocks[index >> BLOCK_BITS].load(std::memory_order_acquire)[index & (BLOCK_SIZE - 1)];
+	}
+	uint32_t claimNode() {
+		uint32_t index = claimedNodes.fetch_add(1, std::memory_order_relaxed);
+		size_t block = index >> BLOCK_BITS;
+		assert(block < MAX_BLOCKS);
+		if(blocks[block].load(std::memory_order_acquire) == nullptr) {
+			Node* newBlock = new Node[BLOCK_SIZE];
+			Node* expected = nullptr;
+			if(!blocks[block].compare_exchange_strong(expected, newBlock, std::memory_order_acq_rel)) {
+				delete[] newBlock;
+			}
+		}
+		return index;
+	}
+public:
+	MBFLayerShard() : blocks(new std::atomic<Node*>[MAX_BLOCKS]), claimedNodes(0) {
+		for(size_t i = 0; i < MAX_BLOCKS; i++) blocks[i].store(nullptr);
+	}
+	~MBFLayerShard() {
+		for(size_t i = 0; i < MAX_BLOCKS; i++) delete[] blocks[i].load();
+	}
+
+	// Not thread safe, clears the shard for the next layer. The node blocks are kept
+	void reset(size_t expectedSize) {
+		size_t bucketCount = 64;
+		while(bucketCount < expectedSize) bucketCount *= 2;
+		if(bucketCount != bucketMask + 1) {
+			buckets.reset(new std::atomic<uint32_t>[bucketCount]);
+			bucketMask = bucketCount - 1;
+		}
+		for(size_t i = 0; i < bucketCount; i++) buckets[i].store(EMPTY, std::memory_order_relaxed);
+		claimedNodes.store(0, std::memory_order_relaxed);
+	}
+
+	// returns wasAdded, may be called from many threads at once
+	bool add(const Monotonic<Variables>& mbf, uint64_t mixedHash) {
+		std::atomic<uint32_t>& bucket = buckets[(mixedHash >> 20) & bucketMask];
+		uint32_t head = bucket.load(std::memory_order_acquire);
+		uint32_t checkedUpTo = EMPTY;
+		uint32_t newNode = EMPTY;
+		while(true) {
+			for(uint32_t i = head; i != checkedUpTo; i = getNode(i).next.load(std::memory_order_relaxed)) {
+				if(getNode(i).mbf == mbf) {
+					if(newNode != EMPTY) getNode(newNode).wasted = true;
+					return false;
+				}
+			}
+			if(newNode == EMPTY) {
+				newNode = claimNode();
+				getNode(newNode).mbf = mbf;
+				getNode(newNode).wasted = false;
+			}
+			getNode(newNode).next.store(head, std::memory_order_relaxed);
+			checkedUpTo = head;
+			if(bucket.compare_exchange_weak(head, newNode, std::memory_order_release, std::memory_order_acquire)) {
+				return true;
+			}
+		}
+	}
+
+	// Not thread safe
+	size_t size() const {
+		size_t count = 0;
+		for(uint32_t i = 0; i < claimedNodes.load(); i++) count += !getNode(i).wasted;
+		return count;
+	}
+	// Not thread safe, returns the number of MBFs written
+	size_t copyTo(Monotonic<Variables>* out) const {
+		Monotonic<Variables>* start = out;
+		for(uint32_t i = 0; i < claimedNodes.load(); i++) {
+			const Node& node = getNode(i);
+			if(!node.wasted) *out++ = node.mbf;
+		}
+		return out - start;
+	}
+};
+
+/*
+	Generates the same MBFs and link count as generateAllMBFsFast, but layer by layer: every MBF of size n+1 is an expansion of one of size n.
+	Each layer is expanded by all threads at once, the expansions are hash-partitioned over shards and added to their shard without locks.
+	At the end of a layer the shards are compacted in parallel into the result, where they form the next layer to expand.
+	The MBFs in the result are ordered by size. Its hash chains are built in parallel at the end.
+*/
+template<unsigned int Variables>
+std::pair<BufferedSet<Monotonic<Variables>>, size_t> generateAllMBFsSharded(int numberOfThreads = std::thread::hardware_concurrency()) {
+#ifdef NO_MULTITHREAD
+	numberOfThreads = 1;
+#endif
+	BufferedSet<Monotonic<Variables>> foundMBFs(mbfCounts[Variables] + mbfCounts[Variables] / 16); // some extra buffer room
+	Monotonic<Variables>* mbfs = foundMBFs.begin(); // Filled layer by layer, linked into the hash chains at the end
+
+	unsigned int shardBits = 4;
+	while((size_t(1) << shardBits) < size_t(numberOfThreads) * 8) shardBits++;
+	size_t shardCount = size_t(1) << shardBits;
+	std::unique_ptr<MBFLayerShard<Variables>[]> shards(new MBFLayerShard<Variables>[shardCount]);
+	// The shard is taken from the top bits of the hash, the bucket from the middle. Not mbf.hash(), that xor of the blocks collides for many MBFs
+
+	auto runOnAllThreads = [numberOfThreads](const auto& func) {
+		std::vector<std::thread> threads;
+		for(int t = 1; t < numberOfThreads; t++) threads.emplace_back(func);
+		func();
+		for(std::thread& t : threads) t.join();
+	};
+
+	mbfs[0] = Monotonic<Variables>::getBot();
+	size_t layerStart = 0;
+	size_t layerEnd = 1;
+	std::atomic<size_t> numberOfLinks(0);
+	while(!mbfs[layerStart].isFull()) {
+		size_t expectedShardSize = (layerEnd - layerStart) * 4 / shardCount;
+		for(size_t s = 0; s < shardCount; s++) shards[s].reset(expectedShardSize);
+
+		constexpr size_t EXPAND_BLOCK = 256;
+		std::atomic<size_t> nextToExpand(layerStart);
+		runOnAllThreads([&]() {
+			size_t linksFound = 0;
+			std::pair<Monotonic<Variables>, int> expandedMBFs[MAX_EXPANSION];
+			for(size_t block; (block = nextToExpand.fetch_add(EXPAND_BLOCK)) < layerEnd;) {
+				size_t blockEnd = std::min(block + EXPAND_BLOCK, layerEnd);
+				for(size_t i = block; i < blockEnd; i++) {
+					size_t newMBFFoundCount = findAllExpandedMBFsFast(mbfs[i], expandedMBFs);
+					linksFound += newMBFFoundCount;
+					for(size_t j = 0; j < newMBFFoundCount; j++) {
+						uint64_t hash = swissHashOf(expandedMBFs[j].first);
+						shards[hash >> (64 - shardBits)].add(expandedMBFs[j].first, hash);
+					}
+				}
+			}
+			numberOfLinks.fetch_add(linksFound);
+		});
+
+		std::unique_ptr<size_t[]> shardOffsets(new size_t[shardCount + 1]);
+		std::atomic<size_t> nextShard(0);
+		runOnAllThreads([&]() {
+			for(size_t s; (s = nextShard.fetch_add(1)) < shardCount;) shardOffsets[s + 1] = shards[s].size();
+		});
+		shardOffsets[0] = layerEnd;
+		for(size_t s = 0; s < shardCount; s++) shardOffsets[s + 1] += shardOffsets[s];
+		if(shardOffsets[shardCount] > mbfCounts[Variables]) {
+			std::cerr << "generateAllMBFsSharded: Found more MBFs than exist! Aborting!" << std::endl;
+			std::abort();
+		}
+		nextShard.store(0);
+		runOnAllThreads([&]() {
+			for(size_t s; (s = nextShard.fetch_add(1)) < shardCount;) shards[s].copyTo(mbfs + shardOffsets[s]);
+		});
+
+		layerStart = layerEnd;
+		layerEnd = shardOffsets[shardCount];
+	}
+
+	// Same structure as BufferedSet::add would build, the order within a bucket's chain doesn't matter
+	foundMBFs.itemCount = layerEnd;
+	constexpr size_t LINK_BLOCK = 4096;
+	std::atomic<size_t> nextToLink(0);
+	runOnAllThreads([&]() {
+		for(size_t block; (block = nextToLink.fetch_add(LINK_BLOCK)) < layerEnd;) {
+			size_t blockEnd = std::min(block + LINK_BLOCK, layerEnd);
+			for(size_t i = block; i < blockEnd; i++) {
+				unsigned int previousHead = foundMBFs.getBucketFor(mbfs[i].hash())->exchange(static_cast<unsigned int>(i));
+				foundMBFs.nextNodeBuffer[i].store(previousHead);
+			}
+		}
+	});
+
+	return std::make_pair(std::move(foundMBFs), numberOfLinks.load());
+}
+
 struct LinkedNode {
 	uint32_t count : 8; // max 35
 	uint32_t index : 24; // max 16440466, which is just shy of 2^24
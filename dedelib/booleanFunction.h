@@ -103,6 +103,56 @@ bool hasPermutationImpl(BooleanFunction<Variables> cur, const Predicate& func) {
 	}
 }
 
+/*
+	The Steinhaus-Johnson-Trotter sequence of adjacent transpositions that visits all permutations of Count elements.
+	Element i of the result means: swap positions i and i+1.
+*/
+template<unsigned int Count>
+constexpr std::array<unsigned int, factorial(Count) - 1> adjacentTranspositionSequence() {
+	std::array<unsigned int, factorial(Count) - 1> result{};
+	if constexpr(Count >= 2) {
+		constexpr std::array<unsigned int, factorial(Count - 1) - 1> inner = adjacentTranspositionSequence<Count - 1>();
+		size_t resultI = 0;
+		for(size_t innerPerm = 0; innerPerm < factorial(Count - 1); innerPerm++) {
+			// The last element sweeps right to left on even inner permutations, and left to right on odd ones
+			bool sweepLeft = innerPerm % 2 == 0;
+			for(unsigned int step = 0; step < Count - 1; step++) {
+				result[resultI++] = sweepLeft ? (Count - 2 - step) : step;
+			}
+			if(innerPerm + 1 < factorial(Count - 1)) {
+				// The last element now sits at the front after a left sweep, shifting the inner swap by one
+				result[resultI++] = inner[innerPerm] + (sweepLeft ? 1 : 0);
+			}
+		}
+	}
+	return result;
+}
+
+// Below this many unfixed variables, forEachPermutationBelow stops pruning and walks the remaining permutations one adjacent swap at a time
+constexpr unsigned int PERMUTATION_WALK_TAIL = 4;
+
+template<unsigned int Variables, unsigned int Current, typename Func>
+void forEachPermutationBelowImpl(BooleanFunction<Variables> cur, const BooleanFunction<Variables>& top, const BitSet<(size_t(1) << Variables)>* extremeSliceMasks, const Func& func) {
+	if constexpr(Variables - Current <= PERMUTATION_WALK_TAIL) {
+		constexpr std::array<unsigned int, factorial(Variables - Current) - 1> walk = adjacentTranspositionSequence<Variables - Current>();
+		if(cur.isSubSetOf(top)) func(cur);
+		for(unsigned int swapPos : walk) {
+			cur.swap(Current + swapPos, Current + swapPos + 1);
+			if(cur.isSubSetOf(top)) func(cur);
+		}
+	} else {
+		// Variable positions up to and including Current are fixed for the subtree, the rest are still free to permute. 
+		// Permuting the free variables maps the elements where all of them are 0, or all are 1, onto themselves. 
+		// So if any of those is not in top, no permutation in the subtree can be. 
+		for(unsigned int swapping = Current; swapping < Variables; swapping++) {
+			if(swapping != Current) cur.swap(Current, swapping);
+			if(isSubSet(cur.bitset & extremeSliceMasks[Current + 1], top.bitset)) {
+				forEachPermutationBelowImpl<Variables, Current + 1, Func>(cur, top, extremeSliceMasks, func);
+			}
+		}
+	}
+}
+
 template<unsigned int Variables>
 class BooleanFunction {
 	static_assert(Variables >= 1, "Cannot make 0 variable BooleanFunction");
@@ -401,6 +451,31 @@ public:
 		forEachPermutationImpl<Variables, 0, Func>(*this, func);
 	}
 
+	/*
+		Calls func(const BooleanFunction& permuted) for every permutation of this which is a subset of top. 
+		Same results in the same multiplicity as forEachPermutation with a subset test, possibly in a different order. 
+		Variables are fixed one by one, skipping subtrees of permutations which cannot fit anymore. 
+	*/
+	template<typename Func>
+	void forEachPermutationBelow(const BooleanFunction& top, const Func& func) const {
+		// Permutations keep every element in its layer
+		for(unsigned int layer = 0; layer <= Variables; layer++) {
+			if((this->bitset & layerMask(layer)).count() > (top.bitset & layerMask(layer)).count()) return;
+		}
+		// extremeSliceMasks[fixed]: the elements for which all variables from fixed upward are 0, or all are 1
+		Bits extremeSliceMasks[Variables + 1];
+		for(unsigned int fixed = 0; fixed <= Variables; fixed++) {
+			Bits allZero = Bits::full();
+			Bits allOne = Bits::full();
+			for(unsigned int v = fixed; v < Variables; v++) {
+				allZero = andnot(allZero, varMask(v));
+				allOne &= varMask(v);
+			}
+			extremeSliceMasks[fixed] = allZero | allOne;
+		}
+		forEachPermutationBelowImpl<Variables, 0, Func>(*this, top, extremeSliceMasks, func);
+	}
+
 	// Expects a predicate of the form bool(BooleanFunction<Variables>)
 	template<typename Predicate>
 	bool hasPermutation(const Predicate& func) const {
@@ -14,6 +14,7 @@
 #include <vector>
 #include <algorithm>
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <chrono>
 #include <iostream>
@@ -21,17 +22,20 @@
 
 #include "flatBufferManagement.h"
 #include "fileNames.h"
+#include "linkCompression.h"
+#include "sharedBufferCache.h"
+#include "jobCheckpoint.h"
 
 #include "aligned_alloc.h"
 
 #include "threadUtils.h"
+#include "pipelineTelemetry.h"
 #include <pthread.h>
 #include "threadPool.h"
 
 #include "numaMem.h"
+#include "topology.h"
 
-typedef uint8_t swapper_block;
-constexpr int BUFFERS_PER_BATCH = sizeof(swapper_block) * 8;
 constexpr size_t PREFETCH_OFFSET = 48;
 
 constexpr size_t FPGA_BLOCK_SIZE = 32;
@@ -103,9 +107,10 @@ static int initializeSwapperRun(
 	return highestLayer;
 }
 
+template<size_t BatchWidth>
 static void initializeSwapperTops(
 	unsigned int Variables,
-	swapper_block* __restrict swapper,
+	swapper_block<BatchWidth>* __restrict swapper,
 	int currentLayer,
 	const JobTopInfo* __restrict tops,
 	const int* topLayers,
@@ -114,7 +119,7 @@ static void initializeSwapperTops(
 	for(int topI = 0; topI < numberOfTops; topI++) {
 		if(topLayers[topI] == currentLayer) {
 			uint32_t topIdxInLayer = tops[topI].top - flatNodeLayerOffsets[Variables][currentLayer];
-			swapper[topIdxInLayer] |= swapper_block(1) << topI;
+			swapper[topIdxInLayer].set(topI);
 		}
 	}
 }
@@ -203,33 +208,41 @@ static void finalizeBuffer(unsigned int Variables, JobInfo& resultBuffer, const
 	std::cout << text << std::flush;*/
 }
 
+template<size_t BatchWidth>
 static void finalizeBuffersMasked(
 	unsigned int Variables,
-	swapper_block bufferMask,
+	swapper_block<BatchWidth> bufferMask,
 	uint32_t nodeOffset, 
 	const JobTopInfo* tops,
 	JobInfo* __restrict resultBuffers
 ) {
-	while(bufferMask != 0) {
-		static_assert(BUFFERS_PER_BATCH == 8);
-		int idx = ctz8(bufferMask);
-		bufferMask &= ~(swapper_block(1) << idx);
-
+	bufferMask.forEachOne([&](size_t idx) {
 		finalizeBuffer(Variables, resultBuffers[idx], tops[idx], nodeOffset);
+	});
+}
+
+// Has a 1 for the first numberOfTops tops
+template<size_t BatchWidth>
+static swapper_block<BatchWidth> firstTopsMask(int numberOfTops) {
+	swapper_block<BatchWidth> mask = swapper_block<BatchWidth>::empty();
+	for(int topI = 0; topI < numberOfTops; topI++) {
+		mask.set(topI);
 	}
+	return mask;
 }
 
+template<size_t BatchWidth>
 static void computeNextLayerLinks (
 	const uint32_t* __restrict links, // Links index from the previous layer to this layer. Last element of a link streak will have a 1 in the 31 bit position. 
-	const swapper_block* __restrict swapperIn,
-	swapper_block* __restrict swapperOut,
+	const swapper_block<BatchWidth>* __restrict swapperIn,
+	swapper_block<BatchWidth>* __restrict swapperOut,
 	uint32_t numberOfLinksToLayer
 #ifndef NDEBUG
 	,uint32_t fromLayerSize,
 	uint32_t toLayerSize
 #endif
 ) {
-	swapper_block currentConnectionsIn = 0;
+	swapper_block<BatchWidth> currentConnectionsIn = swapper_block<BatchWidth>::empty();
 	uint32_t curNodeI = 0;
 	for(uint32_t linkI = 0; linkI < numberOfLinksToLayer; linkI++) {
 		uint32_t curLink = links[linkI];
@@ -239,7 +252,7 @@ static void computeNextLayerLinks (
 		if((curLink & uint32_t(0x80000000)) != 0) {
 			assert(curNodeI < toLayerSize);
 			swapperOut[curNodeI] = currentConnectionsIn;
-			currentConnectionsIn = 0;
+			currentConnectionsIn = swapper_block<BatchWidth>::empty();
 			curNodeI++;
 		}
 
@@ -255,121 +268,302 @@ static void computeNextLayerLinks (
 	assert(curNodeI == toLayerSize);
 }
 
-static swapper_block pushSwapperResults(
-	unsigned int Variables,
-	const JobTopInfo* tops,
-	const swapper_block* __restrict swapper,
-	uint32_t resultIndexOffset,
-	JobInfo* __restrict resultBuffers,
-	swapper_block activeMask, // Has a 1 for active buffers
-	uint32_t swapperSize
+constexpr size_t DECODE_BATCH_GROUPS = 16;
+constexpr size_t DECODE_BATCH_LINKS = DECODE_BATCH_GROUPS * 4;
+
+/*
+	Same as computeNextLayerLinks, but for a block of the compressed link file. 
+	Links are decoded one batch ahead into a small double buffer, the swapperIn lines of the next batch are prefetched while decoding it. 
+*/
+template<size_t BatchWidth>
+static void computeNextLayerLinksCompressed (
+	const uint8_t* __restrict compressedLinks, // Start of the compressed block of links to this layer
+	const swapper_block<BatchWidth>* __restrict swapperIn,
+	swapper_block<BatchWidth>* __restrict swapperOut,
+	uint32_t numberOfLinksToLayer
+#ifndef NDEBUG
+	,uint32_t fromLayerSize,
+	uint32_t toLayerSize
+#endif
 ) {
-	swapper_block finishedConnections = activeMask;
+	alignas(64) uint32_t decodedLinks[2][DECODE_BATCH_LINKS];
+	__m128i previousFromIdx = _mm_setzero_si128();
 
-	for(uint32_t curNodeI = 0; curNodeI < swapperSize; curNodeI++) {
-		swapper_block currentConnectionsIn = swapper[curNodeI];
-		finishedConnections &= currentConnectionsIn;
+	size_t totalGroups = (numberOfLinksToLayer + 3) / 4;
+	size_t decodedGroups = std::min(totalGroups, DECODE_BATCH_GROUPS);
+	compressedLinks = decodeLinkGroups(compressedLinks, decodedGroups, previousFromIdx, decodedLinks[0]);
+
+	swapper_block<BatchWidth> currentConnectionsIn = swapper_block<BatchWidth>::empty();
+	uint32_t curNodeI = 0;
+	for(uint32_t batchStart = 0, batchI = 0; batchStart < numberOfLinksToLayer; batchStart += DECODE_BATCH_LINKS, batchI++) {
+		const uint32_t* batch = decodedLinks[batchI % 2];
+
+		if(decodedGroups < totalGroups) {
+			size_t groupsToDecode = std::min(totalGroups - decodedGroups, DECODE_BATCH_GROUPS);
+			uint32_t* nextBatch = decodedLinks[(batchI + 1) % 2];
+			compressedLinks = decodeLinkGroups(compressedLinks, groupsToDecode, previousFromIdx, nextBatch);
+			decodedGroups += groupsToDecode;
+			for(size_t i = 0; i < groupsToDecode * 4; i++) {
+				_mm_prefetch(swapperIn + (nextBatch[i] & uint32_t(0x7FFFFFFF)), _MM_HINT_T0);
+			}
+		}
+
+		uint32_t linksInBatch = std::min(numberOfLinksToLayer - batchStart, uint32_t(DECODE_BATCH_LINKS));
+		for(uint32_t linkI = 0; linkI < linksInBatch; linkI++) {
+			uint32_t curLink = batch[linkI];
+			uint32_t fromIdx = curLink & uint32_t(0x7FFFFFFF);
+			assert(fromIdx < fromLayerSize);
+			currentConnectionsIn |= swapperIn[fromIdx];
+			if((curLink & uint32_t(0x80000000)) != 0) {
+				assert(curNodeI < toLayerSize);
+				swapperOut[curNodeI] = currentConnectionsIn;
+				currentConnectionsIn = swapper_block<BatchWidth>::empty();
+				curNodeI++;
+			}
+		}
 	}
 
-	for(size_t bufI = 0; bufI < BUFFERS_PER_BATCH; bufI++) {
-		swapper_block bufBit = swapper_block(1) << bufI;
-		if((activeMask & bufBit) == 0) continue;
-		uint32_t curTopDual = tops[bufI].topDual;
-		uint32_t*& curBufEnd = resultBuffers[bufI].bufEnd;
+	assert(curNodeI == toLayerSize);
+}
+
+// Fills swapperOut for toLayer from swapperIn for toLayer+1
+template<size_t BatchWidth>
+static void computeNextLayer(
+	unsigned int Variables,
+	SwapperLinks links,
+	int toLayer,
+	const swapper_block<BatchWidth>* __restrict swapperIn,
+	swapper_block<BatchWidth>* __restrict swapperOut
+) {
+	size_t blockI = (size_t(1) << Variables) - 1 - toLayer; // Reverse order of mbf structure for better memory access pattern
+	uint32_t numberOfLinksToLayer = linkCounts[Variables][toLayer];
 
-		uint32_t upTo = resultIndexOffset + swapperSize;
+	if(links.isCompressed) {
+		computeNextLayerLinksCompressed(getCompressedLinkBlock(links.data, blockI), swapperIn, swapperOut, numberOfLinksToLayer
+#ifndef NDEBUG
+			,layerSizes[Variables][toLayer+1],layerSizes[Variables][toLayer]
+#endif
+		);
+	} else {
+		const uint32_t* thisLayerLinks = static_cast<const uint32_t*>(links.data) + flatLinkOffsets[Variables][blockI];
+		assert(toLayer == (1 << Variables) - 1 || (thisLayerLinks[-1] & uint32_t(0x80000000)) != 0);
+		assert((thisLayerLinks[numberOfLinksToLayer-1] & uint32_t(0x80000000)) != 0);
+		computeNextLayerLinks(thisLayerLinks, swapperIn, swapperOut, numberOfLinksToLayer
+#ifndef NDEBUG
+			,layerSizes[Variables][toLayer+1],layerSizes[Variables][toLayer]
+#endif
+		);
+	}
+}
+
+// Calls func(topI, node) for every node of the layer reached by an active top, in increasing node order per top
+template<size_t BatchWidth, typename Func>
+static void forEachReachedNode(
+	const JobTopInfo* tops,
+	const swapper_block<BatchWidth>* __restrict swapper,
+	uint32_t nodeOffset,
+	swapper_block<BatchWidth> activeMask,
+	uint32_t swapperSize,
+	const Func& func
+) {
+	for(uint32_t curNodeI = 0; curNodeI < swapperSize; curNodeI++) {
+		uint32_t thisValue = nodeOffset + curNodeI;
+		(swapper[curNodeI] & activeMask).forEachOne([&](size_t topI) {
 #ifdef PCOEFF_DEDUPLICATE
-		if(curTopDual < upTo) {
-			upTo = curTopDual;
-		}
+			if(thisValue >= tops[topI].topDual) return;
 #endif
+			func(topI, thisValue);
+		});
+	}
+}
 
-		for(uint32_t thisValue = resultIndexOffset; thisValue < upTo; thisValue++) {
-			if((swapper[thisValue - resultIndexOffset] & bufBit) != 0) {
-				addValueToBlockFPGA(curBufEnd, thisValue);
-			}
-		}
+// Has a 1 for the active tops that reached every node of the layer
+template<size_t BatchWidth>
+static swapper_block<BatchWidth> getFinishedConnections(
+	const swapper_block<BatchWidth>* __restrict swapper,
+	swapper_block<BatchWidth> activeMask,
+	uint32_t swapperSize
+) {
+	swapper_block<BatchWidth> finishedConnections = activeMask;
+	for(uint32_t curNodeI = 0; curNodeI < swapperSize; curNodeI++) {
+		finishedConnections &= swapper[curNodeI];
 	}
+	return finishedConnections;
+}
+
+template<size_t BatchWidth>
+static swapper_block<BatchWidth> pushSwapperResults(
+	unsigned int Variables,
+	const JobTopInfo* tops,
+	const swapper_block<BatchWidth>* __restrict swapper,
+	uint32_t resultIndexOffset,
+	JobInfo* __restrict resultBuffers,
+	swapper_block<BatchWidth> activeMask, // Has a 1 for active buffers
+	uint32_t swapperSize
+) {
+	swapper_block<BatchWidth> finishedConnections = getFinishedConnections(swapper, activeMask, swapperSize);
+
+	forEachReachedNode(tops, swapper, resultIndexOffset, activeMask, swapperSize, [&](size_t bufI, uint32_t thisValue) {
+		addValueToBlockFPGA(resultBuffers[bufI].bufEnd, thisValue);
+	});
 
 	finalizeBuffersMasked(Variables, finishedConnections, resultIndexOffset, tops, resultBuffers);
 
-	return activeMask & ~finishedConnections;
+	return andnot(activeMask, finishedConnections);
 }
 
+template<size_t BatchWidth>
 static void generateBotBuffers(
 	unsigned int Variables, 
-	swapper_block* __restrict swapperA,
-	swapper_block* __restrict swapperB,
+	swapper_block<BatchWidth>* __restrict swapperA,
+	swapper_block<BatchWidth>* __restrict swapperB,
 	uint32_t* __restrict * __restrict resultBuffers,
-	SynchronizedMultiQueue<JobInfo>& outputQueue,
-	size_t socket,
-	const uint32_t* __restrict links,
+	JobInfo* __restrict jobs,
+	SwapperLinks links,
 	const JobTopInfo* tops,
 	int numberOfTops
 ) {
-	memset(swapperA, 0, sizeof(swapper_block) * getMaxLayerSize(Variables));
+	memset(static_cast<void*>(swapperA), 0, sizeof(swapper_block<BatchWidth>) * getMaxLayerSize(Variables));
 
-	JobInfo jobs[BUFFERS_PER_BATCH];
 	for(int i = 0; i < numberOfTops; i++) {
 		jobs[i].bufStart = resultBuffers[i];
 		jobs[i].bufEnd = resultBuffers[i];
 	}
 
-	int topLayers[BUFFERS_PER_BATCH];
+	int topLayers[BatchWidth];
 	int startingLayer = initializeSwapperRun(Variables, jobs, tops, topLayers, numberOfTops);
 
-	swapper_block activeMask = numberOfTops == BUFFERS_PER_BATCH ? swapper_block(0xFFFFFFFFFFFFFFFF) : (swapper_block(1) << numberOfTops) - 1; // Has a 1 for active buffers
+	swapper_block<BatchWidth> activeMask = firstTopsMask<BatchWidth>(numberOfTops); // Has a 1 for active buffers
 
-	// Reverse order of mbf structure for better memory access pattern
-	const uint32_t* thisLayerLinks = links + flatLinkOffsets[Variables][(1 << Variables) - startingLayer];
 	for(int toLayer = startingLayer - 1; toLayer >= 0; toLayer--) {
 		initializeSwapperTops(Variables, swapperA, toLayer+1, tops, topLayers, numberOfTops);
 
-		size_t numberOfLinksToLayer = linkCounts[Variables][toLayer];
-		assert(toLayer == (1 << Variables) - 1 || (thisLayerLinks[-1] & uint32_t(0x80000000)) != 0);
-		assert((thisLayerLinks[numberOfLinksToLayer-1] & uint32_t(0x80000000)) != 0);
-
 		uint32_t nodeOffset = flatNodeLayerOffsets[Variables][toLayer];
 
-		// Computes BUFFERS_PER_BATCH result buffers at a time
-		computeNextLayerLinks(thisLayerLinks, swapperA, swapperB, numberOfLinksToLayer
-#ifndef NDEBUG
-			,layerSizes[Variables][toLayer+1],layerSizes[Variables][toLayer]
-#endif
-		);
+		// Computes BatchWidth result buffers at a time
+		computeNextLayer(Variables, links, toLayer, swapperA, swapperB);
 
 		activeMask = pushSwapperResults(Variables, tops, swapperB, nodeOffset, jobs, activeMask, layerSizes[Variables][toLayer]);
 
-		if(activeMask == 0) break;
-
-		thisLayerLinks += numberOfLinksToLayer;
+		if(activeMask.isEmpty()) break;
 
 		std::swap(swapperA, swapperB);
 	}
 
 	finalizeBuffersMasked(Variables, activeMask, 0, tops, jobs);
+}
+
+template<size_t BatchWidth>
+void generateBotChunks(
+	unsigned int Variables,
+	swapper_block<BatchWidth>* __restrict swapperA,
+	swapper_block<BatchWidth>* __restrict swapperB,
+	SwapperLinks links,
+	const JobTopInfo* tops,
+	int numberOfTops,
+	const std::function<BotChunk*()>& getFreeChunk,
+	const std::function<void(BotChunk*)>& submitChunk
+) {
+	memset(static_cast<void*>(swapperA), 0, sizeof(swapper_block<BatchWidth>) * getMaxLayerSize(Variables));
+
+	BotChunk* chunks[BatchWidth];
+	auto takeNewChunk = [&](int topI) {
+		chunks[topI] = getFreeChunk();
+		chunks[topI]->topInBatch = topI;
+		chunks[topI]->botCount = 0;
+	};
+	auto addBot = [&](int topI, NodeIndex bot) {
+		BotChunk* chunk = chunks[topI];
+		chunk->bots[chunk->botCount++] = bot;
+		if(chunk->botCount == FUSED_CHUNK_SIZE) {
+			submitChunk(chunk);
+			takeNewChunk(topI);
+		}
+	};
+	// Same bottoms as finalizeBuffer adds, all nodes below nodeOffset
+	auto addAllBotsBelow = [&](swapper_block<BatchWidth> finishedMask, uint32_t nodeOffset) {
+		finishedMask.forEachOne([&](size_t topI) {
+			uint32_t fillUpTo = nodeOffset;
+#ifdef PCOEFF_DEDUPLICATE
+			if(tops[topI].topDual < fillUpTo) fillUpTo = tops[topI].topDual;
+#endif
+			for(uint32_t bot = 0; bot < fillUpTo; bot++) {
+				addBot(topI, bot);
+			}
+		});
+	};
+
+	int topLayers[BatchWidth];
+	int startingLayer = 0;
+	for(int topI = 0; topI < numberOfTops; topI++) {
+		takeNewChunk(topI);
+		int layer = getFlatLayerOfIndex(Variables, tops[topI].top);
+		if(layer > startingLayer) startingLayer = layer;
+		topLayers[topI] = layer;
+#ifdef PCOEFF_DEDUPLICATE
+		if(tops[topI].top < tops[topI].topDual)
+#endif
+			addBot(topI, tops[topI].top);
+	}
+
+	swapper_block<BatchWidth> activeMask = firstTopsMask<BatchWidth>(numberOfTops); // Has a 1 for active tops
+
+	for(int toLayer = startingLayer - 1; toLayer >= 0; toLayer--) {
+		initializeSwapperTops(Variables, swapperA, toLayer+1, tops, topLayers, numberOfTops);
+
+		uint32_t nodeOffset = flatNodeLayerOffsets[Variables][toLayer];
+		uint32_t layerSize = layerSizes[Variables][toLayer];
 
-	outputQueue.pushN(socket, jobs, numberOfTops);
+		computeNextLayer(Variables, links, toLayer, swapperA, swapperB);
+
+		swapper_block<BatchWidth> finishedConnections = getFinishedConnections(swapperB, activeMask, layerSize);
+
+		forEachReachedNode(tops, swapperB, nodeOffset, activeMask, layerSize, [&](size_t topI, uint32_t bot) {
+			addBot(topI, bot);
+		});
+
+		addAllBotsBelow(finishedConnections, nodeOffset);
+		activeMask = andnot(activeMask, finishedConnections);
+
+		if(activeMask.isEmpty()) break;
+
+		std::swap(swapperA, swapperB);
+	}
+
+	for(int topI = 0; topI < numberOfTops; topI++) {
+		submitChunk(chunks[topI]);
+	}
 }
 
+#define INSTANTIATE_GENERATE_BOT_CHUNKS(BatchWidth) template void generateBotChunks<BatchWidth>(unsigned int, swapper_block<BatchWidth>*, swapper_block<BatchWidth>*, SwapperLinks, const JobTopInfo*, int, const std::function<BotChunk*()>&, const std::function<void(BotChunk*)>&);
+INSTANTIATE_GENERATE_BOT_CHUNKS(8)
+INSTANTIATE_GENERATE_BOT_CHUNKS(64)
+INSTANTIATE_GENERATE_BOT_CHUNKS(128)
+INSTANTIATE_GENERATE_BOT_CHUNKS(256)
+INSTANTIATE_GENERATE_BOT_CHUNKS(512)
+
 static void runBottomBufferCreatorNoAlloc (
 	unsigned int Variables,
 	std::atomic<const JobTopInfo*>& curStartingJobTop,
 	const JobTopInfo* jobTopsEnd,
 	PCoeffProcessingContext& context,
 	size_t coreComplex,
-	std::atomic<const uint32_t*>& links
+	std::atomic<const void*>& links,
+	bool linksAreCompressed
 ) {
 	size_t SWAPPER_WIDTH = getMaxLayerSize(Variables);
-	swapper_block* swapperA = aligned_mallocT<swapper_block>(SWAPPER_WIDTH, 64);
-	swapper_block* swapperB = aligned_mallocT<swapper_block>(SWAPPER_WIDTH, 64);
+	swapper_block<BUFFERS_PER_BATCH>* swapperA = aligned_mallocT<swapper_block<BUFFERS_PER_BATCH>>(SWAPPER_WIDTH, 64);
+	swapper_block<BUFFERS_PER_BATCH>* swapperB = aligned_mallocT<swapper_block<BUFFERS_PER_BATCH>>(SWAPPER_WIDTH, 64);
 
 	std::cout << "\033[33m[BottomBufferCreator " + std::to_string(coreComplex) + "] Thread Started!\033[39m\n" << std::flush;
 
-	size_t socket = coreComplex / 8;
+	size_t socket = context.getSliceOfCoreComplex(coreComplex);
 	PCoeffProcessingContextEighth& subContext = *context.numaQueues[socket];
+	ThreadTelemetry& telemetry = pipelineTelemetry.registerThread("BottomBufferCreator " + std::to_string(coreComplex), PipelineStage::BOTTOM_BUFFER_CREATOR);
+	StageTelemetry& stageTelemetry = pipelineTelemetry.getStage(PipelineStage::BOTTOM_BUFFER_CREATOR);
 
 	while(true) {
+		if(isActiveJobAbandoned()) break;
 		const JobTopInfo* grabbedTopSet = curStartingJobTop.fetch_add(BUFFERS_PER_BATCH);
 		if(grabbedTopSet >= jobTopsEnd) break;
 
@@ -378,13 +572,29 @@ static void runBottomBufferCreatorNoAlloc (
 		//std::cout << std::this_thread::get_id() << " grabbed " << numberOfTops << " tops!" << std::endl;
 
 		uint32_t* buffersEnd[BUFFERS_PER_BATCH];
-		subContext.inputBufferAlloc.popN_wait(buffersEnd, numberOfTops);
+		{
+			TelemetryTimer waitTimer(stageTelemetry.bufferWaitNanos);
+			subContext.allocInputBuffers(Variables, grabbedTopSet, buffersEnd, numberOfTops);
+		}
 
-		generateBotBuffers(Variables, swapperA, swapperB, buffersEnd, context.inputQueue, socket, links.load(), grabbedTopSet, numberOfTops);
+		telemetry.setBusy(true);
+		uint64_t batchStartTime = telemetryNow();
+		JobInfo jobs[BUFFERS_PER_BATCH];
+		generateBotBuffers<BUFFERS_PER_BATCH>(Variables, swapperA, swapperB, buffersEnd, jobs, SwapperLinks{links.load(), linksAreCompressed}, grabbedTopSet, numberOfTops);
+		// Only the last buffer of the batch can give back its unused space, the others keep it until they are freed
+		subContext.shrinkInputBuffer(jobs[numberOfTops - 1]);
+		context.inputQueue.pushN(socket, jobs, numberOfTops);
+		// Bottoms are counted by the processors, the whole batch is generated at once so every top gets the batch time
+		uint64_t batchTime = telemetryNow() - batchStartTime;
+		for(int topI = 0; topI < numberOfTops; topI++) {
+			stageTelemetry.recordTop(0, 0, batchTime);
+		}
+		telemetry.setBusy(false);
 
-		std::cout << "\033[33m[BottomBufferCreator " + std::to_string(coreComplex) + "] Pushed 8 Buffers\033[39m\n" << std::flush;
+		std::cout << "\033[33m[BottomBufferCreator " + std::to_string(coreComplex) + "] Pushed " + std::to_string(numberOfTops) + " Buffers\033[39m\n" << std::flush;
 	}
 
+	telemetry.finish();
 	std::cout << "\033[33m[BottomBufferCreator " + std::to_string(coreComplex) + "] Thread Finished!\033[39m\n" << std::flush;
 
 	aligned_free(swapperA);
@@ -395,29 +605,81 @@ const uint32_t* loadLinks(unsigned int Variables) {
 	return readFlatBuffer<uint32_t>(FileName::mbfStructure(Variables), getTotalLinkCount(Variables));
 }
 
-constexpr size_t BOTTOM_BUF_CREATOR_COUNT = 16;
+SwapperLinks loadLinksForSwapper(unsigned int Variables) {
+	size_t compressedSize = getCompressedLinksFileSize(Variables);
+	if(compressedSize != 0) {
+		void* links = aligned_malloc(compressedSize, 64);
+		readCompressedLinks(Variables, compressedSize, links);
+		return SwapperLinks{links, true};
+	}
+	size_t linkBufMemSize = getTotalLinkCount(Variables) * sizeof(uint32_t);
+	uint32_t* links = aligned_mallocT<uint32_t>(getTotalLinkCount(Variables) + PREFETCH_OFFSET, 64);
+	readFlatVoidBufferNoMMAP(FileName::mbfStructure(Variables), linkBufMemSize, links);
+	memset(links + getTotalLinkCount(Variables), 0, PREFETCH_OFFSET * sizeof(uint32_t));
+	return SwapperLinks{links, false};
+}
+
+void freeLinksForSwapper(SwapperLinks links) {
+	aligned_free(const_cast<void*>(links.data));
+}
+
+// One bottom buffer creator per core complex
 void runBottomBufferCreator(
 	unsigned int Variables,
 	PCoeffProcessingContext& context
 ) {
-	std::cout << "\033[33m[BottomBufferCreator] Loading Links...\033[39m\n" << std::flush;
-	auto linkLoadStart = std::chrono::high_resolution_clock::now();
-	//const uint32_t* links = loadLinks(Variables);
-	
-	size_t linkBufMemSize = getTotalLinkCount(Variables) * sizeof(uint32_t);
-	size_t linkBufMemSizeWithPrefetching = linkBufMemSize + PREFETCH_OFFSET * sizeof(uint32_t);
-	
-	void* numaLinks[2];
-	allocSocketBuffers(linkBufMemSizeWithPrefetching, numaLinks);
-	readFlatVoidBufferNoMMAP(FileName::mbfStructure(Variables), linkBufMemSize, numaLinks[1]);
-	memset((char*) numaLinks[1] + linkBufMemSize, 0, PREFETCH_OFFSET * sizeof(uint32_t));
-
-	std::atomic<const uint32_t*> links[2];
-	links[0].store(reinterpret_cast<const uint32_t*>(numaLinks[1])); // Not a mistake, gets replaced by numaLinks[1] after it is copied
-	links[1].store(reinterpret_cast<const uint32_t*>(numaLinks[1]));
-	
-	double timeTaken = (std::chrono::high_resolution_clock::now() - linkLoadStart).count() * 1.0e-9;
-	std::cout << "\033[33m[BottomBufferCreator] Finished loading links. Took " + std::to_string(timeTaken) + "s\033[39m\n" << std::flush;
+	int sliceCount = context.numaSliceCount;
+	int loadSlice = sliceCount - 1;
+	std::atomic<const void*> links[MAX_NUMA_SLICE_COUNT];
+	if(context.linkBufferSize == 0 && !SHARED_BUFFER_CACHE_DIR.empty()) {
+		size_t compressedLinksSize = getCompressedLinksFileSize(Variables);
+		bool linksAreCompressed = compressedLinksSize != 0;
+		std::string linksFile = linksAreCompressed ? FileName::mbfStructureCompressed(Variables) : FileName::mbfStructure(Variables);
+		size_t linksFileSize = linksAreCompressed ? compressedLinksSize : getTotalLinkCount(Variables) * sizeof(uint32_t);
+		size_t linkBufferSize = linksAreCompressed ? linksFileSize : linksFileSize + PREFETCH_OFFSET * sizeof(uint32_t); // The shared segment is zero past the file
+		const void* sharedLinks[MAX_NUMA_SLICE_COUNT];
+		if(attachSharedSocketBuffers(linksFile, linksFileSize, linkBufferSize, sharedLinks, sliceCount)) {
+			context.linksAreCompressed = linksAreCompressed;
+			context.linkBufferSize = linkBufferSize;
+			for(int slice = 0; slice < sliceCount; slice++) {
+				context.links[slice] = const_cast<void*>(sharedLinks[slice]); // Read-only mapping, the creators only read the links
+			}
+		}
+	}
+	bool linksNeedCopying = context.linkBufferSize == 0;
+	if(linksNeedCopying) {
+		std::cout << "\033[33m[BottomBufferCreator] Loading Links...\033[39m\n" << std::flush;
+		auto linkLoadStart = std::chrono::high_resolution_clock::now();
+		//const uint32_t* links = loadLinks(Variables);
+		
+		size_t compressedLinksSize = getCompressedLinksFileSize(Variables);
+		context.linksAreCompressed = compressedLinksSize != 0;
+
+		size_t linkBufMemSize = context.linksAreCompressed ? compressedLinksSize : getTotalLinkCount(Variables) * sizeof(uint32_t);
+		context.linkBufferSize = context.linksAreCompressed ? linkBufMemSize : linkBufMemSize + PREFETCH_OFFSET * sizeof(uint32_t);
+		
+		// The links are loaded on the last socket, and copied to the others while the creators already run
+		allocSocketBuffers(context.linkBufferSize, context.links, sliceCount);
+		if(context.linksAreCompressed) {
+			readCompressedLinks(Variables, linkBufMemSize, context.links[loadSlice]);
+		} else {
+			readFlatVoidBufferNoMMAP(FileName::mbfStructure(Variables), linkBufMemSize, context.links[loadSlice]);
+			memset((char*) context.links[loadSlice] + linkBufMemSize, 0, PREFETCH_OFFSET * sizeof(uint32_t));
+		}
+
+		for(int slice = 0; slice < sliceCount; slice++) {
+			links[slice].store(context.links[loadSlice]); // Not a mistake, gets replaced by context.links[slice] after it is copied
+		}
+		
+		double timeTaken = (std::chrono::high_resolution_clock::now() - linkLoadStart).count() * 1.0e-9;
+		std::cout << "\033[33m[BottomBufferCreator] Finished loading " + std::string(context.linksAreCompressed ? "compressed " : "") + "links. Took " + std::to_string(timeTaken) + "s\033[39m\n" << std::flush;
+	} else {
+		for(int slice = 0; slice < sliceCount; slice++) {
+			links[slice].store(context.links[slice]);
+		}
+		std::cout << "\033[33m[BottomBufferCreator] Links already loaded\033[39m\n" << std::flush;
+	}
+	bool linksAreCompressed = context.linksAreCompressed;
 
 	std::atomic<const JobTopInfo*> jobTopAtomic;
 	context.topsAreReady.wait();
@@ -430,21 +692,23 @@ void runBottomBufferCreator(
 		const JobTopInfo* jobTopsEnd;
 		PCoeffProcessingContext* context;
 		size_t coreComplex;
-		std::atomic<const uint32_t*>* links;
+		std::atomic<const void*>* links;
+		bool linksAreCompressed;
 	};
 
 	auto threadFunc = [](void* data) -> void* {
 		ThreadInfo* ti = (ThreadInfo*) data;
 		std::string threadName = "BotBufCrea " + std::to_string(ti->coreComplex);
 		setThreadName(threadName.c_str());
-		runBottomBufferCreatorNoAlloc(ti->Variables, *ti->curStartingJobTop, ti->jobTopsEnd, *ti->context, ti->coreComplex, *ti->links);
+		runBottomBufferCreatorNoAlloc(ti->Variables, *ti->curStartingJobTop, ti->jobTopsEnd, *ti->context, ti->coreComplex, *ti->links, ti->linksAreCompressed);
 		pthread_exit(NULL);
 		return NULL;
 	};
 
-	ThreadInfo threadDatas[BOTTOM_BUF_CREATOR_COUNT];
-	for(size_t coreComplex = 0; coreComplex < BOTTOM_BUF_CREATOR_COUNT; coreComplex++) {
-		size_t socket = coreComplex / 8;
+	size_t creatorCount = getTopology().getCoreComplexCount();
+	std::unique_ptr<ThreadInfo[]> threadDatas(new ThreadInfo[creatorCount]);
+	for(size_t coreComplex = 0; coreComplex < creatorCount; coreComplex++) {
+		size_t socket = context.getSliceOfCoreComplex(coreComplex);
 		ThreadInfo& ti = threadDatas[coreComplex];
 		ti.Variables = Variables;
 		ti.curStartingJobTop = &jobTopAtomic;
@@ -452,22 +716,25 @@ void runBottomBufferCreator(
 		ti.context = &context;
 		ti.coreComplex = coreComplex;
 		ti.links = &links[socket];
+		ti.linksAreCompressed = linksAreCompressed;
 	}
 
-	PThreadBundle threads = spreadThreads(BOTTOM_BUF_CREATOR_COUNT, CPUAffinityType::COMPLEX, threadDatas, threadFunc, 1);
+	PThreadBundle threads = spreadThreads(creatorCount, CPUAffinityType::COMPLEX, threadDatas.get(), threadFunc, 1);
 
-	memcpy(numaLinks[0], numaLinks[1], linkBufMemSizeWithPrefetching);
-	links[0].store(reinterpret_cast<const uint32_t*>(numaLinks[0])); // Switch to closer buffer
+	if(linksNeedCopying) {
+		for(int slice = 0; slice < loadSlice; slice++) {
+			memcpy(context.links[slice], context.links[loadSlice], context.linkBufferSize);
+			links[slice].store(context.links[slice]); // Switch to closer buffer
+		}
+	}
 
-	std::cout << "\033[33m[BottomBufferCreator] Copied Links to second socket buffer\033[39m\n" << std::flush;
+	if(linksNeedCopying && sliceCount > 1) std::cout << "\033[33m[BottomBufferCreator] Copied Links to the other socket buffers\033[39m\n" << std::flush;
 
 	threads.join();
 
 	std::cout << "\033[33m[BottomBufferCreator] All Threads finished! Closing output queue\033[39m\n" << std::flush;
 
-	context.inputQueue.close();
-	numa_free(numaLinks[0], linkBufMemSizeWithPrefetching);
-	numa_free(numaLinks[1], linkBufMemSizeWithPrefetching);
+	context.inputQueue.close(); // The links stay in the context for the next run
 }
 
 std::vector<JobTopInfo> convertTopInfos(const FlatNode* flatNodes, const std::vector<NodeIndex>& topIndices) {
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 
 #include "synchronizedQueue.h"
+#include "bitSet.h"
 
 #include "pcoeffClasses.h"
 #include "processingContext.h"
@@ -15,3 +17,63 @@ void runBottomBufferCreator(
 	unsigned int Variables,
 	PCoeffProcessingContext& context
 );
+
+/*
+	The swapper walks the links once for a whole batch of tops, it holds one bit per top for each node of a layer. 
+	Reading the links is the bottleneck, so wider batches serve more tops per pass over them. 
+	BitSet<128> is backed by SSE, the 256 and 512 wide BitSets compile to AVX2 / AVX-512 operations. 
+	Supported widths are 8, 64, 128, 256 and 512. 
+*/
+template<size_t BatchWidth>
+using swapper_block = BitSet<BatchWidth>;
+
+// Batch width of runBottomBufferCreator. Every batch holds this many input buffers until its traversal is done, 
+// so the core complexes per socket (one creator each) * BUFFERS_PER_BATCH should not exceed the input buffers per socket
+constexpr int BUFFERS_PER_BATCH = 8;
+// Batch width of the fused CPU pipeline, which is only limited by the chunks per complex
+constexpr int FUSED_BATCH_WIDTH = 64;
+
+/*
+	Fused CPU mode. Instead of filling a MAX_BUFSIZE input buffer per top, 
+	the swapper traversal hands out the bottoms in small chunks that stay in cache, 
+	which processors consume immediately. The results are stored in the same chunk. 
+*/
+constexpr size_t FUSED_CHUNK_SIZE = 4096;
+
+struct BotChunk {
+	int topInBatch;
+	uint32_t botCount;
+	double processingSeconds;
+	NodeIndex bots[FUSED_CHUNK_SIZE];
+	ProcessedPCoeffSum results[FUSED_CHUNK_SIZE];
+};
+
+/*
+	The links the swapper walks. Either the plain mbfStructure file, 
+	or its compressed form (see linkCompression.h) which is decoded on the fly in computeNextLayerLinks. 
+*/
+struct SwapperLinks {
+	const void* data;
+	bool isCompressed;
+};
+
+// Loads mbfStructureCompressed if it exists, otherwise mbfStructure with zeroed padding for the swapper prefetch
+SwapperLinks loadLinksForSwapper(unsigned int Variables);
+void freeLinksForSwapper(SwapperLinks links);
+
+/*
+	Produces the same bottoms as the input buffers generated for these tops, except the top dual at TOP_DUAL_INDEX. 
+	getFreeChunk returns an unused chunk, submitChunk takes ownership of a filled one. Submitted chunks may be empty. 
+	swapperA and swapperB must be getMaxLayerSize(Variables) large, numberOfTops at most BatchWidth. 
+*/
+template<size_t BatchWidth>
+void generateBotChunks(
+	unsigned int Variables,
+	swapper_block<BatchWidth>* swapperA,
+	swapper_block<BatchWidth>* swapperB,
+	SwapperLinks links,
+	const JobTopInfo* tops,
+	int numberOfTops,
+	const std::function<BotChunk*()>& getFreeChunk,
+	const std::function<void(BotChunk*)>& submitChunk
+);
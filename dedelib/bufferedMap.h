@@ -3,8 +3,17 @@
 #include <atomic>
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
 
 #include "keyValue.h"
+#include "aligned_alloc.h"
+#include "crossPlatformIntrinsics.h"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 template<typename T>
 class HashBase {
@@ -279,9 +288,12 @@ class BakedHashBase {
 	unsigned int* hashTable;
 	size_t buckets;
 	size_t itemCount;
+	bool ownsHashTable = true;
 
 public:
 	BakedHashBase() : data(nullptr), hashTable(nullptr), buckets(0), itemCount(0) {}
+	// View over a hash table and data laid out by an earlier BakedHashBase, for example from a mapped file. Owns neither
+	BakedHashBase(T* dataBuffer, unsigned int* hashTable, size_t buckets, size_t size) : data(dataBuffer), hashTable(hashTable), buckets(buckets), itemCount(size), ownsHashTable(false) {}
 	BakedHashBase(T* dataBuffer, size_t size, size_t buckets) : data(dataBuffer), hashTable(new unsigned int[buckets+1]), buckets(buckets), itemCount(size) {
 		std::sort(dataBuffer, dataBuffer + size, [buckets](T& a, T& b) {return a.hash() % buckets < b.hash() % buckets; });
 		
@@ -336,10 +348,10 @@ public:
 	}
 
 	~BakedHashBase() {
-		delete[] this->hashTable;
+		if(ownsHashTable) delete[] this->hashTable;
 	}
 
-	BakedHashBase(BakedHashBase&& other) noexcept : data(other.data), hashTable(other.hashTable), buckets(other.buckets), itemCount(other.itemCount) {
+	BakedHashBase(BakedHashBase&& other) noexcept : data(other.data), hashTable(other.hashTable), buckets(other.buckets), itemCount(other.itemCount), ownsHashTable(other.ownsHashTable) {
 		other.hashTable = nullptr;
 		other.data = nullptr;
 		other.buckets = 0;
@@ -351,6 +363,7 @@ public:
 		std::swap(data, other.data);
 		std::swap(buckets, other.buckets);
 		std::swap(itemCount, other.itemCount);
+		std::swap(ownsHashTable, other.ownsHashTable);
 		return *this;
 	}
 
@@ -408,6 +421,9 @@ public:
 	}
 
 	size_t size() const { return this->itemCount; }
+	size_t getBucketCount() const { return this->buckets; }
+	// getBucketCount() + 1 entries, bucket b holds the data items [hashTable[b], hashTable[b+1])
+	const unsigned int* getHashTable() const { return this->hashTable; }
 
 	T& operator[](size_t index) { return data[index]; }
 	const T& operator[](size_t index) const { return data[index]; }
@@ -425,6 +441,7 @@ public:
 	BakedMap(KeyValue<Key, Value>* dataBuffer, size_t size) : BakedHashBase<KeyValue<Key, Value>>(dataBuffer, size) {}
 	BakedMap(const BufferedMap<Key, Value>& from, KeyValue<Key, Value>* dataBuffer) : BakedHashBase<KeyValue<Key, Value>>(static_cast<const HashBase<KeyValue<Key, Value>>&>(from), dataBuffer) {}
 	BakedMap(const BufferedSet<Key>& from, KeyValue<Key, Value>* dataBuffer) : BakedHashBase<KeyValue<Key, Value>>(static_cast<const HashBase<Key>&>(from), dataBuffer, [](const Key& k) {return KeyValue<Key, Value>{k, {}}; }) {}
+	BakedMap(KeyValue<Key, Value>* dataBuffer, unsigned int* hashTable, size_t buckets, size_t size) : BakedHashBase<KeyValue<Key, Value>>(dataBuffer, hashTable, buckets, size) {}
 
 	Value& get(const Key& key) {
 		return BakedHashBase<KeyValue<Key, Value>>::get(key).value;
@@ -459,6 +476,8 @@ public:
 	}
 
 	size_t size() const { return BakedHashBase<KeyValue<Key, Value>>::size(); }
+	size_t getBucketCount() const { return BakedHashBase<KeyValue<Key, Value>>::getBucketCount(); }
+	const unsigned int* getHashTable() const { return BakedHashBase<KeyValue<Key, Value>>::getHashTable(); }
 	const KeyValue<Key, Value>& operator[](size_t index) const { return BakedHashBase<KeyValue<Key, Value>>::operator[](index); }
 	KeyValue<Key, Value>& operator[](size_t index) { return BakedHashBase<KeyValue<Key, Value>>::operator[](index); }
 	const KeyValue<Key, Value>* begin() const { return BakedHashBase<KeyValue<Key, Value>>::begin(); }
@@ -498,3 +517,251 @@ public:
 	T* begin() { return BakedHashBase<T>::begin(); }
 	T* end() { return BakedHashBase<T>::end(); }
 };
+
+/*
+	Hash of the bytes of a key, used by SwissHashBase and to spread MBFs over the shards of generateAllMBFsSharded. The hash() of a BitSet is the xor of its blocks, which collides for many MBFs.
+	That shows as long chains in HashBase, but would be worse with 7 bit fragments that all match. HashBase and BakedHashBase keep using hash(),
+	the layout of the baked files depends on it. Keys must not have padding bytes.
+*/
+template<typename Key>
+uint64_t swissHashOf(const Key& key) {
+	const char* bytes = reinterpret_cast<const char*>(&key);
+	uint64_t result = 0x9E3779B97F4A7C15 ^ sizeof(Key);
+	size_t i = 0;
+	for(; i + sizeof(uint64_t) <= sizeof(Key); i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(uint64_t));
+		result = (result ^ word) * 0xBF58476D1CE4E5B9;
+		result ^= result >> 31;
+	}
+	if(i < sizeof(Key)) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + i, sizeof(Key) - i);
+		result = (result ^ word) * 0xBF58476D1CE4E5B9;
+		result ^= result >> 31;
+	}
+	result *= 0x94D049BB133111EB;
+	return result ^ (result >> 29);
+}
+template<typename Key, typename Value>
+uint64_t swissHashOf(const KeyValue<Key, Value>& item) {
+	return swissHashOf(item.key);
+}
+
+/*
+	Alternative layout to the chained HashBase, an open addressing table in the style of a Swiss table.
+	Next to the slots is an array of control bytes, one per slot: EMPTY_CTRL, or the top 7 bits of the hash of the item in the slot.
+	Slots are probed in groups of 16, the 16 control bytes of a group are compared to the hash fragment with one SSE2 compare,
+	and only the slots whose fragment matches get their key compared. A hit is then nearly always the first key compared.
+	A lookup reads one 16 byte aligned control group and the slot it hits, a miss mostly only the control group,
+	where HashBase follows bucket and next node indices to items spread over the data buffer.
+
+	Like HashBase it is not locked and has a fixed capacity. Items are never removed, so there are no tombstones.
+	Items are not contiguous, iterate with forEach.
+*/
+template<typename T>
+class SwissHashBase {
+public:
+	static constexpr size_t GROUP_SIZE = 16;
+	static constexpr uint8_t EMPTY_CTRL = 0x80;
+
+	uint8_t* ctrl;
+	T* slots;
+	size_t groupMask;
+	size_t capacity;
+	size_t itemCount;
+
+private:
+	static uint8_t getFragment(uint64_t hash) {
+		return static_cast<uint8_t>(hash >> 57);
+	}
+	size_t getHomeGroup(uint64_t hash) const {
+		return hash & groupMask;
+	}
+	// Bit i is set if control byte i of the group is b
+	static uint32_t matchCtrl(const uint8_t* group, uint8_t b) {
+#ifdef __SSE2__
+		__m128i ctrlBytes = _mm_load_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrlBytes, _mm_set1_epi8(static_cast<char>(b)))));
+#else
+		uint32_t result = 0;
+		for(size_t i = 0; i < GROUP_SIZE; i++) {
+			if(group[i] == b) result |= uint32_t(1) << i;
+		}
+		return result;
+#endif
+	}
+
+	// Returns the item, or nullptr and the slot the key would be added in
+	template<typename KeyType>
+	std::pair<T*, size_t> findSlot(const KeyType& key, uint64_t hash) const {
+		uint8_t fragment = getFragment(hash);
+		size_t group = getHomeGroup(hash);
+		// Triangular probing over the groups, visits every group as the group count is a power of 2
+		for(size_t step = 1; ; step++) {
+			const uint8_t* groupCtrl = ctrl + group * GROUP_SIZE;
+			for(uint32_t matches = matchCtrl(groupCtrl, fragment); matches != 0; matches &= matches - 1) {
+				T& item = slots[group * GROUP_SIZE + ctz32(matches)];
+				if(item == key) {
+					return std::make_pair(&item, size_t(0));
+				}
+			}
+			uint32_t empties = matchCtrl(groupCtrl, EMPTY_CTRL);
+			if(empties != 0) {
+				return std::make_pair(nullptr, group * GROUP_SIZE + ctz32(empties));
+			}
+			assert(step <= groupMask);
+			group = (group + step) & groupMask;
+		}
+	}
+	T& addInSlot(const T& item, uint64_t hash, size_t slot) {
+		// Past capacity the 7/8 fill bound breaks, and once no group has an empty slot findSlot never ends
+		if(this->itemCount >= this->capacity) {
+			std::cerr << "SwissHashBase is full, it has a capacity of " << this->capacity << " items!\n" << std::flush;
+			std::abort();
+		}
+		slots[slot] = item;
+		ctrl[slot] = getFragment(hash);
+		this->itemCount++;
+		return slots[slot];
+	}
+
+public:
+	// The table is at most 7/8 full when capacity items are added, so probes always end on an empty slot.
+	// Adding more than capacity items aborts, the table doesn't grow
+	SwissHashBase(size_t capacity) : capacity(capacity), itemCount(0) {
+		size_t groupCount = 1;
+		while(groupCount * GROUP_SIZE * 7 / 8 < capacity) groupCount *= 2;
+		this->groupMask = groupCount - 1;
+		this->ctrl = aligned_mallocT<uint8_t>(groupCount * GROUP_SIZE, 64);
+		memset(this->ctrl, EMPTY_CTRL, groupCount * GROUP_SIZE);
+		this->slots = new T[groupCount * GROUP_SIZE];
+	}
+	SwissHashBase(const HashBase<T>& from) : SwissHashBase(from.size()) {
+		for(const T& item : from) {
+			this->add(item);
+		}
+	}
+	SwissHashBase() : ctrl(nullptr), slots(nullptr), groupMask(0), capacity(0), itemCount(0) {}
+
+	SwissHashBase(SwissHashBase&& other) noexcept : ctrl(other.ctrl), slots(other.slots), groupMask(other.groupMask), capacity(other.capacity), itemCount(other.itemCount) {
+		other.ctrl = nullptr;
+		other.slots = nullptr;
+		other.groupMask = 0;
+		other.capacity = 0;
+		other.itemCount = 0;
+	}
+	SwissHashBase& operator=(SwissHashBase&& other) noexcept {
+		std::swap(this->ctrl, other.ctrl);
+		std::swap(this->slots, other.slots);
+		std::swap(this->groupMask, other.groupMask);
+		std::swap(this->capacity, other.capacity);
+		std::swap(this->itemCount, other.itemCount);
+		return *this;
+	}
+
+	~SwissHashBase() {
+		if(ctrl != nullptr) aligned_free(ctrl);
+		delete[] slots;
+	}
+
+	size_t size() const { return itemCount; }
+	size_t getSlotCount() const { return (groupMask + 1) * GROUP_SIZE; }
+
+	// hash is swissHashOf(key)
+	template<typename KeyType>
+	T* find(const KeyType& key, uint64_t hash) {
+		return findSlot(key, hash).first;
+	}
+	template<typename KeyType>
+	T* find(const KeyType& key) {
+		return this->find(key, swissHashOf(key));
+	}
+	template<typename KeyType>
+	const T* find(const KeyType& key, uint64_t hash) const {
+		return findSlot(key, hash).first;
+	}
+	template<typename KeyType>
+	const T* find(const KeyType& key) const {
+		return this->find(key, swissHashOf(key));
+	}
+
+	template<typename KeyType>
+	T& get(const KeyType& key) {
+		T* foundNode = this->find(key);
+		assert(foundNode != nullptr);
+		return *foundNode;
+	}
+	template<typename KeyType>
+	const T& get(const KeyType& key) const {
+		const T* foundNode = this->find(key);
+		assert(foundNode != nullptr);
+		return *foundNode;
+	}
+
+	T& getOrAdd(const T& item, uint64_t hash) {
+		std::pair<T*, size_t> found = findSlot(item, hash);
+		if(found.first != nullptr) {
+			return *found.first;
+		} else {
+			return addInSlot(item, hash, found.second);
+		}
+	}
+	T& getOrAdd(const T& item) {
+		return getOrAdd(item, swissHashOf(item));
+	}
+
+	// returns wasAdded
+	bool add(const T& item, uint64_t hash) {
+		std::pair<T*, size_t> found = findSlot(item, hash);
+		if(found.first != nullptr) {
+			return false;
+		}
+		addInSlot(item, hash, found.second);
+		return true;
+	}
+	// returns wasAdded
+	bool add(const T& item) {
+		return this->add(item, swissHashOf(item));
+	}
+
+	template<typename Func>
+	void forEach(const Func& func) const {
+		for(size_t i = 0; i < getSlotCount(); i++) {
+			if(ctrl[i] != EMPTY_CTRL) {
+				func(slots[i]);
+			}
+		}
+	}
+};
+
+template<typename Key, typename Value>
+class SwissMap : public SwissHashBase<KeyValue<Key, Value>> {
+public:
+	using SwissHashBase<KeyValue<Key, Value>>::SwissHashBase;
+
+	KeyValue<Key, Value>& getOrAdd(const Key& k, const Value& v) {
+		return SwissHashBase<KeyValue<Key, Value>>::getOrAdd(KeyValue<Key, Value>{k, v});
+	}
+	KeyValue<Key, Value>& getOrAdd(const Key& k, const Value& v, uint64_t hash) {
+		return SwissHashBase<KeyValue<Key, Value>>::getOrAdd(KeyValue<Key, Value>{k, v}, hash);
+	}
+	// returns wasAdded
+	bool add(const Key& k, const Value& v) {
+		return SwissHashBase<KeyValue<Key, Value>>::add(KeyValue<Key, Value>{k, v});
+	}
+	// returns wasAdded
+	bool add(const Key& k, const Value& v, uint64_t hash) {
+		return SwissHashBase<KeyValue<Key, Value>>::add(KeyValue<Key, Value>{k, v}, hash);
+	}
+};
+
+template<typename T>
+class SwissSet : public SwissHashBase<T> {
+public:
+	using SwissHashBase<T>::SwissHashBase;
+
+	bool contains(const T& item) const {
+		return SwissHashBase<T>::find(item) != nullptr;
+	}
+};
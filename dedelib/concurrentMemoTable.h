@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <iostream>
+
+/*
+	Open addressing memo table that many threads look up and insert into without a lock.
+	Every slot has a version: 0 is empty, odd is being written, even is filled.
+	An insert claims an empty slot with a CAS, writes the key and value, and then publishes them by making the version even.
+	Readers copy the key and value and check that the version didn't change meanwhile, like a seqlock, and otherwise skip the slot.
+	Slots never become empty again, so a lookup can stop at the first empty slot of its probe sequence.
+
+	Without eviction the table must be made big enough for everything that is inserted, it aborts when it is full.
+	With eviction, probes are limited to a window of PROBE_WINDOW slots, and an insert into a full window overwrites one of them.
+	Memory then stays bounded at the cost of recomputing evicted entries. Racing inserts of the same key can then both end up in the table,
+	this is harmless as long as equal keys always get equal values, which is the case for a memo.
+
+	Key and Value must be trivially copyable.
+*/
+template<typename Key, typename Value>
+class ConcurrentMemoTable {
+	struct Slot {
+		std::atomic<uint32_t> version;
+		Key key;
+		Value value;
+	};
+
+	Slot* slots;
+	size_t slotMask;
+	bool evictWhenFull;
+	std::atomic<size_t> itemCount;
+	std::atomic<uint64_t> evictionCount;
+
+	static uint64_t mixHash(uint64_t hash) {
+		return hash * 0x9E3779B97F4A7C15; // The plain BitSet hash is a xor of the blocks, mix it up a bit
+	}
+	size_t getHomeSlot(uint64_t mixedHash) const {
+		return (mixedHash >> 32 ^ mixedHash) & slotMask;
+	}
+	size_t getProbeLimit() const {
+		return evictWhenFull ? PROBE_WINDOW : slotMask + 1;
+	}
+
+	// Returns false if the slot changed while it was being read
+	static bool readSlot(const Slot& slot, uint32_t version, Key& key, Value& value) {
+		key = slot.key;
+		value = slot.value;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.version.load(std::memory_order_relaxed) == version;
+	}
+	static void writeSlot(Slot& slot, uint32_t writingVersion, const Key& key, const Value& value) {
+		slot.key = key;
+		slot.value = value;
+		uint32_t filledVersion = writingVersion + 1;
+		if(filledVersion == 0) filledVersion = 2; // 0 would read as empty
+		slot.version.store(filledVersion, std::memory_order_release);
+	}
+
+public:
+	static constexpr size_t PROBE_WINDOW = 16;
+
+	// Has room for at least capacity items at a load factor of at most 1/2
+	ConcurrentMemoTable(size_t capacity, bool evictWhenFull = false) : evictWhenFull(evictWhenFull), itemCount(0), evictionCount(0) {
+		size_t slotCount = PROBE_WINDOW;
+		while(slotCount < capacity * 2) slotCount *= 2;
+		this->slotMask = slotCount - 1;
+		// calloc, so the pages of a big table are only touched once they are used. Zeroed slots are empty
+		this->slots = static_cast<Slot*>(calloc(slotCount, sizeof(Slot)));
+		if(this->slots == nullptr) {
+			std::cerr << "Could not allocate a ConcurrentMemoTable of " << slotCount << " slots!\n" << std::flush;
+			abort();
+		}
+	}
+	~ConcurrentMemoTable() {
+		free(this->slots);
+	}
+	ConcurrentMemoTable(const ConcurrentMemoTable&) = delete;
+	ConcurrentMemoTable& operator=(const ConcurrentMemoTable&) = delete;
+
+	size_t size() const {return itemCount.load(std::memory_order_relaxed);}
+	size_t getSlotCount() const {return slotMask + 1;}
+	uint64_t getEvictionCount() const {return evictionCount.load(std::memory_order_relaxed);}
+
+	// Returns false if the key is not in the table
+	bool find(const Key& key, Value& valueOut) const {
+		uint64_t hash = mixHash(key.hash());
+		size_t homeSlot = getHomeSlot(hash);
+		size_t probeLimit = getProbeLimit();
+		for(size_t i = 0; i < probeLimit; i++) {
+			const Slot& slot = this->slots[(homeSlot + i) & slotMask];
+			uint32_t version = slot.version.load(std::memory_order_acquire);
+			if(version == 0) return false;
+			if(version & 1) continue; // Being written, treat it as a miss
+			Key foundKey;
+			Value foundValue;
+			if(readSlot(slot, version, foundKey, foundValue) && foundKey == key) {
+				valueOut = foundValue;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Returns wasAdded. If the key was already present its value is left alone
+	bool insertIfAbsent(const Key& key, const Value& value) {
+		uint64_t hash = mixHash(key.hash());
+		size_t homeSlot = getHomeSlot(hash);
+		size_t probeLimit = getProbeLimit();
+		for(size_t i = 0; i < probeLimit; i++) {
+			Slot& slot = this->slots[(homeSlot + i) & slotMask];
+			uint32_t version = slot.version.load(std::memory_order_acquire);
+			while(true) {
+				if(version == 0) {
+					if(slot.version.compare_exchange_weak(version, 1, std::memory_order_acquire)) {
+						writeSlot(slot, 1, key, value);
+						itemCount.fetch_add(1, std::memory_order_relaxed);
+						return true;
+					}
+				} else if(version & 1) {
+					// Another thread is writing this slot, possibly with the same key. It's only a key and a value, wait for it
+					std::this_thread::yield();
+					version = slot.version.load(std::memory_order_acquire);
+				} else {
+					Key foundKey;
+					Value foundValue;
+					if(readSlot(slot, version, foundKey, foundValue)) {
+						if(foundKey == key) return false;
+						break;
+					}
+					version = slot.version.load(std::memory_order_acquire);
+				}
+			}
+		}
+		if(!evictWhenFull) {
+			std::cerr << "ConcurrentMemoTable of " << getSlotCount() << " slots is full!\n" << std::flush;
+			abort();
+		}
+		// Random replacement within the window, the victim is picked by the hash
+		size_t firstVictim = hash >> 60;
+		for(size_t i = 0; ; i++) {
+			Slot& victim = this->slots[(homeSlot + (firstVictim + i) % PROBE_WINDOW) & slotMask];
+			uint32_t version = victim.version.load(std::memory_order_relaxed);
+			if(!(version & 1) && victim.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire)) {
+				writeSlot(victim, version + 1, key, value);
+				evictionCount.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+
+	// Not safe to run concurrently with inserts
+	template<typename Func>
+	void forEach(const Func& func) const {
+		for(size_t i = 0; i <= slotMask; i++) {
+			const Slot& slot = this->slots[i];
+			if(slot.version.load(std::memory_order_acquire) != 0) {
+				func(slot.key, slot.value);
+			}
+		}
+	}
+};
+
+/*
+	Small direct-mapped cache in front of a ConcurrentMemoTable, owned by a single thread, so no synchronization is needed.
+	Hot entries are then found without touching the shared table's cache lines.
+	Only put entries in it that are also in the table, as it is never written back.
+*/
+template<typename Key, typename Value, unsigned int CacheSizeBits = 10>
+class MemoFrontCache {
+	static constexpr size_t CACHE_SIZE = size_t(1) << CacheSizeBits;
+
+	struct Entry {
+		Key key;
+		Value value;
+		bool filled;
+	};
+
+	Entry entries[CACHE_SIZE];
+
+	Entry& getEntry(const Key& key) {
+		uint64_t hash = key.hash() * 0x9E3779B97F4A7C15;
+		return entries[hash >> (64 - CacheSizeBits)];
+	}
+public:
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	MemoFrontCache() {
+		for(Entry& e : entries) {
+			e.filled = false;
+		}
+	}
+
+	// Returns false on a miss
+	bool find(const Key& key, Value& valueOut) {
+		Entry& e = getEntry(key);
+		if(e.filled && e.key == key) {
+			hits++;
+			valueOut = e.value;
+			return true;
+		} else {
+			misses++;
+			return false;
+		}
+	}
+	void put(const Key& key, const Value& value) {
+		Entry& e = getEntry(key);
+		e.key = key;
+		e.value = value;
+		e.filled = true;
+	}
+};
+
+// Looks in the front cache first if there is one, table hits are copied into it
+template<typename Key, typename Value, unsigned int CacheSizeBits>
+bool findMemoized(const ConcurrentMemoTable<Key, Value>& table, MemoFrontCache<Key, Value, CacheSizeBits>* frontCache, const Key& key, Value& valueOut) {
+	if(frontCache != nullptr && frontCache->find(key, valueOut)) {
+		return true;
+	}
+	if(table.find(key, valueOut)) {
+		if(frontCache != nullptr) frontCache->put(key, valueOut);
+		return true;
+	}
+	return false;
+}
+template<typename Key, typename Value, unsigned int CacheSizeBits>
+void addMemoized(ConcurrentMemoTable<Key, Value>& table, MemoFrontCache<Key, Value, CacheSizeBits>* frontCache, const Key& key, const Value& value) {
+	table.insertIfAbsent(key, value);
+	if(frontCache != nullptr) frontCache->put(key, value);
+}
@@ -3,9 +3,15 @@
 #include "cmdParser.h"
 #include "fileNames.h"
 #include "flatBufferManagement.h"
+#include "pipelineTelemetry.h"
+#include "jobCheckpoint.h"
+#include "parallelFileLoader.h"
+#include "sharedBufferCache.h"
+#include "dataManifest.h"
 
 #include <string>
 #include <iostream>
+#include <cstdlib>
 
 void configure(const ParsedArgs& parsed) {
 	std::string dataDir = parsed.getOptional("dataDir");
@@ -50,5 +56,57 @@ void configure(const ParsedArgs& parsed) {
 		}
 		std::cout << std::endl;
 	}
+
+	std::string telemetry = parsed.getOptional("telemetry");
+	if(telemetry == "json") {
+		TELEMETRY_FORMAT = TelemetryFormat::JSON_LINES;
+	} else if(telemetry == "prometheus") {
+		TELEMETRY_FORMAT = TelemetryFormat::PROMETHEUS;
+	} else if(!telemetry.empty()) {
+		std::cerr << "Unknown telemetry format " << telemetry << ", expected json or prometheus" << std::endl;
+		std::exit(-1);
+	}
+	std::string telemetryInterval = parsed.getOptional("telemetryInterval");
+	if(!telemetryInterval.empty()) {
+		TELEMETRY_INTERVAL_SECONDS = std::stod(telemetryInterval);
+	}
+
+	std::string checkpointInterval = parsed.getOptional("checkpointInterval");
+	if(!checkpointInterval.empty()) {
+		CHECKPOINT_INTERVAL_SECONDS = std::stod(checkpointInterval);
+	}
+
+	std::string fileLoader = parsed.getOptional("fileLoader");
+	if(fileLoader == "uring") {
+		FILE_LOADER_METHOD = FileLoaderMethod::IO_URING;
+	} else if(fileLoader == "threads") {
+		FILE_LOADER_METHOD = FileLoaderMethod::THREADS;
+	} else if(fileLoader == "stream") {
+		FILE_LOADER_METHOD = FileLoaderMethod::SINGLE_STREAM;
+	} else if(!fileLoader.empty()) {
+		std::cerr << "Unknown file loader " << fileLoader << ", expected uring, threads or stream" << std::endl;
+		std::exit(-1);
+	}
+	std::string fileLoaderThreads = parsed.getOptional("fileLoaderThreads");
+	if(!fileLoaderThreads.empty()) {
+		FILE_LOADER_THREADS = std::stoi(fileLoaderThreads);
+	}
+	std::string fileLoaderQueueDepth = parsed.getOptional("fileLoaderQueueDepth");
+	if(!fileLoaderQueueDepth.empty()) {
+		FILE_LOADER_QUEUE_DEPTH = std::stoi(fileLoaderQueueDepth);
+	}
+	if(parsed.hasFlag("fileLoaderHugePages")) {
+		FILE_LOADER_HUGEPAGES = true;
+	}
+
+	if(parsed.hasFlag("noVerifyDataFiles")) {
+		VERIFY_DATA_FILES = false;
+	}
+
+	std::string sharedBufferCache = parsed.getOptional("sharedBufferCache");
+	if(!sharedBufferCache.empty()) {
+		SHARED_BUFFER_CACHE_DIR = sharedBufferCache;
+		std::cout << "Sharing loaded buffers between processes through " << SHARED_BUFFER_CACHE_DIR << std::endl;
+	}
 }
 
@@ -325,6 +325,144 @@ uint64_t countConnectedVeryFast(BooleanFunction<Variables> graph) {
 	return connectCount;
 }
 
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define CONNECT_GRAPH_BATCHED
+constexpr int CONNECT_BATCH_LANES = 4; // 4 graphs of 7 variables fit in the 128-bit lanes of one AVX-512 register
+
+// Same as BooleanFunction<7>::monotonizeUp, but for each of the 4 128-bit lanes
+inline __m512i monotonizeUp7x4(__m512i bs) {
+	__m512i v0Added = _mm512_slli_epi64(_mm512_andnot_si512(_mm512_set1_epi64(MASK_1), bs), 1);
+	bs = _mm512_or_si512(bs, v0Added);
+	__m512i v1Added = _mm512_slli_epi64(_mm512_andnot_si512(_mm512_set1_epi64(MASK_2), bs), 2);
+	bs = _mm512_or_si512(bs, v1Added);
+	__m512i v2Added = _mm512_slli_epi64(_mm512_andnot_si512(_mm512_set1_epi64(MASK_4), bs), 4);
+	bs = _mm512_or_si512(bs, v2Added);
+	__m512i v3Added = _mm512_slli_epi16(bs, 8);
+	bs = _mm512_or_si512(bs, v3Added);
+	__m512i v4Added = _mm512_slli_epi32(bs, 16);
+	bs = _mm512_or_si512(bs, v4Added);
+	__m512i v5Added = _mm512_slli_epi64(bs, 32);
+	bs = _mm512_or_si512(bs, v5Added);
+	__m512i v6Added = _mm512_bslli_epi128(bs, 8);
+	bs = _mm512_or_si512(bs, v6Added);
+	return bs;
+}
+
+// Same as BooleanFunction<7>::monotonizeDown, but for each of the 4 128-bit lanes
+inline __m512i monotonizeDown7x4(__m512i bs) {
+	__m512i v0Removed = _mm512_srli_epi64(_mm512_and_si512(bs, _mm512_set1_epi64(MASK_1)), 1);
+	bs = _mm512_or_si512(bs, v0Removed);
+	__m512i v1Removed = _mm512_srli_epi64(_mm512_and_si512(bs, _mm512_set1_epi64(MASK_2)), 2);
+	bs = _mm512_or_si512(bs, v1Removed);
+	__m512i v2Removed = _mm512_srli_epi64(_mm512_and_si512(bs, _mm512_set1_epi64(MASK_4)), 4);
+	bs = _mm512_or_si512(bs, v2Removed);
+	__m512i v3Removed = _mm512_srli_epi16(bs, 8);
+	bs = _mm512_or_si512(bs, v3Removed);
+	__m512i v4Removed = _mm512_srli_epi32(bs, 16);
+	bs = _mm512_or_si512(bs, v4Removed);
+	__m512i v5Removed = _mm512_srli_epi64(bs, 32);
+	bs = _mm512_or_si512(bs, v5Removed);
+	__m512i v6Removed = _mm512_bsrli_epi128(bs, 8);
+	bs = _mm512_or_si512(bs, v6Removed);
+	return bs;
+}
+
+// Converts a mask of equal 64-bit elements into a mask of lanes for which both halves are equal
+inline unsigned int equalLanes7x4(__mmask8 equalQWords) {
+	unsigned int bothEqual = equalQWords & (equalQWords >> 1);
+	return (bothEqual & 0b00000001) | ((bothEqual & 0b00000100) >> 1) | ((bothEqual & 0b00010000) >> 2) | ((bothEqual & 0b01000000) >> 3);
+}
+#endif
+
+/*
+	Computes countConnectedVeryFast for every graph in [graphs, graphsEnd), calling func(size_t graphIndex, uint64_t connectCount) for each.
+	The order in which graphs are reported is unspecified.
+
+	For Variables == 7 with AVX-512, the flood fill of CONNECT_BATCH_LANES graphs runs in parallel in the lanes of one register.
+	Whenever a lane has found all components of its graph, it drops out and is refilled with the next graph, so all lanes stay busy.
+*/
+template<unsigned int Variables, typename Func>
+void forEachConnectCountBatched(const BooleanFunction<Variables>* graphs, const BooleanFunction<Variables>* graphsEnd, const Func& func) {
+#ifdef CONNECT_GRAPH_BATCHED
+	if constexpr(Variables == 7) {
+		alignas(64) BooleanFunction<Variables> laneGraphs[CONNECT_BATCH_LANES];
+		alignas(64) BooleanFunction<Variables> laneExpanded[CONNECT_BATCH_LANES];
+		uint64_t laneCounts[CONNECT_BATCH_LANES];
+		size_t laneIndices[CONNECT_BATCH_LANES];
+
+		const BooleanFunction<Variables>* nextGraph = graphs;
+
+		// Places the first graph with non-singleton components into the lane, singleton-only graphs are reported immediately
+		auto fillLane = [&](int lane) -> bool {
+			while(nextGraph != graphsEnd) {
+				BooleanFunction<Variables> graph = *nextGraph;
+				size_t graphIndex = nextGraph - graphs;
+				nextGraph++;
+
+				eliminateLeavesUp(graph);
+				uint64_t connectCount = eliminateSingletons(graph);
+				if(graph.isEmpty()) {
+					func(graphIndex, connectCount);
+					continue;
+				}
+				BooleanFunction<Variables> initialGuess = BooleanFunction<Variables>::empty();
+				initialGuess.add(graph.getLast());
+				laneGraphs[lane] = graph;
+				laneExpanded[lane] = initialGuess.monotonizeDown() & graph;
+				laneCounts[lane] = connectCount + 1;
+				laneIndices[lane] = graphIndex;
+				return true;
+			}
+			// Empty lanes always converge, and are masked out
+			laneGraphs[lane] = BooleanFunction<Variables>::empty();
+			laneExpanded[lane] = BooleanFunction<Variables>::empty();
+			return false;
+		};
+
+		unsigned int activeLanes = 0;
+		for(int lane = 0; lane < CONNECT_BATCH_LANES; lane++) {
+			if(fillLane(lane)) activeLanes |= 1 << lane;
+		}
+
+		__m512i graphReg = _mm512_load_si512(laneGraphs);
+		__m512i expandedDownReg = _mm512_load_si512(laneExpanded);
+		while(activeLanes != 0) {
+			__m512i expandedUpReg = _mm512_and_si512(monotonizeUp7x4(expandedDownReg), graphReg);
+			__m512i newExpandedDownReg = _mm512_and_si512(monotonizeDown7x4(expandedUpReg), graphReg);
+			unsigned int convergedLanes = equalLanes7x4(_mm512_cmpeq_epi64_mask(newExpandedDownReg, expandedDownReg)) & activeLanes;
+			expandedDownReg = newExpandedDownReg;
+
+			if(convergedLanes != 0) {
+				_mm512_store_si512(laneGraphs, graphReg);
+				_mm512_store_si512(laneExpanded, expandedDownReg);
+				do {
+					int lane = ctz32(convergedLanes);
+					convergedLanes &= convergedLanes - 1;
+
+					BooleanFunction<Variables> graph = andnot(laneGraphs[lane], laneExpanded[lane]);
+					if(graph.isEmpty()) {
+						func(laneIndices[lane], laneCounts[lane]);
+						if(!fillLane(lane)) activeLanes &= ~(1 << lane);
+					} else {
+						laneCounts[lane]++;
+						BooleanFunction<Variables> newComponent = BooleanFunction<Variables>::empty();
+						newComponent.add(graph.getLast()); // picks the largest component, first expand downward
+						laneGraphs[lane] = graph;
+						laneExpanded[lane] = newComponent.monotonizeDown() & graph;
+					}
+				} while(convergedLanes != 0);
+				graphReg = _mm512_load_si512(laneGraphs);
+				expandedDownReg = _mm512_load_si512(laneExpanded);
+			}
+		}
+		return;
+	}
+#endif
+	for(const BooleanFunction<Variables>* graph = graphs; graph != graphsEnd; graph++) {
+		func(graph - graphs, countConnectedVeryFast<Variables>(*graph));
+	}
+}
+
 /*template<unsigned int Variables>
 uint64_t countConnectedVeryFast(BooleanFunction<Variables> graph) {
 	while(!graph.isEmpty()) {
@@ -0,0 +1,294 @@
+#include "dataManifest.h"
+
+#include "parallelFileLoader.h"
+#include "aligned_alloc.h"
+
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+bool VERIFY_DATA_FILES = true;
+
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4F;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9;
+constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63;
+constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5;
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+static inline uint64_t read64(const unsigned char* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+static inline uint32_t read32(const unsigned char* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+static inline uint64_t xxh64Round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+static inline uint64_t xxh64MergeRound(uint64_t acc, uint64_t val) {
+	acc ^= xxh64Round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+// XXH64 as specified by xxHash, four independent lanes over 32 byte stripes
+uint64_t xxh64(const void* data, size_t size, uint64_t seed) {
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	uint64_t h;
+	if(size >= 32) {
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+		const unsigned char* stripesEnd = end - 32;
+		do {
+			v1 = xxh64Round(v1, read64(p));
+			v2 = xxh64Round(v2, read64(p + 8));
+			v3 = xxh64Round(v3, read64(p + 16));
+			v4 = xxh64Round(v4, read64(p + 24));
+			p += 32;
+		} while(p <= stripesEnd);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh64MergeRound(h, v1);
+		h = xxh64MergeRound(h, v2);
+		h = xxh64MergeRound(h, v3);
+		h = xxh64MergeRound(h, v4);
+	} else {
+		h = seed + PRIME64_5;
+	}
+	h += size;
+	for(; p + 8 <= end; p += 8) {
+		h ^= xxh64Round(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if(p + 4 <= end) {
+		h ^= uint64_t(read32(p)) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for(; p < end; p++) {
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+	}
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+static const char MANIFEST_HEADER[] = "dedelib data manifest v1";
+
+std::string getDataManifestPath(const std::string& dataFile) {
+	return dataFile + ".manifest";
+}
+
+bool isDataManifestStale(const std::string& dataFile) {
+	std::error_code err;
+	std::filesystem::file_time_type manifestTime = std::filesystem::last_write_time(getDataManifestPath(dataFile), err);
+	return !err && std::filesystem::last_write_time(dataFile, err) > manifestTime;
+}
+
+bool readDataManifest(const std::string& dataFile, DataManifest& manifest) {
+	std::ifstream file(getDataManifestPath(dataFile));
+	if(!file.good()) return false;
+	std::string header;
+	std::getline(file, header);
+	std::string sizeLabel, chunkSizeLabel;
+	file >> sizeLabel >> manifest.fileSize >> chunkSizeLabel >> manifest.chunkSize;
+	if(header != MANIFEST_HEADER || sizeLabel != "size" || chunkSizeLabel != "chunkSize" || !file.good() || manifest.chunkSize == 0) {
+		std::cerr << "Malformed manifest " << getDataManifestPath(dataFile) << std::endl;
+		exit(1);
+	}
+	size_t chunkCount = (manifest.fileSize + manifest.chunkSize - 1) / manifest.chunkSize;
+	manifest.chunkHashes.resize(chunkCount);
+	for(uint64_t& hash : manifest.chunkHashes) {
+		file >> std::hex >> hash;
+	}
+	if(file.fail()) {
+		std::cerr << "Manifest " << getDataManifestPath(dataFile) << " is missing chunk hashes" << std::endl;
+		exit(1);
+	}
+	return true;
+}
+
+void writeDataManifest(const std::string& dataFile, const DataManifest& manifest) {
+	std::ofstream file(getDataManifestPath(dataFile));
+	file << MANIFEST_HEADER << "\nsize " << manifest.fileSize << "\nchunkSize " << manifest.chunkSize << "\n";
+	char hex[17];
+	for(uint64_t hash : manifest.chunkHashes) {
+		snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+		file << hex << "\n";
+	}
+}
+
+DataManifest computeDataManifest(const void* data, size_t size, size_t chunkSize) {
+	DataManifest manifest;
+	manifest.fileSize = size;
+	manifest.chunkSize = chunkSize;
+	manifest.chunkHashes.resize((size + chunkSize - 1) / chunkSize);
+	for(size_t chunk = 0; chunk < manifest.getChunkCount(); chunk++) {
+		manifest.chunkHashes[chunk] = xxh64(static_cast<const char*>(data) + chunk * chunkSize, manifest.getChunkSize(chunk));
+	}
+	return manifest;
+}
+
+void checkDataFileChunk(const std::string& dataFile, const DataManifest& manifest, size_t chunk, const void* chunkData) {
+	if(!manifest.checkChunk(chunk, chunkData)) {
+		size_t start = chunk * manifest.chunkSize;
+		std::cerr << "\033[31mData file " << dataFile << " is corrupt! Chunk " << chunk << " (bytes " << start << "-" << start + manifest.getChunkSize(chunk)
+			<< ") doesn't match " << getDataManifestPath(dataFile) << "\033[39m" << std::endl;
+		exit(1);
+	}
+}
+
+struct HashedFile {
+	std::string path;
+	size_t size;
+	size_t chunkSize;
+	std::vector<uint64_t> chunkHashes;
+	int fd;
+	bool direct;
+};
+
+// Hashes the chunks of all files with FILE_LOADER_THREADS threads. Every thread reads a whole chunk and hashes it, so the drives see many large reads at once.
+// O_DIRECT keeps the files from pushing everything else out of the page cache
+static void hashFilesInParallel(std::vector<HashedFile>& files) {
+	constexpr size_t DIRECT_IO_ALIGN = 4096;
+	struct ChunkRef {
+		size_t file;
+		size_t chunk;
+	};
+	std::vector<ChunkRef> work;
+	size_t maxChunkSize = 0;
+	for(size_t f = 0; f < files.size(); f++) {
+		HashedFile& file = files[f];
+		file.direct = file.chunkSize % DIRECT_IO_ALIGN == 0;
+		file.fd = file.direct ? open(file.path.c_str(), O_RDONLY | O_DIRECT) : -1;
+		if(file.fd == -1) {
+			file.direct = false;
+			file.fd = open(file.path.c_str(), O_RDONLY);
+		}
+		file.chunkHashes.resize((file.size + file.chunkSize - 1) / file.chunkSize);
+		for(size_t chunk = 0; chunk < file.chunkHashes.size(); chunk++) work.push_back(ChunkRef{f, chunk});
+		maxChunkSize = std::max(maxChunkSize, file.chunkSize);
+	}
+
+	std::atomic<size_t> nextWork(0);
+	auto worker = [&]() {
+		char* buffer = static_cast<char*>(aligned_malloc(maxChunkSize + DIRECT_IO_ALIGN, DIRECT_IO_ALIGN));
+		for(size_t w; (w = nextWork.fetch_add(1)) < work.size();) {
+			HashedFile& file = files[work[w].file];
+			size_t offset = work[w].chunk * file.chunkSize;
+			size_t chunkSize = std::min(file.chunkSize, file.size - offset);
+			size_t readSize = file.direct ? (chunkSize + DIRECT_IO_ALIGN - 1) / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN : chunkSize;
+			size_t done = 0;
+			while(done < chunkSize) {
+				ssize_t count = pread(file.fd, buffer + done, readSize - done, offset + done);
+				if(count == -1 && errno == EINTR) continue;
+				if(count <= 0) break;
+				done += count;
+			}
+			// A file that is shorter than its manifest says can't match
+			file.chunkHashes[work[w].chunk] = done >= chunkSize ? xxh64(buffer, chunkSize) : ~xxh64(buffer, done);
+		}
+		aligned_free(buffer);
+	};
+	size_t threadCount = std::min(size_t(std::max(FILE_LOADER_THREADS, 1)), std::max(work.size(), size_t(1)));
+	std::vector<std::thread> threads;
+	for(size_t i = 1; i < threadCount; i++) threads.emplace_back(worker);
+	worker();
+	for(std::thread& t : threads) t.join();
+	for(HashedFile& file : files) close(file.fd);
+}
+
+static std::vector<std::string> listDataFiles(const std::string& folder) {
+	std::vector<std::string> dataFiles;
+	for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(folder)) {
+		std::string name = entry.path().filename().string();
+		if(!entry.is_regular_file() || name[0] == '.' || entry.path().extension() == ".manifest") continue;
+		dataFiles.push_back(entry.path().string());
+	}
+	std::sort(dataFiles.begin(), dataFiles.end());
+	return dataFiles;
+}
+
+size_t verifyDataFiles(const std::string& folder) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::vector<HashedFile> files;
+	std::vector<DataManifest> manifests;
+	size_t badFiles = 0;
+	size_t totalSize = 0;
+	for(const std::string& dataFile : listDataFiles(folder)) {
+		DataManifest manifest;
+		if(!readDataManifest(dataFile, manifest)) {
+			std::cout << "  no manifest  " << dataFile << std::endl;
+			continue;
+		}
+		if(isDataManifestStale(dataFile)) {
+			std::cout << "\033[33m  STALE        " << dataFile << " is newer than its manifest, run createDataManifests\033[39m" << std::endl;
+			continue;
+		}
+		size_t actualSize = std::filesystem::file_size(dataFile);
+		if(actualSize != manifest.fileSize) {
+			std::cout << "\033[31m  WRONG SIZE   " << dataFile << " is " << actualSize << " bytes, the manifest says " << manifest.fileSize << "\033[39m" << std::endl;
+			badFiles++;
+			continue;
+		}
+		files.push_back(HashedFile{dataFile, manifest.fileSize, manifest.chunkSize, {}, -1, false});
+		manifests.push_back(std::move(manifest));
+		totalSize += actualSize;
+	}
+	hashFilesInParallel(files);
+	for(size_t f = 0; f < files.size(); f++) {
+		size_t badChunks = 0;
+		for(size_t chunk = 0; chunk < files[f].chunkHashes.size(); chunk++) {
+			if(files[f].chunkHashes[chunk] != manifests[f].chunkHashes[chunk]) {
+				if(badChunks == 0) std::cout << "\033[31m  CORRUPT      " << files[f].path << "\033[39m" << std::endl;
+				std::cout << "\033[31m    chunk " << chunk << " (bytes " << chunk * manifests[f].chunkSize << "-" << chunk * manifests[f].chunkSize + manifests[f].getChunkSize(chunk) << ")\033[39m" << std::endl;
+				badChunks++;
+			}
+		}
+		if(badChunks == 0) {
+			std::cout << "\033[32m  OK           " << files[f].path << "\033[39m" << std::endl;
+		} else {
+			badFiles++;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "Checked " << files.size() << " files (" << (totalSize >> 20) << "MB) at " << totalSize / seconds / (1 << 20) << "MB/s, "
+		<< (badFiles == 0 ? "\033[32m" : "\033[31m") << badFiles << " bad files\033[39m" << std::endl;
+	return badFiles;
+}
+
+void createDataManifests(const std::string& folder) {
+	std::vector<HashedFile> files;
+	for(const std::string& dataFile : listDataFiles(folder)) {
+		if(std::filesystem::exists(getDataManifestPath(dataFile)) && !isDataManifestStale(dataFile)) continue;
+		files.push_back(HashedFile{dataFile, std::filesystem::file_size(dataFile), DATA_MANIFEST_DEFAULT_CHUNK_SIZE, {}, -1, false});
+	}
+	hashFilesInParallel(files);
+	for(const HashedFile& file : files) {
+		writeDataManifest(file.path, DataManifest{file.size, file.chunkSize, file.chunkHashes});
+		std::cout << "  Created " << getDataManifestPath(file.path) << std::endl;
+	}
+	std::cout << "Created " << files.size() << " manifests in " << folder << std::endl;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+	Integrity manifests for the data files. Every data file can have a sidecar <file>.manifest with the XXH64 hash of each chunk of the file.
+	loadFileIntoBuffers checks each chunk against it as the chunk arrives, so a corrupted file is caught when it is loaded,
+	instead of showing up as wrong results much later.
+
+	The manifest is a text file:
+		dedelib data manifest v1
+		size <file size>
+		chunkSize <chunk size>
+		<hash of chunk 0 as 16 hex digits>
+		...
+*/
+
+// When false, the manifests are ignored while loading. Set by configure() from -noVerifyDataFiles
+extern bool VERIFY_DATA_FILES;
+
+constexpr size_t DATA_MANIFEST_DEFAULT_CHUNK_SIZE = size_t(8) << 20;
+
+uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+struct DataManifest {
+	size_t fileSize;
+	size_t chunkSize;
+	std::vector<uint64_t> chunkHashes;
+
+	size_t getChunkCount() const {return chunkHashes.size();}
+	size_t getChunkSize(size_t chunk) const {return chunk + 1 < chunkHashes.size() ? chunkSize : fileSize - chunk * chunkSize;}
+	// Returns false if the chunk doesn't match
+	bool checkChunk(size_t chunk, const void* chunkData) const {return xxh64(chunkData, getChunkSize(chunk)) == chunkHashes[chunk];}
+};
+
+std::string getDataManifestPath(const std::string& dataFile);
+// The data file was rewritten after its manifest, by something that doesn't write manifests
+bool isDataManifestStale(const std::string& dataFile);
+// Returns false if the file has no manifest. Exits if the manifest is malformed
+bool readDataManifest(const std::string& dataFile, DataManifest& manifest);
+void writeDataManifest(const std::string& dataFile, const DataManifest& manifest);
+DataManifest computeDataManifest(const void* data, size_t size, size_t chunkSize = DATA_MANIFEST_DEFAULT_CHUNK_SIZE);
+
+// Exits with the chunk's byte range if it doesn't match
+void checkDataFileChunk(const std::string& dataFile, const DataManifest& manifest, size_t chunk, const void* chunkData);
+
+// Reads every file in the folder that has a manifest in parallel, and checks all of its chunks. Returns the number of bad files
+size_t verifyDataFiles(const std::string& folder);
+// Writes a manifest for every data file in the folder that doesn't have an up to date one
+void createDataManifests(const std::string& folder);
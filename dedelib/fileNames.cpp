@@ -67,6 +67,9 @@ std::string benchmarkSetTopBots(unsigned int Variables) {
 std::string firstRunBetaSums(unsigned int Variables) {
 	return makeBasicName(Variables, "firstRunBetaSums", ".u128");
 }
+std::string intervalSizeCache(unsigned int Variables, bool useCanonization) {
+	return makeBasicName(Variables, useCanonization ? "intervalSizeCacheCanonical" : "intervalSizeCache", ".isc");
+}
 
 std::string pipelineTestSet(unsigned int Variables) {
 	return makeBasicName(Variables, "pipelineTestSet", ".mem");
@@ -119,6 +122,9 @@ std::string flatLinks(unsigned int Variables) {
 std::string mbfStructure(unsigned int Variables) {
 	return makeBasicName(Variables, "mbfStructure", ".mbfStructure");
 }
+std::string mbfStructureCompressed(unsigned int Variables) {
+	return makeBasicName(Variables, "mbfStructureCompressed", ".mbfStructure");
+}
 std::string flatMBFsU64(unsigned int Variables) {
 	return makeBasicName(Variables, "flatMBFsRandomized", ".mbfU64");
 }
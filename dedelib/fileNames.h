@@ -17,6 +17,7 @@ std::string allIntervalSymmetries(unsigned int Variables);
 std::string benchmarkSet(unsigned int Variables);
 std::string benchmarkSetTopBots(unsigned int Variables);
 std::string firstRunBetaSums(unsigned int Variables);
+std::string intervalSizeCache(unsigned int Variables, bool useCanonization);
 
 // Test sets for the hardware accelerator
 std::string pipelineTestSet(unsigned int Variables);
@@ -38,6 +39,7 @@ std::string flatClassInfo(unsigned int Variables);
 std::string flatNodes(unsigned int Variables);
 std::string flatLinks(unsigned int Variables);
 std::string mbfStructure(unsigned int Variables);
+std::string mbfStructureCompressed(unsigned int Variables);
 std::string flatMBFsU64(unsigned int Variables);
 
 // File name for random MBF generation
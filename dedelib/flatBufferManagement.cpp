@@ -1,6 +1,9 @@
 #include "flatBufferManagement.h"
 
 #include "numaMem.h"
+#include "parallelFileLoader.h"
+#include "sharedBufferCache.h"
+#include "dataManifest.h"
 
 #include <fstream>
 #include <iostream>
@@ -24,14 +27,13 @@ void writeFlatVoidBuffer(const void* data, const std::string& fileName, size_t s
 	file.close();
 }
 
+void writeFlatVoidBufferWithManifest(const void* data, const std::string& fileName, size_t size) {
+	writeFlatVoidBuffer(data, fileName, size);
+	writeDataManifest(fileName, computeDataManifest(data, size));
+}
+
 void readFlatVoidBufferNoMMAP(const std::string& fileName, size_t size, void* buffer) {
-	std::ifstream file(fileName, std::ios::binary);
-	if(!file.good()) {
-		std::cout << "Could not open file '" << fileName << "'!" << std::endl;
-		exit(1);
-	}
-	file.read(static_cast<char*>(buffer), size);
-	file.close();
+	loadFileIntoBuffers(fileName, size, &buffer, 1);
 }
 
 /*void readFlatVoidBufferNoMMAP(const char* fileName, size_t size, void* target) {
@@ -50,10 +52,17 @@ void* readFlatVoidBufferNoMMAP(const std::string& fileName, size_t size) {
 	readFlatVoidBufferNoMMAP(fileName, size, buffer);
 	return buffer;
 }
+const void* readSharedFlatVoidBufferNoMMAP(const std::string& fileName, size_t size) {
+	if(const void* shared = attachSharedBuffer(fileName, size, size, -1)) {
+		return shared;
+	}
+	return readFlatVoidBufferNoMMAP(fileName, size);
+}
 void freeFlatVoidBufferNoMMAP(const void* buffer, size_t size) {
+	if(detachSharedBuffer(buffer)) return;
 	numa_free(const_cast<void*>(buffer), size);
 }
-void* mmapFlatVoidBuffer(const std::string& fileName, size_t size) {
+void* mmapFlatVoidBuffer(const std::string& fileName, size_t size, bool writable) {
 	#ifdef __linux__
 	int fd = open(fileName.c_str(), O_RDONLY);
 	if(fd == -1) {
@@ -70,7 +79,7 @@ void* mmapFlatVoidBuffer(const std::string& fileName, size_t size) {
 			mmapFlags |= (30 << MAP_HUGE_SHIFT);
 		}
 	}
-	void* result = mmap(NULL, size, PROT_READ, mmapFlags, fd, 0);
+	void* result = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, mmapFlags, fd, 0);
 	if(result == MAP_FAILED) {
 		int err = errno;
 		perror("mmap");
@@ -108,7 +117,7 @@ void freeFlatVoidBuffer(const void* buffer, size_t size) {
 	if(BUFMANAGEMENT_MMAP) {
 		munmapFlatVoidBuffer(buffer, size);
 	} else {
-		numa_free(const_cast<void*>(buffer), size);
+		freeFlatVoidBufferNoMMAP(buffer, size);
 	}
 }
 
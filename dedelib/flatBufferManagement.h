@@ -16,11 +16,16 @@ extern BufmanagementPageSize BUFMANAGEMENT_MMAP_PAGE_SIZE;
 
 
 void writeFlatVoidBuffer(const void* data, const std::string& fileName, size_t size);
+// Also writes the <file>.manifest that loading checks the file against, for the data files made by the preCompute generators
+void writeFlatVoidBufferWithManifest(const void* data, const std::string& fileName, size_t size);
 void* readFlatVoidBuffer(const std::string& fileName, size_t size);
 void readFlatVoidBufferNoMMAP(const std::string& fileName, size_t size, void* buffer);
 void* readFlatVoidBufferNoMMAP(const std::string& fileName, size_t size);
+// Attaches the node's copy in the shared buffer cache if it is enabled. Only for the big read-only files every process on a node loads. Free with freeFlatVoidBufferNoMMAP
+const void* readSharedFlatVoidBufferNoMMAP(const std::string& fileName, size_t size);
 void freeFlatVoidBufferNoMMAP(const void* buffer, size_t size);
-void* mmapFlatVoidBuffer(const std::string& fileName, size_t size);
+// The mapping is MAP_PRIVATE. With writable it is also PROT_WRITE: writes go to private copies of the pages, the file and other processes' mappings are untouched
+void* mmapFlatVoidBuffer(const std::string& fileName, size_t size, bool writable = false);
 void munmapFlatVoidBuffer(const void* buf, size_t size);
 void freeFlatVoidBuffer(const void* buffer, size_t size);
 void free_const(const void* buffer);
@@ -30,6 +35,11 @@ void writeFlatBuffer(const T* data, const std::string& fileName, size_t size) {
 	writeFlatVoidBuffer(data, fileName, sizeof(T) * size);
 }
 
+template<typename T>
+void writeFlatBufferWithManifest(const T* data, const std::string& fileName, size_t size) {
+	writeFlatVoidBufferWithManifest(data, fileName, sizeof(T) * size);
+}
+
 template<typename T>
 const T* readFlatBuffer(const std::string& fileName, size_t size) {
 	return static_cast<const T*>(readFlatVoidBuffer(fileName.c_str(), sizeof(T) * size));
@@ -40,6 +50,11 @@ const T* readFlatBufferNoMMAP(const std::string& fileName, size_t size) {
 	return static_cast<const T*>(readFlatVoidBufferNoMMAP(fileName.c_str(), sizeof(T) * size));
 }
 
+template<typename T>
+const T* readSharedFlatBufferNoMMAP(const std::string& fileName, size_t size) {
+	return static_cast<const T*>(readSharedFlatVoidBufferNoMMAP(fileName, sizeof(T) * size));
+}
+
 template<typename T>
 void freeFlatBuffer(const T* buffer, size_t size) {
 	freeFlatVoidBuffer(buffer, sizeof(T) * size);
@@ -69,10 +69,10 @@ public:
 
 template<unsigned int Variables>
 void writeFlatMBFStructure(const FlatMBFStructure<Variables>& structure) {
-	writeFlatBuffer(structure.mbfs, FileName::flatMBFs(Variables), FlatMBFStructure<Variables>::MBF_COUNT);
-	writeFlatBuffer(structure.allClassInfos, FileName::flatClassInfo(Variables), FlatMBFStructure<Variables>::MBF_COUNT);
-	writeFlatBuffer(structure.allNodes, FileName::flatNodes(Variables), FlatMBFStructure<Variables>::MBF_COUNT + 1);
-	writeFlatBuffer(structure.allLinks, FileName::flatLinks(Variables), FlatMBFStructure<Variables>::LINK_COUNT);
+	writeFlatBufferWithManifest(structure.mbfs, FileName::flatMBFs(Variables), FlatMBFStructure<Variables>::MBF_COUNT);
+	writeFlatBufferWithManifest(structure.allClassInfos, FileName::flatClassInfo(Variables), FlatMBFStructure<Variables>::MBF_COUNT);
+	writeFlatBufferWithManifest(structure.allNodes, FileName::flatNodes(Variables), FlatMBFStructure<Variables>::MBF_COUNT + 1);
+	writeFlatBufferWithManifest(structure.allLinks, FileName::flatLinks(Variables), FlatMBFStructure<Variables>::LINK_COUNT);
 }
 
 template<unsigned int Variables>
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <atomic>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <iostream>
 
 #include "knownData.h"
 #include "bitSet.h"
@@ -13,14 +17,16 @@
 #include "resultCollection.h"
 
 #define PCOEFF_MULTITHREAD
+// Only compute the pcoeffs of one permutation per double coset Aut(top) * sigma * Aut(bot), weighted by the size of that coset
+#define PCOEFF_EXPLOIT_SYMMETRIES
 
 template<unsigned int Variables>
 uint64_t computePCoeffSum(const BooleanFunction<Variables>* graphsBuf, const BooleanFunction<Variables>* graphsBufEnd) {
 	uint64_t totalSum = 0;
 
-	for(; graphsBuf != graphsBufEnd; graphsBuf++) {
-		totalSum += uint64_t(1) << countConnectedVeryFast<Variables>(*graphsBuf);
-	}
+	forEachConnectCountBatched<Variables>(graphsBuf, graphsBufEnd, [&](size_t, uint64_t connectCount) {
+		totalSum += uint64_t(1) << connectCount;
+	});
 	return totalSum;
 }
 
@@ -28,12 +34,10 @@ template<unsigned int Variables>
 ProcessedPCoeffSum processPCoeffSum(Monotonic<Variables> top, Monotonic<Variables> bot) {
 	uint64_t pcoeffSum = 0;
 	uint64_t pcoeffCount = 0;
-	bot.forEachPermutation([&](const Monotonic<Variables>& permutedBot) {
-		if(permutedBot <= top) {
-			BooleanFunction<Variables> graph = andnot(top.bf, permutedBot.bf);
-			pcoeffCount++;
-			pcoeffSum += uint64_t(1) << countConnectedVeryFast<Variables>(graph);
-		}
+	bot.forEachPermutationBelow(top, [&](const Monotonic<Variables>& permutedBot) {
+		BooleanFunction<Variables> graph = andnot(top.bf, permutedBot.bf);
+		pcoeffCount++;
+		pcoeffSum += uint64_t(1) << countConnectedVeryFast<Variables>(graph);
 	});
 
 	return produceProcessedPcoeffSumCount(pcoeffSum, pcoeffCount);
@@ -41,11 +45,9 @@ ProcessedPCoeffSum processPCoeffSum(Monotonic<Variables> top, Monotonic<Variable
 
 template<unsigned int Variables>
 BooleanFunction<Variables>* listPermutationsBelow(const Monotonic<Variables>& top, const Monotonic<Variables>& botToPermute, BooleanFunction<Variables> result[factorial(Variables)]) {
-	botToPermute.forEachPermutation([&result, &top](const Monotonic<Variables>& permutedBot) {
-		if(permutedBot <= top) {
-			BooleanFunction<Variables> difference = andnot(top.bf, permutedBot.bf);
-			*result++ = difference;
-		}
+	botToPermute.forEachPermutationBelow(top, [&result, &top](const Monotonic<Variables>& permutedBot) {
+		BooleanFunction<Variables> difference = andnot(top.bf, permutedBot.bf);
+		*result++ = difference;
 	});
 	return result;
 }
@@ -59,7 +61,280 @@ ProcessedPCoeffSum processPCoeffSum(Monotonic<Variables> top, Monotonic<Variable
 }
 
 
+// A permutation of the variables, stored as the list of swaps that performs it
+template<unsigned int Variables>
+struct VariableSwaps {
+	unsigned int swapCount;
+	uint8_t swaps[Variables][2];
+
+	template<typename BF>
+	void applyTo(BF& bf) const {
+		for(unsigned int i = 0; i < swapCount; i++) {
+			bf.swap(swaps[i][0], swaps[i][1]);
+		}
+	}
+};
+
+// The automorphism group of a top, every nontrivial permutation that maps the top onto itself
+template<unsigned int Variables>
+struct TopSymmetries {
+	std::vector<VariableSwaps<Variables>> automorphisms;
+
+	// Only the identity
+	TopSymmetries() = default;
+	TopSymmetries(const Monotonic<Variables>& top) {
+		std::array<unsigned int, Variables> newOrder;
+		for(unsigned int v = 0; v < Variables; v++) newOrder[v] = v;
+
+		while(std::next_permutation(newOrder.begin(), newOrder.end())) { // skips the identity
+			VariableSwaps<Variables> perm;
+			perm.swapCount = 0;
+			std::array<unsigned int, Variables> varAtPos;
+			for(unsigned int v = 0; v < Variables; v++) varAtPos[v] = v;
+			for(unsigned int pos = 0; pos < Variables; pos++) {
+				if(varAtPos[pos] == newOrder[pos]) continue;
+				unsigned int foundPos = pos + 1;
+				while(varAtPos[foundPos] != newOrder[pos]) foundPos++;
+				std::swap(varAtPos[pos], varAtPos[foundPos]);
+				perm.swaps[perm.swapCount][0] = pos;
+				perm.swaps[perm.swapCount][1] = foundPos;
+				perm.swapCount++;
+			}
 
+			Monotonic<Variables> permutedTop = top;
+			perm.applyTo(permutedTop.bf);
+			if(permutedTop == top) {
+				automorphisms.push_back(perm);
+			}
+		}
+	}
+
+	bool isTrivial() const {
+		return automorphisms.empty();
+	}
+};
+
+/*
+	Bit-identical to processPCoeffSum, but exploits the symmetries of top and bot.
+	
+	For every automorphism tau of top and rho of bot, tau(sigma(rho(bot))) has the same pcoeff as sigma(bot),
+	so only one permutation per double coset Aut(top) * sigma * Aut(bot) needs its connected components counted.
+	The distinct permutations of bot are found by sorting, as each of them occurs |Aut(bot)| times. 
+	These are then grouped into orbits under Aut(top). 
+*/
+template<unsigned int Variables>
+ProcessedPCoeffSum processPCoeffSumSymmetric(const Monotonic<Variables>& top, const Monotonic<Variables>& bot, const TopSymmetries<Variables>& topSymmetries, BooleanFunction<Variables>* graphsBuf/*[factorial(Variables)]*/) {
+	BooleanFunction<Variables>* graphsBufEnd = graphsBuf;
+	bot.forEachPermutationBelow(top, [&](const Monotonic<Variables>& permutedBot) {
+		*graphsBufEnd++ = permutedBot.bf;
+	});
+	uint64_t pcoeffCount = graphsBufEnd - graphsBuf;
+	if(pcoeffCount == 0) return produceProcessedPcoeffSumCount(0, 0);
+
+	// Any automorphism of bot must map each variable to one with the same number of occurences
+	bool botMayHaveSymmetries = false;
+	for(unsigned int a = 0; a < Variables; a++) {
+		for(unsigned int b = a + 1; b < Variables; b++) {
+			if(bot.bf.countVariableOccurences(a) == bot.bf.countVariableOccurences(b)) botMayHaveSymmetries = true;
+		}
+	}
+
+	if(!botMayHaveSymmetries && topSymmetries.isTrivial()) {
+		for(BooleanFunction<Variables>* cur = graphsBuf; cur != graphsBufEnd; cur++) {
+			*cur = andnot(top.bf, *cur);
+		}
+		return produceProcessedPcoeffSumCount(computePCoeffSum(graphsBuf, graphsBufEnd), pcoeffCount);
+	}
+
+	std::sort(graphsBuf, graphsBufEnd, [](const BooleanFunction<Variables>& a, const BooleanFunction<Variables>& b) {return a.bitset < b.bitset;});
+	// Every distinct permutation of bot occurs exactly |Aut(bot)| times
+	unsigned int botStabilizerSize = 1;
+	while(graphsBuf + botStabilizerSize != graphsBufEnd && graphsBuf[botStabilizerSize] == graphsBuf[0]) botStabilizerSize++;
+	graphsBufEnd = std::unique(graphsBuf, graphsBufEnd);
+	size_t distinctCount = graphsBufEnd - graphsBuf;
+
+	// weights[i] is the number of the original permutations that graphsBuf[i] represents
+	uint16_t weights[factorial(Variables)];
+	if(topSymmetries.isTrivial()) {
+		for(size_t i = 0; i < distinctCount; i++) {
+			weights[i] = botStabilizerSize;
+		}
+	} else {
+		bool isCovered[factorial(Variables)];
+		for(size_t i = 0; i < distinctCount; i++) {
+			isCovered[i] = false;
+		}
+		for(size_t i = 0; i < distinctCount; i++) {
+			weights[i] = 0; // not a representative
+			if(isCovered[i]) continue;
+			BooleanFunction<Variables> representative = graphsBuf[i];
+			isCovered[i] = true;
+			unsigned int orbitSize = 1;
+			for(const VariableSwaps<Variables>& automorphism : topSymmetries.automorphisms) {
+				BooleanFunction<Variables> image = representative;
+				automorphism.applyTo(image);
+				// image <= top, so it must be in the buffer
+				const BooleanFunction<Variables>* found = std::lower_bound(graphsBuf, graphsBufEnd, image, [](const BooleanFunction<Variables>& a, const BooleanFunction<Variables>& b) {return a.bitset < b.bitset;});
+				assert(found != graphsBufEnd && *found == image);
+				size_t foundIndex = found - graphsBuf;
+				if(!isCovered[foundIndex]) {
+					isCovered[foundIndex] = true;
+					orbitSize++;
+				}
+			}
+			weights[i] = orbitSize * botStabilizerSize;
+		}
+		// Only compact once all orbits are known, the lookups above need the full sorted buffer
+		size_t representativeCount = 0;
+		for(size_t i = 0; i < distinctCount; i++) {
+			if(weights[i] != 0) {
+				weights[representativeCount] = weights[i];
+				graphsBuf[representativeCount] = graphsBuf[i];
+				representativeCount++;
+			}
+		}
+		graphsBufEnd = graphsBuf + representativeCount;
+	}
+
+	for(BooleanFunction<Variables>* cur = graphsBuf; cur != graphsBufEnd; cur++) {
+		*cur = andnot(top.bf, *cur);
+	}
+	uint64_t pcoeffSum = 0;
+	forEachConnectCountBatched<Variables>(graphsBuf, graphsBufEnd, [&](size_t graphIndex, uint64_t connectCount) {
+		pcoeffSum += uint64_t(weights[graphIndex]) << connectCount;
+	});
+	return produceProcessedPcoeffSumCount(pcoeffSum, pcoeffCount);
+}
+
+
+
+
+struct ConnectCountCacheStats {
+	std::atomic<uint64_t> hits{0};
+	std::atomic<uint64_t> misses{0};
+
+	void print() const {
+		uint64_t h = hits.load();
+		uint64_t m = misses.load();
+		std::cout << "Connect count cache: " + std::to_string(h) + " hits, " + std::to_string(m) + " misses (" + std::to_string(h * 100.0 / std::max(h + m, uint64_t(1))) + "% hit rate)\n" << std::flush;
+	}
+};
+// Totals of all ConnectCountCaches, updated when a thread finishes its part of a job
+inline ConnectCountCacheStats connectCountCacheStats;
+
+/*
+	A bounded direct-mapped memo of countConnectedVeryFast results. 
+	Meant to be owned by a single thread, so no synchronization is needed. 
+	With CanonicalKeys, graphs are canonized first, so equivalent graphs share an entry, at the cost of a canonize per lookup. 
+*/
+template<unsigned int Variables, bool CanonicalKeys = false, unsigned int CacheSizeBits = 12>
+class ConnectCountCache {
+	static constexpr size_t CACHE_SIZE = size_t(1) << CacheSizeBits;
+	static constexpr uint64_t EMPTY_ENTRY = ~uint64_t(0);
+
+	struct Entry {
+		BooleanFunction<Variables> graph;
+		uint64_t connectCount;
+	};
+
+	Entry entries[CACHE_SIZE];
+public:
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	ConnectCountCache() {
+		for(Entry& e : entries) {
+			e.connectCount = EMPTY_ENTRY;
+		}
+	}
+
+	BooleanFunction<Variables> getKey(const BooleanFunction<Variables>& graph) const {
+		if constexpr(CanonicalKeys) {
+			return graph.canonize();
+		} else {
+			return graph;
+		}
+	}
+
+	Entry& getEntry(const BooleanFunction<Variables>& key) {
+		uint64_t hash = key.hash() * 0x9E3779B97F4A7C15; // The plain BitSet hash is a xor of the blocks, mix it up a bit
+		return entries[hash >> (64 - CacheSizeBits)];
+	}
+
+	// Returns EMPTY_ENTRY on a miss
+	uint64_t tryGet(const BooleanFunction<Variables>& key) {
+		Entry& e = getEntry(key);
+		if(e.connectCount != EMPTY_ENTRY && e.graph == key) {
+			hits++;
+			return e.connectCount;
+		} else {
+			misses++;
+			return EMPTY_ENTRY;
+		}
+	}
+
+	void put(const BooleanFunction<Variables>& key, uint64_t connectCount) {
+		Entry& e = getEntry(key);
+		e.graph = key;
+		e.connectCount = connectCount;
+	}
+
+	uint64_t countConnected(const BooleanFunction<Variables>& graph) {
+		BooleanFunction<Variables> key = getKey(graph);
+		uint64_t connectCount = tryGet(key);
+		if(connectCount == EMPTY_ENTRY) {
+			connectCount = countConnectedVeryFast<Variables>(graph);
+			put(key, connectCount);
+		}
+		return connectCount;
+	}
+
+	// Adds this thread's statistics to connectCountCacheStats
+	void flushStats() {
+		connectCountCacheStats.hits.fetch_add(hits);
+		connectCountCacheStats.misses.fetch_add(misses);
+		hits = 0;
+		misses = 0;
+	}
+
+	static bool isMiss(uint64_t connectCount) {
+		return connectCount == EMPTY_ENTRY;
+	}
+};
+
+// The cache of the calling thread, it is kept between jobs
+template<unsigned int Variables>
+ConnectCountCache<Variables>& getThreadConnectCountCache() {
+	static thread_local ConnectCountCache<Variables> cache;
+	return cache;
+}
+
+// Same as processPCoeffSum, but looks up every graph in the cache first. Only the misses go to the batched kernel
+template<unsigned int Variables, bool CanonicalKeys>
+ProcessedPCoeffSum processPCoeffSumMemoized(Monotonic<Variables> top, Monotonic<Variables> bot, ConnectCountCache<Variables, CanonicalKeys>& cache, BooleanFunction<Variables>* graphsBuf/*[factorial(Variables)]*/) {
+	BooleanFunction<Variables>* graphsBufEnd = listPermutationsBelow<Variables>(top, bot, graphsBuf);
+	uint64_t pcoeffCount = graphsBufEnd - graphsBuf;
+	uint64_t pcoeffSum = 0;
+
+	// Misses are compacted to the front of the buffer, and their keys stored alongside
+	BooleanFunction<Variables> missKeys[factorial(Variables)];
+	BooleanFunction<Variables>* missesEnd = graphsBuf;
+	for(BooleanFunction<Variables>* cur = graphsBuf; cur != graphsBufEnd; cur++) {
+		BooleanFunction<Variables> key = cache.getKey(*cur);
+		uint64_t connectCount = cache.tryGet(key);
+		if(cache.isMiss(connectCount)) {
+			missKeys[missesEnd - graphsBuf] = key;
+			*missesEnd++ = *cur;
+		} else {
+			pcoeffSum += uint64_t(1) << connectCount;
+		}
+	}
+	forEachConnectCountBatched<Variables>(graphsBuf, missesEnd, [&](size_t graphIndex, uint64_t connectCount) {
+		cache.put(missKeys[graphIndex], connectCount);
+		pcoeffSum += uint64_t(1) << connectCount;
+	});
+	return produceProcessedPcoeffSumCount(pcoeffSum, pcoeffCount);
+}
 
 template<unsigned int Variables>
 ProcessedPCoeffSum processOneBeta(const Monotonic<Variables>* mbfs, NodeIndex topIdx, NodeIndex botIdx) {
@@ -73,6 +348,9 @@ ProcessedPCoeffSum processOneBeta(const Monotonic<Variables>* mbfs, NodeIndex to
 template<unsigned int Variables>
 void processBetasCPU_SingleThread(const Monotonic<Variables>* mbfs, const JobInfo& job, ProcessedPCoeffSum* countConnectedSumBuf) {
 	Monotonic<Variables> top = mbfs[job.getTop()];
+#ifdef PCOEFF_EXPLOIT_SYMMETRIES
+	TopSymmetries<Variables> topSymmetries(top);
+#endif
 
 	BooleanFunction<Variables> graphsBuf[factorial(Variables)];
 
@@ -80,13 +358,21 @@ void processBetasCPU_SingleThread(const Monotonic<Variables>* mbfs, const JobInf
 
 	for(const NodeIndex* cur = job.begin(); cur != jobEnd; cur++) {
 		Monotonic<Variables> bot = mbfs[*cur];
+#ifdef PCOEFF_EXPLOIT_SYMMETRIES
+		countConnectedSumBuf[job.indexOf(cur)] = processPCoeffSumSymmetric<Variables>(top, bot, topSymmetries, graphsBuf);
+#else
 		countConnectedSumBuf[job.indexOf(cur)] = processPCoeffSum<Variables>(top, bot, graphsBuf);
+#endif
 	}
 }
 
-template<unsigned int Variables>
+// With MemoizeConnectCounts, every thread keeps a ConnectCountCache across jobs, see connectCountCacheStats for its effectiveness
+template<unsigned int Variables, bool MemoizeConnectCounts = false>
 void processBetasCPU_MultiThread(const Monotonic<Variables>* mbfs, const JobInfo& job, ProcessedPCoeffSum* countConnectedSumBuf, ThreadPool& threadPool) {
 	Monotonic<Variables> top = mbfs[job.getTop()];
+#ifdef PCOEFF_EXPLOIT_SYMMETRIES
+	TopSymmetries<Variables> topSymmetries(top);
+#endif
 
 	constexpr int NODE_BLOCK_SIZE = Variables >= 7 ? 1024 : 16;
 
@@ -96,7 +382,8 @@ void processBetasCPU_MultiThread(const Monotonic<Variables>* mbfs, const JobInfo
 	const NodeIndex* jobEnd = job.end();
 
 	threadPool.doInParallel([&](){
-		//BooleanFunction<Variables> graphsBuf[factorial(Variables)];
+		// The batched kernel, the symmetry reduction and the memo need all permutations of a bottom up front
+		BooleanFunction<Variables> graphsBuf[factorial(Variables)];
 		const NodeIndex* nextNodeBlock = i.fetch_add(NODE_BLOCK_SIZE);
 		while(true) {
 			const NodeIndex* claimedNodeBlock = nextNodeBlock;
@@ -111,9 +398,22 @@ void processBetasCPU_MultiThread(const Monotonic<Variables>* mbfs, const JobInfo
 			for(const NodeIndex* claimedNodeIndex = claimedNodeBlock; claimedNodeIndex != claimedNodeBlockEnd; claimedNodeIndex++) {
 				Monotonic<Variables> bot = mbfs[*claimedNodeIndex];
 
+				if constexpr(MemoizeConnectCounts) {
+					countConnectedSumBuf[job.indexOf(claimedNodeIndex)] = processPCoeffSumMemoized<Variables>(top, bot, getThreadConnectCountCache<Variables>(), graphsBuf);
+					continue;
+				}
+#if defined(PCOEFF_EXPLOIT_SYMMETRIES)
+				countConnectedSumBuf[job.indexOf(claimedNodeIndex)] = processPCoeffSumSymmetric<Variables>(top, bot, topSymmetries, graphsBuf);
+#elif defined(CONNECT_GRAPH_BATCHED)
+				countConnectedSumBuf[job.indexOf(claimedNodeIndex)] = processPCoeffSum<Variables>(top, bot, graphsBuf);
+#else
 				countConnectedSumBuf[job.indexOf(claimedNodeIndex)] = processPCoeffSum<Variables>(top, bot/*, graphsBuf*/);
+#endif
 			}
 		}
+		if constexpr(MemoizeConnectCounts) {
+			getThreadConnectCountCache<Variables>().flushStats();
+		}
 	});
 }
 
@@ -6,6 +6,8 @@
 
 #include "latch.h"
 #include "pcoeffValidator.h"
+#include "topScheduling.h"
+#include "topology.h"
 
 constexpr size_t NUM_RESULT_VALIDATORS = 16;
 constexpr int MAX_VALIDATOR_COUNT = 16;
@@ -63,12 +65,49 @@ std::vector<NodeIndex> generateRangeSample(unsigned int Variables, NodeIndex sam
 	return resultingVector;
 }
 
+// On the original 2 socket machine with 8 NUMA nodes, this is node 3 where the FPGA processor is
+static int getProcessorNode(const CPUTopology& topology) {
+	return topology.getNUMANodesOfSocket(0).empty() ? 0 : topology.getNUMANodesOfSocket(0).back();
+}
+
+unique_numa_ptr<PCoeffProcessingContext> createPCoeffProcessingContext(unsigned int Variables) {
+	const CPUTopology& topology = getTopology();
+	// Alloc on the processor node, because that's where the FPGA processor is located too. We want as low latency from it to the context
+	return unique_numa_ptr<PCoeffProcessingContext>::alloc_onnode(topology.numaNodeIds[getProcessorNode(topology)], Variables);
+}
+
 ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function<std::vector<JobTopInfo>()>& topLoader, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*), const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc, std::function<void(unsigned int Variables, PCoeffProcessingContext& context)> bufProducer, std::function<ResultProcessorOutput(unsigned int Variables, PCoeffProcessingContext& context, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc)> resultProcessor) {
-	setNUMANodeAffinity(0); // Fopr buffer loading, use the ethernet socket on node 0, to save bandwidth for big flatLinksBuffer on socket 4. 
+	setNUMANodeAffinity(0); // Fopr buffer loading, use the ethernet socket on node 0, to save bandwidth for big flatLinksBuffer on the last socket. 
+	unique_numa_ptr<PCoeffProcessingContext> contextPtr = createPCoeffProcessingContext(Variables);
+	return pcoeffPipeline(*contextPtr, topLoader, processorFunc, validator, errorBufFunc, std::move(bufProducer), std::move(resultProcessor));
+}
+
+ResultProcessorOutput pcoeffPipeline(PCoeffProcessingContext& context, const std::function<std::vector<JobTopInfo>()>& topLoader, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*), const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc, std::function<void(unsigned int Variables, PCoeffProcessingContext& context)> bufProducer, std::function<ResultProcessorOutput(unsigned int Variables, PCoeffProcessingContext& context, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc)> resultProcessor) {
+	unsigned int Variables = context.Variables;
+	const CPUTopology& topology = getTopology();
+	int processorNode = getProcessorNode(topology);
+	// And node 4 of the second socket
+	int producerNode = topology.getNUMANodesOfSocket(topology.getSocketCount() - 1).empty() ? 0 : topology.getNUMANodesOfSocket(topology.getSocketCount() - 1).front();
+
+	setNUMANodeAffinity(0); // Fopr buffer loading, use the ethernet socket on node 0, to save bandwidth for big flatLinksBuffer on the last socket. 
 	setThreadName("Main Thread");
-	// Alloc on node 3, because that's where the FPGA processor is located too. We want as low latency from it to the context
-	unique_numa_ptr<PCoeffProcessingContext> contextPtr = unique_numa_ptr<PCoeffProcessingContext>::alloc_onnode(3, Variables);
-	PCoeffProcessingContext& context = *contextPtr;
+	if(context.finishedRuns != 0) {
+		context.resetForNextRun();
+		std::cout << "\033[32m[Pipeline] Reusing the buffers and loaded data of " + std::to_string(context.finishedRuns) + " earlier runs\033[39m\n" << std::flush;
+	}
+	pipelineTelemetry.setQueueSampler([&context]() {
+		std::vector<std::pair<std::string, size_t>> depths;
+		for(int slice = 0; slice < context.numaSliceCount; slice++) {
+			PCoeffProcessingContextEighth& subContext = *context.numaQueues[slice];
+			std::string sliceStr = std::to_string(slice);
+			depths.emplace_back("input" + sliceStr, context.inputQueue.queues[slice].size());
+			depths.emplace_back("output" + sliceStr, subContext.outputQueue.size());
+			depths.emplace_back("validation" + sliceStr, subContext.validationQueue.size());
+			depths.emplace_back("inputBuffersInUse" + sliceStr, subContext.inputBufferAlloc.getNumberOfChunksInUse());
+			depths.emplace_back("resultBuffersInUse" + sliceStr, subContext.resultBufferAlloc.getNumberOfChunksInUse());
+		}
+		return depths;
+	});
 	
 	struct ProcData {
 		PCoeffProcessingContext* context;
@@ -80,8 +119,8 @@ ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function
 	procData.processorFunc = processorFunc;
 	procData.bufProducer = std::move(bufProducer);
 
-	// Set it on second socket, because that is where 2 ethernet links are for faster buffer download
-	pthread_t inputProducerThread = createNUMANodePThread(4, [](void* voidProcData) -> void* {
+	// Set it on the last socket, because that is where 2 ethernet links are for faster buffer download
+	pthread_t inputProducerThread = createNUMANodePThread(producerNode, [](void* voidProcData) -> void* {
 		ProcData* typedData = (ProcData*) voidProcData;
 		setThreadName("InputProducer");
 		typedData->bufProducer(typedData->context->Variables, *typedData->context);
@@ -89,14 +128,16 @@ ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function
 		return nullptr;
 	}, &procData);
 
-	// FPGAs are on nodes 3 and 7, context is on 3, so start main thread on node 3
-	// createNUMANodePThread(3)
-	pthread_t processorThread = createCPUPThread(3*CORES_PER_NUMA_NODE+0, [](void* voidProcData) -> void* {
+	// FPGAs are on the last node of each socket, context is on the one of socket 0, so start main thread there
+	cpu_set_t processorCPU;
+	CPU_ZERO(&processorCPU);
+	CPU_SET(topology.numaNodes[processorNode].front(), &processorCPU);
+	pthread_t processorThread = createPThreadAffinity(processorCPU, [](void* voidProcData) -> void* {
 		setThreadName("Processor");
 		ProcData* procData = (ProcData*) voidProcData;
 
 		procData->processorFunc(*procData->context);
-		for(int numaNode = 0; numaNode < NUMA_SLICE_COUNT; numaNode++) {
+		for(int numaNode = 0; numaNode < procData->context->numaSliceCount; numaNode++) {
 			procData->context->numaQueues[numaNode]->outputQueue.close();
 		}
 
@@ -108,15 +149,15 @@ ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function
 		setThreadName("Queue Watchdog");
 		while(!context.inputQueue.isClosed) {
 			std::string totalString = "\033[34m[Queues]:";
-			for(int numaNode = 0; numaNode < NUMA_SLICE_COUNT; numaNode++) {
+			for(int numaNode = 0; numaNode < context.numaSliceCount; numaNode++) {
 				PCoeffProcessingContextEighth& subContext = *context.numaQueues[numaNode];
 
 				totalString += "\n" + std::to_string(numaNode)
 				 + "> i:" + std::to_string(context.inputQueue.queues[numaNode].size())
 				 + " o:" + std::to_string(subContext.outputQueue.size())
 				 + " v:" + std::to_string(subContext.validationQueue.size())
-				 + " / i:" + std::to_string(subContext.inputBufferAlloc.size())
-				 + " r:" + std::to_string(subContext.resultBufferAlloc.size());
+				 + " / in use i:" + std::to_string(subContext.inputBufferAlloc.getNumberOfChunksInUse())
+				 + " r:" + std::to_string(subContext.resultBufferAlloc.getNumberOfChunksInUse());
 			}
 			totalString += "\033[39m\n";
 
@@ -127,30 +168,36 @@ ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function
 
 	std::cout << "\033[32m[Result Processor] Started loading MBFS...\033[39m\n" << std::flush;
 	context.initMBFS();
-	std::cout << "\033[32m[Result Processor] Finished loading MBFS...\n[Result Processor] Started loading job tops...\033[39m\n" << std::flush;
-	context.initTops(topLoader());
-	std::cout << "\033[32m[Result Processor] Finished loading job tops...\n[Result Processor] Started loading ClassInfos...\033[39m\n" << std::flush;
-
-	ValidatorThreadData validatorDatas[16];
+	std::cout << "\033[32m[Result Processor] Finished loading MBFS...\n[Result Processor] Started loading ClassInfos...\033[39m\n" << std::flush;
+	context.initClassInfos(); // Scheduling needs them, the result processor then finds them loaded
+	std::cout << "\033[32m[Result Processor] Finished loading ClassInfos...\n[Result Processor] Started loading job tops...\033[39m\n" << std::flush;
+	std::vector<JobTopInfo> tops = topLoader();
+	scheduleTopsLPT(Variables, tops, context.classInfos[0]);
+	context.initTops(std::move(tops));
+	std::cout << "\033[32m[Result Processor] Finished loading and scheduling job tops...\033[39m\n" << std::flush;
+
+	int validatorCount = topology.getCoreComplexCount();
+	std::unique_ptr<ValidatorThreadData[]> validatorDatas(new ValidatorThreadData[std::max(validatorCount, context.numaSliceCount)]);
 	PThreadBundle validatorThreads;
 	if(validator != nullptr) {
-		for(int i = 0; i < 16; i++) {
-			validatorDatas[i].context = context.numaQueues[i / 8].ptr;
-			validatorDatas[i].mbfs = context.mbfs[i / 8];
+		for(int i = 0; i < validatorCount; i++) {
+			int slice = context.getSliceOfCoreComplex(i);
+			validatorDatas[i].context = context.numaQueues[slice].ptr;
+			validatorDatas[i].mbfs = context.mbfs[slice];
 			validatorDatas[i].complexI = i;
 			validatorDatas[i].errorBufFunc = &errorBufFunc;
 		}
-		validatorThreads = spreadThreads(16, CPUAffinityType::COMPLEX, validatorDatas, validator);
+		validatorThreads = spreadThreads(validatorCount, CPUAffinityType::COMPLEX, validatorDatas.get(), validator);
 	} else {
 		std::cout << "***** No validation selected! ******\n" << std::endl;
 
-		for(int i = 0; i < NUMA_SLICE_COUNT; i++) {
+		for(int i = 0; i < context.numaSliceCount; i++) {
 			validatorDatas[i].context = context.numaQueues[i].ptr;
 			validatorDatas[i].mbfs = context.mbfs[i];
 			validatorDatas[i].complexI = i;
 			validatorDatas[i].errorBufFunc = &errorBufFunc;
 		}
-		validatorThreads = spreadThreads(NUMA_SLICE_COUNT, CPUAffinityType::SOCKET, validatorDatas, noValidatorPThread);
+		validatorThreads = spreadThreads(context.numaSliceCount, CPUAffinityType::SOCKET, validatorDatas.get(), noValidatorPThread);
 	}
 
 	ResultProcessorOutput results = resultProcessor(Variables, context, errorBufFunc);
@@ -160,6 +207,10 @@ ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function
 	pthread_join(processorThread, nullptr);
 	queueWatchdogThread.join();
 	validatorThreads.join();
+	pipelineTelemetry.setQueueSampler(nullptr); // The context may be freed on return
+	context.finishedRuns++;
+
+	reportTopTimings(Variables, context.classInfos[0]);
 
 	return results;
 }
@@ -227,6 +278,7 @@ void computeFinalDedekindNumberFromGatheredResults(unsigned int Variables, const
 
 void processDedekindNumber(unsigned int Variables, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*)) {
 	std::cout << "Starting Computation..." << std::endl;
+	TelemetryExporter telemetryExporter("telemetry" + std::to_string(Variables));
 	ResultProcessorOutput betaResults = pcoeffPipeline(Variables, [Variables]() -> std::vector<JobTopInfo> {return loadAllTops(Variables);}, processorFunc, validator, 
 		[](const OutputBuffer& outBuf, const char* name, bool recoverable){
 			std::cerr << "Error from " + std::string(name) + " of top " + std::to_string(outBuf.originalInputData.getTop()) + "\n" << std::flush;
@@ -236,6 +288,10 @@ void processDedekindNumber(unsigned int Variables, void (*processorFunc)(PCoeffP
 		}
 	);
 
+	finishDedekindNumberComputation(Variables, betaResults);
+}
+
+void finishDedekindNumberComputation(unsigned int Variables, ResultProcessorOutput& betaResults) {
 	BetaResultCollector collector(Variables);
 	collector.addBetaResults(betaResults.results);
 
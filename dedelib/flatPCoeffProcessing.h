@@ -6,7 +6,11 @@
 #include <thread>
 #include <queue>
 #include <optional>
+#include <chrono>
 #include <functional>
+#include <mutex>
+#include <memory>
+#include <string.h>
 
 #include "knownData.h"
 #include "flatMBFStructure.h"
@@ -24,6 +28,14 @@
 #include "bottomBufferCreator.h"
 
 #include "processingContext.h"
+#include "resultCollection.h"
+#include "flatBufferManagement.h"
+#include "fileNames.h"
+#include "aligned_alloc.h"
+#include "topScheduling.h"
+#include "topology.h"
+#include "pipelineTelemetry.h"
+#include "jobCheckpoint.h"
 
 // Deterministically shuffles the input bots to get a more uniform mix of bot difficulty
 void shuffleBots(NodeIndex* bots, NodeIndex* botsEnd);
@@ -31,6 +43,8 @@ void shuffleBots(NodeIndex* bots, NodeIndex* botsEnd);
 template<unsigned int Variables>
 void cpuProcessor_SingleThread_MBF(PCoeffProcessingContext& context, const Monotonic<Variables>* mbfs, int preferredNode = 0) {
 	std::cout << "SingleThread CPU Processor started.\n" << std::flush;
+	ThreadTelemetry& telemetry = pipelineTelemetry.registerThread("SingleThread " + std::to_string(preferredNode), PipelineStage::PROCESSOR);
+	StageTelemetry& stageTelemetry = pipelineTelemetry.getStage(PipelineStage::PROCESSOR);
 	for(std::optional<JobInfo> jobOpt; (jobOpt = context.inputQueue.pop_wait_prefer(preferredNode)).has_value(); ) {
 		JobInfo& job = jobOpt.value();
 
@@ -38,15 +52,26 @@ void cpuProcessor_SingleThread_MBF(PCoeffProcessingContext& context, const Monot
 
 		//shuffleBots(job.bufStart + 1, job.bufEnd);
 		//std::cout << "Grabbed job of size " << job.bufferSize() << '\n' << std::flush;
-		ProcessedPCoeffSum* countConnectedSumBuf = subContext.resultBufferAlloc.pop_wait().value();
+		ProcessedPCoeffSum* countConnectedSumBuf;
+		{
+			TelemetryTimer waitTimer(stageTelemetry.bufferWaitNanos);
+			countConnectedSumBuf = subContext.allocResultBuffer(job);
+		}
 		//std::cout << "Grabbed output buffer.\n" << std::flush;
+		telemetry.setBusy(true);
+		auto startTime = std::chrono::high_resolution_clock::now();
 		processBetasCPU_SingleThread(mbfs, job, countConnectedSumBuf);
+		std::chrono::nanoseconds deltaTime = std::chrono::high_resolution_clock::now() - startTime;
+		topTimingLog.add(getJobTopInfo(job), std::chrono::duration<double>(deltaTime).count());
+		stageTelemetry.recordTop(job.getNumberOfBottoms(), job.getNumberOfBottoms(), deltaTime.count());
+		telemetry.setBusy(false);
 		OutputBuffer result;
 		result.originalInputData = job;
 		result.outputBuf = countConnectedSumBuf;
 		subContext.outputQueue.push(result);
 		//std::cout << "Result pushed.\n" << std::flush;
 	}
+	telemetry.finish();
 	std::cout << "SingleThread CPU Processor finished.\n" << std::flush;
 }
 
@@ -59,79 +84,113 @@ void cpuProcessor_CoarseMultiThread_MBF(PCoeffProcessingContext& context, const
 		int numaNode;
 	};
 
-	ThreadData datas[2]{{&context, mbfs, 0}, {&context, mbfs, 1}};
+	// CORE affinity goes socket by socket, so the threads of each slice land on its socket
+	size_t threadsPerSlice = std::max(size_t(1), getTopology().getCPUCount() / context.numaSliceCount);
+	ThreadData datas[MAX_NUMA_SLICE_COUNT];
+	for(int i = 0; i < context.numaSliceCount; i++) {
+		datas[i] = ThreadData{&context, mbfs, i};
+	}
 
-	PThreadBundle threads = spreadThreads(std::thread::hardware_concurrency(), CPUAffinityType::CORE, datas, [](void* voidData) -> void* {
+	PThreadBundle threads = spreadThreads(threadsPerSlice * context.numaSliceCount, CPUAffinityType::CORE, datas, [](void* voidData) -> void* {
 		ThreadData* data = (ThreadData*) voidData;
 		cpuProcessor_SingleThread_MBF(*data->context, data->mbfs, data->numaNode);
 		pthread_exit(nullptr);
 		return nullptr;
-	}, std::thread::hardware_concurrency() / 2);
+	}, threadsPerSlice);
 
 	threads.join();
 	std::cout << "Coarse MultiThread CPU Processor finished.\n" << std::flush;
 }
 
-template<unsigned int Variables>
+template<unsigned int Variables, bool MemoizeConnectCounts = false>
 void cpuProcessor_FineMultiThread_MBF(PCoeffProcessingContext& context, const Monotonic<Variables>* mbfs) {
 	std::cout << "Fine MultiThread CPU Processor started.\n" << std::flush;
 	ThreadPool pool;
 	size_t lastNUMANode = 0;
+	ThreadTelemetry& telemetry = pipelineTelemetry.registerThread("FineMultiThread", PipelineStage::PROCESSOR);
+	StageTelemetry& stageTelemetry = pipelineTelemetry.getStage(PipelineStage::PROCESSOR);
 	for(std::optional<JobInfo> jobOpt; (jobOpt = context.inputQueue.pop_wait_rotate(lastNUMANode)).has_value(); ) {
 		JobInfo& job = jobOpt.value();
 		PCoeffProcessingContextEighth& subContext = context.getNUMAForBuf(job.bufStart);
 
-		ProcessedPCoeffSum* countConnectedSumBuf = subContext.resultBufferAlloc.pop_wait().value();
+		ProcessedPCoeffSum* countConnectedSumBuf;
+		{
+			TelemetryTimer waitTimer(stageTelemetry.bufferWaitNanos);
+			countConnectedSumBuf = subContext.allocResultBuffer(job);
+		}
+		telemetry.setBusy(true);
 		//shuffleBots(job.bufStart + 1, job.bufEnd);
-		processBetasCPU_MultiThread(mbfs, job, countConnectedSumBuf, pool);
+		auto startTime = std::chrono::high_resolution_clock::now();
+		processBetasCPU_MultiThread<Variables, MemoizeConnectCounts>(mbfs, job, countConnectedSumBuf, pool);
+		std::chrono::nanoseconds deltaTime = std::chrono::high_resolution_clock::now() - startTime;
+		topTimingLog.add(getJobTopInfo(job), std::chrono::duration<double>(deltaTime).count());
+		stageTelemetry.recordTop(job.getNumberOfBottoms(), job.getNumberOfBottoms(), deltaTime.count());
+		telemetry.setBusy(false);
 		OutputBuffer result;
 		result.originalInputData = job;
 		result.outputBuf = countConnectedSumBuf;
 		subContext.outputQueue.push(result);
 	}
+	telemetry.finish();
+	if constexpr(MemoizeConnectCounts) {
+		connectCountCacheStats.print();
+	}
 	std::cout << "Fine MultiThread CPU Processor finished.\n" << std::flush;
 }
 
-template<unsigned int Variables>
+template<unsigned int Variables, bool MemoizeConnectCounts = false>
 void cpuProcessor_SuperMultiThread(PCoeffProcessingContext& context) {
-	// Assume 16 core complexes of 8 cores each
-	constexpr int CORE_COMPLEX_COUNT = 16;
-	constexpr int CORES_PER_COMPLEX = 8;
-	constexpr int COMPLEXES_PER_SOCKET = CORE_COMPLEX_COUNT / NUMA_SLICE_COUNT;
+	// One processor per core complex, with a thread for every CPU of the complex
+	const CPUTopology& topology = getTopology();
+	int coreComplexCount = topology.getCoreComplexCount();
 
 	struct ProcessorData {
 		PCoeffProcessingContext* context;
 		const Monotonic<Variables>* mbfs;
 		int coreComplex;
+		int socket;
+		int cpuCount;
 	};
 
-	context.mbfsBothReady.wait();
-	ProcessorData procData[CORE_COMPLEX_COUNT];
-	for(int i = 0; i < CORE_COMPLEX_COUNT; i++) {
+	context.mbfsAllReady.wait();
+	std::unique_ptr<ProcessorData[]> procData(new ProcessorData[coreComplexCount]);
+	for(int i = 0; i < coreComplexCount; i++) {
 		procData[i].context = &context;
-		procData[i].mbfs = static_cast<const Monotonic<Variables>*>(context.mbfs[i / COMPLEXES_PER_SOCKET]);
+		procData[i].socket = context.getSliceOfCoreComplex(i);
+		procData[i].mbfs = static_cast<const Monotonic<Variables>*>(context.mbfs[procData[i].socket]);
 		procData[i].coreComplex = i;
+		procData[i].cpuCount = topology.coreComplexes[i].size();
 	}
 
 	auto processorFunc = [](void* voidData) -> void* {
 		ProcessorData* procData = (ProcessorData*) voidData;
 
 		setThreadName(("CPU " + std::to_string(procData->coreComplex)).c_str());
-		ThreadPool threadPool(CORES_PER_COMPLEX);
+		ThreadPool threadPool(procData->cpuCount);
 
 		PCoeffProcessingContext& context = *procData->context;
 
-		int socket = procData->coreComplex / COMPLEXES_PER_SOCKET;
+		int socket = procData->socket;
 		PCoeffProcessingContextEighth& numaQueue = *context.numaQueues[socket];
+		ThreadTelemetry& telemetry = pipelineTelemetry.registerThread("CPU " + std::to_string(procData->coreComplex), PipelineStage::PROCESSOR);
+		StageTelemetry& stageTelemetry = pipelineTelemetry.getStage(PipelineStage::PROCESSOR);
 
 		for(std::optional<JobInfo> jobOpt; (jobOpt = context.inputQueue.pop_wait_prefer(socket)).has_value(); ) {
 			JobInfo& job = jobOpt.value();
-			ProcessedPCoeffSum* countConnectedSumBuf = numaQueue.resultBufferAlloc.pop_wait().value();
+			ProcessedPCoeffSum* countConnectedSumBuf;
+			{
+				TelemetryTimer waitTimer(stageTelemetry.bufferWaitNanos);
+				countConnectedSumBuf = numaQueue.allocResultBuffer(job);
+			}
+			telemetry.setBusy(true);
 			auto startTime = std::chrono::high_resolution_clock::now();
 			//shuffleBots(job.bufStart + 1, job.bufEnd);
 			//processBetasCPU_SingleThread(procData->mbfs, job, countConnectedSumBuf);
-			processBetasCPU_MultiThread(procData->mbfs, job, countConnectedSumBuf, threadPool);
+			processBetasCPU_MultiThread<Variables, MemoizeConnectCounts>(procData->mbfs, job, countConnectedSumBuf, threadPool);
 			std::chrono::nanoseconds deltaTime = std::chrono::high_resolution_clock::now() - startTime;
+			topTimingLog.add(getJobTopInfo(job), std::chrono::duration<double>(deltaTime).count());
+			stageTelemetry.recordTop(job.getNumberOfBottoms(), job.getNumberOfBottoms(), deltaTime.count());
+			telemetry.setBusy(false);
 			std::cout << 
 				"CPU " + std::to_string(procData->coreComplex) + ": Processed job " + std::to_string(job.getTop())
 				 + " of " + std::to_string(job.getNumberOfBottoms() / 1000000.0)
@@ -141,13 +200,17 @@ void cpuProcessor_SuperMultiThread(PCoeffProcessingContext& context) {
 			result.outputBuf = countConnectedSumBuf;
 			numaQueue.outputQueue.push(result);
 		}
+		telemetry.finish();
 
 		pthread_exit(nullptr);
 		return nullptr;
 	};
 
-	PThreadBundle coreComplexThreads = spreadThreads(CORE_COMPLEX_COUNT, CPUAffinityType::COMPLEX, procData, processorFunc);
+	PThreadBundle coreComplexThreads = spreadThreads(coreComplexCount, CPUAffinityType::COMPLEX, procData.get(), processorFunc);
 	coreComplexThreads.join();
+	if constexpr(MemoizeConnectCounts) {
+		connectCountCacheStats.print();
+	}
 }
 
 template<unsigned int Variables>
@@ -160,14 +223,255 @@ void cpuProcessor_CoarseMultiThread(PCoeffProcessingContext& context) {
 	context.mbfs0Ready.wait();
 	cpuProcessor_CoarseMultiThread_MBF(context, static_cast<const Monotonic<Variables>*>(context.mbfs[0]));
 }
-template<unsigned int Variables>
+template<unsigned int Variables, bool MemoizeConnectCounts = false>
 void cpuProcessor_FineMultiThread(PCoeffProcessingContext& context) {
 	context.mbfs0Ready.wait();
-	cpuProcessor_FineMultiThread_MBF(context, static_cast<const Monotonic<Variables>*>(context.mbfs[0]));
+	cpuProcessor_FineMultiThread_MBF<Variables, MemoizeConnectCounts>(context, static_cast<const Monotonic<Variables>*>(context.mbfs[0]));
+}
+
+/*
+	Replaces the whole buffer pipeline for CPU-only runs. Every core complex runs its own swapper on one thread, 
+	which hands BotChunks of bottoms to the other threads of the complex as it finds them. 
+	The swapper thread then folds the finished chunks into the results, under a lock for the shared validation buffer. 
+	Memory use is the MBFs, links, ClassInfos and one validation buffer, instead of the full input and result buffer pools. 
+*/
+// The MBFs, links and ClassInfos fusedCPUPipeline reads, a resident worker loads them once for all its jobs
+template<unsigned int Variables>
+struct FusedPipelineData {
+	const Monotonic<Variables>* mbfs;
+	const ClassInfo* classInfos;
+	SwapperLinks links;
+
+	FusedPipelineData() {
+		std::cout << "\033[32m[Fused] Loading MBFs, links and ClassInfos...\033[39m\n" << std::flush;
+		mbfs = readSharedFlatBufferNoMMAP<Monotonic<Variables>>(FileName::flatMBFs(Variables), mbfCounts[Variables]);
+		classInfos = readSharedFlatBufferNoMMAP<ClassInfo>(FileName::flatClassInfo(Variables), mbfCounts[Variables]);
+		links = loadLinksForSwapper(Variables);
+	}
+	~FusedPipelineData() {
+		freeLinksForSwapper(links);
+		freeFlatBufferNoMMAP(mbfs, mbfCounts[Variables]);
+		freeFlatBufferNoMMAP(classInfos, mbfCounts[Variables]);
+	}
+	FusedPipelineData(const FusedPipelineData&) = delete;
+	FusedPipelineData& operator=(const FusedPipelineData&) = delete;
+};
+
+template<unsigned int Variables>
+ResultProcessorOutput fusedCPUPipeline(const FusedPipelineData<Variables>& data, const std::function<std::vector<JobTopInfo>()>& topLoader) {
+	const CPUTopology& topology = getTopology();
+	int coreComplexCount = topology.getCoreComplexCount();
+
+	const Monotonic<Variables>* mbfs = data.mbfs;
+	const ClassInfo* classInfos = data.classInfos;
+	SwapperLinks links = data.links;
+	std::vector<JobTopInfo> tops = topLoader();
+	scheduleTopsLPT(Variables, tops, classInfos);
+	std::cout << "\033[32m[Fused] Loaded " + std::to_string(tops.size()) + " tops. Starting " + std::to_string(coreComplexCount) + " core complexes\033[39m\n" << std::flush;
+
+	ResultProcessorOutput result;
+	result.results.resize(tops.size());
+	result.validationBuffer = static_cast<ValidationData*>(numa_alloc_interleaved(VALIDATION_BUFFER_SIZE(Variables) * sizeof(ValidationData)));
+	memset(static_cast<void*>(result.validationBuffer), 0, VALIDATION_BUFFER_SIZE(Variables) * sizeof(ValidationData));
+	std::mutex validationBufferMutex;
+
+	std::atomic<size_t> nextTopI;
+	nextTopI.store(0);
+	// Results are stored in the order tops finish, so the finished ones are always a prefix for checkpoints
+	std::atomic<size_t> finishedTopCount;
+	finishedTopCount.store(0);
+	JobCheckpoint* checkpoint = activeJobCheckpoint;
+
+	struct ComplexData {
+		int coreComplex;
+		std::function<void(int)>* run;
+	};
+	std::function<void(int)> runComplex = [&](int coreComplex) {
+		setThreadName(("Fused " + std::to_string(coreComplex)).c_str());
+		// The swapper runs on one of the threads, so at least one more is needed to process the chunks
+		size_t threadCount = std::max(size_t(2), topology.coreComplexes[coreComplex].size());
+		size_t chunksPerComplex = FUSED_BATCH_WIDTH + 4 * threadCount; // Every top of a batch holds a chunk while it is being filled
+
+		struct TopState {
+			Monotonic<Variables> top;
+			TopSymmetries<Variables> topSymmetries;
+			BetaSum betaSum;
+			uint64_t botCount;
+			double processingSeconds; // Summed over all chunks of this top
+		};
+		std::unique_ptr<TopState[]> batch(new TopState[FUSED_BATCH_WIDTH]);
+
+		std::unique_ptr<BotChunk[]> chunkMemory(new BotChunk[chunksPerComplex]);
+		std::vector<BotChunk*> unusedChunks;
+		for(size_t i = 0; i < chunksPerComplex; i++) {
+			unusedChunks.push_back(&chunkMemory[i]);
+		}
+		size_t chunksInFlight = 0;
+		SynchronizedQueue<BotChunk*> filledChunks(chunksPerComplex);
+		SynchronizedQueue<BotChunk*> processedChunks(chunksPerComplex);
+
+		swapper_block<FUSED_BATCH_WIDTH>* swapperA = aligned_mallocT<swapper_block<FUSED_BATCH_WIDTH>>(getMaxLayerSize(Variables), 64);
+		swapper_block<FUSED_BATCH_WIDTH>* swapperB = aligned_mallocT<swapper_block<FUSED_BATCH_WIDTH>>(getMaxLayerSize(Variables), 64);
+
+		const JobTopInfo* batchTops = nullptr;
+		auto foldChunkIntoResults = [&](BotChunk* chunk) {
+			TopState& state = batch[chunk->topInBatch];
+			ClassInfo topDualClassInfo = classInfos[batchTops[chunk->topInBatch].topDual];
+			for(uint32_t i = 0; i < chunk->botCount; i++) {
+				state.betaSum += produceBetaTerm(classInfos[chunk->bots[i]], chunk->results[i]);
+			}
+			state.botCount += chunk->botCount;
+			state.processingSeconds += chunk->processingSeconds;
+			std::lock_guard<std::mutex> lock(validationBufferMutex);
+			for(uint32_t i = 0; i < chunk->botCount; i++) {
+				// This is the sum to be added to the top "inv(bot)", because we deduplicated it off from that top
+				result.validationBuffer[chunk->bots[i]].dualBetaSum += produceBetaTerm(topDualClassInfo, chunk->results[i]);
+			}
+		};
+		ThreadTelemetry* swapperTelemetry = nullptr;
+		StageTelemetry& swapperStageTelemetry = pipelineTelemetry.getStage(PipelineStage::BOTTOM_BUFFER_CREATOR);
+		StageTelemetry& processorStageTelemetry = pipelineTelemetry.getStage(PipelineStage::PROCESSOR);
+		auto getFreeChunk = [&]() -> BotChunk* {
+			if(!unusedChunks.empty()) {
+				BotChunk* chunk = unusedChunks.back();
+				unusedChunks.pop_back();
+				return chunk;
+			}
+			BotChunk* chunk;
+			{
+				swapperTelemetry->setBusy(false);
+				TelemetryTimer waitTimer(swapperStageTelemetry.bufferWaitNanos);
+				chunk = processedChunks.pop_wait().value();
+				swapperTelemetry->setBusy(true);
+			}
+			chunksInFlight--;
+			foldChunkIntoResults(chunk);
+			return chunk;
+		};
+		auto submitChunk = [&](BotChunk* chunk) {
+			chunksInFlight++;
+			filledChunks.push(chunk);
+		};
+
+		ThreadPool threadPool(threadCount);
+		threadPool.doInParallel([&]() {
+			BooleanFunction<Variables> graphsBuf[factorial(Variables)];
+			ThreadTelemetry& telemetry = pipelineTelemetry.registerThread("Fused " + std::to_string(coreComplex) + " worker", PipelineStage::PROCESSOR);
+			for(std::optional<BotChunk*> chunkOpt; (chunkOpt = filledChunks.pop_wait()).has_value(); ) {
+				telemetry.setBusy(true);
+				BotChunk* chunk = chunkOpt.value();
+				const TopState& state = batch[chunk->topInBatch];
+				auto startTime = std::chrono::high_resolution_clock::now();
+				for(uint32_t i = 0; i < chunk->botCount; i++) {
+					Monotonic<Variables> bot = mbfs[chunk->bots[i]];
+#if defined(PCOEFF_EXPLOIT_SYMMETRIES)
+					chunk->results[i] = processPCoeffSumSymmetric<Variables>(state.top, bot, state.topSymmetries, graphsBuf);
+#elif defined(CONNECT_GRAPH_BATCHED)
+					chunk->results[i] = processPCoeffSum<Variables>(state.top, bot, graphsBuf);
+#else
+					chunk->results[i] = processPCoeffSum<Variables>(state.top, bot);
+#endif
+				}
+				chunk->processingSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+				telemetry.setBusy(false);
+				processedChunks.push(chunk);
+			}
+			telemetry.finish();
+		}, [&]() {
+			swapperTelemetry = &pipelineTelemetry.registerThread("Fused " + std::to_string(coreComplex) + " swapper", PipelineStage::BOTTOM_BUFFER_CREATOR);
+			swapperTelemetry->setBusy(true);
+			while(true) {
+				CheckpointGateSection gateSection(checkpoint != nullptr ? &checkpoint->gate : nullptr);
+				if(checkpoint != nullptr && checkpoint->isAbandoned()) break;
+				size_t grabbedTopI = nextTopI.fetch_add(FUSED_BATCH_WIDTH);
+				if(grabbedTopI >= tops.size()) break;
+				int numberOfTops = std::min(int(tops.size() - grabbedTopI), FUSED_BATCH_WIDTH);
+				batchTops = &tops[grabbedTopI];
+
+				for(int topI = 0; topI < numberOfTops; topI++) {
+					batch[topI].top = mbfs[batchTops[topI].top];
+					batch[topI].topSymmetries = TopSymmetries<Variables>(batch[topI].top);
+					batch[topI].betaSum = BetaSum{0, 0};
+					batch[topI].botCount = 0;
+					batch[topI].processingSeconds = 0.0;
+				}
+				uint64_t batchStartTime = telemetryNow();
+
+				generateBotChunks<FUSED_BATCH_WIDTH>(Variables, swapperA, swapperB, links, batchTops, numberOfTops, getFreeChunk, submitChunk);
+
+				// All chunks of this batch must be folded before the batch state is reused
+				swapperTelemetry->setBusy(false);
+				while(chunksInFlight != 0) {
+					BotChunk* chunk = processedChunks.pop_wait().value();
+					chunksInFlight--;
+					foldChunkIntoResults(chunk);
+					unusedChunks.push_back(chunk);
+				}
+
+				for(int topI = 0; topI < numberOfTops; topI++) {
+					BetaResult& topResult = result.results[finishedTopCount.fetch_add(1)];
+					topResult.topIndex = batchTops[topI].top;
+					topResult.dataForThisTop.betaSum = batch[topI].betaSum;
+					NodeIndex topDual = batchTops[topI].topDual;
+					topResult.dataForThisTop.betaSumDualDedup = produceBetaTerm(classInfos[topDual], processPCoeffSum<Variables>(batch[topI].top, mbfs[topDual]));
+					topTimingLog.add(batchTops[topI], batch[topI].processingSeconds);
+					processorStageTelemetry.recordTop(batch[topI].botCount, batch[topI].botCount, uint64_t(batch[topI].processingSeconds * 1.0e9));
+					// The swapper generates the whole batch at once, so every top of it gets the batch time
+					swapperStageTelemetry.recordTop(batch[topI].botCount, 0, telemetryNow() - batchStartTime);
+				}
+				swapperTelemetry->setBusy(true);
+			}
+			swapperTelemetry->finish();
+			filledChunks.close();
+		});
+		processedChunks.close();
+
+		aligned_free(swapperA);
+		aligned_free(swapperB);
+	};
+
+	std::unique_ptr<ComplexData[]> complexDatas(new ComplexData[coreComplexCount]);
+	for(int i = 0; i < coreComplexCount; i++) {
+		complexDatas[i].coreComplex = i;
+		complexDatas[i].run = &runComplex;
+	}
+	PThreadBundle complexThreads = spreadThreads(coreComplexCount, CPUAffinityType::COMPLEX, complexDatas.get(), [](void* voidData) -> void* {
+		ComplexData* data = (ComplexData*) voidData;
+		(*data->run)(data->coreComplex);
+		pthread_exit(nullptr);
+		return nullptr;
+	});
+	std::unique_ptr<CheckpointTimer> checkpointTimer;
+	if(checkpoint != nullptr) {
+		size_t checkpointedTopCount = 0;
+		checkpointTimer = std::make_unique<CheckpointTimer>([&, checkpointedTopCount]() mutable {
+			checkpoint->gate.pause();
+			size_t finishedCount = finishedTopCount.load();
+			checkpoint->addToCheckpoint(result.results.data() + checkpointedTopCount, finishedCount - checkpointedTopCount, &result.validationBuffer, 1);
+			checkpointedTopCount = finishedCount;
+			checkpoint->gate.resume();
+			checkpoint->writeToFile();
+		});
+	}
+	complexThreads.join();
+	checkpointTimer.reset();
+
+	std::cout << "\033[32m[Fused] All core complexes finished\033[39m\n" << std::flush;
+	reportTopTimings(Variables, classInfos);
+	return result;
+}
+
+template<unsigned int Variables>
+ResultProcessorOutput fusedCPUPipeline(const std::function<std::vector<JobTopInfo>()>& topLoader) {
+	FusedPipelineData<Variables> data;
+	return fusedCPUPipeline<Variables>(data, topLoader);
 }
 
 ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function<std::vector<JobTopInfo>()>& topLoader, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*), const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc, std::function<void(unsigned int Variables, PCoeffProcessingContext& context)> bufProducer, std::function<ResultProcessorOutput(unsigned int Variables, PCoeffProcessingContext& context, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc)> resultProcessor);
 ResultProcessorOutput pcoeffPipeline(unsigned int Variables, const std::function<std::vector<JobTopInfo>()>& topLoader, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*), const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc);
+// Runs the pipeline on a context that may be reused for later runs. Its buffer pools, MBFs, ClassInfos and links are only loaded by the first run
+ResultProcessorOutput pcoeffPipeline(PCoeffProcessingContext& context, const std::function<std::vector<JobTopInfo>()>& topLoader, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*), const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc, std::function<void(unsigned int Variables, PCoeffProcessingContext& context)> bufProducer, std::function<ResultProcessorOutput(unsigned int Variables, PCoeffProcessingContext& context, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc)> resultProcessor);
+unique_numa_ptr<PCoeffProcessingContext> createPCoeffProcessingContext(unsigned int Variables);
 
 
 std::unique_ptr<u128[]> mergeResultsAndValidationForFinalBuffer(unsigned int Variables, const std::vector<BetaSumPair>& betaSums, const ValidationData* validationBuf);
@@ -178,3 +482,16 @@ std::vector<NodeIndex> generateRangeSample(unsigned int Variables, NodeIndex sam
 
 void computeFinalDedekindNumberFromGatheredResults(unsigned int Variables, const std::vector<BetaSumPair>& sortedBetaSumPairs, const ValidationData* validationBuffer);
 void processDedekindNumber(unsigned int Variables, void (*processorFunc)(PCoeffProcessingContext& context), void*(*validator)(void*) = nullptr);
+// Collects the results, prints the Dedekind number and frees the validation buffer
+void finishDedekindNumberComputation(unsigned int Variables, ResultProcessorOutput& betaResults);
+
+template<unsigned int Variables>
+void processDedekindNumberFused() {
+	std::cout << "Starting Computation..." << std::endl;
+	ResultProcessorOutput betaResults;
+	{
+		TelemetryExporter telemetryExporter("telemetry" + std::to_string(Variables));
+		betaResults = fusedCPUPipeline<Variables>([]() -> std::vector<JobTopInfo> {return loadAllTops(Variables);});
+	}
+	finishDedekindNumberComputation(Variables, betaResults);
+}
@@ -213,6 +213,12 @@ struct Monotonic {
 		copy.forEachPermutation(fromVar, toVar, [&func](const BooleanFunction<Variables>& bf) {func(Monotonic(bf)); });
 	}
 
+	// Calls func(const Monotonic& permuted) for every permutation with permuted <= top
+	template<typename Func>
+	void forEachPermutationBelow(const Monotonic& top, const Func& func) const {
+		this->bf.forEachPermutationBelow(top.bf, [&func](const BooleanFunction<Variables>& bf) {func(Monotonic(bf)); });
+	}
+
 	// Expects a predicate of the form bool(Monotonic<Variables>)
 	template<typename Predicate>
 	bool hasPermutation(const Predicate& func) const {
@@ -2,13 +2,22 @@
 
 #include "interval.h"
 #include "bufferedMap.h"
+#include "concurrentMemoTable.h"
 
 #include "parallelIter.h"
 
 #include "MBFDecomposition.h"
+#include "flatBufferManagement.h"
+#include "fileNames.h"
+#include "aligned_alloc.h"
 
 #include <mutex>
+#include <memory>
 #include <atomic>
+#include <string>
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
 
 template<unsigned int Variables, bool UseCanonization>
 BooleanFunction<Variables> getIntervalBFRepresentation(const Monotonic<Variables>& bot, const Monotonic<Variables>& top) {
@@ -21,8 +30,14 @@ BooleanFunction<Variables> getIntervalBFRepresentation(const Monotonic<Variables
 	}
 }
 
+template<unsigned int Variables>
+using IntervalSizeMemoTable = ConcurrentMemoTable<BooleanFunction<Variables>, uint64_t>;
+template<unsigned int Variables>
+using IntervalSizeFrontCache = MemoFrontCache<BooleanFunction<Variables>, uint64_t>;
+
+// knownIntervalSizes is shared between threads, frontCache is optional and must belong to the calling thread
 template<unsigned int Variables, bool UseCanonization>
-uint64_t intervalSizeMemoized(const Monotonic<Variables>& intervalBot, const Monotonic<Variables>& intervalTop, BufferedMap<BooleanFunction<Variables>, uint64_t>& knownIntervalSizes, std::mutex& knownIntervalSizeMutex) {
+uint64_t intervalSizeMemoized(const Monotonic<Variables>& intervalBot, const Monotonic<Variables>& intervalTop, IntervalSizeMemoTable<Variables>& knownIntervalSizes, IntervalSizeFrontCache<Variables>* frontCache = nullptr) {
 	using MBF = Monotonic<Variables>;
 	using AC = AntiChain<Variables>;
 	if(!(intervalBot <= intervalTop)) {
@@ -45,9 +60,9 @@ uint64_t intervalSizeMemoized(const Monotonic<Variables>& intervalBot, const Mon
 
 	// memoization result
 	BooleanFunction<Variables> hashRep = getIntervalBFRepresentation<Variables, UseCanonization>(bot, top);
-	KeyValue<BooleanFunction<Variables>, uint64_t>* found = knownIntervalSizes.find(hashRep);
-	if(found) {
-		return found->value;
+	uint64_t knownSize;
+	if(findMemoized(knownIntervalSizes, frontCache, hashRep, knownSize)) {
+		return knownSize;
 	}
 
 	size_t firstOnBit = topAC.getFirst();
@@ -59,7 +74,7 @@ uint64_t intervalSizeMemoized(const Monotonic<Variables>& intervalBot, const Mon
 	size_t universe = size_t(1U << Variables) - 1;
 	AC umb1{universe & ~firstOnBit};
 
-	uint64_t v1 = intervalSizeMemoized<Variables, UseCanonization>(bot | top1ac, top, knownIntervalSizes, knownIntervalSizeMutex);
+	uint64_t v1 = intervalSizeMemoized<Variables, UseCanonization>(bot | top1ac, top, knownIntervalSizes, frontCache);
 
 	uint64_t v2 = 0;
 
@@ -74,16 +89,14 @@ uint64_t intervalSizeMemoized(const Monotonic<Variables>& intervalBot, const Mon
 
 			MBF subTop = acProd(gpm, umb1) & top;
 
-			uint64_t vv = intervalSizeMemoized<Variables, UseCanonization>(bot | subSet, subTop, knownIntervalSizes, knownIntervalSizeMutex);
+			uint64_t vv = intervalSizeMemoized<Variables, UseCanonization>(bot | subSet, subTop, knownIntervalSizes, frontCache);
 
 			v2 += vv;
 		}
 	});
 
 	uint64_t result = 2 * v1 + v2;
-	knownIntervalSizeMutex.lock();
-	knownIntervalSizes.add(hashRep, result);
-	knownIntervalSizeMutex.unlock();
+	addMemoized(knownIntervalSizes, frontCache, hashRep, result);
 	return result;
 }
 
@@ -91,16 +104,130 @@ constexpr size_t compactIntervalBufferSizes[]{2, 2, 8, 35, 347, 35877, 999999999
 constexpr size_t fastIntervalBufferSizes[]{2, 2, 11, 99, 3936, 3257608};
 
 
+/*
+	The cache file is the baked hash map as it is in memory, so load() can map it and look up in place:
+		IntervalSizeCacheFileHeader
+		hash table, bucketCount+1 unsigned ints
+		(padding up to dataOffset)
+		KeyValue<BooleanFunction<Variables>, uint64_t> items, itemCount of them
+	Mapped pages are shared through the page cache, so processes using the same cache file share one copy. 
+	The mapping is private and writable, so the baked map can use it like its own memory: nothing writes to it, and if something did it would only get a private copy of the page.
+*/
+struct IntervalSizeCacheFileHeader {
+	static constexpr uint64_t MAGIC = 0x31484341435A5349; // "ISZCACH1"
+	uint64_t magic;
+	uint32_t variables;
+	uint32_t useCanonization;
+	uint64_t bucketCount;
+	uint64_t itemCount;
+	uint64_t dataOffset; // From the start of the file, 64 byte aligned
+};
+
 template<unsigned int Variables, bool UseCanonization = (Variables >= 6)>
 class IntervalSizeCache {
+	using IntervalKeyValue = KeyValue<BooleanFunction<Variables>, uint64_t>;
+
 	BakedMap<BooleanFunction<Variables>, uint64_t> intervalSizes;
+	// Set if this cache is a view of a file mapped by load()
+	void* mappedFile = nullptr;
+	size_t mappedFileSize = 0;
 
+	IntervalSizeCache(BakedMap<BooleanFunction<Variables>, uint64_t>&& mappedSizes, void* mappedFile, size_t mappedFileSize) : 
+		intervalSizes(std::move(mappedSizes)), mappedFile(mappedFile), mappedFileSize(mappedFileSize) {}
 public:
 	IntervalSizeCache() = default;
-	IntervalSizeCache(const BufferedMap<BooleanFunction<Variables>, uint64_t>& intervals) : 
-		intervalSizes(intervals, new KeyValue<BooleanFunction<Variables>, uint64_t>[intervals.size()]) {}
+	// Bakes the intervals, none may be inserted into it meanwhile
+	IntervalSizeCache(const IntervalSizeMemoTable<Variables>& intervals) : IntervalSizeCache() {
+		IntervalKeyValue* items = new IntervalKeyValue[intervals.size()];
+		size_t itemCount = 0;
+		intervals.forEach([&](const BooleanFunction<Variables>& key, uint64_t value) {
+			items[itemCount++] = IntervalKeyValue{key, value};
+		});
+		intervalSizes = BakedMap<BooleanFunction<Variables>, uint64_t>(items, itemCount);
+	}
 	~IntervalSizeCache() {
-		delete[] intervalSizes.begin();
+		if(mappedFile != nullptr) {
+			munmapFlatVoidBuffer(mappedFile, mappedFileSize);
+		} else {
+			delete[] intervalSizes.begin();
+		}
+	}
+
+	IntervalSizeCache(IntervalSizeCache&& other) noexcept : intervalSizes(std::move(other.intervalSizes)), mappedFile(other.mappedFile), mappedFileSize(other.mappedFileSize) {
+		other.mappedFile = nullptr;
+	}
+	IntervalSizeCache& operator=(IntervalSizeCache&& other) noexcept {
+		std::swap(intervalSizes, other.intervalSizes);
+		std::swap(mappedFile, other.mappedFile);
+		std::swap(mappedFileSize, other.mappedFileSize);
+		return *this;
+	}
+	IntervalSizeCache(const IntervalSizeCache&) = delete;
+	IntervalSizeCache& operator=(const IntervalSizeCache&) = delete;
+
+	size_t size() const {
+		return intervalSizes.size();
+	}
+
+	void save(const std::string& fileName) const {
+		IntervalSizeCacheFileHeader header;
+		header.magic = IntervalSizeCacheFileHeader::MAGIC;
+		header.variables = Variables;
+		header.useCanonization = UseCanonization;
+		header.bucketCount = intervalSizes.getBucketCount();
+		header.itemCount = intervalSizes.size();
+		size_t hashTableBytes = (header.bucketCount + 1) * sizeof(unsigned int);
+		header.dataOffset = alignUpTo(sizeof(IntervalSizeCacheFileHeader) + hashTableBytes, size_t(64));
+		size_t fileSize = header.dataOffset + header.itemCount * sizeof(IntervalKeyValue);
+
+		char* fileData = aligned_mallocT<char>(fileSize, 64);
+		memset(fileData, 0, header.dataOffset);
+		memcpy(fileData, &header, sizeof(IntervalSizeCacheFileHeader));
+		memcpy(fileData + sizeof(IntervalSizeCacheFileHeader), intervalSizes.getHashTable(), hashTableBytes);
+		memcpy(fileData + header.dataOffset, static_cast<const void*>(intervalSizes.begin()), header.itemCount * sizeof(IntervalKeyValue));
+		// Written next to the file and renamed over it, so a process that has the old file mapped keeps it whole, and no process maps a half written one
+		std::string tmpFileName = fileName + ".tmp" + std::to_string(getpid());
+		writeFlatVoidBuffer(fileData, tmpFileName, fileSize);
+		aligned_free(fileData);
+		std::filesystem::rename(tmpFileName, fileName);
+		std::cout << "Saved " << header.itemCount << " interval sizes to " << fileName << "\n" << std::flush;
+	}
+
+	// Maps the file copy-on-write, lookups read straight from the mapping
+	static IntervalSizeCache load(const std::string& fileName) {
+		size_t fileSize = std::filesystem::file_size(fileName);
+		if(fileSize < sizeof(IntervalSizeCacheFileHeader)) {
+			std::cerr << "Interval size cache " << fileName << " is truncated!\n" << std::flush;
+			exit(1);
+		}
+		char* fileData = static_cast<char*>(mmapFlatVoidBuffer(fileName, fileSize, true));
+		IntervalSizeCacheFileHeader header;
+		memcpy(&header, fileData, sizeof(IntervalSizeCacheFileHeader));
+		if(header.magic != IntervalSizeCacheFileHeader::MAGIC || header.variables != Variables || header.useCanonization != UseCanonization) {
+			std::cerr << "Interval size cache " << fileName << " is not a cache for " << Variables << " Variables" << (UseCanonization ? " with" : " without") << " canonization! Delete it to regenerate it.\n" << std::flush;
+			exit(1);
+		}
+		if(header.dataOffset + header.itemCount * sizeof(IntervalKeyValue) != fileSize) {
+			std::cerr << "Interval size cache " << fileName << " is truncated!\n" << std::flush;
+			exit(1);
+		}
+		unsigned int* hashTable = reinterpret_cast<unsigned int*>(fileData + sizeof(IntervalSizeCacheFileHeader));
+		IntervalKeyValue* items = reinterpret_cast<IntervalKeyValue*>(fileData + header.dataOffset);
+		return IntervalSizeCache(BakedMap<BooleanFunction<Variables>, uint64_t>(items, hashTable, header.bucketCount, header.itemCount), fileData, fileSize);
+	}
+
+	// Loads the cache file if it exists, otherwise generates the cache and saves it there for the next runs
+	static IntervalSizeCache loadOrGenerate(const std::string& fileName) {
+		if(std::filesystem::exists(fileName)) {
+			std::cout << "Loading interval sizes from " << fileName << "\n" << std::flush;
+			return load(fileName);
+		}
+		IntervalSizeCache generated = generate();
+		generated.save(fileName);
+		return generated;
+	}
+	static IntervalSizeCache loadOrGenerate() {
+		return loadOrGenerate(FileName::intervalSizeCache(Variables, UseCanonization));
 	}
 
 	uint64_t getIntervalSize(const Monotonic<Variables>& intervalBot, const Monotonic<Variables>& intervalTop) const {
@@ -149,32 +276,34 @@ public:
 			std::pair<BufferedSet<Monotonic<Variables>>, uint64_t> allMBFsPair = generateAllMBFsFast<Variables>();
 			const BufferedSet<Monotonic<Variables>>& allMBFs = allMBFsPair.first;
 
-			std::mutex intervalSizeMutex;
-			BufferedMap<BooleanFunction<Variables>, uint64_t> intervalSizes(compactIntervalBufferSizes[Variables]);
+			IntervalSizeMemoTable<Variables> intervalSizes(compactIntervalBufferSizes[Variables]);
 			std::cout << "made interval buffer\n";
 
 			std::cout << "Iterating MBFs: " << allMBFs.size() << " mbfs found!\n";
 
 			std::atomic<int> i = 0;
 
-			//iterCollectionInParallel(allMBFs, [&](const Monotonic<Variables>& top) {
-			for(const Monotonic<Variables>& top : allMBFs) {
-				int curI = i.fetch_add(1);
-				if(curI % 1000 == 0) {
-					std::cout << curI << "/" << allMBFs.size() << " ---- " << intervalSizes.size() << "/" << compactIntervalBufferSizes[Variables] << " intervals found" << "\n";
-				}
-				forEachMonotonicFunctionUpTo<Variables>(top, [&](const Monotonic<Variables>& bot) {
-					intervalSizeMemoized<Variables, UseCanonization>(bot, top, intervalSizes, intervalSizeMutex); // memoizes this interval, and all related
+			const Monotonic<Variables>* topIter = allMBFs.begin();
+			std::mutex topIterMutex;
+			runInParallel([&]() {
+				std::unique_ptr<IntervalSizeFrontCache<Variables>> frontCache = std::make_unique<IntervalSizeFrontCache<Variables>>();
+				whileIterGrab(topIter, allMBFs.end(), topIterMutex, [&](const Monotonic<Variables>& top) {
+					int curI = i.fetch_add(1);
+					if(curI % 1000 == 0) {
+						std::cout << std::to_string(curI) + "/" + std::to_string(allMBFs.size()) + " ---- " + std::to_string(intervalSizes.size()) + "/" + std::to_string(compactIntervalBufferSizes[Variables]) + " intervals found\n";
+					}
+					forEachMonotonicFunctionUpTo<Variables>(top, [&](const Monotonic<Variables>& bot) {
+						intervalSizeMemoized<Variables, UseCanonization>(bot, top, intervalSizes, frontCache.get()); // memoizes this interval, and all related
+					});
 				});
-			}
-			//});
+			});
 
 			std::cout << Variables << "> Number of intervals: " << intervalSizes.size() << "\n";
 
 			return IntervalSizeCache(intervalSizes);
 		} else {
-			std::mutex intervalSizeMutex;
-			BufferedMap<BooleanFunction<Variables>, uint64_t> intervalSizes(fastIntervalBufferSizes[Variables]);
+			IntervalSizeMemoTable<Variables> intervalSizes(fastIntervalBufferSizes[Variables]);
+			std::unique_ptr<IntervalSizeFrontCache<Variables>> frontCache = std::make_unique<IntervalSizeFrontCache<Variables>>();
 			std::cout << "made interval buffer\n";
 
 			std::atomic<int> i = 0;
@@ -185,7 +314,7 @@ public:
 					std::cout << curI << "/" << dedekindNumbers[Variables] << " ---- " << intervalSizes.size() << "/" << fastIntervalBufferSizes[Variables] << " intervals found" << "\n";
 				}
 				forEachMonotonicFunctionUpTo<Variables>(top, [&](const Monotonic<Variables>& bot) {
-					intervalSizeMemoized<Variables, UseCanonization>(bot, top, intervalSizes, intervalSizeMutex); // memoizes this interval, and all related
+					intervalSizeMemoized<Variables, UseCanonization>(bot, top, intervalSizes, frontCache.get()); // memoizes this interval, and all related
 				});
 			});
 
@@ -0,0 +1,396 @@
+#include "jobBroker.h"
+
+#include "supercomputerJobs.h"
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <sstream>
+#include <ctime>
+#include <string.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+BrokerAddress BrokerAddress::parse(const std::string& address) {
+	BrokerAddress result;
+	if(address.rfind("unix:", 0) == 0) {
+		result.isUnix = true;
+		result.path = address.substr(5);
+		if(result.path.size() >= sizeof(sockaddr_un::sun_path)) {
+			std::cerr << "Broker socket path " + result.path + " is too long! Aborting!\n" << std::flush;
+			std::abort();
+		}
+		return result;
+	}
+	if(address.rfind("tcp:", 0) == 0) {
+		size_t portColon = address.rfind(':');
+		if(portColon > 4) {
+			result.isUnix = false;
+			result.host = address.substr(4, portColon - 4);
+			result.port = static_cast<uint16_t>(std::stoi(address.substr(portColon + 1)));
+			return result;
+		}
+	}
+	std::cerr << "Invalid broker address " + address + ", expected unix:<path> or tcp:<host>:<port>! Aborting!\n" << std::flush;
+	std::abort();
+}
+
+std::string BrokerAddress::toString() const {
+	return isUnix ? "unix:" + path : "tcp:" + host + ":" + std::to_string(port);
+}
+
+std::string getDefaultBrokerSocketPath(const std::string& computeFolder) {
+	return (std::filesystem::path(computeFolder) / "broker.sock").string();
+}
+
+static int connectTo(const BrokerAddress& address) {
+	if(address.isUnix) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd == -1) return -1;
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address.path.c_str(), sizeof(addr.sun_path) - 1);
+		if(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	} else {
+		addrinfo hints{};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* found;
+		if(getaddrinfo(address.host.c_str(), std::to_string(address.port).c_str(), &hints, &found) != 0) return -1;
+		int fd = -1;
+		for(addrinfo* ai = found; ai != nullptr; ai = ai->ai_next) {
+			fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if(fd == -1) continue;
+			if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(found);
+		return fd;
+	}
+}
+
+static int listenOn(const BrokerAddress& address) {
+	int fd;
+	if(address.isUnix) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd != -1) {
+			unlink(address.path.c_str()); // Left behind by a broker that didn't shut down cleanly
+			sockaddr_un addr{};
+			addr.sun_family = AF_UNIX;
+			strncpy(addr.sun_path, address.path.c_str(), sizeof(addr.sun_path) - 1);
+			if(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {close(fd); fd = -1;}
+		}
+	} else {
+		addrinfo hints{};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		addrinfo* found;
+		fd = -1;
+		if(getaddrinfo(address.host.empty() ? nullptr : address.host.c_str(), std::to_string(address.port).c_str(), &hints, &found) == 0) {
+			for(addrinfo* ai = found; ai != nullptr; ai = ai->ai_next) {
+				fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+				if(fd == -1) continue;
+				int reuse = 1;
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+				if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+				close(fd);
+				fd = -1;
+			}
+			freeaddrinfo(found);
+		}
+	}
+	if(fd == -1 || listen(fd, 64) != 0) {
+		perror(("Job broker could not listen on " + address.toString()).c_str());
+		std::abort();
+	}
+	return fd;
+}
+
+static bool sendAll(int fd, const std::string& data) {
+	size_t sent = 0;
+	while(sent < data.size()) {
+		ssize_t count = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if(count <= 0) return false;
+		sent += count;
+	}
+	return true;
+}
+
+// Sorts numeric job IDs numerically, so jobs are handed out in the order they were generated
+static bool jobIDLess(const std::string& a, const std::string& b) {
+	if(a.size() != b.size()) return a.size() < b.size();
+	return a < b;
+}
+
+JobBroker::JobBroker(std::string computeFolder, BrokerAddress address, double leaseSeconds) :
+	computeFolder(std::move(computeFolder)),
+	address(std::move(address)),
+	leaseSeconds(leaseSeconds),
+	shouldStop(false),
+	log((std::filesystem::path(this->computeFolder) / "broker.log").string(), std::ios::app) {
+
+	std::vector<std::string> jobIDs;
+	for(const std::filesystem::directory_entry& jobFile : std::filesystem::directory_iterator(computeFolderPath(this->computeFolder, "jobs"))) {
+		std::string fileName = jobFile.path().filename().string();
+		if(fileName.size() < 5 || fileName[0] != 'j' || jobFile.path().extension() != ".job") continue;
+		jobIDs.push_back(fileName.substr(1, fileName.size() - 5));
+	}
+	std::sort(jobIDs.begin(), jobIDs.end(), jobIDLess);
+	pendingJobs.assign(jobIDs.begin(), jobIDs.end());
+
+	// Workers that were running before the broker (re)started get one lease time to show up
+	std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(leaseSeconds));
+	for(const char* folder : {"working", "critical"}) {
+		for(const std::filesystem::directory_entry& jobFile : std::filesystem::directory_iterator(computeFolderPath(this->computeFolder, folder))) {
+			std::string fileName = jobFile.path().filename().string();
+			size_t underscoreIdx = fileName.find('_');
+			if(fileName[0] != 'j' || underscoreIdx == std::string::npos || jobFile.path().extension() != ".job") continue;
+			std::string jobID = fileName.substr(1, underscoreIdx - 1);
+			std::string workerID = fileName.substr(underscoreIdx + 1, fileName.size() - 4 - underscoreIdx - 1);
+			leases[jobID] = Lease{workerID, expiry};
+		}
+	}
+
+	listenFD = listenOn(this->address);
+	std::cout << "\033[33m[Broker] Serving " + this->computeFolder + " on " + this->address.toString() + ": " + std::to_string(pendingJobs.size()) + " jobs pending, "
+		+ std::to_string(leases.size()) + " already running, lease time " + std::to_string(leaseSeconds) + "s\033[39m\n" << std::flush;
+	logEvent("START pending " + std::to_string(pendingJobs.size()) + " running " + std::to_string(leases.size()));
+}
+
+JobBroker::~JobBroker() {
+	close(listenFD);
+	if(address.isUnix) unlink(address.path.c_str());
+	logEvent("STOP pending " + std::to_string(pendingJobs.size()) + " running " + std::to_string(leases.size()) + " finished " + std::to_string(finishedJobCount));
+}
+
+void JobBroker::logEvent(const std::string& line) {
+	log << std::time(nullptr) << ' ' << line << '\n' << std::flush;
+}
+
+void JobBroker::expireLeases() {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	for(auto iter = leases.begin(); iter != leases.end();) {
+		const std::string& jobID = iter->first;
+		Lease& lease = iter->second;
+		if(lease.expiry > now) {
+			++iter;
+			continue;
+		}
+		if(isJobInCriticalSection(computeFolder, jobID, lease.workerID)) {
+			// The worker is committing its results, taking the job away now could lose them
+			lease.expiry = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(leaseSeconds));
+			++iter;
+			continue;
+		}
+		if(unclaimJob(computeFolder, jobID, lease.workerID)) {
+			std::cout << "\033[33m[Broker] Lease of job " + jobID + " by " + lease.workerID + " expired, job returned\033[39m\n" << std::flush;
+			logEvent("EXPIRED " + jobID + " " + lease.workerID);
+			pendingJobs.push_front(jobID); // It may hold a checkpoint, finish it first
+		} else {
+			std::cerr << "\033[33m[Broker] Lease of job " + jobID + " by " + lease.workerID + " expired, but the job is no longer in working/. Dropped it\033[39m\n" << std::flush;
+			logEvent("DROPPED " + jobID + " " + lease.workerID);
+		}
+		iter = leases.erase(iter);
+	}
+}
+
+std::string JobBroker::handleRequest(const std::string& request) {
+	std::istringstream words(request);
+	std::string command;
+	words >> command;
+	std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(leaseSeconds));
+
+	if(command == "LEASE") {
+		std::string workerID;
+		words >> workerID;
+		if(workerID.empty() || workerID.find('/') != std::string::npos) return "ERROR invalid worker\n";
+		// Workers with the same ID share their validation file, they must not run jobs at the same time. Worker IDs include the process ID, so this only holds back a restarted worker with a reused PID
+		for(const std::pair<const std::string, Lease>& lease : leases) {
+			if(lease.second.workerID == workerID) return "WAIT " + std::to_string(leaseSeconds / 4) + "\n";
+		}
+		while(!pendingJobs.empty()) {
+			std::string jobID = pendingJobs.front();
+			pendingJobs.pop_front();
+			if(claimJob(computeFolder, jobID, workerID)) {
+				leases[jobID] = Lease{workerID, expiry};
+				logEvent("LEASE " + jobID + " " + workerID);
+				return "JOB " + jobID + " " + std::to_string(leaseSeconds) + "\n";
+			}
+			std::cerr << "\033[33m[Broker] Could not claim job " + jobID + " for " + workerID + ", skipping it\033[39m\n" << std::flush;
+			logEvent("SKIPPED " + jobID + " " + workerID);
+		}
+		if(leases.empty()) return "DONE\n";
+		return "WAIT " + std::to_string(std::min(leaseSeconds / 4, 60.0)) + "\n";
+	}
+	if(command == "HEARTBEAT" || command == "COMPLETE" || command == "RELEASE") {
+		std::string jobID, workerID, outcome;
+		words >> jobID >> workerID >> outcome;
+		auto found = leases.find(jobID);
+		if(found == leases.end() || found->second.workerID != workerID) return "LOST\n";
+		if(command == "HEARTBEAT") {
+			found->second.expiry = expiry;
+		} else if(command == "COMPLETE") {
+			leases.erase(found);
+			finishedJobCount++;
+			logEvent("COMPLETE " + jobID + " " + workerID + " " + outcome);
+			std::cout << "\033[33m[Broker] Job " + jobID + " finished by " + workerID + " (" + outcome + "), " + std::to_string(pendingJobs.size()) + " pending, " + std::to_string(leases.size()) + " running\033[39m\n" << std::flush;
+		} else {
+			leases.erase(found);
+			if(unclaimJob(computeFolder, jobID, workerID)) pendingJobs.push_front(jobID);
+			logEvent("RELEASE " + jobID + " " + workerID);
+		}
+		return "OK\n";
+	}
+	if(command == "STATUS") {
+		return "STATUS " + std::to_string(pendingJobs.size()) + " " + std::to_string(leases.size()) + " " + std::to_string(finishedJobCount) + "\n";
+	}
+	return "ERROR unknown command\n";
+}
+
+void JobBroker::run() {
+	struct Client {
+		int fd;
+		std::string received;
+		std::chrono::steady_clock::time_point connectTime;
+	};
+	std::vector<Client> clients;
+	std::vector<pollfd> pollFDs;
+	while(!shouldStop.load()) {
+		pollFDs.clear();
+		pollFDs.push_back(pollfd{listenFD, POLLIN, 0});
+		for(const Client& client : clients) pollFDs.push_back(pollfd{client.fd, POLLIN, 0});
+		if(poll(pollFDs.data(), pollFDs.size(), 1000) < 0 && errno != EINTR) {
+			perror("Job broker poll failed");
+			std::abort();
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+		for(size_t i = clients.size(); i > 0; i--) {
+			Client& client = clients[i - 1];
+			bool done = false;
+			if(pollFDs[i].revents != 0) {
+				char buf[256];
+				ssize_t count = recv(client.fd, buf, sizeof(buf), 0);
+				if(count <= 0) {
+					done = true;
+				} else {
+					client.received.append(buf, count);
+					size_t lineEnd = client.received.find('\n');
+					if(lineEnd != std::string::npos) {
+						sendAll(client.fd, handleRequest(client.received.substr(0, lineEnd)));
+						done = true;
+					} else if(client.received.size() > 4096) {
+						done = true;
+					}
+				}
+			}
+			// A client has a few seconds to send its request
+			if(done || now - client.connectTime > std::chrono::seconds(10)) {
+				close(client.fd);
+				clients.erase(clients.begin() + (i - 1));
+			}
+		}
+		if(pollFDs[0].revents & POLLIN) {
+			int clientFD = accept(listenFD, nullptr, nullptr);
+			if(clientFD != -1) clients.push_back(Client{clientFD, std::string(), now});
+		}
+
+		expireLeases();
+	}
+	for(const Client& client : clients) close(client.fd);
+}
+
+std::string JobBrokerClient::request(const std::string& line, int attempts) const {
+	for(int attempt = 0; attempt < attempts; attempt++) {
+		if(attempt != 0) std::this_thread::sleep_for(std::chrono::seconds(std::min(1 << attempt, 60)));
+		int fd = connectTo(address);
+		if(fd == -1) continue;
+		std::string reply;
+		if(sendAll(fd, line + "\n")) {
+			char buf[256];
+			ssize_t count;
+			while(reply.find('\n') == std::string::npos && (count = recv(fd, buf, sizeof(buf), 0)) > 0) {
+				reply.append(buf, count);
+			}
+		}
+		close(fd);
+		size_t lineEnd = reply.find('\n');
+		if(lineEnd != std::string::npos) return reply.substr(0, lineEnd);
+	}
+	std::cerr << "\033[33m[Broker] Could not reach the job broker at " + address.toString() + " for: " + line + "\033[39m\n" << std::flush;
+	return std::string();
+}
+
+JobBrokerClient::LeaseStatus JobBrokerClient::lease(std::string& jobID, double& seconds) const {
+	std::string reply = request("LEASE " + workerID, 10);
+	std::istringstream words(reply);
+	std::string status;
+	words >> status;
+	if(status == "JOB") {
+		words >> jobID >> seconds;
+		return LeaseStatus::LEASED;
+	} else if(status == "WAIT") {
+		words >> seconds;
+		return LeaseStatus::WAIT;
+	} else if(status == "DONE") {
+		return LeaseStatus::DONE;
+	}
+	std::cerr << "Job broker refused lease: \"" + reply + "\"! Aborting!\n" << std::flush;
+	std::abort();
+}
+
+JobBrokerClient::HeartbeatStatus JobBrokerClient::heartbeat(const std::string& jobID) const {
+	std::string reply = request("HEARTBEAT " + jobID + " " + workerID, 3);
+	if(reply == "OK") return HeartbeatStatus::OK;
+	if(reply == "LOST") return HeartbeatStatus::LOST;
+	return HeartbeatStatus::UNREACHABLE;
+}
+
+void JobBrokerClient::complete(const std::string& jobID, bool noErrors) const {
+	// The results are already committed to the project folder, a lost completion only shows up in broker.log
+	if(request("COMPLETE " + jobID + " " + workerID + (noErrors ? " ok" : " wrong"), 10) != "OK") {
+		std::cerr << "\033[33m[Broker] Broker did not record the completion of job " + jobID + "\033[39m\n" << std::flush;
+	}
+}
+
+void JobBrokerClient::release(const std::string& jobID) const {
+	request("RELEASE " + jobID + " " + workerID, 10);
+}
+
+LeaseHeartbeat::LeaseHeartbeat(const JobBrokerClient& client, std::string jobID, double leaseSeconds) : leaseLost(false) {
+	this->thread = std::thread([this, &client, jobID = std::move(jobID), leaseSeconds]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!stopSignal.wait_for(lock, std::chrono::duration<double>(leaseSeconds / 4), [this]() {return shouldStop;})) {
+			lock.unlock();
+			JobBrokerClient::HeartbeatStatus status = client.heartbeat(jobID);
+			if(status == JobBrokerClient::HeartbeatStatus::LOST) {
+				std::cerr << "\033[33m[Broker] Lost the lease of job " + jobID + ", abandoning it\033[39m\n" << std::flush;
+				leaseLost.store(true);
+				return; // A lost lease doesn't come back
+			} else if(status == JobBrokerClient::HeartbeatStatus::UNREACHABLE) {
+				std::cerr << "\033[33m[Broker] Could not heartbeat job " + jobID + ", another worker may take it over\033[39m\n" << std::flush;
+			}
+			lock.lock();
+		}
+	});
+}
+
+LeaseHeartbeat::~LeaseHeartbeat() {
+	{std::lock_guard<std::mutex> lock(mutex);
+		shouldStop = true;
+	}
+	stopSignal.notify_all();
+	this->thread.join();
+}
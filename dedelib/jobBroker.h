@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <condition_variable>
+
+/*
+	Job broker. One process owns the project folder and hands out jobs, instead of every worker racing to rename job files on a shared filesystem.
+	The broker claims a job for a worker by moving it from jobs/ to working/ exactly like processJob does, so the folder layout
+	and the critical section commit stay the same, and a project can switch between both ways of claiming.
+
+	Jobs are leased: a worker must heartbeat its job within the lease time, or the broker moves the job back to jobs/ and hands it to the next worker.
+	A worker that is inside the critical section (its job is in critical/) keeps its lease.
+	Jobs found in working/ when the broker starts are treated as leased to the worker in their filename, so running workers can continue.
+	A worker that hears LOST stops its job without committing anything, the job has already gone back to jobs/.
+
+	A worker holds at most one lease, as its ID names its validation file. Worker IDs therefore include the process ID,
+	so several workers on one host with the same method each get their own ID.
+
+	The protocol is one line per connection, the broker answers with one line:
+		LEASE <worker>                        -> JOB <jobID> <leaseSeconds> | WAIT <seconds> | DONE
+		HEARTBEAT <jobID> <worker>            -> OK | LOST
+		COMPLETE <jobID> <worker> <ok|wrong>  -> OK | LOST
+		RELEASE <jobID> <worker>              -> OK | LOST
+		STATUS                                -> STATUS <pending> <leased> <finished>
+	WAIT means no job is free but leased jobs may still come back, DONE that every job is finished.
+*/
+
+// "unix:<socket path>" or "tcp:<host>:<port>"
+struct BrokerAddress {
+	bool isUnix = true;
+	std::string path; // unix
+	std::string host; // tcp
+	uint16_t port = 0;
+
+	static BrokerAddress parse(const std::string& address);
+	std::string toString() const;
+};
+
+// The unix socket inside the project folder, used by the local broker
+std::string getDefaultBrokerSocketPath(const std::string& computeFolder);
+
+class JobBroker {
+	struct Lease {
+		std::string workerID;
+		std::chrono::steady_clock::time_point expiry;
+	};
+
+	std::string computeFolder;
+	BrokerAddress address;
+	double leaseSeconds;
+	int listenFD = -1;
+	std::atomic<bool> shouldStop;
+
+	std::deque<std::string> pendingJobs;
+	std::map<std::string, Lease> leases;
+	size_t finishedJobCount = 0;
+	std::ofstream log; // broker.log in the project folder, one line per lease, completion and expiry
+
+	void logEvent(const std::string& line);
+	void expireLeases();
+	std::string handleRequest(const std::string& request);
+public:
+	// Scans the project folder, then binds the socket. Aborts if the address can't be bound
+	JobBroker(std::string computeFolder, BrokerAddress address, double leaseSeconds);
+	~JobBroker();
+	JobBroker(const JobBroker&) = delete;
+	JobBroker& operator=(const JobBroker&) = delete;
+
+	// Serves requests until stop() is called
+	void run();
+	// Safe to call from a signal handler
+	void stop() {shouldStop.store(true);}
+};
+
+class JobBrokerClient {
+	BrokerAddress address;
+	std::string workerID;
+
+	// Returns the reply line, or an empty string if the broker couldn't be reached after retrying
+	std::string request(const std::string& line, int attempts) const;
+public:
+	enum class LeaseStatus {LEASED, WAIT, DONE};
+	enum class HeartbeatStatus {OK, LOST, UNREACHABLE};
+
+	JobBrokerClient(BrokerAddress address, std::string workerID) : address(std::move(address)), workerID(std::move(workerID)) {}
+
+	// seconds receives the lease time for LEASED, and the time to wait for WAIT. Aborts if the broker can't be reached
+	LeaseStatus lease(std::string& jobID, double& seconds) const;
+	// LOST means the broker gave the job away, UNREACHABLE that it may still be ours
+	HeartbeatStatus heartbeat(const std::string& jobID) const;
+	void complete(const std::string& jobID, bool noErrors) const;
+	void release(const std::string& jobID) const;
+};
+
+// Heartbeats a leased job from a background thread for as long as it exists
+class LeaseHeartbeat {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable stopSignal;
+	bool shouldStop = false;
+	std::atomic<bool> leaseLost;
+public:
+	LeaseHeartbeat(const JobBrokerClient& client, std::string jobID, double leaseSeconds);
+	// Set once the broker answered LOST, the job must then be abandoned
+	const std::atomic<bool>& getLeaseLostSignal() const {return leaseLost;}
+	~LeaseHeartbeat();
+	LeaseHeartbeat(const LeaseHeartbeat&) = delete;
+	LeaseHeartbeat& operator=(const LeaseHeartbeat&) = delete;
+};
@@ -0,0 +1,241 @@
+#include "jobCheckpoint.h"
+
+#include "resultCollection.h"
+#include "numaMem.h"
+
+#include <iostream>
+#include <filesystem>
+#include <unordered_set>
+#include <chrono>
+#include <string.h>
+
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+
+double CHECKPOINT_INTERVAL_SECONDS = 1800.0;
+
+void CheckpointGate::enter() {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() {return !pauseRequested;});
+	activeWorkers++;
+}
+void CheckpointGate::leave() {
+	std::lock_guard<std::mutex> lock(mutex);
+	activeWorkers--;
+	changed.notify_all();
+}
+void CheckpointGate::pause() {
+	std::unique_lock<std::mutex> lock(mutex);
+	pauseRequested = true;
+	changed.wait(lock, [this]() {return activeWorkers == 0;});
+}
+void CheckpointGate::resume() {
+	std::lock_guard<std::mutex> lock(mutex);
+	pauseRequested = false;
+	changed.notify_all();
+}
+
+constexpr uint64_t CHECKPOINT_MAGIC = 0x31544B504B48434A; // "JCHKPKT1"
+
+struct CheckpointFileHeader {
+	uint64_t magic;
+	uint32_t Variables;
+	uint32_t errorsFound;
+	uint64_t resultCount;
+	uint64_t hasValidationBuffer;
+	ValidationData validationCheckSum;
+	BetaSum resultsCheckSum;
+};
+
+static BetaSum getResultsCheckSum(const std::vector<BetaResult>& results) {
+	BetaSum sum{0, 0};
+	for(const BetaResult& result : results) {
+		sum += result.dataForThisTop.betaSum;
+		sum += result.dataForThisTop.betaSumDualDedup;
+		sum.countedIntervalSizeDown += result.topIndex;
+	}
+	return sum;
+}
+
+static ValidationData getValidationCheckSum(const ValidationData* buf, size_t size) {
+	ValidationData sum;
+	sum.dualBetaSum = BetaSum{0, 0};
+	for(size_t i = 0; i < size; i++) {
+		sum.dualBetaSum += buf[i].dualBetaSum;
+	}
+	return sum;
+}
+
+static bool readFully(int fd, void* buf, size_t size) {
+	while(size != 0) {
+		ssize_t readCount = read(fd, buf, size);
+		if(readCount <= 0) return false;
+		size -= readCount;
+		buf = static_cast<char*>(buf) + readCount;
+	}
+	return true;
+}
+
+static void writeFully(int fd, const void* buf, size_t size, const std::string& filePath) {
+	while(size != 0) {
+		ssize_t writeCount = write(fd, buf, size);
+		if(writeCount == -1) {
+			perror(("Failed to write checkpoint " + filePath).c_str());
+			std::abort();
+		}
+		size -= writeCount;
+		buf = static_cast<const char*>(buf) + writeCount;
+	}
+}
+
+JobCheckpoint::JobCheckpoint(unsigned int Variables, std::string filePath) : Variables(Variables), filePath(std::move(filePath)), errorsFound(false) {
+	int fd = open(this->filePath.c_str(), O_RDONLY);
+	if(fd == -1) return;
+
+	CheckpointFileHeader header;
+	bool intact = readFully(fd, &header, sizeof(CheckpointFileHeader)) && header.magic == CHECKPOINT_MAGIC;
+	if(intact && header.Variables != Variables) {
+		std::cerr << "Checkpoint " + this->filePath + " is for D(" + std::to_string(header.Variables + 2) + "), not D(" + std::to_string(Variables + 2) + ")! Aborting!\n" << std::flush;
+		std::abort();
+	}
+	if(intact) {
+		results.resize(header.resultCount);
+		intact = readFully(fd, results.data(), sizeof(BetaResult) * header.resultCount) && getResultsCheckSum(results) == header.resultsCheckSum;
+	}
+	if(intact && header.hasValidationBuffer) {
+		allocValidationBuffer();
+		intact = readFully(fd, validationBuffer, sizeof(ValidationData) * VALIDATION_BUFFER_SIZE(Variables))
+			&& getValidationCheckSum(validationBuffer, VALIDATION_BUFFER_SIZE(Variables)).dualBetaSum == header.validationCheckSum.dualBetaSum;
+	}
+	close(fd);
+
+	// The file is only ever replaced by rename, so this means it was damaged afterwards. Continuing would silently lose tops
+	if(!intact) {
+		std::cerr << "Checkpoint " + this->filePath + " is corrupt! Remove it to recompute the job from scratch. Aborting!\n" << std::flush;
+		std::abort();
+	}
+	loadedResultCount = results.size();
+	errorsFound.store(header.errorsFound != 0);
+	std::cout << "\033[32m[Checkpoint] Resuming from " + this->filePath + " with " + std::to_string(loadedResultCount) + " finished tops\033[39m\n" << std::flush;
+}
+
+JobCheckpoint::~JobCheckpoint() {
+	if(validationBuffer != nullptr) {
+		numa_free(validationBuffer, sizeof(ValidationData) * VALIDATION_BUFFER_SIZE(Variables));
+	}
+}
+
+void JobCheckpoint::allocValidationBuffer() {
+	size_t bufferSize = sizeof(ValidationData) * VALIDATION_BUFFER_SIZE(Variables);
+	validationBuffer = static_cast<ValidationData*>(numa_alloc_interleaved(bufferSize));
+	memset(static_cast<void*>(validationBuffer), 0, bufferSize);
+}
+
+std::vector<JobTopInfo> JobCheckpoint::removeFinishedTops(const std::vector<JobTopInfo>& jobTops) const {
+	std::unordered_set<NodeIndex> finishedTops;
+	for(size_t i = 0; i < loadedResultCount; i++) {
+		finishedTops.insert(results[i].topIndex);
+	}
+	std::vector<JobTopInfo> remainingTops;
+	size_t foundTops = 0;
+	for(const JobTopInfo& top : jobTops) {
+		if(finishedTops.count(top.top) != 0) {
+			foundTops++;
+		} else {
+			remainingTops.push_back(top);
+		}
+	}
+	if(foundTops != finishedTops.size() || finishedTops.size() != loadedResultCount) {
+		std::cerr << "Checkpoint " + filePath + " contains tops that are not part of this job! Aborting!\n" << std::flush;
+		std::abort();
+	}
+	return remainingTops;
+}
+
+void JobCheckpoint::addToCheckpoint(const BetaResult* newResults, size_t newResultCount, ValidationData* const* validationBuffers, int validationBufferCount) {
+	results.insert(results.end(), newResults, newResults + newResultCount);
+	if(validationBuffer == nullptr) allocValidationBuffer();
+	addValidationBuffers(validationBuffer, validationBuffers, validationBufferCount, VALIDATION_BUFFER_SIZE(Variables), true);
+}
+
+void JobCheckpoint::writeToFile() {
+	if(isAbandoned()) {
+		std::cout << "\033[32m[Checkpoint] Job was abandoned, not saving the checkpoint to " + filePath + "\033[39m\n" << std::flush;
+		return;
+	}
+	auto startTime = std::chrono::high_resolution_clock::now();
+	size_t validationBufferSize = VALIDATION_BUFFER_SIZE(Variables);
+
+	CheckpointFileHeader header;
+	memset(static_cast<void*>(&header), 0xFF, sizeof(CheckpointFileHeader)); // No random padding in the file
+	header.magic = CHECKPOINT_MAGIC;
+	header.Variables = Variables;
+	header.errorsFound = errorsFound.load() ? 1 : 0;
+	header.resultCount = results.size();
+	header.hasValidationBuffer = validationBuffer != nullptr ? 1 : 0;
+	if(validationBuffer != nullptr) header.validationCheckSum = getValidationCheckSum(validationBuffer, validationBufferSize);
+	header.resultsCheckSum = getResultsCheckSum(results);
+
+	// Unique per writer: a worker that lost its job may still be writing while the next worker checkpoints the same job, maybe on another node
+	char hostName[HOST_NAME_MAX+1];
+	gethostname(hostName, HOST_NAME_MAX+1);
+	std::string tmpPath = filePath + ".tmp_" + hostName + "_" + std::to_string(getpid());
+	int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if(fd == -1) {
+		perror(("Failed to create checkpoint " + tmpPath).c_str());
+		std::abort();
+	}
+	writeFully(fd, &header, sizeof(CheckpointFileHeader), tmpPath);
+	writeFully(fd, results.data(), sizeof(BetaResult) * results.size(), tmpPath);
+	if(validationBuffer != nullptr) writeFully(fd, validationBuffer, sizeof(ValidationData) * validationBufferSize, tmpPath);
+	if(fsync(fd) != 0 || close(fd) != 0) {
+		perror(("Failed to sync checkpoint " + tmpPath).c_str());
+		std::abort();
+	}
+	std::filesystem::rename(tmpPath, filePath); // Throws filesystem::filesystem_error on error
+
+	// Make the rename itself durable
+	std::string folder = std::filesystem::path(filePath).parent_path().string();
+	int folderFD = open(folder.empty() ? "." : folder.c_str(), O_RDONLY | O_DIRECTORY);
+	if(folderFD != -1) {
+		fsync(folderFD);
+		close(folderFD);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "\033[32m[Checkpoint] Saved " + std::to_string(results.size()) + " finished tops to " + filePath + " in " + std::to_string(seconds) + "s\033[39m\n" << std::flush;
+}
+
+void JobCheckpoint::addToOutput(ResultProcessorOutput& output) {
+	output.results.insert(output.results.end(), results.begin(), results.begin() + loadedResultCount);
+	if(validationBuffer != nullptr) {
+		addValidationBuffers(output.validationBuffer, &validationBuffer, 1, VALIDATION_BUFFER_SIZE(Variables), false);
+	}
+}
+
+void JobCheckpoint::removeFile() {
+	std::error_code err;
+	std::filesystem::remove(filePath, err);
+}
+
+CheckpointTimer::CheckpointTimer(std::function<void()> checkpointFunc) {
+	if(CHECKPOINT_INTERVAL_SECONDS <= 0.0) return;
+	this->thread = std::thread([this, checkpointFunc = std::move(checkpointFunc)]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!stopSignal.wait_for(lock, std::chrono::duration<double>(CHECKPOINT_INTERVAL_SECONDS), [this]() {return shouldStop;})) {
+			lock.unlock();
+			checkpointFunc();
+			lock.lock();
+		}
+	});
+}
+
+CheckpointTimer::~CheckpointTimer() {
+	if(!this->thread.joinable()) return;
+	{std::lock_guard<std::mutex> lock(mutex);
+		shouldStop = true;
+	}
+	stopSignal.notify_all();
+	this->thread.join();
+}
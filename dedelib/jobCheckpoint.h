@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include "pcoeffClasses.h"
+
+// Set by configure() from --checkpointInterval <seconds>, 0 turns periodic checkpoints off
+extern double CHECKPOINT_INTERVAL_SECONDS;
+
+/*
+	Lets a checkpoint briefly stop the workers of a pipeline at a point where their results and validation buffers agree.
+	Workers wrap every unit of work (a result buffer, a batch of tops) in enter() and leave(),
+	pause() waits until no unit is in progress and holds back new ones until resume().
+*/
+class CheckpointGate {
+	std::mutex mutex;
+	std::condition_variable changed;
+	int activeWorkers = 0;
+	bool pauseRequested = false;
+public:
+	void enter();
+	void leave();
+	void pause();
+	void resume();
+};
+
+// Holds the gate for one unit of work, does nothing without a gate
+class CheckpointGateSection {
+	CheckpointGate* gate;
+public:
+	CheckpointGateSection(CheckpointGate* gate) : gate(gate) {if(gate != nullptr) gate->enter();}
+	~CheckpointGateSection() {if(gate != nullptr) gate->leave();}
+	CheckpointGateSection(const CheckpointGateSection&) = delete;
+	CheckpointGateSection& operator=(const CheckpointGateSection&) = delete;
+};
+
+/*
+	Saved progress of one supercomputer job, so a preempted job only recomputes the tops that were in flight.
+	The file holds every BetaResult finished so far and the sum of their validation terms. It is replaced atomically on every save,
+	so a crash at any point leaves either the previous or the new checkpoint.
+	Validation terms are folded out of the pipeline buffers into this checkpoint, the pipeline buffers are zeroed.
+	A save waits for the pcoeffValidators to give their verdict on every saved top, so errorsFound covers all of them.
+*/
+class JobCheckpoint {
+	unsigned int Variables;
+	std::string filePath;
+	std::vector<BetaResult> results;
+	size_t loadedResultCount = 0; // Results of earlier runs, the rest are also in this run's pipeline output
+	ValidationData* validationBuffer = nullptr; // Only allocated once something is folded in
+	std::atomic<bool> errorsFound;
+	const std::atomic<bool>* abandonSignal = nullptr;
+
+	void allocValidationBuffer();
+public:
+	CheckpointGate gate;
+
+	// Loads the checkpoint at filePath if there is one
+	JobCheckpoint(unsigned int Variables, std::string filePath);
+	~JobCheckpoint();
+	JobCheckpoint(const JobCheckpoint&) = delete;
+	JobCheckpoint& operator=(const JobCheckpoint&) = delete;
+
+	size_t getLoadedResultCount() const {return loadedResultCount;}
+	bool hasFoundErrors() const {return errorsFound.load();}
+	void markErrorFound() {errorsFound.store(true);}
+
+	// Once abandonSignal is set, the job belongs to another worker: pipelines stop taking new tops and nothing is written to the checkpoint file anymore
+	void setAbandonSignal(const std::atomic<bool>* abandonSignal) {this->abandonSignal = abandonSignal;}
+	bool isAbandoned() const {return abandonSignal != nullptr && abandonSignal->load();}
+
+	// The tops of the job that no earlier run finished. Aborts if the checkpoint holds a top that is not part of the job
+	std::vector<JobTopInfo> removeFinishedTops(const std::vector<JobTopInfo>& jobTops) const;
+
+	// Must be called while the pipeline is paused. Adds the given validation buffers into the checkpoint and zeroes them
+	void addToCheckpoint(const BetaResult* newResults, size_t newResultCount, ValidationData* const* validationBuffers, int validationBufferCount);
+	// Writes everything added so far, may run while the pipeline continues. Does nothing once the job is abandoned
+	void writeToFile();
+
+	// Adds the results and validation terms of earlier runs and folded out of this run back into the pipeline output
+	void addToOutput(ResultProcessorOutput& output);
+	void removeFile();
+};
+
+// Set by processJob while it runs a job with checkpointing, the pipelines checkpoint into it if it is not nullptr
+inline JobCheckpoint* activeJobCheckpoint = nullptr;
+
+// Checked by the pipelines before they take more tops of the job
+inline bool isActiveJobAbandoned() {
+	JobCheckpoint* checkpoint = activeJobCheckpoint;
+	return checkpoint != nullptr && checkpoint->isAbandoned();
+}
+
+// Calls checkpointFunc every CHECKPOINT_INTERVAL_SECONDS until destroyed. Does nothing if the interval is 0
+class CheckpointTimer {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable stopSignal;
+	bool shouldStop = false;
+public:
+	CheckpointTimer(std::function<void()> checkpointFunc);
+	~CheckpointTimer();
+	CheckpointTimer(const CheckpointTimer&) = delete;
+	CheckpointTimer& operator=(const CheckpointTimer&) = delete;
+};
@@ -13,6 +13,8 @@ public:
 	void notify(int amount = 1) noexcept;
 	void notify_wait(std::unique_lock<std::mutex>& lock, int amount = 1) noexcept;
 	void notify_wait_unlock(std::unique_lock<std::mutex>& lock, int amount = 1) noexcept;
+	// Rearm the latch, while no thread waits on it
+	void reset(int latchCount = 1) noexcept {this->latchCount.store(latchCount);}
 };
 
 class MutexLatch : private Latch {
@@ -22,4 +24,5 @@ public:
 	void wait() noexcept;
 	void notify(int amount = 1) noexcept;
 	void notify_wait(int amount = 1) noexcept;
+	using Latch::reset;
 };
@@ -0,0 +1,80 @@
+#include "linkCompression.h"
+
+#include <memory>
+#include <iostream>
+#include <filesystem>
+#include <string.h>
+#include <cassert>
+
+#include "knownData.h"
+#include "fileNames.h"
+#include "flatBufferManagement.h"
+
+size_t compressLinkBlock(const uint32_t* links, size_t linkCount, uint8_t* out) {
+	uint8_t* outStart = out;
+	uint32_t previousFromIdx = 0;
+	for(size_t groupStart = 0; groupStart < linkCount; groupStart += 4) {
+		uint8_t* control = out++;
+		*control = 0;
+		for(size_t value = 0; value < 4; value++) {
+			uint32_t encoded = 0; // Padding
+			if(groupStart + value < linkCount) {
+				uint32_t link = links[groupStart + value];
+				uint32_t fromIdx = link & uint32_t(0x7FFFFFFF);
+				assert(fromIdx < (uint32_t(1) << 30)); // zigzag delta must fit in 31 bits
+				int32_t delta = static_cast<int32_t>(fromIdx - previousFromIdx);
+				uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+				encoded = (zigzag << 1) | (link >> 31);
+				previousFromIdx = fromIdx;
+			}
+			unsigned int len = 1;
+			while(len < 4 && (encoded >> (8 * len)) != 0) len++;
+			*control |= (len - 1) << (2 * value);
+			for(unsigned int b = 0; b < len; b++) {
+				*out++ = static_cast<uint8_t>(encoded >> (8 * b));
+			}
+		}
+	}
+	return out - outStart;
+}
+
+void compressMBFStructure(unsigned int Variables) {
+	const uint32_t* links = readFlatBuffer<uint32_t>(FileName::mbfStructure(Variables), getTotalLinkCount(Variables));
+
+	constexpr size_t MAX_BLOCK_COUNT = (1 << 7) + 1;
+	size_t blockCount = size_t(1) << Variables;
+	uint64_t blockStarts[MAX_BLOCK_COUNT];
+	size_t headerSize = sizeof(uint64_t) * (blockCount + 1);
+
+	size_t maxFileSize = headerSize + COMPRESSED_LINKS_PADDING;
+	for(size_t blockI = 0; blockI < blockCount; blockI++) {
+		maxFileSize += maxCompressedLinkBlockSize(flatLinkOffsets[Variables][blockI + 1] - flatLinkOffsets[Variables][blockI]);
+	}
+
+	std::unique_ptr<uint8_t[]> compressed(new uint8_t[maxFileSize]);
+	size_t curByte = headerSize;
+	for(size_t blockI = 0; blockI < blockCount; blockI++) {
+		blockStarts[blockI] = curByte;
+		size_t linkCount = flatLinkOffsets[Variables][blockI + 1] - flatLinkOffsets[Variables][blockI];
+		curByte += compressLinkBlock(links + flatLinkOffsets[Variables][blockI], linkCount, compressed.get() + curByte);
+	}
+	blockStarts[blockCount] = curByte;
+	memcpy(compressed.get(), blockStarts, headerSize);
+	memset(compressed.get() + curByte, 0, COMPRESSED_LINKS_PADDING);
+	curByte += COMPRESSED_LINKS_PADDING;
+
+	std::cout << "Compressed " << getTotalLinkCount(Variables) * sizeof(uint32_t) << " bytes of links to " << curByte << " bytes" << std::endl;
+	writeFlatVoidBufferWithManifest(compressed.get(), FileName::mbfStructureCompressed(Variables), curByte);
+
+	freeFlatBuffer(links, getTotalLinkCount(Variables));
+}
+
+size_t getCompressedLinksFileSize(unsigned int Variables) {
+	std::string fileName = FileName::mbfStructureCompressed(Variables);
+	if(!std::filesystem::exists(fileName)) return 0;
+	return std::filesystem::file_size(fileName);
+}
+
+void readCompressedLinks(unsigned int Variables, size_t fileSize, void* buffer) {
+	readFlatVoidBufferNoMMAP(FileName::mbfStructureCompressed(Variables), fileSize, buffer);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+/*
+	Compressed form of the mbfStructure link file, written by compressMBFStructure.
+	It consists of the same (1 << Variables) layer blocks in the same order as mbfStructure.
+	Each link is stored as (zigzag(fromIdx - previousFromIdx) << 1) | endOfStreak,
+	where previousFromIdx restarts at 0 in every block, so decoding can begin at any block.
+	These values are packed in groups of 4, Stream VByte style:
+	a control byte with the byte length - 1 of each value in 2 bits, followed by the bytes of the 4 values.
+	The last group of a block is padded with zeros.
+
+	File layout:
+		uint64_t blockStarts[(1 << Variables) + 1]; // byte offsets from the start of the file
+		the blocks
+		COMPRESSED_LINKS_PADDING zero bytes, so the decoder can always load 16 bytes
+*/
+
+constexpr size_t COMPRESSED_LINKS_PADDING = 16;
+
+// Worst case size of a compressed block
+constexpr size_t maxCompressedLinkBlockSize(size_t linkCount) {
+	return (linkCount + 3) / 4 * (1 + 4 * sizeof(uint32_t));
+}
+
+// Returns the number of bytes written to out
+size_t compressLinkBlock(const uint32_t* links, size_t linkCount, uint8_t* out);
+void compressMBFStructure(unsigned int Variables);
+
+// Size of the compressed file including padding, 0 if it does not exist
+size_t getCompressedLinksFileSize(unsigned int Variables);
+void readCompressedLinks(unsigned int Variables, size_t fileSize, void* buffer);
+
+inline const uint8_t* getCompressedLinkBlock(const void* compressedLinks, size_t blockI) {
+	const uint64_t* blockStarts = static_cast<const uint64_t*>(compressedLinks);
+	return static_cast<const uint8_t*>(compressedLinks) + blockStarts[blockI];
+}
+
+struct LinkGroupDecodeTables {
+	alignas(16) uint8_t shuffles[256][16];
+	uint8_t groupSizes[256]; // Including the control byte
+
+	constexpr LinkGroupDecodeTables() : shuffles{}, groupSizes{} {
+		for(unsigned int control = 0; control < 256; control++) {
+			unsigned int srcByte = 0; // Relative to the first byte after the control byte
+			for(unsigned int value = 0; value < 4; value++) {
+				unsigned int len = ((control >> (2 * value)) & 0b11) + 1;
+				for(unsigned int b = 0; b < 4; b++) {
+					shuffles[control][value * 4 + b] = b < len ? srcByte + b : 0x80;
+				}
+				srcByte += len;
+			}
+			groupSizes[control] = 1 + srcByte;
+		}
+	}
+};
+inline constexpr LinkGroupDecodeTables linkGroupDecodeTables{};
+
+/*
+	Decodes groupCount groups of 4 links back into the mbfStructure format: fromIdx | (endOfStreak << 31).
+	previousFromIdx holds the last decoded fromIdx in all lanes, start a block with _mm_setzero_si128().
+	Returns the start of the next group.
+*/
+inline const uint8_t* decodeLinkGroups(const uint8_t* data, size_t groupCount, __m128i& previousFromIdx, uint32_t* out) {
+	const __m128i one = _mm_set1_epi32(1);
+	for(size_t groupI = 0; groupI < groupCount; groupI++) {
+		uint8_t control = data[0];
+		__m128i raw = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 1)), _mm_load_si128(reinterpret_cast<const __m128i*>(linkGroupDecodeTables.shuffles[control])));
+		data += linkGroupDecodeTables.groupSizes[control];
+
+		__m128i endOfStreak = _mm_slli_epi32(raw, 31);
+		__m128i zigzag = _mm_srli_epi32(raw, 1);
+		__m128i deltas = _mm_xor_si128(_mm_srli_epi32(zigzag, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(zigzag, one)));
+
+		// Prefix sum over the 4 lanes
+		deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+		deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+		__m128i fromIdxs = _mm_add_epi32(deltas, previousFromIdx);
+		previousFromIdx = _mm_shuffle_epi32(fromIdxs, 0xFF);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_or_si128(fromIdxs, endOfStreak));
+		out += 4;
+	}
+	return data;
+}
@@ -1,10 +1,13 @@
 #include "numaMem.h"
 
 #include <string.h>
+#include <string>
 #include <xmmintrin.h>
 #include <emmintrin.h>
 #include <immintrin.h>
 
+#include "topology.h"
+
 #ifndef USE_NUMA
 #include "aligned_alloc.h"
 void numa_free(void* ptr, size_t size) {
@@ -30,19 +33,21 @@ void* allocInterleaved(size_t bufSize, const char* nodeString) {
 }
 
 void* numa_alloc_onsocket(size_t size, unsigned int socket) {
-	assert(socket < 2);
-	const char* sockets[]{"0-3", "4-7"};
-	return allocInterleaved(size, sockets[socket]);
+	const CPUTopology& topology = getTopology();
+	std::string nodeString = topology.getNUMANodeString(socket % topology.getSocketCount());
+	return allocInterleaved(size, nodeString.empty() ? "all" : nodeString.c_str());
 }
 
-void allocSocketBuffers(size_t bufSize, void* socketBuffers[2]) {
-	socketBuffers[0] = allocInterleaved(bufSize, "0-3");
-	socketBuffers[1] = allocInterleaved(bufSize, "4-7");
+void allocSocketBuffers(size_t bufSize, void** socketBuffers, size_t bufferCount) {
+	for(size_t socket = 0; socket < bufferCount; socket++) {
+		socketBuffers[socket] = numa_alloc_onsocket(bufSize, socket);
+	}
 }
 
-void allocNumaNodeBuffers(size_t bufSize, void* buffers[8]) {
-	for(int nn = 0; nn < 8; nn++) {
-		buffers[nn] = numa_alloc_onnode(bufSize, nn);
+void allocNumaNodeBuffers(size_t bufSize, void** buffers, size_t bufferCount) {
+	const CPUTopology& topology = getTopology();
+	for(size_t nn = 0; nn < bufferCount; nn++) {
+		buffers[nn] = numa_alloc_onnode(bufSize, topology.numaNodeIds[nn % topology.getNUMANodeCount()]);
 	}
 }
 
@@ -3,9 +3,6 @@
 #include <stddef.h>
 #include <cassert>
 
-constexpr int NUMA_NODE_COUNT = 8;
-constexpr int CORES_PER_NUMA_NODE = 16;
-
 #ifdef USE_NUMA
 #include <numa.h>
 #else
@@ -14,11 +11,14 @@ void* numa_alloc_onnode(size_t size, int numaNode);
 void* numa_alloc_interleaved(size_t size);
 #endif
 
+// Interleaved over the NUMA nodes of the socket, socket wraps around the detected socket count
 void* numa_alloc_onsocket(size_t size, unsigned int socket);
 
 void* allocInterleaved(size_t bufSize, const char* nodeString);
-void allocSocketBuffers(size_t bufSize, void* socketBuffers[2]);
-void allocNumaNodeBuffers(size_t bufSize, void* buffers[8]);
+// Buffer i is placed on socket i
+void allocSocketBuffers(size_t bufSize, void** socketBuffers, size_t bufferCount);
+// Buffer i is placed on the i-th NUMA node of getTopology()
+void allocNumaNodeBuffers(size_t bufSize, void** buffers, size_t bufferCount);
 void duplicateNUMAData(const void* from, void** buffers, size_t numBuffers, size_t bufferSize);
 
 template<typename T>
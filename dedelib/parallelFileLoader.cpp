@@ -0,0 +1,360 @@
+#include "parallelFileLoader.h"
+
+#include "dataManifest.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+FileLoaderMethod FILE_LOADER_METHOD = FileLoaderMethod::IO_URING;
+int FILE_LOADER_THREADS = 8;
+int FILE_LOADER_QUEUE_DEPTH = 32;
+size_t FILE_LOADER_CHUNK_SIZE = size_t(8) << 20;
+bool FILE_LOADER_HUGEPAGES = false;
+
+// O_DIRECT needs the buffer, offset and length aligned to the logical block size, 4096 covers every device we use
+constexpr size_t DIRECT_IO_ALIGN = 4096;
+
+[[noreturn]] static void failRead(const std::string& fileName, const char* what, int err) {
+	std::cout << "Could not read file '" << fileName << "': " << what << ": " << strerror(err) << std::endl;
+	exit(1);
+}
+
+struct OpenedFile {
+	int directFD = -1; // -1 if O_DIRECT isn't possible for this destination or filesystem
+	int bufferedFD = -1;
+	size_t directSize = 0; // Bytes read through directFD, the rest through bufferedFD
+
+	OpenedFile(const std::string& fileName, size_t size, const void* destination) {
+		bufferedFD = open(fileName.c_str(), O_RDONLY);
+		if(bufferedFD == -1) {
+			std::cout << "Could not open file '" << fileName << "'!" << std::endl;
+			exit(1);
+		}
+		if(reinterpret_cast<uintptr_t>(destination) % DIRECT_IO_ALIGN == 0) {
+			directFD = open(fileName.c_str(), O_RDONLY | O_DIRECT); // Fails with EINVAL on tmpfs and some network filesystems
+			if(directFD != -1) directSize = size / DIRECT_IO_ALIGN * DIRECT_IO_ALIGN;
+		}
+		if(directFD == -1) posix_fadvise(bufferedFD, 0, size, POSIX_FADV_SEQUENTIAL);
+	}
+	~OpenedFile() {
+		if(directFD != -1) close(directFD);
+		close(bufferedFD);
+	}
+	int getFD(size_t offset) const {return offset < directSize ? directFD : bufferedFD;}
+};
+
+// Chunk boundaries fall on DIRECT_IO_ALIGN, except for the end of the direct part and the end of the file
+struct Chunk {
+	size_t offset;
+	size_t size;
+};
+
+/*
+	Checks the loaded data against the file's manifest, if it has one. The loader then uses the manifest's chunk size,
+	so every full chunk is checked by the thread that loaded it as soon as it arrives. The last chunk, which the loader may
+	have split in an O_DIRECT and a buffered read, is checked at the end.
+*/
+class ChunkVerifier {
+	const std::string& fileName;
+	const char* data;
+	size_t loadedSize;
+	DataManifest manifest;
+	std::vector<char> checked; // char, so threads can mark neighbouring chunks
+	bool active;
+public:
+	ChunkVerifier(const std::string& fileName, size_t loadedSize, const void* data) : fileName(fileName), data(static_cast<const char*>(data)), loadedSize(loadedSize) {
+		active = VERIFY_DATA_FILES && readDataManifest(fileName, manifest);
+		if(active && isDataManifestStale(fileName)) {
+			std::cerr << "\033[33mWarning: " << fileName << " is newer than its manifest, not checking it\033[39m\n" << std::flush;
+			active = false;
+		}
+		if(active && loadedSize > manifest.fileSize) {
+			std::cerr << "\033[31mLoading " << loadedSize << " bytes of " << fileName << ", but its manifest is for a " << manifest.fileSize << " byte file\033[39m" << std::endl;
+			exit(1);
+		}
+		if(active) checked.assign(manifest.getChunkCount(), 0);
+	}
+	size_t getLoaderChunkSize() const {
+		if(active && manifest.chunkSize % DIRECT_IO_ALIGN == 0) return manifest.chunkSize;
+		return FILE_LOADER_CHUNK_SIZE;
+	}
+	void onChunkLoaded(Chunk chunk) {
+		if(!active || chunk.offset % manifest.chunkSize != 0) return;
+		size_t manifestChunk = chunk.offset / manifest.chunkSize;
+		if(manifestChunk < manifest.getChunkCount() && chunk.size == manifest.getChunkSize(manifestChunk)) {
+			checkDataFileChunk(fileName, manifest, manifestChunk, data + chunk.offset);
+			checked[manifestChunk] = 1;
+		}
+	}
+	void finish() {
+		if(!active) return;
+		for(size_t manifestChunk = 0; manifestChunk < manifest.getChunkCount(); manifestChunk++) {
+			size_t chunkStart = manifestChunk * manifest.chunkSize;
+			if(!checked[manifestChunk] && chunkStart + manifest.getChunkSize(manifestChunk) <= loadedSize) {
+				checkDataFileChunk(fileName, manifest, manifestChunk, data + chunkStart);
+			}
+		}
+	}
+};
+
+static std::vector<Chunk> makeChunks(const OpenedFile& file, size_t size, size_t loaderChunkSize) {
+	size_t chunkSize = std::max(loaderChunkSize / DIRECT_IO_ALIGN, size_t(1)) * DIRECT_IO_ALIGN;
+	std::vector<Chunk> chunks;
+	for(size_t offset = 0; offset < file.directSize; offset += chunkSize) {
+		chunks.push_back(Chunk{offset, std::min(chunkSize, file.directSize - offset)});
+	}
+	if(file.directSize < size) {
+		chunks.push_back(Chunk{file.directSize, size - file.directSize});
+	}
+	return chunks;
+}
+
+static void finishChunk(void* const* destinations, int destinationCount, ChunkVerifier& verifier, Chunk chunk) {
+	verifier.onChunkLoaded(chunk);
+	const char* source = static_cast<const char*>(destinations[0]) + chunk.offset;
+	for(int i = 1; i < destinationCount; i++) {
+		memcpy(static_cast<char*>(destinations[i]) + chunk.offset, source, chunk.size);
+	}
+}
+
+static void readChunkBlocking(const std::string& fileName, const OpenedFile& file, void* destination, Chunk chunk) {
+	char* target = static_cast<char*>(destination);
+	size_t done = 0;
+	while(done < chunk.size) {
+		ssize_t count = pread(file.getFD(chunk.offset), target + chunk.offset + done, chunk.size - done, chunk.offset + done);
+		if(count == -1 && errno == EINTR) continue;
+		if(count == -1) failRead(fileName, "pread", errno);
+		if(count == 0) failRead(fileName, "file is shorter than expected", EIO);
+		done += count;
+	}
+}
+
+static void loadWithThreads(const std::string& fileName, const OpenedFile& file, const std::vector<Chunk>& chunks, void* const* destinations, int destinationCount, ChunkVerifier& verifier) {
+	std::atomic<size_t> nextChunk(0);
+	auto worker = [&]() {
+		for(size_t c; (c = nextChunk.fetch_add(1)) < chunks.size();) {
+			readChunkBlocking(fileName, file, destinations[0], chunks[c]);
+			finishChunk(destinations, destinationCount, verifier, chunks[c]);
+		}
+	};
+	size_t threadCount = std::min(size_t(std::max(FILE_LOADER_THREADS, 1)), chunks.size());
+	std::vector<std::thread> threads;
+	for(size_t i = 1; i < threadCount; i++) threads.emplace_back(worker);
+	worker();
+	for(std::thread& t : threads) t.join();
+}
+
+/*
+	Minimal io_uring over the raw syscalls, so no liburing is needed. Only what the loader uses: IORING_OP_READ and completions.
+*/
+class IOURing {
+	int ringFD = -1;
+	void* sqRing = MAP_FAILED;
+	void* cqRing = MAP_FAILED;
+	size_t sqRingSize = 0;
+	size_t cqRingSize = 0;
+	io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+	size_t sqesSize = 0;
+
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	io_uring_cqe* cqes;
+	unsigned toSubmit = 0;
+public:
+	// Returns false if io_uring isn't available
+	bool init(unsigned entries) {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		ringFD = syscall(__NR_io_uring_setup, entries, &params);
+		if(ringFD < 0) return false;
+
+		sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool singleMMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if(singleMMap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+		sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQ_RING);
+		if(sqRing == MAP_FAILED) return false;
+		cqRing = singleMMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_CQ_RING);
+		if(cqRing == MAP_FAILED) return false;
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQES));
+		if(sqes == MAP_FAILED) return false;
+
+		char* sq = static_cast<char*>(sqRing);
+		char* cq = static_cast<char*>(cqRing);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		return true;
+	}
+	// IORING_OP_READ only exists since 5.6, older kernels fail every read with EINVAL. Probing came with it, so a failed probe also means no IORING_OP_READ
+	bool supportsRead() const {
+		constexpr unsigned PROBE_OPS = 256;
+		std::vector<char> probeData(sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op), 0);
+		io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeData.data());
+		if(syscall(__NR_io_uring_register, ringFD, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) return false;
+		return IORING_OP_READ <= probe->last_op && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+	}
+	~IOURing() {
+		if(sqes != MAP_FAILED) munmap(sqes, sqesSize);
+		if(cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+		if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+		if(ringFD >= 0) close(ringFD);
+	}
+
+	// The caller never has more reads in flight than the ring has entries
+	void queueRead(int fd, void* buf, unsigned length, uint64_t offset, uint64_t userData) {
+		unsigned tail = *sqTail;
+		unsigned index = tail & *sqMask;
+		io_uring_sqe& sqe = sqes[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READ;
+		sqe.fd = fd;
+		sqe.addr = reinterpret_cast<uint64_t>(buf);
+		sqe.len = length;
+		sqe.off = offset;
+		sqe.user_data = userData;
+		sqArray[index] = index;
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+		toSubmit++;
+	}
+
+	// Submits the queued reads and waits for at least one completion
+	int submitAndWait() {
+		while(true) {
+			int result = syscall(__NR_io_uring_enter, ringFD, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if(result >= 0) {
+				toSubmit -= result;
+				return result;
+			}
+			if(errno != EINTR) return -errno;
+		}
+	}
+
+	bool popCompletion(uint64_t& userData, int& result) {
+		unsigned head = *cqHead;
+		if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+		const io_uring_cqe& cqe = cqes[head & *cqMask];
+		userData = cqe.user_data;
+		result = cqe.res;
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+// Returns false if io_uring couldn't be set up or can't read on this kernel, before anything was read
+static bool loadWithIOURing(const std::string& fileName, const OpenedFile& file, const std::vector<Chunk>& chunks, void* const* destinations, int destinationCount, ChunkVerifier& verifier) {
+	unsigned queueDepth = std::max(FILE_LOADER_QUEUE_DEPTH, 1);
+	IOURing ring;
+	if(!ring.init(queueDepth)) return false;
+	if(!ring.supportsRead()) {
+		std::cout << "io_uring has no IORING_OP_READ on this kernel, loading " + fileName + " with threads\n" << std::flush;
+		return false;
+	}
+
+	char* target = static_cast<char*>(destinations[0]);
+	std::vector<size_t> chunkDone(chunks.size(), 0); // Short reads are continued where they stopped
+	auto queueChunk = [&](size_t c) {
+		const Chunk& chunk = chunks[c];
+		size_t offset = chunk.offset + chunkDone[c];
+		ring.queueRead(file.getFD(chunk.offset), target + offset, chunk.size - chunkDone[c], offset, c);
+	};
+
+	size_t nextChunk = 0;
+	size_t inFlight = 0;
+	size_t finishedChunks = 0;
+	for(; nextChunk < chunks.size() && inFlight < queueDepth; nextChunk++, inFlight++) queueChunk(nextChunk);
+	while(finishedChunks < chunks.size()) {
+		int submitted = ring.submitAndWait();
+		if(submitted < 0) failRead(fileName, "io_uring_enter", -submitted);
+
+		uint64_t c;
+		int result;
+		while(ring.popCompletion(c, result)) {
+			if(result == -EAGAIN || result == -EINTR) {
+				queueChunk(c);
+				continue;
+			}
+			if(result < 0) failRead(fileName, "io_uring read", -result);
+			if(result == 0) failRead(fileName, "file is shorter than expected", EIO);
+			chunkDone[c] += result;
+			if(chunkDone[c] < chunks[c].size) {
+				queueChunk(c);
+				continue;
+			}
+			// Keep the drive busy before spending time on the copies
+			inFlight--;
+			finishedChunks++;
+			if(nextChunk < chunks.size()) {
+				queueChunk(nextChunk++);
+				inFlight++;
+			}
+			finishChunk(destinations, destinationCount, verifier, chunks[c]);
+		}
+	}
+	return true;
+}
+
+static void adviseHugePages(void* buffer, size_t size) {
+	constexpr size_t HUGE_PAGE_SIZE = size_t(1) << 21;
+	uintptr_t start = (reinterpret_cast<uintptr_t>(buffer) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	uintptr_t end = (reinterpret_cast<uintptr_t>(buffer) + size) & ~(HUGE_PAGE_SIZE - 1);
+	if(end > start) madvise(reinterpret_cast<void*>(start), end - start, MADV_HUGEPAGE);
+}
+
+void loadFileIntoBuffers(const std::string& fileName, size_t size, void* const* destinations, int destinationCount) {
+	if(FILE_LOADER_HUGEPAGES) {
+		for(int i = 0; i < destinationCount; i++) adviseHugePages(destinations[i], size);
+	}
+	if(FILE_LOADER_METHOD == FileLoaderMethod::SINGLE_STREAM || size == 0) {
+		std::ifstream file(fileName, std::ios::binary);
+		if(!file.good()) {
+			std::cout << "Could not open file '" << fileName << "'!" << std::endl;
+			exit(1);
+		}
+		file.read(static_cast<char*>(destinations[0]), size);
+		file.close();
+		ChunkVerifier(fileName, size, destinations[0]).finish();
+		for(int i = 1; i < destinationCount; i++) memcpy(destinations[i], destinations[0], size);
+		return;
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	OpenedFile file(fileName, size, destinations[0]);
+	ChunkVerifier verifier(fileName, size, destinations[0]);
+	std::vector<Chunk> chunks = makeChunks(file, size, verifier.getLoaderChunkSize());
+	bool usedIOURing = FILE_LOADER_METHOD == FileLoaderMethod::IO_URING && loadWithIOURing(fileName, file, chunks, destinations, destinationCount, verifier);
+	if(!usedIOURing) {
+		loadWithThreads(fileName, file, chunks, destinations, destinationCount, verifier);
+	}
+	verifier.finish();
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	if(size >= (size_t(1) << 30)) {
+		std::cout << "Loaded " + fileName + " (" + std::to_string(size >> 20) + "MB) into " + std::to_string(destinationCount) + " buffers with "
+			+ (usedIOURing ? "io_uring" : std::to_string(FILE_LOADER_THREADS) + " threads") + (file.directFD != -1 ? ", O_DIRECT" : "")
+			+ " at " + std::to_string(size / seconds / (1 << 20)) + "MB/s\n" << std::flush;
+	}
+}
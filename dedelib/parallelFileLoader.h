@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+/*
+	Loads the big flat files (MBFs, ClassInfos, links) with many large reads in flight instead of one stream,
+	which is what it takes to get the full bandwidth out of NVMe drives.
+	The file is cut in chunks of FILE_LOADER_CHUNK_SIZE. Chunks are read straight into the first destination buffer with O_DIRECT where
+	the buffer alignment and filesystem allow it, and copied to the other destinations (the copies on the other sockets) as soon as they arrive.
+	If the file has a manifest (see dataManifest.h) each chunk is also checked against it when it arrives.
+
+	IO_URING keeps FILE_LOADER_QUEUE_DEPTH reads in flight from one thread, THREADS has FILE_LOADER_THREADS threads each doing blocking reads.
+	IO_URING falls back to THREADS if the kernel or a seccomp filter doesn't allow io_uring.
+*/
+enum class FileLoaderMethod {
+	IO_URING,
+	THREADS,
+	SINGLE_STREAM // The original single std::ifstream::read
+};
+
+// Set by configure() from --fileLoader uring|threads|stream, --fileLoaderThreads <n>, --fileLoaderQueueDepth <n> and -fileLoaderHugePages
+extern FileLoaderMethod FILE_LOADER_METHOD;
+extern int FILE_LOADER_THREADS;
+extern int FILE_LOADER_QUEUE_DEPTH;
+extern size_t FILE_LOADER_CHUNK_SIZE;
+extern bool FILE_LOADER_HUGEPAGES; // madvise(MADV_HUGEPAGE) the destinations before reading, for fewer TLB misses on the random link and MBF accesses
+
+// Reads the first size bytes of fileName into every one of the destinationCount buffers. Exits if the file can't be read
+void loadFileIntoBuffers(const std::string& fileName, size_t size, void* const* destinations, int destinationCount);
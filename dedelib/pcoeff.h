@@ -169,11 +169,9 @@ bool atLeastOneIsLarger(const std::array<int, Size>& a, const std::array<int, Si
 template<unsigned int Variables>
 SmallVector<BooleanFunction<Variables>, factorial(Variables)> listPermutationsBelow(const Monotonic<Variables>& top, const Monotonic<Variables>& botToPermute) {
 	SmallVector<BooleanFunction<Variables>, factorial(Variables)> result;
-	botToPermute.forEachPermutation([&result, &top](const Monotonic<Variables>& permutedBot) {
-		if(permutedBot <= top) {
-			BooleanFunction<Variables> difference = andnot(top.bf, permutedBot.bf);
-			result.push_back(difference);
-		}
+	botToPermute.forEachPermutationBelow(top, [&result, &top](const Monotonic<Variables>& permutedBot) {
+		BooleanFunction<Variables> difference = andnot(top.bf, permutedBot.bf);
+		result.push_back(difference);
 	});
 	STATS(successfulBots += result.size());
 	STATS(failedBots += factorial(Variables) - result.size());
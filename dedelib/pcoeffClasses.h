@@ -197,6 +197,15 @@ struct JobTopInfo {
 	uint32_t topDual;
 };
 
+// The top of a bottom buffer with the dual that the buffer creator stored in it. Without PCOEFF_DEDUPLICATE no dual is stored, and the top stands in for it
+inline JobTopInfo getJobTopInfo(const JobInfo& job) {
+#ifdef PCOEFF_DEDUPLICATE
+	return JobTopInfo{job.getTop(), job.bufStart[TOP_DUAL_INDEX]};
+#else
+	return JobTopInfo{job.getTop(), job.getTop()};
+#endif
+}
+
 
 std::string toString(const BetaSum& betaSum);
 std::string toString(const BetaResult& br);
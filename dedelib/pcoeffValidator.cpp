@@ -1,4 +1,5 @@
 #include "pcoeffValidator.h"
+#include "pipelineTelemetry.h"
 
 #include <iostream>
 #include <string>
@@ -14,6 +15,7 @@ void validatorStartMessage(int validatorIdx, NodeIndex topIdx, size_t numBottoms
 }
 void validatorFinishMessage(int validatorIdx, NodeIndex topIdx, size_t numBottoms, size_t numTestedPCoeffs, std::chrono::time_point<std::chrono::high_resolution_clock> startTime) {
 	std::chrono::nanoseconds deltaTime = std::chrono::high_resolution_clock::now() - startTime;
+	pipelineTelemetry.getStage(PipelineStage::VALIDATOR).recordTop(numBottoms, numTestedPCoeffs, deltaTime.count());
 	std::cout << "\033[35m[Validator " + std::to_string(validatorIdx) + "] Correct top " + std::to_string(topIdx) + " with " + std::to_string(numBottoms) + " bottoms: " + std::to_string(numTestedPCoeffs) + " p-coefficients checked in " + std::to_string(deltaTime.count() / 1000000.0) + "ms\033[39m\n" << std::flush;
 }
 
@@ -31,8 +33,8 @@ void printBadPCoeffSumError(NodeIndex botIdx, size_t elementIdx, ProcessedPCoeff
 void freeBuffersAfterValidation(int complexI, PCoeffProcessingContextEighth& context, const OutputBuffer& resultBuf, uint64_t workAmount, std::chrono::time_point<std::chrono::high_resolution_clock>& startTime) {
 	NodeIndex topIdx = resultBuf.originalInputData.getTop();
 	size_t numBottoms = resultBuf.originalInputData.getNumberOfBottoms();
-	context.inputBufferAlloc.push(resultBuf.originalInputData.bufStart);
-	context.resultBufferAlloc.push(resultBuf.outputBuf);
+	context.inputBufferAlloc.free(resultBuf.originalInputData.bufStart);
+	context.resultBufferAlloc.free(resultBuf.outputBuf);
 	validatorFinishMessage(complexI, topIdx, numBottoms, workAmount, startTime);
 }
 
@@ -48,6 +50,7 @@ void* noValidatorPThread(void* voidData) {
 
 	for(std::optional<OutputBuffer> outputBuffer; (outputBuffer = context.validationQueue.pop_wait()).has_value(); ) {
 		OutputBuffer outBuf = outputBuffer.value();
+		context.markValidated();
 
 		size_t bufSize = outBuf.originalInputData.alignedBufferSize();
 		context.freeBuf(outBuf.originalInputData.bufStart, bufSize);
@@ -68,6 +68,7 @@ struct ValidatorWorkerData {
 	std::atomic<int> nextJob; // Controlled by main thread. Either A=0, or B=1, or VALIDATOR_EXIT
 	std::atomic<int> numProcessingB; // Controlled by worker threads. numProcessingA = totalThreads - numProcessingB
 	std::atomic<bool> correct[2];
+	bool errorReported[2]; // Controlled by main thread. A job's verdict is given before it is done, errors found after are reported when it is freed
 	alignas(64)
 	const void* mbfs;
 	std::chrono::time_point<std::chrono::high_resolution_clock> startTimes[2];
@@ -83,6 +84,14 @@ struct ValidatorWorkerData {
 		processedCounts[jobIdx].store(0);
 		nextJob.store(jobIdx);
 		correct[jobIdx].store(true);
+		errorReported[jobIdx] = false;
+	}
+
+	void reportIfIncorrect(int jobIdx, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc) {
+		if(!errorReported[jobIdx] && correct[jobIdx].load() == false) {
+			errorBufFunc(jobs[jobIdx], "validator", false);
+			errorReported[jobIdx] = true;
+		}
 	}
 
 	void workerSwitchTo(int newJob) {
@@ -133,6 +142,7 @@ bool validateWholeBufferIfTooSmall(int complexI, const std::function<void(const
 		if(correct.load() == false) {
 			errorBufFunc(resultBuf, "validator", false);
 		}
+		context.markValidated();
 		freeBuffersAfterValidation(complexI, context, resultBuf, numValidated, startTime);
 
 		return true;
@@ -234,7 +244,10 @@ void* continuousValidatorPThread(void* voidData) {
 				workedNow = validateRandomBufferPart(indices, results, top, numBottoms, mbfs, generator, workerData.correct[curJob]);
 			}
 
-			// Minimum work target met!
+			// Minimum work target met! Give the verdict now, as a checkpoint may be waiting on it
+			workerData.reportIfIncorrect(curJob, errorBufFunc);
+			context.markValidated();
+
 			// Clear out space for new buffer. Wait until attempting to acquire new buffer to validate. Continue to validate in the meantime
 			if(!isFirstBuffer) {
 				int jobToReplace = 1 - curJob;
@@ -242,9 +255,7 @@ void* continuousValidatorPThread(void* voidData) {
 					validateRandomBufferPart(indices, results, top, numBottoms, mbfs, generator, workerData.correct[jobToReplace]);
 				}
 
-				if(workerData.correct[jobToReplace].load() == false) {
-					errorBufFunc(workerData.jobs[jobToReplace], "validator", false);
-				}
+				workerData.reportIfIncorrect(jobToReplace, errorBufFunc);
 				freeBuffersAfterValidation(complexI, context, workerData, jobToReplace);
 			}
 
@@ -255,9 +266,7 @@ void* continuousValidatorPThread(void* voidData) {
 				workerData.nextJob.store(VALIDATOR_EXIT);
 				workerThreads.join();
 
-				if(workerData.correct[curJob].load() == false) {
-					errorBufFunc(workerData.jobs[curJob], "validator", false);
-				}
+				workerData.reportIfIncorrect(curJob, errorBufFunc);
 				freeBuffersAfterValidation(complexI, context, workerData, curJob);
 
 				goto exit;
@@ -334,6 +343,7 @@ void* basicValidatorPThread(void* voidData) {
 			const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc = *validatorData->errorBufFunc;
 			errorBufFunc(outBuf, "validator", false);
 		}
+		context.markValidated();
 
 		size_t bufSize = outBuf.originalInputData.alignedBufferSize();
 		context.freeBuf(outBuf.originalInputData.bufStart, bufSize);
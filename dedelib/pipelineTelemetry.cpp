@@ -0,0 +1,238 @@
+#include "pipelineTelemetry.h"
+
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+TelemetryFormat TELEMETRY_FORMAT = TelemetryFormat::NONE;
+double TELEMETRY_INTERVAL_SECONDS = 10.0;
+
+const char* getStageName(PipelineStage stage) {
+	switch(stage) {
+		case PipelineStage::BOTTOM_BUFFER_CREATOR: return "bottomBufferCreator";
+		case PipelineStage::PROCESSOR: return "processor";
+		case PipelineStage::RESULT_PROCESSOR: return "resultProcessor";
+		case PipelineStage::VALIDATOR: return "validator";
+	}
+	return "unknown";
+}
+
+void LatencyHistogram::add(uint64_t nanos) {
+	uint64_t millis = nanos / 1000000;
+	int bucket = 0;
+	while(bucket < BUCKET_COUNT - 1 && millis >= (uint64_t(1) << bucket)) bucket++;
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+	for(std::atomic<uint64_t>& bucket : buckets) bucket.store(0);
+	totalNanos.store(0);
+}
+
+void StageTelemetry::recordTop(uint64_t bottomCount, uint64_t pcoeffCount, uint64_t nanos) {
+	tops.fetch_add(1, std::memory_order_relaxed);
+	bottoms.fetch_add(bottomCount, std::memory_order_relaxed);
+	pcoeffs.fetch_add(pcoeffCount, std::memory_order_relaxed);
+	topLatency.add(nanos);
+}
+
+void StageTelemetry::reset() {
+	tops.store(0);
+	bottoms.store(0);
+	pcoeffs.store(0);
+	bufferWaitNanos.store(0);
+	topLatency.reset();
+}
+
+ThreadTelemetry::ThreadTelemetry(std::string name, PipelineStage stage) :
+	name(std::move(name)),
+	stage(stage),
+	busyNanos(0),
+	idleNanos(0),
+	phaseStart(telemetryNow()),
+	isBusy(false),
+	isFinished(false) {}
+
+void ThreadTelemetry::setBusy(bool busy) {
+	uint64_t now = telemetryNow();
+	uint64_t phaseTime = now - phaseStart.exchange(now, std::memory_order_relaxed);
+	(isBusy.load(std::memory_order_relaxed) ? busyNanos : idleNanos).fetch_add(phaseTime, std::memory_order_relaxed);
+	isBusy.store(busy, std::memory_order_relaxed);
+}
+
+void ThreadTelemetry::finish() {
+	setBusy(false);
+	isFinished.store(true, std::memory_order_relaxed);
+}
+
+void ThreadTelemetry::getTimes(double& busySeconds, double& idleSeconds) const {
+	uint64_t busy = busyNanos.load(std::memory_order_relaxed);
+	uint64_t idle = idleNanos.load(std::memory_order_relaxed);
+	if(!isFinished.load(std::memory_order_relaxed)) {
+		uint64_t currentPhase = telemetryNow() - phaseStart.load(std::memory_order_relaxed);
+		(isBusy.load(std::memory_order_relaxed) ? busy : idle) += currentPhase;
+	}
+	busySeconds = busy * 1.0e-9;
+	idleSeconds = idle * 1.0e-9;
+}
+
+ThreadTelemetry& PipelineTelemetry::registerThread(std::string name, PipelineStage stage) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return threads.emplace_back(std::move(name), stage);
+}
+
+void PipelineTelemetry::setQueueSampler(std::function<std::vector<std::pair<std::string, size_t>>()> sampler) {
+	std::lock_guard<std::mutex> lock(mutex);
+	queueSampler = std::move(sampler);
+}
+
+void PipelineTelemetry::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for(StageTelemetry& stage : stages) stage.reset();
+	threads.clear();
+	queueSampler = nullptr;
+	startTime = telemetryNow();
+}
+
+static std::string escapeName(const std::string& name) {
+	std::string result;
+	for(char c : name) {
+		if(c == '"' || c == '\\') result += '\\';
+		result += c;
+	}
+	return result;
+}
+
+std::string PipelineTelemetry::toJSONLine() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string result = "{\"seconds\":" + std::to_string((telemetryNow() - startTime) * 1.0e-9) + ",\"stages\":{";
+	for(int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+		const StageTelemetry& stage = stages[s];
+		if(s != 0) result += ",";
+		result += "\"" + std::string(getStageName(static_cast<PipelineStage>(s))) + "\":{"
+			+ "\"tops\":" + std::to_string(stage.tops.load())
+			+ ",\"bottoms\":" + std::to_string(stage.bottoms.load())
+			+ ",\"pcoeffs\":" + std::to_string(stage.pcoeffs.load())
+			+ ",\"bufferWaitSeconds\":" + std::to_string(stage.bufferWaitNanos.load() * 1.0e-9)
+			+ ",\"topSeconds\":" + std::to_string(stage.topLatency.totalNanos.load() * 1.0e-9)
+			+ ",\"topLatencyLog2MsBuckets\":[";
+		for(int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) {
+			if(b != 0) result += ",";
+			result += std::to_string(stage.topLatency.buckets[b].load());
+		}
+		result += "]}";
+	}
+	result += "},\"queues\":{";
+	if(queueSampler) {
+		bool first = true;
+		for(const std::pair<std::string, size_t>& queue : queueSampler()) {
+			if(!first) result += ",";
+			first = false;
+			result += "\"" + escapeName(queue.first) + "\":" + std::to_string(queue.second);
+		}
+	}
+	result += "},\"threads\":[";
+	for(size_t i = 0; i < threads.size(); i++) {
+		double busySeconds, idleSeconds;
+		threads[i].getTimes(busySeconds, idleSeconds);
+		double total = busySeconds + idleSeconds;
+		if(i != 0) result += ",";
+		result += "{\"name\":\"" + escapeName(threads[i].name) + "\",\"stage\":\"" + getStageName(threads[i].stage)
+			+ "\",\"busySeconds\":" + std::to_string(busySeconds)
+			+ ",\"idleSeconds\":" + std::to_string(idleSeconds)
+			+ ",\"busyRatio\":" + std::to_string(total != 0.0 ? busySeconds / total : 0.0) + "}";
+	}
+	result += "]}\n";
+	return result;
+}
+
+std::string PipelineTelemetry::toPrometheusText() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string result;
+	auto addStageCounter = [&](const char* metric, const char* help, const std::function<std::string(const StageTelemetry&)>& value) {
+		result += std::string("# HELP ") + metric + " " + help + "\n# TYPE " + metric + " counter\n";
+		for(int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+			result += std::string(metric) + "{stage=\"" + getStageName(static_cast<PipelineStage>(s)) + "\"} " + value(stages[s]) + "\n";
+		}
+	};
+	addStageCounter("dedekind_tops_total", "Tops finished by the stage", [](const StageTelemetry& st) {return std::to_string(st.tops.load());});
+	addStageCounter("dedekind_bottoms_total", "Bottoms finished by the stage", [](const StageTelemetry& st) {return std::to_string(st.bottoms.load());});
+	addStageCounter("dedekind_pcoeffs_total", "P-coefficients computed or checked by the stage", [](const StageTelemetry& st) {return std::to_string(st.pcoeffs.load());});
+	addStageCounter("dedekind_buffer_wait_seconds_total", "Time the stage waited for free buffers", [](const StageTelemetry& st) {return std::to_string(st.bufferWaitNanos.load() * 1.0e-9);});
+
+	result += "# HELP dedekind_top_seconds Time a stage spent per top\n# TYPE dedekind_top_seconds histogram\n";
+	for(int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+		std::string stageLabel = std::string("stage=\"") + getStageName(static_cast<PipelineStage>(s)) + "\"";
+		const LatencyHistogram& histogram = stages[s].topLatency;
+		uint64_t cumulative = 0;
+		for(int b = 0; b < LatencyHistogram::BUCKET_COUNT - 1; b++) {
+			cumulative += histogram.buckets[b].load();
+			result += "dedekind_top_seconds_bucket{" + stageLabel + ",le=\"" + std::to_string(LatencyHistogram::getBucketUpperBoundSeconds(b)) + "\"} " + std::to_string(cumulative) + "\n";
+		}
+		cumulative += histogram.buckets[LatencyHistogram::BUCKET_COUNT - 1].load();
+		result += "dedekind_top_seconds_bucket{" + stageLabel + ",le=\"+Inf\"} " + std::to_string(cumulative) + "\n";
+		result += "dedekind_top_seconds_sum{" + stageLabel + "} " + std::to_string(histogram.totalNanos.load() * 1.0e-9) + "\n";
+		result += "dedekind_top_seconds_count{" + stageLabel + "} " + std::to_string(cumulative) + "\n";
+	}
+
+	result += "# HELP dedekind_queue_depth Elements in a pipeline queue\n# TYPE dedekind_queue_depth gauge\n";
+	if(queueSampler) {
+		for(const std::pair<std::string, size_t>& queue : queueSampler()) {
+			result += "dedekind_queue_depth{queue=\"" + escapeName(queue.first) + "\"} " + std::to_string(queue.second) + "\n";
+		}
+	}
+
+	result += "# HELP dedekind_thread_busy_seconds_total Time a pipeline thread was working\n# TYPE dedekind_thread_busy_seconds_total counter\n";
+	std::string idleLines = "# HELP dedekind_thread_idle_seconds_total Time a pipeline thread was waiting for work\n# TYPE dedekind_thread_idle_seconds_total counter\n";
+	for(const ThreadTelemetry& thread : threads) {
+		double busySeconds, idleSeconds;
+		thread.getTimes(busySeconds, idleSeconds);
+		std::string labels = "{thread=\"" + escapeName(thread.name) + "\",stage=\"" + getStageName(thread.stage) + "\"} ";
+		result += "dedekind_thread_busy_seconds_total" + labels + std::to_string(busySeconds) + "\n";
+		idleLines += "dedekind_thread_idle_seconds_total" + labels + std::to_string(idleSeconds) + "\n";
+	}
+	result += idleLines;
+	return result;
+}
+
+TelemetryExporter::TelemetryExporter(const std::string& filePathWithoutExtension) {
+	pipelineTelemetry.reset();
+	if(TELEMETRY_FORMAT == TelemetryFormat::NONE) return;
+
+	this->filePath = filePathWithoutExtension + (TELEMETRY_FORMAT == TelemetryFormat::JSON_LINES ? ".telemetry.jsonl" : ".telemetry.prom");
+	std::cout << "Writing telemetry to " + this->filePath + " every " + std::to_string(TELEMETRY_INTERVAL_SECONDS) + "s\n" << std::flush;
+	this->thread = std::thread([this]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!stopSignal.wait_for(lock, std::chrono::duration<double>(TELEMETRY_INTERVAL_SECONDS), [this]() {return shouldStop;})) {
+			writeSample();
+		}
+	});
+}
+
+TelemetryExporter::~TelemetryExporter() {
+	if(!this->thread.joinable()) return;
+	{std::lock_guard<std::mutex> lock(mutex);
+		shouldStop = true;
+	}
+	stopSignal.notify_all();
+	this->thread.join();
+	writeSample();
+	pipelineTelemetry.setQueueSampler(nullptr);
+}
+
+void TelemetryExporter::writeSample() {
+	if(TELEMETRY_FORMAT == TelemetryFormat::JSON_LINES) {
+		std::ofstream file(filePath, std::ios::app);
+		file << pipelineTelemetry.toJSONLine() << std::flush;
+	} else {
+		std::string tmpPath = filePath + ".tmp";
+		{
+			std::ofstream file(tmpPath);
+			file << pipelineTelemetry.toPrometheusText() << std::flush;
+		}
+		std::error_code err;
+		std::filesystem::rename(tmpPath, filePath, err);
+		if(err) std::cerr << "Could not write telemetry to " + filePath + ": " + err.message() + "\n" << std::flush;
+	}
+}
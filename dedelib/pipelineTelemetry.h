@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+/*
+	Counters of the processing pipelines, for watching unattended jobs without reading the console logs.
+	Every stage counts the tops, bottoms and p-coefficients it got through, the time it waited for free buffers,
+	and a histogram of the time it spent per top. Threads register themselves to report how much of the time they were busy.
+	A TelemetryExporter periodically writes all of this, together with the queue depths, as JSON lines or as a Prometheus text file.
+*/
+
+enum class TelemetryFormat {
+	NONE,
+	JSON_LINES,
+	PROMETHEUS
+};
+
+// Set by configure() from --telemetry json|prometheus and --telemetryInterval <seconds>
+extern TelemetryFormat TELEMETRY_FORMAT;
+extern double TELEMETRY_INTERVAL_SECONDS;
+
+enum class PipelineStage {
+	BOTTOM_BUFFER_CREATOR,
+	PROCESSOR,
+	RESULT_PROCESSOR,
+	VALIDATOR
+};
+constexpr int PIPELINE_STAGE_COUNT = 4;
+const char* getStageName(PipelineStage stage);
+
+inline uint64_t telemetryNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds the time spent in its scope to a nanosecond counter
+class TelemetryTimer {
+	std::atomic<uint64_t>& counter;
+	uint64_t start;
+public:
+	TelemetryTimer(std::atomic<uint64_t>& counter) : counter(counter), start(telemetryNow()) {}
+	~TelemetryTimer() {counter.fetch_add(telemetryNow() - start, std::memory_order_relaxed);}
+};
+
+// Bucket i counts the tops that took less than 2^i milliseconds, the last bucket everything longer
+struct LatencyHistogram {
+	static constexpr int BUCKET_COUNT = 24;
+	std::atomic<uint64_t> buckets[BUCKET_COUNT];
+	std::atomic<uint64_t> totalNanos;
+
+	static double getBucketUpperBoundSeconds(int bucket) {return (uint64_t(1) << bucket) / 1000.0;}
+	void add(uint64_t nanos);
+	void reset();
+};
+
+struct StageTelemetry {
+	std::atomic<uint64_t> tops;
+	std::atomic<uint64_t> bottoms;
+	std::atomic<uint64_t> pcoeffs;
+	std::atomic<uint64_t> bufferWaitNanos;
+	LatencyHistogram topLatency;
+
+	void recordTop(uint64_t bottomCount, uint64_t pcoeffCount, uint64_t nanos);
+	void reset();
+};
+
+struct ThreadTelemetry {
+	std::string name;
+	PipelineStage stage;
+	std::atomic<uint64_t> busyNanos;
+	std::atomic<uint64_t> idleNanos;
+	std::atomic<uint64_t> phaseStart;
+	std::atomic<bool> isBusy;
+	std::atomic<bool> isFinished;
+
+	ThreadTelemetry(std::string name, PipelineStage stage);
+
+	// Switches between busy and idle, threads start out idle
+	void setBusy(bool busy);
+	// Stops counting, for when the thread exits
+	void finish();
+	// Includes the current phase
+	void getTimes(double& busySeconds, double& idleSeconds) const;
+};
+
+class PipelineTelemetry {
+	StageTelemetry stages[PIPELINE_STAGE_COUNT];
+	std::mutex mutex;
+	std::deque<ThreadTelemetry> threads; // deque so registered references stay valid
+	std::function<std::vector<std::pair<std::string, size_t>>()> queueSampler;
+	uint64_t startTime = telemetryNow();
+
+public:
+	StageTelemetry& getStage(PipelineStage stage) {return stages[static_cast<int>(stage)];}
+	ThreadTelemetry& registerThread(std::string name, PipelineStage stage);
+
+	// Reports the current depth of every named queue. Must be cleared with setQueueSampler(nullptr) before the queues are destroyed
+	void setQueueSampler(std::function<std::vector<std::pair<std::string, size_t>>()> sampler);
+
+	// Only while no pipeline is running
+	void reset();
+
+	std::string toJSONLine();
+	std::string toPrometheusText();
+};
+inline PipelineTelemetry pipelineTelemetry;
+
+/*
+	Resets pipelineTelemetry, and writes it to filePathWithoutExtension + ".telemetry.jsonl" or ".telemetry.prom"
+	every TELEMETRY_INTERVAL_SECONDS while it exists, and once more when destroyed. Does nothing if TELEMETRY_FORMAT is NONE.
+	JSON lines are appended, the Prometheus file is replaced on every sample, so it can be picked up by a textfile collector.
+*/
+class TelemetryExporter {
+	std::string filePath;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable stopSignal;
+	bool shouldStop = false;
+
+	void writeSample();
+public:
+	TelemetryExporter(const std::string& filePathWithoutExtension);
+	~TelemetryExporter();
+
+	TelemetryExporter(const TelemetryExporter&) = delete;
+	TelemetryExporter& operator=(const TelemetryExporter&) = delete;
+};
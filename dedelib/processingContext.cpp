@@ -2,21 +2,28 @@
 
 #include <iostream>
 #include <cassert>
+#include <thread>
+#include <chrono>
 
 #include "aligned_alloc.h"
 #include "knownData.h"
 
 #include "numaMem.h"
+#include "topology.h"
 
 #include "flatBufferManagement.h"
+#include "parallelFileLoader.h"
+#include "sharedBufferCache.h"
 #include "fileNames.h"
 #include <string.h>
 
 #define USE_NUMA_ALLOC_FOR_FPGA_BUFFERS
 
 
-constexpr size_t NUM_INPUT_BUFFERS_PER_NODE = 120; // 240 buffers in total
-constexpr size_t NUM_RESULT_BUFFERS_PER_NODE = 80; // 160 buffers in total
+// The slabs are sized in buffers of the biggest top, smaller tops take only part of such a buffer
+constexpr size_t NUM_INPUT_BUFFERS_PER_NODE = 120; // per slice
+constexpr size_t NUM_RESULT_BUFFERS_PER_NODE = 80; // per slice
+constexpr size_t MAX_JOBS_IN_FLIGHT_PER_NODE = 2048; // per slice, bounds the number of buffers allocated from a slab at once
 
 // Also alignment is required for openCL buffer sending and receiving methods
 constexpr size_t ALLOC_ALIGN = 1 << 15;
@@ -28,39 +35,49 @@ static size_t getAlignedBufferSize(unsigned int Variables) {
 	// return alignUpTo(mbfCounts[Variables] + ALLOC_ALIGN, ALLOC_ALIGN);
 }
 
+static size_t getAlignedBufferSizeForTop(unsigned int Variables, NodeIndex top) {
+	return alignUpTo(maxDeduplicateBottomsForTopLayer(Variables, getFlatLayerOfIndex(Variables, top))+20, ALLOC_ALIGN);
+}
+
 PCoeffProcessingContextEighth::PCoeffProcessingContextEighth() : 
-	inputBufferAlloc(NUM_INPUT_BUFFERS_PER_NODE),
-	resultBufferAlloc(NUM_RESULT_BUFFERS_PER_NODE),
-	outputQueue(std::min(NUM_INPUT_BUFFERS_PER_NODE, NUM_RESULT_BUFFERS_PER_NODE)),
-	validationQueue(std::min(NUM_INPUT_BUFFERS_PER_NODE, NUM_RESULT_BUFFERS_PER_NODE)) {}
+	outputQueue(MAX_JOBS_IN_FLIGHT_PER_NODE),
+	validationQueue(MAX_JOBS_IN_FLIGHT_PER_NODE),
+	sentToValidation(0),
+	validatedCount(0) {}
 
-PCoeffProcessingContextEighth::~PCoeffProcessingContextEighth() {
-	inputBufferAlloc.close();
-	resultBufferAlloc.close();
-}
+PCoeffProcessingContextEighth::~PCoeffProcessingContextEighth() {}
 
-void PCoeffProcessingContextEighth::freeBuf(NodeIndex* bufToFree, size_t bufSize) {
-	this->inputBufferAlloc.push(bufToFree);
-}
-void PCoeffProcessingContextEighth::freeBuf(ProcessedPCoeffSum* bufToFree, size_t bufSize) {
-	memset(static_cast<void*>(bufToFree), 0xFF, sizeof(ProcessedPCoeffSum) * bufSize); // Fill with fixed data so any computation gaps are easily spotted
-	this->resultBufferAlloc.push(bufToFree);
+void PCoeffProcessingContextEighth::pushForValidation(const OutputBuffer& buf) {
+	sentToValidation.fetch_add(1, std::memory_order_relaxed);
+	validationQueue.push(buf);
 }
 
-template<typename T>
-void setStackToBufferParts(SynchronizedStack<T*>& target, T* bufMemory, size_t partSize, size_t numParts) {
-	T** stack = target.get();
-	for(size_t i = 0; i < numParts; i++) {
-		stack[i] = bufMemory + i * partSize;
+void PCoeffProcessingContextEighth::waitForValidators() const {
+	while(validatedCount.load(std::memory_order_acquire) != sentToValidation.load(std::memory_order_relaxed)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
-	target.sz = numParts;
 }
-template<typename T>
-void setQueueToBufferParts(SynchronizedQueue<T*>& target, T* bufMemory, size_t partSize, size_t numParts) {
-	RingQueue<T*>& q = target.get();
-	for(size_t i = 0; i < numParts; i++) {
-		q.push(bufMemory + i * partSize);
+
+void PCoeffProcessingContextEighth::allocInputBuffers(unsigned int Variables, const JobTopInfo* tops, NodeIndex** buffers, int numberOfTops) {
+	std::vector<size_t> bufferSizes(numberOfTops);
+	for(int topI = 0; topI < numberOfTops; topI++) {
+		bufferSizes[topI] = getAlignedBufferSizeForTop(Variables, tops[topI].top);
 	}
+	this->inputBufferAlloc.allocN_wait(buffers, bufferSizes.data(), numberOfTops);
+}
+void PCoeffProcessingContextEighth::shrinkInputBuffer(const JobInfo& job) {
+	this->inputBufferAlloc.shrinkIfLastAllocation(job.bufStart, alignUpTo(job.alignedBufferSize(), ALLOC_ALIGN));
+}
+ProcessedPCoeffSum* PCoeffProcessingContextEighth::allocResultBuffer(const JobInfo& job) {
+	return this->resultBufferAlloc.alloc_wait(alignUpTo(job.alignedBufferSize(), ALLOC_ALIGN));
+}
+
+void PCoeffProcessingContextEighth::freeBuf(NodeIndex* bufToFree, size_t bufSize) {
+	this->inputBufferAlloc.free(bufToFree);
+}
+void PCoeffProcessingContextEighth::freeBuf(ProcessedPCoeffSum* bufToFree, size_t bufSize) {
+	memset(static_cast<void*>(bufToFree), 0xFF, sizeof(ProcessedPCoeffSum) * bufSize); // Fill with fixed data so any computation gaps are easily spotted
+	this->resultBufferAlloc.free(bufToFree);
 }
 
 static void* posix_aligned_alloc(size_t size, size_t align) {
@@ -74,18 +91,32 @@ static void* posix_aligned_alloc(size_t size, size_t align) {
 	return result;
 }
 
-PCoeffProcessingContext::PCoeffProcessingContext(unsigned int Variables) : Variables(Variables), inputQueue(NUMA_SLICE_COUNT, NUM_INPUT_BUFFERS_PER_NODE), topsAreReady(1), mbfs0Ready(1), mbfsBothReady(1) {
+static int getNUMASliceCount() {
+	return std::min(int(getTopology().getSocketCount()), MAX_NUMA_SLICE_COUNT);
+}
+
+PCoeffProcessingContext::PCoeffProcessingContext(unsigned int Variables) : Variables(Variables), numaSliceCount(getNUMASliceCount()), inputQueue(numaSliceCount, MAX_JOBS_IN_FLIGHT_PER_NODE), topsAreReady(1), mbfs0Ready(1), mbfsAllReady(1) {
+	const CPUTopology& topology = getTopology();
 	std::cout 
-		<< "Create PCoeffProcessingContext in 2 parts with " 
+		<< "Detected " << topology.toString() << "\n"
+		<< "Create PCoeffProcessingContext in " << numaSliceCount << " parts with " 
 		<< Variables 
 		<< " Variables, " 
 		<< NUM_INPUT_BUFFERS_PER_NODE
-		<< " buffers / socket, and "
+		<< " max size buffers / socket, and "
 		<< NUM_RESULT_BUFFERS_PER_NODE
-		<< " result buffers\n" << std::flush;
+		<< " max size result buffers, shared by up to "
+		<< MAX_JOBS_IN_FLIGHT_PER_NODE
+		<< " jobs\n" << std::flush;
+
+	for(int socketI = 0; socketI < MAX_NUMA_SLICE_COUNT; socketI++) {
+		this->mbfs[socketI] = nullptr;
+		this->classInfos[socketI] = nullptr;
+		this->links[socketI] = nullptr;
+	}
 
 	size_t alignedBufSize = getAlignedBufferSize(Variables);
-	for(int socketI = 0; socketI < NUMA_SLICE_COUNT; socketI++) {
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
 #ifdef USE_NUMA_ALLOC_FOR_FPGA_BUFFERS
 		this->numaInputMemory[socketI] = (NodeIndex*) numa_alloc_onsocket(alignedBufSize * NUM_INPUT_BUFFERS_PER_NODE * sizeof(NodeIndex), socketI);
 		this->numaResultMemory[socketI] = (ProcessedPCoeffSum*) numa_alloc_onsocket(alignedBufSize * NUM_RESULT_BUFFERS_PER_NODE * sizeof(ProcessedPCoeffSum), socketI);
@@ -93,30 +124,53 @@ PCoeffProcessingContext::PCoeffProcessingContext(unsigned int Variables) : Varia
 		this->numaInputMemory[socketI] = (NodeIndex*) posix_aligned_alloc(alignedBufSize * NUM_INPUT_BUFFERS_PER_NODE * sizeof(NodeIndex), ALLOC_ALIGN * sizeof(NodeIndex));
 		this->numaResultMemory[socketI] = (ProcessedPCoeffSum*) posix_aligned_alloc(alignedBufSize * NUM_RESULT_BUFFERS_PER_NODE * sizeof(ProcessedPCoeffSum), ALLOC_ALIGN * sizeof(ProcessedPCoeffSum));
 #endif
-		this->numaQueues[socketI] = unique_numa_ptr<PCoeffProcessingContextEighth>::alloc_onnode(socketI * 4 + 3); // Prefer nodes 3 and 7 because that's where the FPGAs are
+		// Prefer the last node of the socket, on the original machine that's nodes 3 and 7 because that's where the FPGAs are
+		int queueNode = topology.getNUMANodesOfSocket(socketI).empty() ? 0 : topology.getNUMANodesOfSocket(socketI).back();
+		this->numaQueues[socketI] = unique_numa_ptr<PCoeffProcessingContextEighth>::alloc_onnode(topology.numaNodeIds[queueNode]);
 
-		setQueueToBufferParts(this->numaQueues[socketI]->inputBufferAlloc, this->numaInputMemory[socketI], alignedBufSize, NUM_INPUT_BUFFERS_PER_NODE);
-		setQueueToBufferParts(this->numaQueues[socketI]->resultBufferAlloc, this->numaResultMemory[socketI], alignedBufSize, NUM_RESULT_BUFFERS_PER_NODE);
+		this->numaQueues[socketI]->inputBufferAlloc.get() = SlabAllocator<NodeIndex>(alignedBufSize * NUM_INPUT_BUFFERS_PER_NODE, MAX_JOBS_IN_FLIGHT_PER_NODE, this->numaInputMemory[socketI]);
+		this->numaQueues[socketI]->resultBufferAlloc.get() = SlabAllocator<ProcessedPCoeffSum>(alignedBufSize * NUM_RESULT_BUFFERS_PER_NODE, MAX_JOBS_IN_FLIGHT_PER_NODE, this->numaResultMemory[socketI]);
 	}
 
 	std::cout << "Finished PCoeffProcessingContext\n" << std::flush;
 }
 
-static void freeNUMA_MBFs(unsigned int Variables, const void* mbfs[2]) {
+static void freeSocketBuffer(const void* buffer, size_t bufSize) {
+	if(buffer != nullptr && !detachSharedBuffer(buffer)) numa_free(const_cast<void*>(buffer), bufSize);
+}
+
+// Attaches the node's shared copies if the shared buffer cache is enabled, otherwise loads private ones
+static void loadSocketBuffers(const std::string& fileName, size_t bufSize, const void** socketBuffers, int socketCount) {
+	if(attachSharedSocketBuffers(fileName, bufSize, bufSize, socketBuffers, socketCount)) return;
+	void* allocatedBuffers[MAX_NUMA_SLICE_COUNT];
+	allocSocketBuffers(bufSize, allocatedBuffers, socketCount);
+	// The copies to the other sockets are made per chunk while the next reads are in flight
+	loadFileIntoBuffers(fileName, bufSize, allocatedBuffers, socketCount);
+	for(int socketI = 0; socketI < socketCount; socketI++) {
+		socketBuffers[socketI] = allocatedBuffers[socketI];
+	}
+}
+
+static void freeNUMA_MBFs(unsigned int Variables, const void* const* mbfs, int numaSliceCount) {
 	size_t mbfSize = (1 << (Variables > 3 ? Variables-3 : 0)); // sizeof(Monotonic<Variables>)
 	size_t mbfBufSize = mbfSize * mbfCounts[Variables];
 
-	numa_free(const_cast<void*>(mbfs[0]), mbfBufSize);
-	numa_free(const_cast<void*>(mbfs[1]), mbfBufSize);
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
+		freeSocketBuffer(mbfs[socketI], mbfBufSize);
+	}
 }
 
 PCoeffProcessingContext::~PCoeffProcessingContext() {
 	std::cout << "Destroy PCoeffProcessingContext, Deleting input and output buffers..." << std::endl;
-	freeNUMA_MBFs(this->Variables, this->mbfs);
+	freeNUMA_MBFs(this->Variables, this->mbfs, this->numaSliceCount);
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
+		freeSocketBuffer(this->classInfos[socketI], mbfCounts[Variables] * sizeof(ClassInfo));
+		freeSocketBuffer(this->links[socketI], this->linkBufferSize);
+	}
 
 	size_t alignedBufSize = getAlignedBufferSize(this->Variables);
 
-	for(size_t socketI = 0; socketI < NUMA_SLICE_COUNT; socketI++) {
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
 #ifdef USE_NUMA_ALLOC_FOR_FPGA_BUFFERS
 		numa_free(this->numaInputMemory[socketI], alignedBufSize * NUM_INPUT_BUFFERS_PER_NODE * sizeof(NodeIndex));
 		numa_free(this->numaResultMemory[socketI], alignedBufSize * NUM_RESULT_BUFFERS_PER_NODE * sizeof(ProcessedPCoeffSum));
@@ -133,41 +187,68 @@ void PCoeffProcessingContext::initTops(std::vector<JobTopInfo> tops) {
 }
 
 void PCoeffProcessingContext::initMBFS() {
-	void* numaMBFBuffers[2];
+	if(mbfs[0] != nullptr) {
+		this->mbfs0Ready.notify();
+		this->mbfsAllReady.notify();
+		return;
+	}
 	size_t mbfSize = (1 << (Variables > 3 ? Variables-3 : 0)); // sizeof(Monotonic<Variables>)
 	size_t mbfBufSize = mbfSize * mbfCounts[Variables];
-	allocSocketBuffers(mbfBufSize, numaMBFBuffers);
-	readFlatVoidBufferNoMMAP(FileName::flatMBFs(Variables), mbfBufSize, numaMBFBuffers[0]);
-
-	mbfs[0] = numaMBFBuffers[0];
+	loadSocketBuffers(FileName::flatMBFs(Variables), mbfBufSize, mbfs, numaSliceCount);
 	this->mbfs0Ready.notify();
-	memcpy(numaMBFBuffers[1], numaMBFBuffers[0], mbfBufSize);
-	mbfs[1] = numaMBFBuffers[1];
-	this->mbfsBothReady.notify();
+	this->mbfsAllReady.notify();
 }
 
+void PCoeffProcessingContext::initClassInfos() {
+	if(classInfos[0] != nullptr) return;
+	const void* numaClassInfos[MAX_NUMA_SLICE_COUNT];
+	size_t classInfoBufferSize = mbfCounts[Variables] * sizeof(ClassInfo);
+	loadSocketBuffers(FileName::flatClassInfo(Variables), classInfoBufferSize, numaClassInfos, numaSliceCount);
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
+		classInfos[socketI] = static_cast<const ClassInfo*>(numaClassInfos[socketI]);
+	}
+}
 
-template<size_t N, typename T>
-static size_t getIndexOf(T* const (&arrs)[N], size_t bufSize, const T* ptr) {
-	for(size_t i = 0; i < N; i++) {
-		const T* bufStart = arrs[i];
-		const T* bufEnd = bufStart + bufSize;
-		if(ptr >= bufStart && ptr < bufEnd) {
-			return i;
+void PCoeffProcessingContext::resetForNextRun() {
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
+		PCoeffProcessingContextEighth& subContext = *numaQueues[socketI];
+		if(subContext.inputBufferAlloc.getNumberOfChunksInUse() != 0 || subContext.resultBufferAlloc.getNumberOfChunksInUse() != 0) {
+			std::cerr << "PCoeffProcessingContext: Not all buffers were returned by the previous run! Aborting!\n" << std::flush;
+			std::abort();
 		}
+		subContext.outputQueue.reopen();
+		subContext.validationQueue.reopen();
 	}
-	// unreachable
-	__builtin_unreachable();
-	assert(false);
+	inputQueue.reopen();
+	topsAreReady.reset();
+	mbfs0Ready.reset();
+	mbfsAllReady.reset();
+	tops.clear();
+}
+
+int PCoeffProcessingContext::getSliceOfCoreComplex(int coreComplex) const {
+	const CPUTopology& topology = getTopology();
+	return getSliceOfSocket(topology.coreComplexSocket[coreComplex % topology.getCoreComplexCount()]);
+}
+int PCoeffProcessingContext::getSliceOfNUMANode(int numaNode) const {
+	const CPUTopology& topology = getTopology();
+	return getSliceOfSocket(topology.numaNodeSocket[numaNode % topology.getNUMANodeCount()]);
 }
 
+
 PCoeffProcessingContextEighth& PCoeffProcessingContext::getNUMAForBuf(const NodeIndex* id) const {
-	size_t alignedBufSize = getAlignedBufferSize(this->Variables);
-	size_t totalBufSize = alignedBufSize * NUM_INPUT_BUFFERS_PER_NODE;
-	return *numaQueues[getIndexOf(numaInputMemory, totalBufSize, id)];
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
+		if(numaQueues[socketI]->inputBufferAlloc.owns(id)) return *numaQueues[socketI];
+	}
+	// unreachable
+	__builtin_unreachable();
+	assert(false);
 }
 PCoeffProcessingContextEighth& PCoeffProcessingContext::getNUMAForBuf(const ProcessedPCoeffSum* id) const {
-	size_t alignedBufSize = getAlignedBufferSize(this->Variables);
-	size_t totalBufSize = alignedBufSize * NUM_RESULT_BUFFERS_PER_NODE;
-	return *numaQueues[getIndexOf(numaResultMemory, totalBufSize, id)];
+	for(int socketI = 0; socketI < numaSliceCount; socketI++) {
+		if(numaQueues[socketI]->resultBufferAlloc.owns(id)) return *numaQueues[socketI];
+	}
+	// unreachable
+	__builtin_unreachable();
+	assert(false);
 }
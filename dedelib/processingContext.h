@@ -6,8 +6,8 @@
 
 /*
 	This is a closed-loop buffer circulation system. 
-	Buffers are allocated once at the start of the program, 
-	and are then passed from module to module. 
+	The buffer memory is allocated once at the start of the program, 
+	one input and one result slab per slice, and buffers are carved from it and passed from module to module. 
 	There are two classes of buffers in circulation:
 		- NodeIndex* buffers: These contain the MBF indices 
 								of the bottoms that correspond
@@ -16,32 +16,67 @@
 		- ProcessedPCoeffSum* buffers:  These contain the results 
 										of processPCoeffSum on
 										each of the inputs. 
+	Buffers are sized for their own top instead of for the biggest top, so many small tops can be in flight at once. 
+	An input buffer is allocated for the upper bound of bottoms of the top's layer, and shrunk to the real size once it is filled. 
+	A result buffer is allocated with the size of its input buffer. 
+	The slabs are used as rings: space is only reused once the oldest buffer in flight is freed, freeing a younger buffer gives nothing back yet. 
+	One slow top, such as a big top held by the validator, can therefore stall allocation while most of the slab is free. 
+	NUM_INPUT_BUFFERS_PER_NODE and NUM_RESULT_BUFFERS_PER_NODE must leave room for the tops in flight behind the slowest one. 
 */
 
-constexpr int NUMA_SLICE_COUNT = 2;
+// Use the lock-free LockFreeQueue for the buffer circulation, instead of the mutex based SynchronizedQueue
+#define PCOEFF_LOCK_FREE_QUEUES
+
+#ifdef PCOEFF_LOCK_FREE_QUEUES
+template<typename T>
+using PipelineQueue = LockFreeQueue<T>;
+#else
+template<typename T>
+using PipelineQueue = SynchronizedQueue<T>;
+#endif
+
+// The buffers and queues are split into one slice per socket, of which there can be at most this many
+constexpr int MAX_NUMA_SLICE_COUNT = 8;
 
 class PCoeffProcessingContextEighth {
 public:
-	// Return queues are implemented as stacks, to try and reuse recently retired buffers more often, to improve cache coherency. 
-	SynchronizedQueue<NodeIndex*> inputBufferAlloc;
-	SynchronizedQueue<ProcessedPCoeffSum*> resultBufferAlloc;
+	// Ring allocators over the slice's slabs. Freed space only becomes available again once every older buffer has been freed too
+	SynchronizedSlabAllocator<NodeIndex> inputBufferAlloc;
+	SynchronizedSlabAllocator<ProcessedPCoeffSum> resultBufferAlloc;
 
-	SynchronizedQueue<OutputBuffer> outputQueue;
-	SynchronizedQueue<OutputBuffer> validationQueue;
+	PipelineQueue<OutputBuffer> outputQueue;
+	PipelineQueue<OutputBuffer> validationQueue;
+
+	// Buffers given to the validators, and how many of those have their verdict. A checkpoint only saves tops that have been validated
+	std::atomic<uint64_t> sentToValidation;
+	std::atomic<uint64_t> validatedCount;
 
 	PCoeffProcessingContextEighth();
 	~PCoeffProcessingContextEighth();
 
+	// Allocates the input buffers for a batch of tops at once, each large enough for any top of its layer
+	void allocInputBuffers(unsigned int Variables, const JobTopInfo* tops, NodeIndex** buffers, int numberOfTops);
+	// Gives back the unused part of a filled input buffer if no later buffer was allocated yet. Must be done before the job is passed on
+	void shrinkInputBuffer(const JobInfo& job);
+	ProcessedPCoeffSum* allocResultBuffer(const JobInfo& job);
+
 	void freeBuf(NodeIndex* bufToFree, size_t bufSize);
 	void freeBuf(ProcessedPCoeffSum* bufToFree, size_t bufSize);
+
+	void pushForValidation(const OutputBuffer& buf);
+	// Called by a validator once it has checked its minimum share of a buffer and reported any error found in it, it may keep checking the buffer after
+	void markValidated() {validatedCount.fetch_add(1, std::memory_order_release);}
+	// Waits until every buffer pushed for validation has its verdict. Validators must not depend on new buffers arriving to give it
+	void waitForValidators() const;
 };
 
 class PCoeffProcessingContext {
 public:
 	unsigned int Variables;
-	NodeIndex* numaInputMemory[NUMA_SLICE_COUNT];
-	ProcessedPCoeffSum* numaResultMemory[NUMA_SLICE_COUNT];
-	unique_numa_ptr<PCoeffProcessingContextEighth> numaQueues[NUMA_SLICE_COUNT];
+	int numaSliceCount; // One per detected socket
+	NodeIndex* numaInputMemory[MAX_NUMA_SLICE_COUNT];
+	ProcessedPCoeffSum* numaResultMemory[MAX_NUMA_SLICE_COUNT];
+	unique_numa_ptr<PCoeffProcessingContextEighth> numaQueues[MAX_NUMA_SLICE_COUNT];
 
 	SynchronizedMultiQueue<JobInfo> inputQueue;
 
@@ -49,15 +84,34 @@ public:
 	std::vector<JobTopInfo> tops; // Synchronizes on the topsAreReady latch
 
 	MutexLatch mbfs0Ready;
-	MutexLatch mbfsBothReady;
-	const void* mbfs[2]; // One buffer on Socket 0 and one on Socket 1
+	MutexLatch mbfsAllReady;
+	const void* mbfs[MAX_NUMA_SLICE_COUNT]; // One buffer per slice, on its socket
+
+	/*
+		The read-only data of the pipeline stages is loaded by the first pipeline run and stays resident until the context is destroyed, 
+		so a worker that runs many jobs on one context only loads it once. 
+	*/
+	const ClassInfo* classInfos[MAX_NUMA_SLICE_COUNT]; // One buffer per slice, nullptr until loaded
+	void* links[MAX_NUMA_SLICE_COUNT]; // One buffer per slice, loaded by runBottomBufferCreator
+	size_t linkBufferSize = 0; // Including the prefetch padding, 0 until the links are loaded
+	bool linksAreCompressed = false;
+	size_t finishedRuns = 0;
 
 	void initTops(std::vector<JobTopInfo> tops);
+	// Loads the MBFs if no earlier run did, and opens the latches
 	void initMBFS();
+	// Loads the ClassInfos if no earlier run did
+	void initClassInfos();
+	// Reopens the queues and rearms the latches for the next pipeline run. All buffers must be back in their alloc queues
+	void resetForNextRun();
 
 	PCoeffProcessingContext(unsigned int Variables);
 	~PCoeffProcessingContext();
 
+	int getSliceOfSocket(int socket) const {return socket % numaSliceCount;}
+	int getSliceOfCoreComplex(int coreComplex) const;
+	int getSliceOfNUMANode(int numaNode) const;
+
 	PCoeffProcessingContextEighth& getNUMAForBuf(const NodeIndex* id) const;
 	PCoeffProcessingContextEighth& getNUMAForBuf(const ProcessedPCoeffSum* id) const;
 };
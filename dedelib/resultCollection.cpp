@@ -8,13 +8,18 @@
 #include "threadUtils.h"
 #include "threadPool.h"
 #include "numaMem.h"
+#include "topology.h"
+#include "pipelineTelemetry.h"
+#include "jobCheckpoint.h"
 
 
 #include <iostream>
 #include <string>
 #include <atomic>
+#include <memory>
 
 #include <string.h>
+#include <algorithm>
 #include <immintrin.h>
 
 #define SECOND_RUN
@@ -107,8 +112,10 @@ struct ResultProcessingThreadData {
 	std::atomic<BetaResult*>* finalResultPtr;
 	ValidationData* validationBuffer;
 	int numaNode;
+	int numaSlice;
 	unsigned int Variables;
 	const std::function<void(const OutputBuffer&, const char*, bool)>* errorBufFunc;
+	CheckpointGate* checkpointGate;
 
 #ifdef SECOND_RUN
 	const u128* firstRunBetaSums;
@@ -117,17 +124,26 @@ struct ResultProcessingThreadData {
 static void* resultprocessingPThread(void* voidData) {
 	ResultProcessingThreadData* tData = (ResultProcessingThreadData*) voidData;
 	setThreadName(("Result " + std::to_string(tData->numaNode)).c_str());
-	memset(static_cast<void*>(tData->validationBuffer), 0, tData->validationBufferSize);
+	{
+		CheckpointGateSection gateSection(tData->checkpointGate);
+		memset(static_cast<void*>(tData->validationBuffer), 0, tData->validationBufferSize);
+	}
 	//resultprocessingThread(tData->mbfClassInfos, *tData->context, *tData->finalResultPtr, tData->validationBuffer, *tData->errorBufFunc);
 
 	const ClassInfo* mbfClassInfos = tData->mbfClassInfos;
 	ValidationData* validationBuffer = tData->validationBuffer;
 	const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc = *tData->errorBufFunc;
-	PCoeffProcessingContextEighth& subContext = *tData->context->numaQueues[tData->numaNode / 4];
+	PCoeffProcessingContextEighth& subContext = *tData->context->numaQueues[tData->numaSlice];
 	std::atomic<BetaResult*>& finalResultPtr = *tData->finalResultPtr;
 	std::cout << "\033[32m[Result Processor] Result processor Thread started.\033[39m\n" << std::flush;
+	ThreadTelemetry& telemetry = pipelineTelemetry.registerThread("Result " + std::to_string(tData->numaNode), PipelineStage::RESULT_PROCESSOR);
+	StageTelemetry& stageTelemetry = pipelineTelemetry.getStage(PipelineStage::RESULT_PROCESSOR);
 	for(std::optional<OutputBuffer> outputBuffer; (outputBuffer = subContext.outputQueue.pop_wait()).has_value(); ) {
 		OutputBuffer buf = outputBuffer.value();
+		// A checkpoint must see the validation terms and the BetaResult of a buffer together
+		CheckpointGateSection gateSection(tData->checkpointGate);
+		telemetry.setBusy(true);
+		uint64_t bufStartTime = telemetryNow();
 
 		BetaResult curBetaResult;
 		//if constexpr(Variables == 7) std::cout << "Results for job " << buf.originalInputData.getTop() << std::endl;
@@ -154,8 +170,9 @@ static void* resultprocessingPThread(void* voidData) {
 
 			if(recoverable) {
 				std::cout << "\033[32m[Result Processor] Retrying buffer for top " + std::to_string(buf.originalInputData.getTop()) + "!\033[39m\n" << std::flush;
-				tData->context->inputQueue.push(tData->numaNode / 4, buf.originalInputData); // Return the buffer to try again
+				tData->context->inputQueue.push(tData->numaSlice, buf.originalInputData); // Return the buffer to try again
 				subContext.freeBuf(buf.outputBuf, buf.originalInputData.alignedBufferSize());
+				telemetry.setBusy(false);
 				continue;
 			}
 		}
@@ -174,27 +191,72 @@ static void* resultprocessingPThread(void* voidData) {
 			addValidationData(buf, topDualClassInfo, validationBuffer);
 #endif
 
-			subContext.validationQueue.push(buf);
+			size_t numBottoms = buf.originalInputData.getNumberOfBottoms();
+			subContext.pushForValidation(buf);
 			BetaResult* allocatedSlot = finalResultPtr.fetch_add(1);
 			*allocatedSlot = std::move(curBetaResult);
+			stageTelemetry.recordTop(numBottoms, numBottoms, telemetryNow() - bufStartTime);
 		}
+		telemetry.setBusy(false);
 	}
+	telemetry.finish();
 	std::cout << "\033[32m[Result Processor] Result processor Thread finished.\033[39m\n" << std::flush;
 
 	pthread_exit(nullptr);
 	return nullptr;
 }
 
+// Writes the summed validation terms past the cache, they are not read again until the next merge
+static void streamValidationData(ValidationData* target, BetaSum value) {
+	static_assert(sizeof(ValidationData) % sizeof(long long) == 0);
+	long long words[sizeof(ValidationData) / sizeof(long long)];
+	ValidationData data;
+	data.dualBetaSum = value;
+	memcpy(static_cast<void*>(words), static_cast<const void*>(&data), sizeof(ValidationData));
+	long long* targetWords = reinterpret_cast<long long*>(target);
+	for(size_t i = 0; i < sizeof(ValidationData) / sizeof(long long); i++) {
+		_mm_stream_si64(targetWords + i, words[i]);
+	}
+}
+
+void addValidationBuffers(ValidationData* target, ValidationData* const* sources, int sourceCount, size_t bufferSize, bool clearSources) {
+	if(sourceCount == 0) return;
+	const CPUTopology& topology = getTopology();
+	int numaNodeCount = topology.getNUMANodeCount();
+	int threadsPerNode = std::max(size_t(1), topology.physicalCores.size() / numaNodeCount);
+
+	// NUMA_DOMAIN affinity wraps around the nodes, so thread i works on slice i % numaNodeCount
+	runInParallel(numaNodeCount * threadsPerNode, CPUAffinityType::NUMA_DOMAIN, [&](int threadID) {
+		setThreadName(("Reduce " + std::to_string(threadID)).c_str());
+		int slice = threadID % numaNodeCount;
+		int part = threadID / numaNodeCount;
+		size_t sliceStart = bufferSize * slice / numaNodeCount;
+		size_t sliceEnd = bufferSize * (slice + 1) / numaNodeCount;
+		size_t start = sliceStart + (sliceEnd - sliceStart) * part / threadsPerNode;
+		size_t end = sliceStart + (sliceEnd - sliceStart) * (part + 1) / threadsPerNode;
+
+		constexpr size_t PREFETCH_DISTANCE = 32;
+		for(size_t i = start; i < end; i++) {
+			BetaSum total = target[i].dualBetaSum;
+			for(int sourceI = 0; sourceI < sourceCount; sourceI++) {
+				_mm_prefetch(reinterpret_cast<const char*>(&sources[sourceI][i + PREFETCH_DISTANCE]), _MM_HINT_NTA);
+				total += sources[sourceI][i].dualBetaSum;
+				if(clearSources) streamValidationData(&sources[sourceI][i], BetaSum{0, 0});
+			}
+			streamValidationData(&target[i], total);
+		}
+		_mm_sfence();
+	});
+}
+
 ResultProcessorOutput NUMAResultProcessor(
 	unsigned int Variables,
 	PCoeffProcessingContext& context,
 	const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc
 ) {
-	void* numaClassInfos[2];
-	size_t classInfoBufferSize = mbfCounts[Variables] * sizeof(ClassInfo);
-	allocSocketBuffers(classInfoBufferSize, numaClassInfos);
-	readFlatVoidBufferNoMMAP(FileName::flatClassInfo(Variables), classInfoBufferSize, numaClassInfos[0]);
-	memcpy(numaClassInfos[1], numaClassInfos[0], classInfoBufferSize);
+	// One result processor and validation buffer per NUMA node, reading the ClassInfos of its slice
+	int numaNodeCount = getTopology().getNUMANodeCount();
+	context.initClassInfos();
 	std::cout << "\033[32m[Result Processor] Finished Loading ClassInfos. Allocating validation buffers\033[39m\n" << std::flush;
 
 	ResultProcessorOutput result;
@@ -202,49 +264,68 @@ ResultProcessorOutput NUMAResultProcessor(
 	std::atomic<BetaResult*> finalResultPtr;
 	finalResultPtr.store(&result.results[0]);
 
-	void* validationBuffers[8];
+	std::unique_ptr<void*[]> validationBuffers(new void*[numaNodeCount]);
 	size_t validationBufferSize = sizeof(ValidationData) * VALIDATION_BUFFER_SIZE(Variables);
-	allocNumaNodeBuffers(validationBufferSize, validationBuffers);
+	allocNumaNodeBuffers(validationBufferSize, validationBuffers.get(), numaNodeCount);
+	std::unique_ptr<ValidationData*[]> typedValidationBuffers(new ValidationData*[numaNodeCount]);
+	for(int i = 0; i < numaNodeCount; i++) {
+		typedValidationBuffers[i] = static_cast<ValidationData*>(validationBuffers[i]);
+	}
 	std::cout << "\033[32m[Result Processor] Allocated validation buffers. Starting result processing threads\033[39m\n" << std::flush;
 
+	JobCheckpoint* checkpoint = activeJobCheckpoint;
+
 #ifdef SECOND_RUN
 	const u128* firstRunBetaSums = readFlatBuffer<u128>(FileName::firstRunBetaSums(Variables), mbfCounts[Variables]);
 #endif
 
-	ResultProcessingThreadData datas[8];
-	for(int i = 0; i < 8; i++) {
+	std::unique_ptr<ResultProcessingThreadData[]> datas(new ResultProcessingThreadData[numaNodeCount]);
+	for(int i = 0; i < numaNodeCount; i++) {
 		datas[i].validationBufferSize = validationBufferSize;
 		datas[i].context = &context;
-		datas[i].mbfClassInfos = static_cast<const ClassInfo*>(numaClassInfos[i / 4]);
+		datas[i].numaSlice = context.getSliceOfNUMANode(i);
+		datas[i].mbfClassInfos = context.classInfos[datas[i].numaSlice];
 		datas[i].finalResultPtr = &finalResultPtr;
 		datas[i].validationBuffer = static_cast<ValidationData*>(validationBuffers[i]);
 		datas[i].numaNode = i;
 		datas[i].Variables = Variables;
 		datas[i].errorBufFunc = &errorBufFunc;
+		datas[i].checkpointGate = checkpoint != nullptr ? &checkpoint->gate : nullptr;
 #ifdef SECOND_RUN
 		datas[i].firstRunBetaSums = firstRunBetaSums;
 #endif
 	}
 
-	PThreadBundle threads = spreadThreads(8, CPUAffinityType::NUMA_DOMAIN, datas, resultprocessingPThread);
+	PThreadBundle threads = spreadThreads(numaNodeCount, CPUAffinityType::NUMA_DOMAIN, datas.get(), resultprocessingPThread);
+	std::unique_ptr<CheckpointTimer> checkpointTimer;
+	if(checkpoint != nullptr) {
+		size_t checkpointedResultCount = 0;
+		checkpointTimer = std::make_unique<CheckpointTimer>([&, checkpointedResultCount]() mutable {
+			checkpoint->gate.pause();
+			// With the gate paused nothing new is sent to the validators. A saved top is never processed again, so it must not miss its validation, nor hide an error found by it
+			for(int i = 0; i < context.numaSliceCount; i++) {
+				context.numaQueues[i]->waitForValidators();
+			}
+			size_t finishedResultCount = finalResultPtr.load() - result.results.data();
+			checkpoint->addToCheckpoint(result.results.data() + checkpointedResultCount, finishedResultCount - checkpointedResultCount, typedValidationBuffers.get(), numaNodeCount);
+			checkpointedResultCount = finishedResultCount;
+			checkpoint->gate.resume();
+			checkpoint->writeToFile();
+		});
+	}
 	threads.join();
+	checkpointTimer.reset();
 
-	for(size_t i = 0; i < NUMA_SLICE_COUNT; i++) {
+	for(int i = 0; i < context.numaSliceCount; i++) {
 		context.numaQueues[i]->validationQueue.close();
 	}
 
 	std::cout << "\033[32m[Result Processor] Result processor finished.\033[39m\n" << std::flush;
 
-	for(size_t i = 0; i < VALIDATION_BUFFER_SIZE(Variables); i++) {
-		for(int otherNode = 1; otherNode < 8; otherNode++) {
-			datas[0].validationBuffer[i].dualBetaSum += datas[otherNode].validationBuffer[i].dualBetaSum;
-		}
-	}
+	addValidationBuffers(typedValidationBuffers[0], typedValidationBuffers.get() + 1, numaNodeCount - 1, VALIDATION_BUFFER_SIZE(Variables), false);
+	std::cout << "\033[32m[Result Processor] Merged the validation buffers of " + std::to_string(numaNodeCount) + " NUMA nodes.\033[39m\n" << std::flush;
 
-	for(int i = 0; i < 2; i++) {
-		numa_free(numaClassInfos[i], classInfoBufferSize);
-	}
-	for(int otherNode = 1; otherNode < 8; otherNode++) {
+	for(int otherNode = 1; otherNode < numaNodeCount; otherNode++) {
 		numa_free(validationBuffers[otherNode], validationBufferSize);
 	}
 
@@ -29,6 +29,14 @@ constexpr size_t VALIDATION_BUFFER_SIZE(unsigned int Variables) {
 BetaSum produceBetaTerm(ClassInfo info, uint64_t pcoeffSum, uint64_t pcoeffCount);
 BetaSum produceBetaTerm(ClassInfo info, ProcessedPCoeffSum processedPCoeff);
 
+/*
+	target += the sum of all sources, optionally zeroing the sources. 
+	The range is cut in one slice per NUMA node, and the physical cores of each node add up their slice across all buffers in a single pass. 
+	A pairwise tree would pass over the data log2(nodes) times, this way every buffer is read once and the target written once. 
+	Stores are non-temporal, the buffers are too big to be worth caching. 
+*/
+void addValidationBuffers(ValidationData* target, ValidationData* const* sources, int sourceCount, size_t bufferSize, bool clearSources);
+
 ResultProcessorOutput NUMAResultProcessor(
 	unsigned int Variables,
 	PCoeffProcessingContext& context,
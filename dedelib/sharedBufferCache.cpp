@@ -0,0 +1,356 @@
+#include "sharedBufferCache.h"
+
+#include "parallelFileLoader.h"
+#include "topology.h"
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/vfs.h>
+
+#ifdef USE_NUMA
+#include <numa.h>
+#endif
+
+std::string SHARED_BUFFER_CACHE_DIR = "";
+
+constexpr uint64_t SEGMENT_MAGIC = 0x6465646553484D31; // "dedeSHM1"
+constexpr uint32_t SEGMENT_LOADING = 0;
+constexpr uint32_t SEGMENT_READY = 1;
+constexpr long HUGETLBFS_MAGIC_NUMBER = 0x958458f6;
+constexpr size_t CHECKSUM_SAMPLE_SIZE = size_t(1) << 20;
+const char SEGMENT_PREFIX[] = "dedelib-";
+
+// Lives in the first page of the segment, the data starts at the next page
+struct SegmentHeader {
+	uint64_t magic;
+	uint32_t state;
+	uint32_t padding;
+	uint64_t dataOffset;
+	uint64_t fileSize;
+	uint64_t bufferSize;
+	char key[2048];
+};
+
+struct Attachment {
+	void* mapping;
+	size_t mappingSize;
+	int fd; // Holds the shared flock
+};
+static std::mutex attachmentsMutex;
+static std::map<const void*, Attachment> attachments;
+
+static uint64_t fnv1a(const void* data, size_t size, uint64_t hash) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325;
+
+static std::string toHex(uint64_t value) {
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+	return buf;
+}
+
+// Returns false if the file can't be read
+static bool sampleChecksum(const std::string& fileName, size_t fileSize, uint64_t& checksum) {
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd == -1) return false;
+	std::vector<char> sample(std::min(fileSize, CHECKSUM_SAMPLE_SIZE));
+	bool success = pread(fd, sample.data(), sample.size(), 0) == ssize_t(sample.size());
+	checksum = fnv1a(sample.data(), sample.size(), FNV_OFFSET_BASIS);
+	if(fileSize > CHECKSUM_SAMPLE_SIZE) {
+		success = success && pread(fd, sample.data(), sample.size(), fileSize - sample.size()) == ssize_t(sample.size());
+		checksum = fnv1a(sample.data(), sample.size(), checksum);
+	}
+	close(fd);
+	return success;
+}
+
+// The key only depends on the file, not on how much of it the caller reads. Returns an empty key if the file can't be read
+static std::string makeSegmentKey(const std::string& fileName, int socket, size_t& wholeFileSize) {
+	struct stat st;
+	if(stat(fileName.c_str(), &st) != 0) return "";
+	wholeFileSize = st.st_size;
+	uint64_t checksum;
+	if(!sampleChecksum(fileName, wholeFileSize, checksum)) return "";
+	char* absolutePath = realpath(fileName.c_str(), nullptr);
+	std::string key = std::string(absolutePath) + " size=" + std::to_string(wholeFileSize) + " socket=" + std::to_string(socket) + " mtime=" + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec)
+		+ " checksum=" + toHex(checksum);
+	free(absolutePath);
+	return key;
+}
+
+static std::string getSegmentPath(const std::string& fileName, const std::string& key, int socket) {
+	std::string baseName = fileName.substr(fileName.find_last_of('/') + 1);
+	std::string socketName = socket < 0 ? "all" : "s" + std::to_string(socket);
+	return SHARED_BUFFER_CACHE_DIR + "/" + SEGMENT_PREFIX + baseName + "-" + socketName + "-" + toHex(fnv1a(key.data(), key.size(), FNV_OFFSET_BASIS));
+}
+
+static size_t getSegmentPageSize(const std::string& dir) {
+	struct statfs fs;
+	if(statfs(dir.c_str(), &fs) == 0 && static_cast<long>(fs.f_type) == HUGETLBFS_MAGIC_NUMBER) return fs.f_bsize;
+	return sysconf(_SC_PAGESIZE);
+}
+
+static size_t alignUp(size_t value, size_t align) {
+	return (value + align - 1) / align * align;
+}
+
+static void placeOnSocket(void* mapping, size_t size, int socket) {
+#ifdef USE_NUMA
+	// For shared memory, the policy is stored on the segment itself, so the pages fallocate creates are placed by it
+	const CPUTopology& topology = getTopology();
+	std::string nodeString = socket < 0 ? "all" : topology.getNUMANodeString(socket % topology.getSocketCount());
+	struct bitmask* nodeMask = numa_parse_nodestring(nodeString.empty() ? "all" : nodeString.c_str());
+	numa_interleave_memory(mapping, size, nodeMask);
+	numa_free_nodemask(nodeMask);
+#else
+	(void) mapping; (void) size; (void) socket;
+#endif
+}
+
+static const void* registerAttachment(void* mapping, size_t mappingSize, int fd) {
+	const SegmentHeader* header = static_cast<const SegmentHeader*>(mapping);
+	const void* data = static_cast<const char*>(mapping) + header->dataOffset;
+	std::lock_guard<std::mutex> lock(attachmentsMutex);
+	attachments.emplace(data, Attachment{mapping, mappingSize, fd});
+	return data;
+}
+
+enum class CreateResult {CREATED, EXISTS, FAILED};
+
+// Creates the segment under a temporary name, and only links it in place once it is locked, so no attacher can see it unlocked and half-made
+static CreateResult tryCreateSegment(const std::string& fileName, const std::string& segmentPath, const std::string& key, size_t fileSize, size_t bufferSize, int socket, const void*& result) {
+	std::string tmpPath = segmentPath + ".tmp" + std::to_string(getpid());
+	int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if(fd == -1) {
+		std::cerr << "\033[31m[SharedBufferCache] Could not create " << tmpPath << ": " << strerror(errno) << "\033[39m\n" << std::flush;
+		return CreateResult::FAILED;
+	}
+	flock(fd, LOCK_EX);
+	if(link(tmpPath.c_str(), segmentPath.c_str()) != 0) {
+		int err = errno;
+		unlink(tmpPath.c_str());
+		close(fd);
+		if(err == EEXIST) return CreateResult::EXISTS;
+		std::cerr << "\033[31m[SharedBufferCache] Could not create " << segmentPath << ": " << strerror(err) << "\033[39m\n" << std::flush;
+		return CreateResult::FAILED;
+	}
+	unlink(tmpPath.c_str());
+
+	size_t pageSize = getSegmentPageSize(SHARED_BUFFER_CACHE_DIR);
+	size_t dataOffset = alignUp(sizeof(SegmentHeader), pageSize);
+	size_t mappingSize = alignUp(dataOffset + bufferSize, pageSize);
+	void* mapping = MAP_FAILED;
+	// ftruncate only sizes the file, so it can be mapped and the NUMA policy set on the mapping before any page exists.
+	// posix_fallocate then creates the pages under that policy, and reserves them: a full tmpfs fails here and not with a SIGBUS while loading
+	if(ftruncate(fd, mappingSize) == 0) {
+		mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	int err = errno;
+	if(mapping != MAP_FAILED) {
+		placeOnSocket(mapping, mappingSize, socket);
+		err = posix_fallocate(fd, 0, mappingSize);
+	}
+	if(mapping == MAP_FAILED || err != 0) {
+		std::cerr << "\033[31m[SharedBufferCache] Could not allocate " << std::to_string(mappingSize >> 20) << "MB for " << segmentPath << ": " << strerror(err) << ", loading privately\033[39m\n" << std::flush;
+		if(mapping != MAP_FAILED) munmap(mapping, mappingSize);
+		unlink(segmentPath.c_str());
+		close(fd);
+		return CreateResult::FAILED;
+	}
+
+	SegmentHeader* header = static_cast<SegmentHeader*>(mapping);
+	header->magic = SEGMENT_MAGIC;
+	header->state = SEGMENT_LOADING;
+	header->dataOffset = dataOffset;
+	header->fileSize = fileSize;
+	header->bufferSize = bufferSize;
+	strncpy(header->key, key.c_str(), sizeof(header->key) - 1);
+	void* data = static_cast<char*>(mapping) + dataOffset;
+	loadFileIntoBuffers(fileName, fileSize, &data, 1); // The bytes past fileSize are already zero
+	__atomic_store_n(&header->state, SEGMENT_READY, __ATOMIC_RELEASE);
+
+	mprotect(mapping, mappingSize, PROT_READ);
+	flock(fd, LOCK_SH);
+	std::cout << "\033[36m[SharedBufferCache] Loaded " + segmentPath + " (" + std::to_string(mappingSize >> 20) + "MB)\033[39m\n" << std::flush;
+	result = registerAttachment(mapping, mappingSize, fd);
+	return CreateResult::CREATED;
+}
+
+enum class AttachResult {ATTACHED, MISSING, ABANDONED, MISMATCH};
+
+static AttachResult tryAttachSegment(const std::string& segmentPath, const std::string& key, size_t bufferSize, const void*& result) {
+	int fd = open(segmentPath.c_str(), O_RDONLY);
+	if(fd == -1) return AttachResult::MISSING;
+	flock(fd, LOCK_SH); // Waits for a loading process to finish
+	struct stat st;
+	fstat(fd, &st);
+	if(size_t(st.st_size) < sizeof(SegmentHeader)) {
+		close(fd);
+		return AttachResult::ABANDONED;
+	}
+	void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(mapping == MAP_FAILED) {
+		close(fd);
+		return AttachResult::MISMATCH;
+	}
+	const SegmentHeader* header = static_cast<const SegmentHeader*>(mapping);
+	AttachResult status = AttachResult::ATTACHED;
+	if(__atomic_load_n(&header->state, __ATOMIC_ACQUIRE) != SEGMENT_READY) {
+		status = AttachResult::ABANDONED; // We hold the lock, so the loading process is gone
+	} else if(header->magic != SEGMENT_MAGIC || header->bufferSize < bufferSize || key != header->key) {
+		status = AttachResult::MISMATCH;
+	}
+	if(status != AttachResult::ATTACHED) {
+		munmap(mapping, st.st_size);
+		close(fd);
+		return status;
+	}
+	result = registerAttachment(mapping, st.st_size, fd);
+	return AttachResult::ATTACHED;
+}
+
+// Only removes the segment if it still is the abandoned one, another process may already have replaced it
+static void removeAbandonedSegment(const std::string& segmentPath) {
+	int fd = open(segmentPath.c_str(), O_RDONLY);
+	if(fd == -1) return;
+	if(flock(fd, LOCK_EX | LOCK_NB) == 0) {
+		struct stat opened, current;
+		fstat(fd, &opened);
+		SegmentHeader readHeader;
+		memset(&readHeader, 0, sizeof(readHeader));
+		bool stillAbandoned = pread(fd, &readHeader, sizeof(readHeader), 0) != ssize_t(sizeof(readHeader)) || readHeader.state != SEGMENT_READY;
+		if(stillAbandoned && stat(segmentPath.c_str(), &current) == 0 && current.st_ino == opened.st_ino) {
+			std::cerr << "\033[31m[SharedBufferCache] Removing " << segmentPath << ", its loading process died\033[39m\n" << std::flush;
+			unlink(segmentPath.c_str());
+		}
+	}
+	close(fd);
+}
+
+const void* attachSharedBuffer(const std::string& fileName, size_t fileSize, size_t bufferSize, int socket) {
+	if(SHARED_BUFFER_CACHE_DIR.empty()) return nullptr;
+	size_t wholeFileSize;
+	std::string key = makeSegmentKey(fileName, socket, wholeFileSize);
+	if(key.empty() || wholeFileSize < fileSize) return nullptr; // Let the normal loader report the missing file
+	// The segment holds the whole file, so callers reading a different part of it share the same segment
+	size_t segmentBufferSize = std::max(wholeFileSize, bufferSize);
+	std::string segmentPath = getSegmentPath(fileName, key, socket);
+
+	for(int attempt = 0; attempt < 3; attempt++) {
+		const void* result = nullptr;
+		switch(tryAttachSegment(segmentPath, key, bufferSize, result)) {
+			case AttachResult::ATTACHED:
+				std::cout << "\033[36m[SharedBufferCache] Attached " + segmentPath + "\033[39m\n" << std::flush;
+				return result;
+			case AttachResult::MISMATCH:
+				std::cerr << "\033[31m[SharedBufferCache] " << segmentPath << " holds a different buffer, loading privately\033[39m\n" << std::flush;
+				return nullptr;
+			case AttachResult::ABANDONED:
+				removeAbandonedSegment(segmentPath);
+				break;
+			case AttachResult::MISSING:
+				break;
+		}
+		switch(tryCreateSegment(fileName, segmentPath, key, wholeFileSize, segmentBufferSize, socket, result)) {
+			case CreateResult::CREATED: return result;
+			case CreateResult::FAILED: return nullptr;
+			case CreateResult::EXISTS: break; // Another process was first, attach to its segment
+		}
+	}
+	return nullptr;
+}
+
+bool attachSharedSocketBuffers(const std::string& fileName, size_t fileSize, size_t bufferSize, const void** buffers, int socketCount) {
+	for(int socket = 0; socket < socketCount; socket++) {
+		buffers[socket] = attachSharedBuffer(fileName, fileSize, bufferSize, socket);
+		if(buffers[socket] == nullptr) {
+			for(int i = 0; i < socket; i++) detachSharedBuffer(buffers[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool detachSharedBuffer(const void* buffer) {
+	Attachment attachment;
+	{
+		std::lock_guard<std::mutex> lock(attachmentsMutex);
+		auto found = attachments.find(buffer);
+		if(found == attachments.end()) return false;
+		attachment = found->second;
+		attachments.erase(found);
+	}
+	munmap(attachment.mapping, attachment.mappingSize);
+	close(attachment.fd); // Releases the shared lock
+	return true;
+}
+
+static std::vector<std::string> getSegmentNames(const std::string& cacheDir) {
+	std::vector<std::string> names;
+	DIR* dir = opendir(cacheDir.c_str());
+	if(dir == nullptr) {
+		std::cerr << "Could not open shared buffer cache " << cacheDir << ": " << strerror(errno) << std::endl;
+		return names;
+	}
+	while(struct dirent* entry = readdir(dir)) {
+		if(strncmp(entry->d_name, SEGMENT_PREFIX, sizeof(SEGMENT_PREFIX) - 1) == 0) names.emplace_back(entry->d_name);
+	}
+	closedir(dir);
+	return names;
+}
+
+void listSharedBufferCache(const std::string& cacheDir) {
+	std::vector<std::string> names = getSegmentNames(cacheDir);
+	std::cout << names.size() << " segments in " << cacheDir << std::endl;
+	for(const std::string& name : names) {
+		std::string path = cacheDir + "/" + name;
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd == -1) continue;
+		struct stat st;
+		fstat(fd, &st);
+		SegmentHeader header;
+		memset(&header, 0, sizeof(header));
+		ssize_t headerRead = pread(fd, &header, sizeof(header), 0);
+		bool inUse = flock(fd, LOCK_EX | LOCK_NB) != 0;
+		close(fd);
+		const char* state = headerRead != ssize_t(sizeof(header)) || header.state != SEGMENT_READY ? "incomplete" : inUse ? "attached" : "idle";
+		std::cout << "  " << name << " " << (st.st_size >> 20) << "MB " << state << "\n    " << header.key << std::endl;
+	}
+}
+
+void clearSharedBufferCache(const std::string& cacheDir) {
+	size_t removed = 0;
+	size_t inUse = 0;
+	for(const std::string& name : getSegmentNames(cacheDir)) {
+		std::string path = cacheDir + "/" + name;
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd == -1) continue;
+		if(flock(fd, LOCK_EX | LOCK_NB) == 0) {
+			unlink(path.c_str());
+			removed++;
+		} else {
+			inUse++;
+		}
+		close(fd);
+	}
+	std::cout << "Removed " << removed << " segments from " << cacheDir << ", " << inUse << " are still attached" << std::endl;
+}
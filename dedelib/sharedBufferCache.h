@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+/*
+	Node-wide cache of the big read-only buffers (MBFs, ClassInfos, links), shared between production processes.
+	The first process that needs a file loads it into a named segment in SHARED_BUFFER_CACHE_DIR, later processes on the node
+	map the same segment read-only instead of loading and holding their own copy.
+
+	SHARED_BUFFER_CACHE_DIR is a tmpfs (/dev/shm) or a hugetlbfs mount (e.g. /dev/hugepages, segments then use its huge pages).
+	Segments are keyed by the file's path, size, modification time and a checksum over its first and last MB,
+	so a regenerated file gets a new segment instead of stale data. There is one segment per socket for the per-socket copies.
+	A segment holds the whole file, whatever part of it the caller asked for, so every reader of the file shares it.
+	Only the files that are opted in are cached: the MBFs, ClassInfos and links, see readSharedFlatBufferNoMMAP.
+	Segments outlive the processes, listSharedBufferCache and clearSharedBufferCache manage them.
+
+	A process holds a shared flock on every segment it has attached. The loading process holds an exclusive one while loading,
+	so attaching processes wait for it to finish, and a segment left behind by a process that died while loading is detected and rebuilt.
+*/
+
+// Empty disables the cache. Set by configure() from --sharedBufferCache <dir>
+extern std::string SHARED_BUFFER_CACHE_DIR;
+
+// Maps the shared copy of fileName for the socket, socket -1 for one interleaved over all sockets.
+// The first fileSize bytes are the file's, bufferSize >= fileSize, the bytes past the end of the file are zero. The mapping is read-only.
+// Returns nullptr if the cache is disabled, or the segment could not be created or was made by a caller that needed a smaller buffer.
+// The caller then loads the file privately
+const void* attachSharedBuffer(const std::string& fileName, size_t fileSize, size_t bufferSize, int socket);
+// Fills buffers[socket] for every socket < socketCount. Returns false with nothing attached if any segment couldn't be attached
+bool attachSharedSocketBuffers(const std::string& fileName, size_t fileSize, size_t bufferSize, const void** buffers, int socketCount);
+// Returns false if buffer wasn't attached with attachSharedBuffer
+bool detachSharedBuffer(const void* buffer);
+
+void listSharedBufferCache(const std::string& cacheDir);
+// Removes the segments no process has attached
+void clearSharedBufferCache(const std::string& cacheDir);
@@ -7,6 +7,10 @@
 #include "threadPool.h"
 #include "resultCollection.h"
 #include <pthread.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 SingleTopPThreadData::SingleTopPThreadData(unsigned int Variables) : Variables(Variables) {
 	size_t mbfSize = (1 << (Variables > 3 ? Variables-3 : 0)); // sizeof(Monotonic<Variables>)
@@ -24,7 +28,7 @@ SingleTopPThreadData::SingleTopPThreadData(unsigned int Variables) : Variables(V
 	classInfos = static_cast<const ClassInfo*>(numaClassInfos);
 }
 
-void SingleTopPThreadData::run(NodeIndex topIdx, void*(*func)(void*)) {
+void SingleTopPThreadData::run(NodeIndex topIdx, bool skipValidationSum, void*(*func)(void*)) {
 	this->topIdx = topIdx;
 
 	void* flatNodes = mmapFlatVoidBuffer(FileName::flatNodes(Variables), mbfCounts[Variables] * sizeof(FlatNode));
@@ -33,7 +37,15 @@ void SingleTopPThreadData::run(NodeIndex topIdx, void*(*func)(void*)) {
 
 	std::cout << "Top dual " + std::to_string(topDual) + "\n" << std::endl;
 
-	curIndex.store(0);
+	NodeIndex totalBottoms = (skipValidationSum && topIdx > topDual) ? topDual : topIdx + 1;
+	size_t threadCount = std::thread::hardware_concurrency(); // Same as allCoresSpread
+	this->bottomRanges = WorkStealingRanges(totalBottoms, threadCount);
+	this->threadResults = std::unique_ptr<SingleTopThreadResult[]>(new SingleTopThreadResult[threadCount]);
+	for(size_t t = 0; t < threadCount; t++) {
+		threadResults[t].processedBottoms.store(0);
+	}
+	this->nextThreadIdx.store(0);
+
 	this->result.resultSum.betaSum = 0;
 	this->result.resultSum.countedIntervalSizeDown = 0;
 	this->result.dualSum.betaSum = 0;
@@ -41,8 +53,34 @@ void SingleTopPThreadData::run(NodeIndex topIdx, void*(*func)(void*)) {
 	this->result.validationSum.betaSum = 0;
 	this->result.validationSum.countedIntervalSizeDown = 0;
 
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::mutex finishedMutex;
+	std::condition_variable finishedCV;
+	bool finished = false;
+	std::thread progressReporter([&]() {
+		std::unique_lock<std::mutex> lock(finishedMutex);
+		while(!finishedCV.wait_for(lock, std::chrono::seconds(10), [&]() {return finished;})) {
+			uint64_t processed = 0;
+			for(size_t t = 0; t < threadCount; t++) {
+				processed += threadResults[t].processedBottoms.load(std::memory_order_relaxed);
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+			std::cout << std::to_string(processed) + " / " + std::to_string(totalBottoms) + " bottoms after " + std::to_string(int(seconds)) + "s\n" << std::flush;
+		}
+	});
+
 	PThreadBundle allThreads = allCoresSpread(this, func);
 	allThreads.join();
+	{std::lock_guard<std::mutex> lock(finishedMutex);
+		finished = true;
+	}
+	finishedCV.notify_all();
+	progressReporter.join();
+
+	for(size_t t = 0; t < threadCount; t++) {
+		this->result.resultSum += threadResults[t].resultSum;
+		this->result.validationSum += threadResults[t].validationSum;
+	}
 }
 
 SingleTopPThreadData::~SingleTopPThreadData() {
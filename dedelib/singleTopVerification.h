@@ -3,9 +3,10 @@
 #include "pcoeffClasses.h"
 #include "flatPCoeff.h"
 #include "u192.h"
+#include "threadPool.h"
 
 #include <atomic>
-#include <mutex>
+#include <memory>
 #include <iostream>
 
 
@@ -15,58 +16,59 @@ struct SingleTopResult {
 	BetaSum validationSum;
 };
 
+// Each thread sums its own BetaSums, they're only added up after the join
+struct alignas(64) SingleTopThreadResult {
+	std::atomic<uint64_t> processedBottoms; // Only for the progress report
+	BetaSum resultSum;
+	BetaSum validationSum;
+};
+
 struct SingleTopPThreadData {
-	alignas(64) std::atomic<NodeIndex> curIndex;
 	NodeIndex topIdx;
 	NodeIndex topDual;
 	unsigned int Variables;
 	const void* mbfLUT;
 	const ClassInfo* classInfos;
+
+	// The bottoms are split with work stealing, a suspicious top may have a very uneven mix of easy and hard bottoms
+	WorkStealingRanges bottomRanges;
+	std::unique_ptr<SingleTopThreadResult[]> threadResults;
+	alignas(64) std::atomic<size_t> nextThreadIdx;
 	
-	alignas(64) std::mutex resultMutex;
 	SingleTopResult result;
 	
 	SingleTopPThreadData(unsigned int Variables);
-	void run(NodeIndex topIdx, void*(*func)(void*));
+	// Bottoms [0, topIdx], or up to the dual if skipValidationSum
+	void run(NodeIndex topIdx, bool skipValidationSum, void*(*func)(void*));
 	~SingleTopPThreadData();
 };
 
-template<unsigned int Variables, bool SkipValidationSum = true>
+template<unsigned int Variables>
 void* computeSingleTopWithAllCoresPThread(void* voidData) {
 	constexpr NodeIndex BLOCK_SIZE = (Variables <= 6) ? 16 : 512;
-	constexpr NodeIndex REPORT_EVERY = (Variables <= 6) ? 1024 : 1024*1024;
 
 	SingleTopPThreadData* data = (SingleTopPThreadData*) voidData;
+	size_t threadIdx = data->nextThreadIdx.fetch_add(1);
+	SingleTopThreadResult& threadResult = data->threadResults[threadIdx];
 
 	const Monotonic<Variables>* mbfLUT = (const Monotonic<Variables>*) data->mbfLUT;
 	const ClassInfo* classInfos = data->classInfos;
 	NodeIndex topIndex = data->topIdx;
 	NodeIndex topDual = data->topDual;
-	NodeIndex endAt = topIndex;
-	if(SkipValidationSum && endAt > topDual) endAt = topDual - 1;
-
-	std::atomic<NodeIndex>& curIndex = data->curIndex;
 	
 	Monotonic<Variables> top = mbfLUT[topIndex];
 
 	BetaSum resultSum{0, 0};
 	BetaSum validationSum{0, 0};
+	// The batched kernel needs all permutations of a bottom up front
 	BooleanFunction<Variables> graphBuf[factorial(Variables)];
-	while(true) {
-		NodeIndex claimedSet = curIndex.fetch_add(BLOCK_SIZE);
-		if(claimedSet % REPORT_EVERY == 0) {
-			std::cout << std::to_string(claimedSet) + "\n" << std::flush;
-		}
-		if(claimedSet > endAt) break;
-		NodeIndex claimedSetEnd = claimedSet + BLOCK_SIZE;
-		if(claimedSetEnd > endAt+1) {
-			claimedSetEnd = endAt+1;
-		}
-		for(NodeIndex botIdx = claimedSet; botIdx < claimedSetEnd; botIdx++) {
+	NodeIndex blockStart;
+	NodeIndex blockEnd;
+	while(data->bottomRanges.claimBlock(threadIdx, BLOCK_SIZE, blockStart, blockEnd)) {
+		for(NodeIndex botIdx = blockStart; botIdx < blockEnd; botIdx++) {
 			if(botIdx == topDual) continue;
 
 			bool isValidation = botIdx > topDual;
-			// if(SkipValidationSum && isValidation) continue; // Not needed, should be covered more efficiently by endAt, but this is the correct logic
 			Monotonic<Variables> bot = mbfLUT[botIdx];
 			ProcessedPCoeffSum result = processPCoeffSum(top, bot, graphBuf);
 			ClassInfo botInfo = classInfos[botIdx];
@@ -78,12 +80,11 @@ void* computeSingleTopWithAllCoresPThread(void* voidData) {
 				resultSum += subSum;
 			}
 		}
+		threadResult.processedBottoms.fetch_add(blockEnd - blockStart, std::memory_order_relaxed);
 	}
 
-	data->resultMutex.lock();
-	data->result.resultSum += resultSum;
-	data->result.validationSum += validationSum;
-	data->resultMutex.unlock();
+	threadResult.resultSum = resultSum;
+	threadResult.validationSum = validationSum;
 
 	pthread_exit(nullptr);
 	return nullptr;
@@ -95,7 +96,7 @@ SingleTopResult computeSingleTopWithAllCores(NodeIndex topIdx) {
 
 	SingleTopPThreadData data(Variables);
 	if(topIdx != mbfCounts[Variables]-1) {
-		data.run(topIdx, computeSingleTopWithAllCoresPThread<Variables, SkipValidationSum>);
+		data.run(topIdx, SkipValidationSum, computeSingleTopWithAllCoresPThread<Variables>);
 		ClassInfo dualInfo = data.classInfos[data.topDual];
 		const Monotonic<Variables>* mbfLUT = (const Monotonic<Variables>*) data.mbfLUT;
 		ProcessedPCoeffSum result = processPCoeffSum(mbfLUT[data.topIdx], mbfLUT[data.topDual]);
@@ -5,7 +5,7 @@ SlabAddrAllocator::SlabAddrAllocator() noexcept : chunksInUse(nullptr) {
 }
 
 SlabAddrAllocator::SlabAddrAllocator(uint64_t slabSize, size_t maxChunks) : 
-	slabSize(slabSize), nextReserveAddr(0), chunksInUse(new uint64_t[maxChunks]), chunksInUseEnd(chunksInUse), maxChunks(maxChunks) {}
+	slabSize(slabSize), nextReserveAddr(0), wrapped(false), chunksInUse(new uint64_t[maxChunks]), chunksInUseEnd(chunksInUse), maxChunks(maxChunks) {}
 
 SlabAddrAllocator::~SlabAddrAllocator() {
 	delete[] chunksInUse;
@@ -14,6 +14,7 @@ SlabAddrAllocator::~SlabAddrAllocator() {
 SlabAddrAllocator::SlabAddrAllocator(SlabAddrAllocator&& other) noexcept :
 	slabSize(other.slabSize), 
 	nextReserveAddr(other.nextReserveAddr), 
+	wrapped(other.wrapped), 
 	chunksInUse(other.chunksInUse),
 	chunksInUseEnd(other.chunksInUseEnd),
 	maxChunks(other.maxChunks) {
@@ -22,6 +23,7 @@ SlabAddrAllocator::SlabAddrAllocator(SlabAddrAllocator&& other) noexcept :
 }
 SlabAddrAllocator& SlabAddrAllocator::operator=(SlabAddrAllocator&& other) noexcept {
 	std::swap(this->nextReserveAddr, other.nextReserveAddr);
+	std::swap(this->wrapped, other.wrapped);
 	std::swap(this->chunksInUse, other.chunksInUse);
 	std::swap(this->chunksInUseEnd, other.chunksInUseEnd);
 	std::swap(this->maxChunks, other.maxChunks);
@@ -38,10 +40,15 @@ uint64_t SlabAddrAllocator::alloc(uint64_t allocSize) {
 		chunksInUse[0] = 0;
 		chunksInUseEnd = chunksInUse + 1;
 		nextReserveAddr = allocSize;
+		wrapped = false;
 		return 0;
 	} else {
 		uint64_t constrainingAlloc = chunksInUse[0];
-		if(nextReserveAddr < constrainingAlloc) { // We're in a gap
+		// Once the oldest chunk lies before nextReserveAddr, the chunks from before the wrap have all been freed
+		if(wrapped && constrainingAlloc < nextReserveAddr) {
+			wrapped = false;
+		}
+		if(wrapped) { // We're in a gap
 			uint64_t spaceLeft = constrainingAlloc - nextReserveAddr;
 			if(spaceLeft < allocSize) {
 				return INVALID_ALLOC;
@@ -53,6 +60,7 @@ uint64_t SlabAddrAllocator::alloc(uint64_t allocSize) {
 				// Can't? Try to restart from beginning
 				if(constrainingAlloc >= allocSize) {
 					nextReserveAddr = 0;
+					wrapped = true;
 				} else {
 					return INVALID_ALLOC;
 				}
@@ -85,6 +93,21 @@ void SlabAddrAllocator::shrinkLastAllocation(uint64_t newSize) {
 	nextReserveAddr = newChunkEnd;
 }
 
+bool SlabAddrAllocator::isLastAllocation(uint64_t bufStart) const {
+	return chunksInUseEnd != chunksInUse && chunksInUseEnd[-1] == bufStart;
+}
+
 size_t SlabAddrAllocator::getNumberOfChunksInUse() const {
 	return chunksInUseEnd - chunksInUse;
 }
+
+SlabAddrAllocator::ReservePoint SlabAddrAllocator::getReservePoint() const {
+	return ReservePoint{nextReserveAddr, wrapped};
+}
+
+void SlabAddrAllocator::rollBackTo(const ReservePoint& point, size_t chunkCount) {
+	assert(chunkCount <= getNumberOfChunksInUse());
+	chunksInUseEnd -= chunkCount;
+	nextReserveAddr = point.nextReserveAddr;
+	wrapped = point.wrapped;
+}
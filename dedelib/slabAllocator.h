@@ -14,11 +14,19 @@ public:
 	uint64_t slabSize;
 private:
 	uint64_t nextReserveAddr;
-	// Starts of allocated blocks
+	// Set when nextReserveAddr restarted at the start of the slab while older chunks were still in use further on.
+	// Allocations then go in the gap up to the oldest chunk, even when that gap is exactly full. Cleared once those older chunks are freed
+	bool wrapped;
+	// Starts of allocated blocks, oldest first
 	uint64_t* chunksInUse;
 	uint64_t* chunksInUseEnd;
 	uint64_t maxChunks;
 public:
+	// Where the next allocation would go. Saved before a batch of allocations, so a failed batch can be rolled back
+	struct ReservePoint {
+		uint64_t nextReserveAddr;
+		bool wrapped;
+	};
 
 	SlabAddrAllocator() noexcept;
 	SlabAddrAllocator(uint64_t slabSize, size_t maxChunks);
@@ -32,7 +40,11 @@ public:
 	uint64_t alloc(uint64_t allocSize);
 	void free(uint64_t bufStart);
 	void shrinkLastAllocation(uint64_t newSize);
+	bool isLastAllocation(uint64_t bufStart) const;
 	size_t getNumberOfChunksInUse() const;
+	ReservePoint getReservePoint() const;
+	// Frees the chunkCount newest chunks, which must all have been allocated after point was taken, and restores point
+	void rollBackTo(const ReservePoint& point, size_t chunkCount);
 };
 
 /*
@@ -66,12 +78,21 @@ public:
 		//assert((newSize * sizeof(T)) % Align == 0);
 		addrAllocator.shrinkLastAllocation(newSize);
 	}
+	bool isLastAllocation(const T* allocatedBuf) const {
+		return addrAllocator.isLastAllocation(allocatedBuf - slabStart);
+	}
 	bool owns(const T* allocatedBuf) const {
-		return allocatedBuf - slabStart < addrAllocator.slabSize;
+		return allocatedBuf >= slabStart && size_t(allocatedBuf - slabStart) < addrAllocator.slabSize;
 	}
 	size_t getNumberOfChunksInUse() const {
 		return addrAllocator.getNumberOfChunksInUse();
 	}
+	SlabAddrAllocator::ReservePoint getReservePoint() const {
+		return addrAllocator.getReservePoint();
+	}
+	void rollBackTo(const SlabAddrAllocator::ReservePoint& point, size_t chunkCount) {
+		addrAllocator.rollBackTo(point, chunkCount);
+	}
 };
 
 
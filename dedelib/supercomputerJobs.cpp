@@ -3,6 +3,9 @@
 #include <filesystem>
 #include <random>
 #include <algorithm>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
 
 #include <unistd.h>
 #include <limits.h>
@@ -13,6 +16,10 @@
 #include <fcntl.h>
 
 #include "crossPlatformIntrinsics.h"
+#include "pipelineTelemetry.h"
+#include "jobCheckpoint.h"
+#include "topScheduling.h"
+#include "jobBroker.h"
 
 
 // Utilities for easily working with syscall open
@@ -89,7 +96,7 @@ static std::string computeFileName(const std::string& jobID, const std::string&
 	return result;
 }
 
-static std::string computeFolderPath(std::string computeFolder, const char* folder) {
+std::string computeFolderPath(std::string computeFolder, const char* folder) {
 	if(computeFolder[computeFolder.size() - 1] != '/') computeFolder.append("/");
 	computeFolder.append(folder);
 	computeFolder.append("/");
@@ -246,10 +253,20 @@ static void checkNotExists(const std::string& fileName) {
 	}
 }
 
-void writeJobToFile(unsigned int Variables, const std::string& jobFileName, const std::vector<JobTopInfo>& topVector) {
+// Set in the Variables field of the job header if the predicted work of the job follows it
+constexpr uint32_t JOB_FILE_HAS_PREDICTED_WORK = 0x80000000;
+
+void writeJobToFile(unsigned int Variables, const std::string& jobFileName, const std::vector<JobTopInfo>& topVector, double predictedWork) {
 	std::ofstream jobFile(jobFileName, std::ios::binary);
 
-	serializeU32(Variables, jobFile);
+	if(predictedWork >= 0.0) {
+		uint64_t predictedWorkBits;
+		memcpy(&predictedWorkBits, &predictedWork, sizeof(double));
+		serializeU32(Variables | JOB_FILE_HAS_PREDICTED_WORK, jobFile);
+		serializeU64(predictedWorkBits, jobFile);
+	} else {
+		serializeU32(Variables, jobFile);
+	}
 	serializePODVector(topVector, jobFile);
 }
 
@@ -260,7 +277,73 @@ static void addJobTop(std::vector<JobTopInfo>& jobVector, NodeIndex newTop, cons
 	jobVector.push_back(std::move(newVal));
 }
 
-void initializeComputeProject(unsigned int Variables, std::string computeFolder, size_t numberOfJobs, size_t numberOfJobsToActuallyGenerate) {
+/*
+	Predicted work of every cluster of tops, in TopCostModel units. 
+	Tops measured in timingsCSV are converted back to work units with the secondsPerWork fitted over all measured tops, 
+	so measured and predicted tops can be packed together. 
+*/
+static std::vector<double> predictClusterWork(unsigned int Variables, const std::vector<std::vector<JobTopInfo>>& clusters, const std::string& timingsCSV) {
+	// Last measurement of every top in timingsCSV. Small next to the project, so the work of the project's tops isn't kept per MBF
+	std::unordered_map<NodeIndex, double> measuredSeconds;
+	size_t timingCount = 0;
+	if(!timingsCSV.empty()) {
+		std::vector<std::pair<NodeIndex, double>> timings = readTopTimingsCSV(timingsCSV);
+		timingCount = timings.size();
+		for(const std::pair<NodeIndex, double>& t : timings) {
+			if(t.first >= mbfCounts[Variables]) {
+				std::cerr << "Top " + std::to_string(t.first) + " in " + timingsCSV + " does not exist in D(" + std::to_string(Variables + 2) + ")! Aborting!\n" << std::flush;
+				std::abort();
+			}
+			measuredSeconds[t.first] = t.second;
+		}
+	}
+
+	const ClassInfo* classInfos = readFlatBuffer<ClassInfo>(FileName::flatClassInfo(Variables), mbfCounts[Variables]);
+	TopCostModel model;
+
+	// Indexed like the tops of the clusters one after another
+	std::vector<double> topWork;
+	size_t topCount = 0;
+	for(const std::vector<JobTopInfo>& cluster : clusters) topCount += cluster.size();
+	topWork.reserve(topCount);
+	std::vector<std::pair<double, double>> workAndSeconds; // Only tops of this project, tops outside it have no predicted work to fit against
+	for(const std::vector<JobTopInfo>& cluster : clusters) {
+		for(const JobTopInfo& top : cluster) {
+			double work = model.predictWork(Variables, top, classInfos);
+			topWork.push_back(work);
+			auto found = measuredSeconds.find(top.top);
+			if(found != measuredSeconds.end()) workAndSeconds.emplace_back(work, found->second);
+		}
+	}
+	freeFlatBuffer(classInfos, mbfCounts[Variables]);
+
+	if(!timingsCSV.empty()) {
+		double secondsPerWork = fitSecondsPerWork(workAndSeconds);
+		if(secondsPerWork > 0.0) {
+			size_t topI = 0;
+			for(const std::vector<JobTopInfo>& cluster : clusters) {
+				for(const JobTopInfo& top : cluster) {
+					auto found = measuredSeconds.find(top.top);
+					if(found != measuredSeconds.end()) topWork[topI] = found->second / secondsPerWork;
+					topI++;
+				}
+			}
+		}
+		std::cout << "Using " << workAndSeconds.size() << " of " << timingCount << " measured top timings from " << timingsCSV << " (" << secondsPerWork << "s per unit of predicted work)" << std::endl;
+	}
+
+	std::vector<double> clusterWork;
+	clusterWork.reserve(clusters.size());
+	size_t topI = 0;
+	for(const std::vector<JobTopInfo>& cluster : clusters) {
+		double work = 0.0;
+		for(size_t i = 0; i < cluster.size(); i++) work += topWork[topI++];
+		clusterWork.push_back(work);
+	}
+	return clusterWork;
+}
+
+void initializeComputeProject(unsigned int Variables, std::string computeFolder, size_t numberOfJobs, size_t numberOfJobsToActuallyGenerate, JobSplitting splitting, const std::string& timingsCSV) {
 	if(numberOfJobsToActuallyGenerate != numberOfJobs) {
 		std::cerr << "WARNING initializeComputeProject: GENERATING ONLY PARTIAL JOBS:" << numberOfJobsToActuallyGenerate << '/' << numberOfJobs << " -> INVALID COMPUTE PROJECT!\n" << std::flush;
 	}
@@ -274,7 +357,7 @@ void initializeComputeProject(unsigned int Variables, std::string computeFolder,
 		std::abort();
 	}
 
-	std::cout << "Generating directories: " << computeFolder << "/\n    jobs/\n    working/\n    critical/\n    finished/\n    results/\n    logs/\n    validation/\n    errors/\n    wrong_finished/\n    wrong_results/\n\n" << std::flush;
+	std::cout << "Generating directories: " << computeFolder << "/\n    jobs/\n    working/\n    critical/\n    finished/\n    results/\n    logs/\n    validation/\n    errors/\n    wrong_finished/\n    wrong_results/\n    checkpoints/\n\n" << std::flush;
 	std::filesystem::create_directory(computeFolder);
 	std::filesystem::create_directory(computeFolderPath(computeFolder, "jobs"));
 	std::filesystem::create_directory(computeFolderPath(computeFolder, "working"));
@@ -286,6 +369,7 @@ void initializeComputeProject(unsigned int Variables, std::string computeFolder,
 	std::filesystem::create_directory(computeFolderPath(computeFolder, "errors"));
 	std::filesystem::create_directory(computeFolderPath(computeFolder, "wrong_finished"));
 	std::filesystem::create_directory(computeFolderPath(computeFolder, "wrong_results"));
+	std::filesystem::create_directory(computeFolderPath(computeFolder, "checkpoints"));
 
 	size_t numberOfMBFsToProcess = mbfCounts[Variables];
 	size_t numberOfCompleteBatches = numberOfMBFsToProcess / TOP_CLUSTER_SIZE;
@@ -304,29 +388,65 @@ void initializeComputeProject(unsigned int Variables, std::string computeFolder,
 
 	const FlatNode* flatNodes = readFlatBuffer<FlatNode>(FileName::flatNodes(Variables), mbfCounts[Variables]);
 
-	size_t currentBatchIndex = 0;
-	for(size_t jobI = 0; jobI < numberOfJobsToActuallyGenerate; jobI++) {
-		size_t jobsLeft = numberOfJobs - jobI;
-		size_t topBatchesLeft = numberOfCompleteBatches - currentBatchIndex;
-		size_t numberOfBatchesInThisJob = topBatchesLeft / jobsLeft;
+	if(splitting == JobSplitting::EQUAL_TOP_COUNT) {
+		size_t currentBatchIndex = 0;
+		for(size_t jobI = 0; jobI < numberOfJobsToActuallyGenerate; jobI++) {
+			size_t jobsLeft = numberOfJobs - jobI;
+			size_t topBatchesLeft = numberOfCompleteBatches - currentBatchIndex;
+			size_t numberOfBatchesInThisJob = topBatchesLeft / jobsLeft;
+
+			std::vector<JobTopInfo> topIndices;
+			topIndices.reserve(numberOfBatchesInThisJob * TOP_CLUSTER_SIZE);
+			for(size_t i = 0; i < numberOfBatchesInThisJob; i++) {
+				std::uint32_t curBatchStart = completeBatchIndices[currentBatchIndex++] * TOP_CLUSTER_SIZE;
+				for(size_t j = 0; j < TOP_CLUSTER_SIZE; j++) {
+					addJobTop(topIndices, curBatchStart + j, flatNodes);
+				}
+			}
+			// Add remaining tops to job 0
+			if(jobI == 0) {
+				size_t firstUnbatchedTop = numberOfCompleteBatches * TOP_CLUSTER_SIZE;
+				for(size_t topI = firstUnbatchedTop; topI < numberOfMBFsToProcess; topI++) {
+					addJobTop(topIndices, topI, flatNodes);
+				}
+			}
 
-		std::vector<JobTopInfo> topIndices;
-		topIndices.reserve(numberOfBatchesInThisJob * TOP_CLUSTER_SIZE);
-		for(size_t i = 0; i < numberOfBatchesInThisJob; i++) {
-			std::uint32_t curBatchStart = completeBatchIndices[currentBatchIndex++] * TOP_CLUSTER_SIZE;
+			writeJobToFile(Variables, computeFilePath(computeFolder, "jobs", std::to_string(jobI), ".job"), topIndices);
+		}
+	} else {
+		// Clusters are kept intact and packed whole, the remaining tops form one extra cluster
+		std::vector<std::vector<JobTopInfo>> clusters(numberOfCompleteBatches);
+		for(size_t i = 0; i < numberOfCompleteBatches; i++) {
+			std::uint32_t curBatchStart = completeBatchIndices[i] * TOP_CLUSTER_SIZE;
 			for(size_t j = 0; j < TOP_CLUSTER_SIZE; j++) {
-				addJobTop(topIndices, curBatchStart + j, flatNodes);
+				addJobTop(clusters[i], curBatchStart + j, flatNodes);
+			}
+		}
+		if(numberOfCompleteBatches * TOP_CLUSTER_SIZE != numberOfMBFsToProcess) {
+			std::vector<JobTopInfo>& remainingTops = clusters.emplace_back();
+			for(size_t topI = numberOfCompleteBatches * TOP_CLUSTER_SIZE; topI < numberOfMBFsToProcess; topI++) {
+				addJobTop(remainingTops, topI, flatNodes);
 			}
 		}
-		// Add remaining tops to job 0
-		if(jobI == 0) {
-			size_t firstUnbatchedTop = numberOfCompleteBatches * TOP_CLUSTER_SIZE;
-			for(size_t topI = firstUnbatchedTop; topI < numberOfMBFsToProcess; topI++) {
-				addJobTop(topIndices, topI, flatNodes);
+
+		std::vector<double> clusterWork = predictClusterWork(Variables, clusters, timingsCSV);
+		std::vector<double> jobWork;
+		std::vector<size_t> jobOfCluster = packIntoBinsLPT(clusterWork, numberOfJobs, jobWork);
+
+		std::vector<std::vector<JobTopInfo>> jobTops(numberOfJobsToActuallyGenerate);
+		for(size_t i = 0; i < clusters.size(); i++) {
+			if(jobOfCluster[i] < numberOfJobsToActuallyGenerate) {
+				std::vector<JobTopInfo>& job = jobTops[jobOfCluster[i]];
+				job.insert(job.end(), clusters[i].begin(), clusters[i].end());
 			}
 		}
+		for(size_t jobI = 0; jobI < numberOfJobsToActuallyGenerate; jobI++) {
+			writeJobToFile(Variables, computeFilePath(computeFolder, "jobs", std::to_string(jobI), ".job"), jobTops[jobI], jobWork[jobI]);
+		}
 
-		writeJobToFile(Variables, computeFilePath(computeFolder, "jobs", std::to_string(jobI), ".job"), topIndices);
+		double minWork = *std::min_element(jobWork.begin(), jobWork.end());
+		double maxWork = *std::max_element(jobWork.begin(), jobWork.end());
+		std::cout << "Predicted work per job ranges from " << minWork << " to " << maxWork << " (max/min = " << (minWork != 0.0 ? maxWork / minWork : 0.0) << ")" << std::endl;
 	}
 
 	freeFlatBuffer<FlatNode>(flatNodes, mbfCounts[Variables]);
@@ -338,6 +458,13 @@ static std::vector<JobTopInfo> loadJob(unsigned int Variables, const std::string
 	std::ifstream jobIn(workingFile, std::ios::binary);
 
 	unsigned int fileVariables = deserializeU32(jobIn);
+	if(fileVariables & JOB_FILE_HAS_PREDICTED_WORK) {
+		fileVariables &= ~JOB_FILE_HAS_PREDICTED_WORK;
+		uint64_t predictedWorkBits = deserializeU64(jobIn);
+		double predictedWork;
+		memcpy(&predictedWork, &predictedWorkBits, sizeof(double));
+		std::cout << "Predicted work of job " + workingFile + ": " + std::to_string(predictedWork) + "\n" << std::flush;
+	}
 	if(Variables != fileVariables) {
 		std::cerr << "File for incorrect Dedekind Target! Specified Target: D(" + std::to_string(Variables + 2) + "), target from file: D(" + std::to_string(fileVariables + 2) + ")" << std::endl;
 		std::abort();
@@ -508,33 +635,98 @@ uint64_t readProcessingBufferPairFromFile(const char* fileName, NodeIndex* idxBu
 }
 
 bool processJob(unsigned int Variables, const std::string& computeFolder, const std::string& jobID, const std::string& methodName, void (*processorFunc)(PCoeffProcessingContext&), void*(*validator)(void*)) {
-	std::string computeID = methodName + "_" + getComputeIdentifier();
+	return processJob(Variables, computeFolder, jobID, methodName, [&](const std::function<std::vector<JobTopInfo>()>& topLoader, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc) {
+		return pcoeffPipeline(Variables, topLoader, processorFunc, validator, errorBufFunc);
+	});
+}
 
-	std::string validationFileName = getValidationFilePath(computeFolder, jobID, computeID);
+JobPipeline makeResidentPCoeffPipeline(unsigned int Variables, void (*processorFunc)(PCoeffProcessingContext&), void*(*validator)(void*)) {
+	// Shared by the copies of the JobPipeline, the context is freed with the last one
+	std::shared_ptr<unique_numa_ptr<PCoeffProcessingContext>> context = std::make_shared<unique_numa_ptr<PCoeffProcessingContext>>();
+	return [=](const std::function<std::vector<JobTopInfo>()>& topLoader, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc) {
+		if(context->ptr == nullptr) {
+			*context = createPCoeffProcessingContext(Variables);
+		}
+		return pcoeffPipeline(**context, topLoader, processorFunc, validator, errorBufFunc, runBottomBufferCreator, NUMAResultProcessor);
+	};
+}
+
+std::string getComputeID(const std::string& methodName) {
+	return methodName + "_" + getComputeIdentifier();
+}
+
+static bool reportIfExists(const std::string& fileName) {
+	if(std::filesystem::exists(fileName)) {
+		std::cerr << "File " + fileName + " already exists!\n" << std::flush;
+		return true;
+	}
+	return false;
+}
+
+bool claimJob(const std::string& computeFolder, const std::string& jobID, const std::string& computeID) {
 	std::string jobFile = computeFilePath(computeFolder, "jobs", jobID, ".job");
 	std::string workingFile = computeFilePath(computeFolder, "working", jobID, "_" + computeID + ".job");
+
+	if(reportIfExists(workingFile)
+	|| reportIfExists(computeFilePath(computeFolder, "critical", jobID, "_" + computeID + ".job"))
+	|| reportIfExists(computeFilePath(computeFolder, "finished", jobID, "_" + computeID + ".job"))
+	|| reportIfExists(computeFilePath(computeFolder, "results", jobID, "_" + computeID + ".results"))) {
+		return false;
+	}
+	std::error_code err;
+	std::filesystem::rename(jobFile, workingFile, err);
+	if(err) {
+		std::cerr << "Could not claim job " + jobFile + ": " + err.message() + "\n" << std::flush;
+		return false;
+	}
+	std::cout << "Moved job to working directory: " << jobFile << "=>" << workingFile << std::endl;
+	return true;
+}
+
+bool unclaimJob(const std::string& computeFolder, const std::string& jobID, const std::string& computeID) {
+	std::error_code err;
+	std::filesystem::rename(computeFilePath(computeFolder, "working", jobID, "_" + computeID + ".job"), computeFilePath(computeFolder, "jobs", jobID, ".job"), err);
+	return !err;
+}
+
+bool isJobInCriticalSection(const std::string& computeFolder, const std::string& jobID, const std::string& computeID) {
+	return std::filesystem::exists(computeFilePath(computeFolder, "critical", jobID, "_" + computeID + ".job"));
+}
+
+bool processJob(unsigned int Variables, const std::string& computeFolder, const std::string& jobID, const std::string& methodName, const JobPipeline& pipeline) {
+	std::string computeID = getComputeID(methodName);
+	if(!claimJob(computeFolder, jobID, computeID)) {
+		std::cerr << "Could not claim job " + jobID + "! Aborting!\n" << std::flush;
+		std::abort();
+	}
+	return processClaimedJob(Variables, computeFolder, jobID, computeID, pipeline);
+}
+
+bool processClaimedJob(unsigned int Variables, const std::string& computeFolder, const std::string& jobID, const std::string& computeID, const JobPipeline& pipeline, const std::atomic<bool>* abandonSignal, bool* committed) {
+	if(committed != nullptr) *committed = false;
+	std::string validationFileName = getValidationFilePath(computeFolder, jobID, computeID);
+	std::string workingFile = computeFilePath(computeFolder, "working", jobID, "_" + computeID + ".job");
 	std::string criticalFile = computeFilePath(computeFolder, "critical", jobID, "_" + computeID + ".job");
 	std::string finishedFile = computeFilePath(computeFolder, "finished", jobID, "_" + computeID + ".job");
 	std::string resultsFile = computeFilePath(computeFolder, "results", jobID, "_" + computeID + ".results");
 	std::string wrong_finishedFile = computeFilePath(computeFolder, "wrong_finished", jobID, "_" + computeID + ".job");
 	std::string wrong_resultsFile = computeFilePath(computeFolder, "wrong_results", jobID, "_" + computeID + ".results");
+	// Not tied to the computeID, a job reset by resetUnfinishedJobs may resume on a different node
+	std::string checkpointFile = computeFilePath(computeFolder, "checkpoints", jobID, ".checkpoint");
 
-	checkNotExists(workingFile);
-	checkNotExists(criticalFile);
-	checkNotExists(finishedFile);
-	checkNotExists(resultsFile);
-	/*checkNotExists(wrong_finishedFile);
-	checkNotExists(wrong_resultsFile);*/
-	std::filesystem::rename(jobFile, workingFile); // Throws filesystem::filesystem_error on error
-	std::cout << "Moved job to working directory: " << jobFile << "=>" << workingFile << std::endl;
+	std::filesystem::create_directories(computeFolderPath(computeFolder, "checkpoints")); // For projects created before checkpoints existed
+	JobCheckpoint checkpoint(Variables, checkpointFile);
+	checkpoint.setAbandonSignal(abandonSignal);
+	std::vector<JobTopInfo> remainingTops = checkpoint.removeFinishedTops(loadJob(Variables, workingFile));
 
 	std::cout << "Starting Computation..." << std::endl;
 	
 	std::atomic<bool> noErrorsAtomic;
-	noErrorsAtomic.store(true);
+	noErrorsAtomic.store(!checkpoint.hasFoundErrors());
 	auto errorBufFunc = [&](const OutputBuffer& outBuf, const char* moduleThatFoundError, bool recoverable) {
 		if(!recoverable) {
 			noErrorsAtomic.store(false);
+			checkpoint.markErrorFound();
 		}
 		
 		std::string bufErrorFile = computeFilePath(computeFolder, "errors", moduleThatFoundError + std::to_string(outBuf.originalInputData.getTop()), "_" + computeID + ".flatBuf");
@@ -544,7 +736,26 @@ bool processJob(unsigned int Variables, const std::string& computeFolder, const
 		writeProcessingBufferPairToFile(bufErrorFile.c_str(), outBuf);
 	};
 
-	ResultProcessorOutput pipelineOutput = pcoeffPipeline(Variables, [&]() -> std::vector<JobTopInfo> {return loadJob(Variables, workingFile);}, processorFunc, validator, errorBufFunc);
+	ResultProcessorOutput pipelineOutput;
+	if(!remainingTops.empty()) {
+		TelemetryExporter telemetryExporter(computeFilePath(computeFolder, "results", jobID, "_" + computeID));
+		activeJobCheckpoint = &checkpoint;
+		topTimingsCSVFile = computeFilePath(computeFolder, "results", jobID, "_" + computeID + ".topTimings.csv");
+		pipelineOutput = pipeline([&]() -> std::vector<JobTopInfo> {return remainingTops;}, errorBufFunc);
+		topTimingsCSVFile.clear();
+		activeJobCheckpoint = nullptr;
+	} else {
+		std::cout << "All tops were finished before the last checkpoint" << std::endl;
+		pipelineOutput.validationBuffer = static_cast<ValidationData*>(numa_alloc_interleaved(VALIDATION_BUFFER_SIZE(Variables) * sizeof(ValidationData)));
+		memset(static_cast<void*>(pipelineOutput.validationBuffer), 0, VALIDATION_BUFFER_SIZE(Variables) * sizeof(ValidationData));
+	}
+	if(checkpoint.isAbandoned()) {
+		// Another worker owns the job and its checkpoint file now, leave both alone
+		std::cout << "Job " + jobID + " was abandoned, discarding its results\n" << std::flush;
+		numa_free(pipelineOutput.validationBuffer, VALIDATION_BUFFER_SIZE(Variables) * sizeof(ValidationData));
+		return noErrorsAtomic.load();
+	}
+	checkpoint.addToOutput(pipelineOutput);
 	std::vector<BetaResult>& betaResults = pipelineOutput.results;
 	
 
@@ -582,17 +793,116 @@ bool processJob(unsigned int Variables, const std::string& computeFolder, const
 	checkNotExists(selectedResultsFile);
 
 	std::cout << "Entering critical section: " << workingFile << "=>" << criticalFile << std::endl;
-	std::filesystem::rename(workingFile, criticalFile); // Throws filesystem::filesystem_error on error
+	std::error_code renameErr;
+	std::filesystem::rename(workingFile, criticalFile, renameErr);
+	if(renameErr) {
+		// The job was taken away from us, most likely because the job broker's lease expired. Whoever has it now will commit it
+		std::cerr << "Could not enter the critical section for job " + jobID + ": " + renameErr.message() + ". Discarding its results\n" << std::flush;
+		if(noErrors) std::filesystem::remove(validationFileNameTmp);
+		return noErrors;
+	}
 
 	saveResults(Variables, selectedResultsFile, betaResults, checkSum);
 	if(noErrors) std::filesystem::rename(validationFileNameTmp, validationFileName); // Commit the new validation file, Throws filesystem::filesystem_error on error
 
 	std::filesystem::rename(criticalFile, selectedFinishedFile); // Throws filesystem::filesystem_error on error
 	std::cout << "Finished critical section, everything comitted! " << criticalFile << "=>" << selectedFinishedFile << std::endl;
+	checkpoint.removeFile();
 
+	if(committed != nullptr) *committed = true;
 	return noErrors;
 }
 
+bool processJobList(unsigned int Variables, const std::string& computeFolder, const std::vector<std::string>& jobIDs, const std::string& methodName, const JobPipeline& pipeline) {
+	bool allWithoutErrors = true;
+	for(const std::string& jobID : jobIDs) {
+		bool noErrors = processJob(Variables, computeFolder, jobID, methodName, pipeline);
+		allWithoutErrors = allWithoutErrors && noErrors;
+	}
+	return allWithoutErrors;
+}
+
+// Job IDs in jobs/, lowest first
+static std::vector<std::string> listWaitingJobs(const std::string& computeFolder) {
+	std::vector<std::string> jobIDs;
+	for(const std::filesystem::directory_entry& jobFile : std::filesystem::directory_iterator(computeFolderPath(computeFolder, "jobs"))) {
+		std::string fileName = jobFile.path().filename().string();
+		if(fileName.size() < 5 || fileName[0] != 'j' || jobFile.path().extension() != ".job") continue;
+		jobIDs.push_back(fileName.substr(1, fileName.size() - 5));
+	}
+	std::sort(jobIDs.begin(), jobIDs.end(), [](const std::string& a, const std::string& b) {
+		return a.size() != b.size() ? a.size() < b.size() : a < b;
+	});
+	return jobIDs;
+}
+
+bool processJobsFromFolder(unsigned int Variables, const std::string& computeFolder, double idleExitSeconds, const std::string& methodName, const JobPipeline& pipeline) {
+	// Polling instead of inotify, which doesn't see files added by other nodes on network filesystems
+	constexpr double POLL_INTERVAL_SECONDS = 5.0;
+	std::string computeID = getComputeID(methodName);
+
+	bool allWithoutErrors = true;
+	size_t jobCount = 0;
+	auto lastJobTime = std::chrono::steady_clock::now();
+	while(true) {
+		bool claimedAJob = false;
+		for(const std::string& jobID : listWaitingJobs(computeFolder)) {
+			// Another worker may have claimed it since the folder was listed, the rename decides
+			if(!std::filesystem::exists(computeFilePath(computeFolder, "jobs", jobID, ".job")) || !claimJob(computeFolder, jobID, computeID)) continue;
+			bool noErrors = processClaimedJob(Variables, computeFolder, jobID, computeID, pipeline);
+			allWithoutErrors = allWithoutErrors && noErrors;
+			jobCount++;
+			claimedAJob = true;
+			break;
+		}
+		if(claimedAJob) {
+			lastJobTime = std::chrono::steady_clock::now();
+			continue;
+		}
+		if(std::chrono::duration<double>(std::chrono::steady_clock::now() - lastJobTime).count() >= idleExitSeconds) break;
+		std::this_thread::sleep_for(std::chrono::duration<double>(std::min(POLL_INTERVAL_SECONDS, idleExitSeconds)));
+	}
+	std::cout << "No new jobs in " + computeFolderPath(computeFolder, "jobs") + " for " + std::to_string(idleExitSeconds) + "s, processed " + std::to_string(jobCount) + " jobs\n" << std::flush;
+	return allWithoutErrors;
+}
+
+bool processJobsFromBroker(unsigned int Variables, const std::string& computeFolder, const std::string& brokerAddress, const std::string& methodName, const JobPipeline& pipeline) {
+	// The broker gives every worker ID one lease at a time, the PID lets several workers run on one host
+	std::string computeID = getComputeID(methodName) + "-" + std::to_string(getpid());
+	JobBrokerClient broker(BrokerAddress::parse(brokerAddress), computeID);
+	std::cout << "\033[33m[Broker] Worker " + computeID + " pulling jobs from " + brokerAddress + "\033[39m\n" << std::flush;
+
+	bool allWithoutErrors = true;
+	size_t jobCount = 0;
+	while(true) {
+		std::string jobID;
+		double seconds;
+		JobBrokerClient::LeaseStatus status = broker.lease(jobID, seconds);
+		if(status == JobBrokerClient::LeaseStatus::DONE) break;
+		if(status == JobBrokerClient::LeaseStatus::WAIT) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+			continue;
+		}
+
+		std::cout << "\033[33m[Broker] Leased job " + jobID + " for " + std::to_string(seconds) + "s\033[39m\n" << std::flush;
+		bool noErrors;
+		bool committed;
+		{
+			LeaseHeartbeat heartbeat(broker, jobID, seconds);
+			noErrors = processClaimedJob(Variables, computeFolder, jobID, computeID, pipeline, &heartbeat.getLeaseLostSignal(), &committed);
+		}
+		if(!committed) {
+			std::cout << "\033[33m[Broker] Gave up job " + jobID + ", it went back to the broker\033[39m\n" << std::flush;
+			continue;
+		}
+		broker.complete(jobID, noErrors);
+		allWithoutErrors = allWithoutErrors && noErrors;
+		jobCount++;
+	}
+	std::cout << "\033[33m[Broker] No jobs left, processed " + std::to_string(jobCount) + " jobs\033[39m\n" << std::flush;
+	return allWithoutErrors;
+}
+
 static std::pair<std::string, std::string> parseFileName(const std::filesystem::path& filePath, const std::string& extention) {
 	std::string fileName = filePath.filename().string();
 
@@ -702,6 +1012,8 @@ static void collectResultFilesInFolder(unsigned int Variables, BetaResultCollect
 			std::cout << "Reading results file " << filePath << std::endl;
 			std::vector<BetaResult> results = readResultsFile(Variables, path.c_str(), checkSum);
 			collector.addBetaResults(results);
+		} else if(filePath.find(".topTimings.") != std::string::npos || filePath.find(".telemetry.") != std::string::npos) {
+			// Written next to the results of a job, see processClaimedJob
 		} else {
 			std::cerr << "Unknown file found, expected results file: " << filePath << std::endl;
 		}
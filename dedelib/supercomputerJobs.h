@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <fstream>
 #include <vector>
+#include <atomic>
 
 #include "fileNames.h"
 #include "knownData.h"
@@ -36,18 +37,50 @@ struct ValidationFileData{
 
 ValidationData getIntactnessCheckSum(const ValidationData* buf, unsigned int Variables);
 
+std::string computeFolderPath(std::string computeFolder, const char* folder);
 std::string computeFilePath(std::string computeFolder, const char* folder, const std::string& jobID, const std::string& extention);
-void writeJobToFile(unsigned int Variables, const std::string& jobFileName, const std::vector<JobTopInfo>& topVector);
+// A negative predictedWork leaves it out of the job header
+void writeJobToFile(unsigned int Variables, const std::string& jobFileName, const std::vector<JobTopInfo>& topVector, double predictedWork = -1.0);
+
+enum class JobSplitting {
+	EQUAL_TOP_COUNT, // Every job gets the same number of top clusters
+	PREDICTED_WORK // Top clusters are bin-packed into jobs of near-equal predicted work, which is written into the job header
+};
 
 // Creates all necessary files and folders for a project to compute the given dedekind number
 // Requires that the compute folder does not already exist to prevent data loss
-void initializeComputeProject(unsigned int Variables, std::string computeFolder, size_t numberOfJobs, size_t numberOfJobsToActuallyGenerate);
+// With PREDICTED_WORK, tops listed in timingsCSV use their measured time instead of the TopCostModel prediction. It is a topTimings file from reportTopTimings, or the results/ folder of an earlier project to use the timings of all its jobs
+void initializeComputeProject(unsigned int Variables, std::string computeFolder, size_t numberOfJobs, size_t numberOfJobsToActuallyGenerate, JobSplitting splitting = JobSplitting::EQUAL_TOP_COUNT, const std::string& timingsCSV = "");
 
 void writeProcessingBufferPairToFile(const char* fileName, const OutputBuffer& outBuf);
 uint64_t readProcessingBufferPairFromFile(const char* fileName, NodeIndex* idxBuf = nullptr, ProcessedPCoeffSum* resultsBuf = nullptr);
 
 // Returns true if computation finished without detected errors
 bool processJob(unsigned int Variables, const std::string& computeFolder, const std::string& jobID, const std::string& methodName, void (*processorFunc)(PCoeffProcessingContext&), void*(*validator)(void*) = nullptr);
+// Computes the tops given by the topLoader, reporting faulty buffers to the errorBufFunc. pcoeffPipeline or fusedCPUPipeline
+typedef std::function<ResultProcessorOutput(const std::function<std::vector<JobTopInfo>()>& topLoader, const std::function<void(const OutputBuffer&, const char*, bool)>& errorBufFunc)> JobPipeline;
+bool processJob(unsigned int Variables, const std::string& computeFolder, const std::string& jobID, const std::string& methodName, const JobPipeline& pipeline);
+
+// pcoeffPipeline on one PCoeffProcessingContext that is kept for every job the returned pipeline runs, so its buffers and loaded files stay resident between jobs
+JobPipeline makeResidentPCoeffPipeline(unsigned int Variables, void (*processorFunc)(PCoeffProcessingContext&), void*(*validator)(void*) = nullptr);
+
+// methodName + "_" + host name, identifies the worker in the names of its job, results and validation files
+std::string getComputeID(const std::string& methodName);
+// Moves the job from jobs/ to working/. Returns false if it isn't in jobs/, or the worker already has files for it
+bool claimJob(const std::string& computeFolder, const std::string& jobID, const std::string& computeID);
+// Moves a claimed job from working/ back to jobs/. Returns false if it is no longer in working/
+bool unclaimJob(const std::string& computeFolder, const std::string& jobID, const std::string& computeID);
+bool isJobInCriticalSection(const std::string& computeFolder, const std::string& jobID, const std::string& computeID);
+// processJob for a job that claimJob already moved to working/
+// Once abandonSignal is set the job is given up: the pipeline stops early and nothing is committed. Giving up also happens when the job was moved out of working/ meanwhile.
+// committed receives whether the results were committed
+bool processClaimedJob(unsigned int Variables, const std::string& computeFolder, const std::string& jobID, const std::string& computeID, const JobPipeline& pipeline, const std::atomic<bool>* abandonSignal = nullptr, bool* committed = nullptr);
+// Processes the given jobs one after the other with the same pipeline. Returns true if no job had errors
+bool processJobList(unsigned int Variables, const std::string& computeFolder, const std::vector<std::string>& jobIDs, const std::string& methodName, const JobPipeline& pipeline);
+// Keeps claiming and processing jobs from jobs/, and stops once it has been empty for idleExitSeconds. Returns true if no job had errors
+bool processJobsFromFolder(unsigned int Variables, const std::string& computeFolder, double idleExitSeconds, const std::string& methodName, const JobPipeline& pipeline);
+// Leases jobs from the job broker at brokerAddress and processes them until it has none left. Returns true if no job had errors
+bool processJobsFromBroker(unsigned int Variables, const std::string& computeFolder, const std::string& brokerAddress, const std::string& methodName, const JobPipeline& pipeline);
 
 std::vector<BetaResult> readResultsFile(unsigned int Variables, const char* filePath, ValidationData& checkSum);
 
@@ -8,6 +8,12 @@
 #include <memory>
 #include <vector>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include "slabAllocator.h"
 #include "numaMem.h"
@@ -194,6 +200,13 @@ public:
 		readyForPop.notify_all();
 	}
 
+	// Reuse a closed and drained queue for another run, while no thread is using it
+	void reopen() {
+		std::lock_guard<std::mutex> lock(mutex);
+		assert(this->isClosed);
+		this->isClosed = false;
+	}
+
 	// Read side
 	std::optional<T> pop_wait() {
 		std::unique_lock<std::mutex> lock(mutex);
@@ -250,6 +263,183 @@ public:
 	}
 };
 
+// Blocks while *word == expected, or until woken by futexWake
+inline void futexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+inline void futexWake(std::atomic<uint32_t>& word, int count) {
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+/*
+	Bounded lock-free multi producer multi consumer queue, with the same interface as SynchronizedQueue. 
+	Every cell carries a sequence number that says whether it is ready to be written or read for the current lap, 
+	so pushing and popping only take a compare-exchange on the write or read head (Vyukov's bounded MPMC queue). 
+	Blocking pops sleep on a futex that is bumped by every push, pushers only make the syscall when someone sleeps. 
+
+	Like SynchronizedQueue the capacity must never be exceeded, which the closed-loop buffer circulation guarantees. 
+*/
+template<typename T>
+class LockFreeQueue {
+	struct alignas(64) Cell {
+		std::atomic<uint64_t> sequence;
+		T data;
+	};
+	std::unique_ptr<Cell[]> cells;
+	uint64_t dataCapacityMask;
+	alignas(64) std::atomic<uint64_t> writeHead;
+	alignas(64) std::atomic<uint64_t> readHead;
+	alignas(64) std::atomic<uint32_t> popSignal; // Futex word, changes on every push and on close
+	std::atomic<uint32_t> sleepingPoppers;
+	std::atomic<bool> isClosed;
+
+	bool tryPushNoWake(T& item) {
+		uint64_t pos = writeHead.load(std::memory_order_relaxed);
+		while(true) {
+			Cell& cell = cells[pos & dataCapacityMask];
+			int64_t diff = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(pos);
+			if(diff == 0) {
+				if(writeHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.data = std::move(item);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if(diff < 0) {
+				return false; // Full
+			} else {
+				pos = writeHead.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	void pushNoWake(T item) {
+		if(isClosed.load(std::memory_order_relaxed)) {
+			std::cerr << "Attempting to add element to closed queue!\n" << std::flush;
+			std::abort();
+		}
+		// Can only be momentarily full, while a popper is still moving out of the cell
+		while(!tryPushNoWake(item)) {
+			std::this_thread::yield();
+		}
+	}
+	void wakePoppers(int count) {
+		popSignal.fetch_add(1, std::memory_order_seq_cst);
+		if(sleepingPoppers.load(std::memory_order_seq_cst) != 0) {
+			futexWake(popSignal, count);
+		}
+	}
+public:
+	LockFreeQueue(size_t capacity) :
+		cells(new Cell[roundUpToPow2(capacity)]),
+		dataCapacityMask(roundUpToPow2(capacity) - 1),
+		writeHead(0),
+		readHead(0),
+		popSignal(0),
+		sleepingPoppers(0),
+		isClosed(false) {
+		for(uint64_t i = 0; i <= dataCapacityMask; i++) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+#ifndef NDEBUG
+	~LockFreeQueue() {assert(this->isClosed);}
+#endif
+
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+	bool queueHasBeenClosed() const {
+		return isClosed.load(std::memory_order_acquire);
+	}
+
+	// Approximate while other threads push or pop
+	size_t size() const {
+		uint64_t read = readHead.load(std::memory_order_relaxed);
+		uint64_t write = writeHead.load(std::memory_order_relaxed);
+		return write > read ? write - read : 0;
+	}
+
+	size_t capacity() const {
+		return dataCapacityMask + 1;
+	}
+
+	size_t freeSpace() const {
+		return capacity() - size();
+	}
+
+	// Write side
+	void push(T item) {
+		pushNoWake(std::move(item));
+		wakePoppers(1);
+	}
+
+	void pushN(const T* values, size_t count) {
+		for(size_t i = 0; i < count; i++) {
+			pushNoWake(values[i]);
+		}
+		wakePoppers(INT_MAX);
+	}
+
+	void close() {
+		if(isClosed.exchange(true, std::memory_order_acq_rel)) {
+			std::cerr << "Queue already closed!\n" << std::flush;
+			std::abort();
+		}
+		wakePoppers(INT_MAX);
+	}
+
+	// Reuse a closed and drained queue for another run, while no thread is using it
+	void reopen() {
+		assert(isClosed.load() && size() == 0);
+		isClosed.store(false, std::memory_order_release);
+	}
+
+	// Read side
+	TryPopStatus try_pop(T& out) {
+		uint64_t pos = readHead.load(std::memory_order_relaxed);
+		while(true) {
+			Cell& cell = cells[pos & dataCapacityMask];
+			int64_t diff = int64_t(cell.sequence.load(std::memory_order_acquire)) - int64_t(pos + 1);
+			if(diff == 0) {
+				if(readHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					out = std::move(cell.data);
+					cell.sequence.store(pos + dataCapacityMask + 1, std::memory_order_release);
+					return TryPopStatus::SUCCESS;
+				}
+			} else if(diff < 0) {
+				// Once closed and no push is still filling a cell, the queue stays empty
+				bool closedAndDrained = isClosed.load(std::memory_order_acquire) && writeHead.load(std::memory_order_acquire) == pos;
+				return closedAndDrained ? TryPopStatus::CLOSED : TryPopStatus::EMPTY;
+			} else {
+				pos = readHead.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::optional<T> pop_wait() {
+		T result;
+		while(true) {
+			uint32_t signal = popSignal.load(std::memory_order_seq_cst);
+			switch(try_pop(result)) {
+				case TryPopStatus::SUCCESS: return std::make_optional(std::move(result));
+				case TryPopStatus::CLOSED: return std::nullopt;
+				case TryPopStatus::EMPTY: break;
+			}
+			sleepingPoppers.fetch_add(1, std::memory_order_seq_cst);
+			futexWait(popSignal, signal); // Returns immediately if something was pushed since reading signal
+			sleepingPoppers.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	// Pops a number of elements into the provided buffer. 
+	// May wait forever
+	void popN_wait(T* buffer, size_t numberToPop) {
+		for(size_t i = 0; i < numberToPop; i++) {
+			buffer[i] = pop_wait().value();
+		}
+	}
+};
+
 template<typename T>
 class SynchronizedStack {
 	std::unique_ptr<T[]> stack;
@@ -361,6 +551,22 @@ public:
 			readyForAlloc.wait(lock);
 		}
 	}
+	// Allocates all buffers at once or waits, so threads allocating batches can't each hold part of the slab and starve each other
+	void allocN_wait(T** buffers, const size_t* allocSizes, size_t numberToAlloc) {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true) {
+			SlabAddrAllocator::ReservePoint beforeBatch = slabAlloc.getReservePoint();
+			size_t allocated = 0;
+			for(; allocated < numberToAlloc; allocated++) {
+				buffers[allocated] = slabAlloc.alloc(allocSizes[allocated]);
+				if(buffers[allocated] == nullptr) break;
+			}
+			if(allocated == numberToAlloc) return;
+			// Roll back, including a wrap to the start of the slab the partial batch may have made
+			slabAlloc.rollBackTo(beforeBatch, allocated);
+			readyForAlloc.wait(lock);
+		}
+	}
 	void free(const T* allocatedBuf) {
 		{std::lock_guard<std::mutex> lock(mutex);
 			slabAlloc.free(allocatedBuf);
@@ -372,9 +578,23 @@ public:
 			slabAlloc.shrinkLastAllocation(newSize);
 		}
 	}
+	// Other threads may have allocated after allocatedBuf, then it can't shrink and keeps its size until it is freed. Returns true if it shrunk
+	bool shrinkIfLastAllocation(const T* allocatedBuf, uint64_t newSize) {
+		bool shrunk;
+		{std::lock_guard<std::mutex> lock(mutex);
+			shrunk = slabAlloc.isLastAllocation(allocatedBuf);
+			if(shrunk) slabAlloc.shrinkLastAllocation(newSize);
+		}
+		if(shrunk) readyForAlloc.notify_all();
+		return shrunk;
+	}
 	bool owns(const T* allocatedBuf) const {
 		return slabAlloc.owns(allocatedBuf);
 	}
+	size_t getNumberOfChunksInUse() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return slabAlloc.getNumberOfChunksInUse();
+	}
 };
 
 
@@ -434,6 +654,13 @@ public:
 		readyForPop.notify_all();
 	}
 
+	// Reuse a closed and drained queue for another run, while no thread is using it
+	void reopen() {
+		std::lock_guard<std::mutex> lock(mutex);
+		assert(this->isClosed);
+		this->isClosed = false;
+	}
+
 	// Write side
 	void push(size_t queueIdx, T item) {
 		{std::lock_guard<std::mutex> lock(mutex);
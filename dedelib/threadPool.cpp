@@ -100,6 +100,64 @@ PThreadBundle::~PThreadBundle() {
 	assert(this->threads.get() == nullptr); // Must be joined before destroying
 }
 
+static uint64_t packRange(uint32_t begin, uint32_t end) {
+	return uint64_t(begin) | (uint64_t(end) << 32);
+}
+static uint32_t rangeBegin(uint64_t range) {return uint32_t(range);}
+static uint32_t rangeEnd(uint64_t range) {return uint32_t(range >> 32);}
+
+WorkStealingRanges::WorkStealingRanges(uint32_t size, size_t threadCount) : ranges(new Range[threadCount]), threadCount(threadCount) {
+	for(size_t t = 0; t < threadCount; t++) {
+		uint32_t begin = uint32_t(uint64_t(size) * t / threadCount);
+		uint32_t end = uint32_t(uint64_t(size) * (t + 1) / threadCount);
+		ranges[t].range.store(packRange(begin, end));
+	}
+}
+
+bool WorkStealingRanges::claimBlock(size_t threadIdx, uint32_t blockSize, uint32_t& blockStart, uint32_t& blockEnd) {
+	std::atomic<uint64_t>& ownRange = ranges[threadIdx].range;
+	uint64_t range = ownRange.load();
+	while(rangeBegin(range) != rangeEnd(range)) {
+		uint32_t begin = rangeBegin(range);
+		uint32_t end = rangeEnd(range);
+		uint32_t claimedEnd = end - begin > blockSize ? begin + blockSize : end;
+		if(ownRange.compare_exchange_weak(range, packRange(claimedEnd, end))) {
+			blockStart = begin;
+			blockEnd = claimedEnd;
+			return true;
+		}
+	}
+
+	// Nobody else adds to an empty range, so once the own range is empty it only changes when we store the stolen part in it
+	while(true) {
+		size_t victim = threadCount;
+		uint64_t victimRange = 0;
+		uint32_t mostLeft = 0;
+		for(size_t t = 0; t < threadCount; t++) {
+			if(t == threadIdx) continue;
+			uint64_t otherRange = ranges[t].range.load();
+			uint32_t left = rangeEnd(otherRange) - rangeBegin(otherRange);
+			if(left > mostLeft) {
+				mostLeft = left;
+				victim = t;
+				victimRange = otherRange;
+			}
+		}
+		if(victim == threadCount) return false;
+
+		uint32_t begin = rangeBegin(victimRange);
+		uint32_t end = rangeEnd(victimRange);
+		// Leftovers of a block or less are taken whole
+		uint32_t stealFrom = mostLeft <= blockSize ? begin : begin + mostLeft / 2;
+		if(!ranges[victim].range.compare_exchange_strong(victimRange, packRange(begin, stealFrom))) continue;
+
+		blockStart = stealFrom;
+		blockEnd = end - stealFrom > blockSize ? stealFrom + blockSize : end;
+		ownRange.store(packRange(blockEnd, end));
+		return true;
+	}
+}
+
 PThreadBundle multiThread(size_t threadCount, int cpuI, CPUAffinityType affinity, void* data, void*(*func)(void*)) {
 	pthread_t* threads = new pthread_t[threadCount]; 
 	for(size_t i = 0; i < threadCount; i++) {
@@ -6,6 +6,7 @@
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 
 #include <pthread.h>
 #include "threadUtils.h"
@@ -151,6 +152,25 @@ public:
 	~PThreadBundle();
 };
 
+/*
+	Splits [0, size) into one contiguous range per thread. A thread takes blocks from the front of its own range, 
+	and once that is empty it steals the back half of the fullest other range, which then becomes its own range. 
+	Unlike a single shared counter, threads only contend when stealing. 
+*/
+class WorkStealingRanges {
+	struct alignas(64) Range {
+		std::atomic<uint64_t> range; // begin in the low 32 bits, end in the high 32 bits
+	};
+	std::unique_ptr<Range[]> ranges;
+	size_t threadCount;
+public:
+	WorkStealingRanges() : ranges(), threadCount(0) {}
+	WorkStealingRanges(uint32_t size, size_t threadCount);
+
+	// Returns false once no range has work left
+	bool claimBlock(size_t threadIdx, uint32_t blockSize, uint32_t& blockStart, uint32_t& blockEnd);
+};
+
 PThreadBundle multiThread(size_t threadCount, int cpuI, CPUAffinityType affinity, void* data, void*(*func)(void*));
 PThreadBundle allCoresSpread(void* data, void*(*func)(void*));
 
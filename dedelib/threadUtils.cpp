@@ -5,64 +5,57 @@
 #include <pthread.h>
 #include <iostream>
 
+#include "topology.h"
 
-// AMD Milan 7763 architecture
-constexpr int CORE_COMPLEX_SIZE = 8;
-constexpr int CORES_PER_NUMA = 16;
-constexpr int CORES_PER_SOCKET = 64;
 
-
-static size_t getAffinityBlockSize(CPUAffinityType t) {
-	return static_cast<int>(t);
-}
-
-static cpu_set_t createCPUSet(int cpuI, int numCPUs) {
+static cpu_set_t createCPUSet(const std::vector<int>& cpus) {
 	cpu_set_t cpuset;
 	CPU_ZERO(&cpuset);
-	for(int i = 0; i < numCPUs; i++) {
-		CPU_SET(cpuI + i, &cpuset);
+	for(int cpu : cpus) {
+		CPU_SET(cpu, &cpuset);
 	}
 	return cpuset;
 }
+static const std::vector<int>& getGroup(const std::vector<std::vector<int>>& groups, int index) {
+	return groups[index % groups.size()];
+}
 cpu_set_t createCPUSet(int cpuI, CPUAffinityType t) {
-	size_t blockSize = getAffinityBlockSize(t);
-	return createCPUSet(cpuI * blockSize, blockSize);
+	const CPUTopology& topology = getTopology();
+	switch(t) {
+		case CPUAffinityType::CORE: return createCPUSet(std::vector<int>{topology.cpuOrder[cpuI % topology.cpuOrder.size()]});
+		case CPUAffinityType::COMPLEX: return createCPUSet(getGroup(topology.coreComplexes, cpuI));
+		case CPUAffinityType::NUMA_DOMAIN: return createCPUSet(getGroup(topology.numaNodes, cpuI));
+		case CPUAffinityType::SOCKET: return createCPUSet(getGroup(topology.sockets, cpuI));
+	}
+	__builtin_unreachable();
 }
 
 pthread_t createPThreadAffinity(int cpuI, CPUAffinityType t, void* (*func)(void*), void* data) {
 	return createPThreadAffinity(createCPUSet(cpuI, t), func, data);
 }
 
-static void setCPUAffinity(pthread_t pt, int cpuI) {
-	cpu_set_t cpuset = createCPUSet(cpuI, 1);
+static void setAffinity(pthread_t pt, int index, CPUAffinityType t) {
+	cpu_set_t cpuset = createCPUSet(index, t);
 	int rc = pthread_setaffinity_np(pt, sizeof(cpu_set_t), &cpuset);
 	if (rc != 0) {
 		std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
 	}
 }
 
+static void setCPUAffinity(pthread_t pt, int cpuI) {
+	setAffinity(pt, cpuI, CPUAffinityType::CORE);
+}
+
 static void setCoreComplexAffinity(pthread_t pt, int coreComplex) {
-	cpu_set_t cpuset = createCPUSet(coreComplex * CORE_COMPLEX_SIZE, CORE_COMPLEX_SIZE);
-	int rc = pthread_setaffinity_np(pt, sizeof(cpu_set_t), &cpuset);
-	if (rc != 0) {
-		std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
-	}
+	setAffinity(pt, coreComplex, CPUAffinityType::COMPLEX);
 }
 
 static void setNUMANodeAffinity(pthread_t pt, int numaNode) {
-	cpu_set_t cpuset = createCPUSet(numaNode * CORES_PER_NUMA, CORES_PER_NUMA);
-	int rc = pthread_setaffinity_np(pt, sizeof(cpu_set_t), &cpuset);
-	if (rc != 0) {
-		std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
-	}
+	setAffinity(pt, numaNode, CPUAffinityType::NUMA_DOMAIN);
 }
 
 static void setSocketAffinity(pthread_t pt, int socketI) {
-	cpu_set_t cpuset = createCPUSet(socketI * CORES_PER_SOCKET, CORES_PER_SOCKET);
-	int rc = pthread_setaffinity_np(pt, sizeof(cpu_set_t), &cpuset);
-	if (rc != 0) {
-		std::cerr << "Error calling pthread_setaffinity_np: " << rc << "\n";
-	}
+	setAffinity(pt, socketI, CPUAffinityType::SOCKET);
 }
 
 void setCPUAffinity(std::thread& th, int cpuI) {
@@ -133,16 +126,16 @@ pthread_t createPThreadAffinity(cpu_set_t cpuset, void* (*func)(void*), void* da
 }
 
 pthread_t createCPUPThread(int cpuI, void* (*func)(void*), void* data) {
-	return createPThreadAffinity(createCPUSet(cpuI, 1), func, data);
+	return createPThreadAffinity(cpuI, CPUAffinityType::CORE, func, data);
 }
 pthread_t createCoreComplexPThread(int coreComplex, void* (*func)(void*), void* data) {
-	return createPThreadAffinity(createCPUSet(CORE_COMPLEX_SIZE * coreComplex, CORE_COMPLEX_SIZE), func, data);
+	return createPThreadAffinity(coreComplex, CPUAffinityType::COMPLEX, func, data);
 }
 pthread_t createNUMANodePThread(int numaNode, void* (*func)(void*), void* data) {
-	return createPThreadAffinity(createCPUSet(CORES_PER_NUMA * numaNode, CORES_PER_NUMA), func, data);
+	return createPThreadAffinity(numaNode, CPUAffinityType::NUMA_DOMAIN, func, data);
 }
 pthread_t createSocketPThread(int socketI, void* (*func)(void*), void* data) {
-	return createPThreadAffinity(createCPUSet(CORES_PER_SOCKET * socketI, CORES_PER_SOCKET), func, data);
+	return createPThreadAffinity(socketI, CPUAffinityType::SOCKET, func, data);
 }
 
 
@@ -3,11 +3,13 @@
 #include <thread>
 #include <pthread.h>
 
+// Group of CPUs a thread is pinned to, the accompanying index selects one of the groups of the detected CPUTopology. 
+// Indices wrap around the number of groups, so code sized for a bigger machine still runs on a smaller one. 
 enum class CPUAffinityType {
-	CORE = 1,
-	COMPLEX = 8,
-	NUMA_DOMAIN = 16,
-	SOCKET = 64
+	CORE,
+	COMPLEX,
+	NUMA_DOMAIN,
+	SOCKET
 };
 
 cpu_set_t createCPUSet(int cpuI, CPUAffinityType t);
@@ -350,7 +350,7 @@ PerThreadTotals tjomnCountInParallel() {
 
 	BufferedMap<MBF, int> alltaus = generateNonEquivalentMonotonics<Variables>();
 	
-	IntervalSizeCache<Variables> intervalSizes = IntervalSizeCache<Variables>::generate();
+	IntervalSizeCache<Variables> intervalSizes = IntervalSizeCache<Variables>::loadOrGenerate();
 	return iterCollectionPartitionedWithSeparateTotalsWithBuffers(alltaus, PerThreadTotals{0, 0, 0}, []() { return BufferedMap<AntiChain<Variables>, int>(dedekindNumbers[Variables]); }, 
 	[&](const KeyValue<MBF, int>& veetau, PerThreadTotals& localTotal, BufferedMap<AntiChain<Variables>, int>& bufSet) {
 		std::cout << '.' << std::flush;
@@ -508,14 +508,15 @@ uint256_t revolution() {
 	return result;
 }
 
+// intervalSizeCacheFile is loaded, or generated and saved if it doesn't exist yet
 template<unsigned int Variables>
-u192 revolutionMemoized() {
+u192 revolutionMemoized(const std::string& intervalSizeCacheFile = FileName::intervalSizeCache(Variables, Variables >= 6)) {
 	using MBF = Monotonic<Variables>;
 	using INT = Interval<Variables>;
 
 	MBF a = MBF::getTop();
 
-	IntervalSizeCache<Variables> intervalSizes = IntervalSizeCache<Variables>::generate();
+	IntervalSizeCache<Variables> intervalSizes = IntervalSizeCache<Variables>::loadOrGenerate(intervalSizeCacheFile);
 
 	u192 result = 0;
 	uint64_t counting = 0;
@@ -0,0 +1,156 @@
+#include "topScheduling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <queue>
+#include <string>
+
+#include "knownData.h"
+#include "fileNames.h"
+#include "flatBufferManagement.h"
+
+double TopCostModel::predictWork(unsigned int Variables, JobTopInfo top, const ClassInfo* classInfos) const {
+	int topLayer = getFlatLayerOfIndex(Variables, top.top);
+	double work = double(classInfos[top.top].intervalSizeDown) * (1.0 + layerFactor * topLayer / (1 << Variables));
+#ifdef PCOEFF_DEDUPLICATE
+	if(top.topDual < top.top) {
+		work *= double(top.topDual) / top.top;
+	}
+#endif
+	return work;
+}
+
+void scheduleTopsLPT(unsigned int Variables, std::vector<JobTopInfo>& tops, const ClassInfo* classInfos, const TopCostModel& model) {
+	std::vector<std::pair<double, JobTopInfo>> predicted;
+	predicted.reserve(tops.size());
+	for(JobTopInfo top : tops) {
+		predicted.emplace_back(model.predictWork(Variables, top, classInfos), top);
+	}
+	std::stable_sort(predicted.begin(), predicted.end(), [](const std::pair<double, JobTopInfo>& a, const std::pair<double, JobTopInfo>& b) {
+		return a.first > b.first;
+	});
+	for(size_t i = 0; i < tops.size(); i++) {
+		tops[i] = predicted[i].second;
+	}
+}
+
+std::vector<size_t> packIntoBinsLPT(const std::vector<double>& costs, size_t binCount, std::vector<double>& binTotals) {
+	std::vector<size_t> order(costs.size());
+	for(size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {return costs[a] > costs[b];});
+
+	// Min-heap of (total, bin), ties go to the lowest bin so the result is deterministic
+	std::priority_queue<std::pair<double, size_t>, std::vector<std::pair<double, size_t>>, std::greater<std::pair<double, size_t>>> lightestBin;
+	for(size_t bin = 0; bin < binCount; bin++) lightestBin.emplace(0.0, bin);
+
+	std::vector<size_t> binOfItem(costs.size());
+	for(size_t item : order) {
+		std::pair<double, size_t> bin = lightestBin.top();
+		lightestBin.pop();
+		binOfItem[item] = bin.second;
+		lightestBin.emplace(bin.first + costs[item], bin.second);
+	}
+	binTotals.assign(binCount, 0.0);
+	for(; !lightestBin.empty(); lightestBin.pop()) {
+		binTotals[lightestBin.top().second] = lightestBin.top().first;
+	}
+	return binOfItem;
+}
+
+double fitSecondsPerWork(const std::vector<std::pair<double, double>>& workAndSeconds) {
+	double workTimesSeconds = 0.0;
+	double workSquared = 0.0;
+	for(const std::pair<double, double>& ws : workAndSeconds) {
+		workTimesSeconds += ws.first * ws.second;
+		workSquared += ws.first * ws.first;
+	}
+	return workSquared != 0.0 ? workTimesSeconds / workSquared : 0.0;
+}
+
+std::vector<std::pair<NodeIndex, double>> readTopTimingsCSV(const std::string& csvFileOrFolder) {
+	if(std::filesystem::is_directory(csvFileOrFolder)) {
+		std::vector<std::pair<NodeIndex, double>> timings;
+		for(const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(csvFileOrFolder)) {
+			std::string fileName = file.path().filename().string();
+			const std::string extension = ".topTimings.csv";
+			if(fileName.size() <= extension.size() || fileName.compare(fileName.size() - extension.size(), extension.size(), extension) != 0) continue;
+			std::vector<std::pair<NodeIndex, double>> fileTimings = readTopTimingsCSV(file.path().string());
+			timings.insert(timings.end(), fileTimings.begin(), fileTimings.end());
+		}
+		return timings;
+	}
+	const std::string& csvFileName = csvFileOrFolder;
+	std::ifstream csv(csvFileName);
+	if(!csv.is_open()) {
+		std::cerr << "Could not open top timings file " + csvFileName + "! Aborting!\n" << std::flush;
+		std::abort();
+	}
+	std::vector<std::pair<NodeIndex, double>> timings;
+	std::string line;
+	std::getline(csv, line); // top,layer,intervalSizeDown,predictedSeconds,actualSeconds
+	while(std::getline(csv, line)) {
+		size_t firstComma = line.find(',');
+		size_t lastComma = line.rfind(',');
+		if(firstComma == std::string::npos) continue;
+		timings.emplace_back(static_cast<NodeIndex>(std::stoul(line.substr(0, firstComma))), std::stod(line.substr(lastComma + 1)));
+	}
+	return timings;
+}
+
+void TopTimingLog::add(JobTopInfo top, double seconds) {
+	std::lock_guard<std::mutex> lock(mutex);
+	timings.emplace_back(top, seconds);
+}
+
+std::vector<std::pair<JobTopInfo, double>> TopTimingLog::take() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return std::move(timings);
+}
+
+void reportTopTimings(unsigned int Variables, const ClassInfo* classInfos, const TopCostModel& model) {
+	std::vector<std::pair<JobTopInfo, double>> timings = topTimingLog.take();
+	if(timings.empty()) return;
+
+	struct TopTiming {
+		NodeIndex top;
+		double predictedWork;
+		double actualSeconds;
+	};
+	std::vector<TopTiming> tops;
+	tops.reserve(timings.size());
+	std::vector<std::pair<double, double>> workAndSeconds;
+	workAndSeconds.reserve(timings.size());
+	double totalSeconds = 0.0;
+	for(const std::pair<JobTopInfo, double>& t : timings) {
+		double work = model.predictWork(Variables, t.first, classInfos);
+		tops.push_back(TopTiming{t.first.top, work, t.second});
+		workAndSeconds.emplace_back(work, t.second);
+		totalSeconds += t.second;
+	}
+	double secondsPerWork = fitSecondsPerWork(workAndSeconds);
+
+	std::string csvFileName = topTimingsCSVFile.empty() ? "topTimings" + std::to_string(Variables) + ".csv" : topTimingsCSVFile;
+	std::ofstream csv(csvFileName);
+	csv << "top,layer,intervalSizeDown,predictedSeconds,actualSeconds\n";
+	double squaredError = 0.0;
+	for(const TopTiming& t : tops) {
+		double predictedSeconds = t.predictedWork * secondsPerWork;
+		squaredError += (predictedSeconds - t.actualSeconds) * (predictedSeconds - t.actualSeconds);
+		csv << t.top << ',' << getFlatLayerOfIndex(Variables, t.top) << ',' << classInfos[t.top].intervalSizeDown << ',' << predictedSeconds << ',' << t.actualSeconds << '\n';
+	}
+
+	std::sort(tops.begin(), tops.end(), [secondsPerWork](const TopTiming& a, const TopTiming& b) {
+		return std::abs(a.predictedWork * secondsPerWork - a.actualSeconds) > std::abs(b.predictedWork * secondsPerWork - b.actualSeconds);
+	});
+	std::string report = "\033[36m[Top Timings] " + std::to_string(tops.size()) + " tops took " + std::to_string(totalSeconds) + "s, "
+		+ std::to_string(secondsPerWork * 1.0e9) + "ns per unit of predicted work, RMS error " + std::to_string(std::sqrt(squaredError / tops.size())) + "s. Worst predictions:\n";
+	for(size_t i = 0; i < std::min(tops.size(), size_t(10)); i++) {
+		report += "  top " + std::to_string(tops[i].top) + " (layer " + std::to_string(getFlatLayerOfIndex(Variables, tops[i].top)) + "): predicted "
+			+ std::to_string(tops[i].predictedWork * secondsPerWork) + "s, actual " + std::to_string(tops[i].actualSeconds) + "s\n";
+	}
+	report += "Written all timings to " + csvFileName + "\033[39m\n";
+	std::cout << report << std::flush;
+}
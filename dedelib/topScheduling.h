@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <string>
+
+#include "pcoeffClasses.h"
+
+/*
+	Top scheduling. Tops are handed to the pipeline largest predicted job first (LPT order),
+	so the few tops with huge bottom sets start early instead of finishing long after everything else.
+
+	The prediction is intervalSizeDown (~ the number of bottoms) times a per-bottom cost that grows with the layer of the top,
+	as the graphs to count get larger. With PCOEFF_DEDUPLICATE only the bottoms below the top dual are processed.
+*/
+struct TopCostModel {
+	double layerFactor = 1.0; // Cost of a bottom below a top in the highest layer, relative to one below a top in layer 0
+
+	double predictWork(unsigned int Variables, JobTopInfo top, const ClassInfo* classInfos) const;
+};
+
+// Reorders the tops by decreasing predicted work. classInfos is the pipeline's resident copy of flatClassInfo
+void scheduleTopsLPT(unsigned int Variables, std::vector<JobTopInfo>& tops, const ClassInfo* classInfos, const TopCostModel& model = TopCostModel());
+
+/*
+	Splits items over binCount bins of near-equal total cost: largest first, each into the currently lightest bin.
+	Returns the bin of every item, binTotals receives the total cost of every bin.
+*/
+std::vector<size_t> packIntoBinsLPT(const std::vector<double>& costs, size_t binCount, std::vector<double>& binTotals);
+
+// Least squares factor from predicted work to measured seconds, over (predictedWork, seconds) pairs
+double fitSecondsPerWork(const std::vector<std::pair<double, double>>& workAndSeconds);
+
+// Reads the measured (top, seconds) pairs back from a CSV written by reportTopTimings.
+// For a folder, such as a project's results/, it reads every *.topTimings.csv in it
+std::vector<std::pair<NodeIndex, double>> readTopTimingsCSV(const std::string& csvFileOrFolder);
+
+// Measured processing times of tops, filled in by the processors
+class TopTimingLog {
+	std::mutex mutex;
+	std::vector<std::pair<JobTopInfo, double>> timings;
+public:
+	void add(JobTopInfo top, double seconds);
+	// Returns and clears the collected timings
+	std::vector<std::pair<JobTopInfo, double>> take();
+};
+inline TopTimingLog topTimingLog;
+
+// The CSV reportTopTimings writes. processClaimedJob points it at the job's file in the project's results/ folder, otherwise it is topTimings<Variables>.csv in the working directory
+inline std::string topTimingsCSVFile;
+
+/*
+	Compares the predicted work of the collected timings with the measured times, so the model can be tuned.
+	Predictions are scaled to seconds with the least squares fit over all measured tops.
+	Prints a summary with the worst mispredictions, and writes a line per top to topTimingsCSVFile
+*/
+void reportTopTimings(unsigned int Variables, const ClassInfo* classInfos, const TopCostModel& model = TopCostModel());
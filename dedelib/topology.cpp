@@ -0,0 +1,162 @@
+#include "topology.h"
+
+#include <map>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+std::vector<int> parseCPUList(const std::string& list) {
+	std::vector<int> result;
+	size_t pos = 0;
+	while(pos < list.size()) {
+		size_t end = list.find(',', pos);
+		if(end == std::string::npos) end = list.size();
+		std::string range = list.substr(pos, end - pos);
+		size_t dash = range.find('-');
+		try {
+			if(dash == std::string::npos) {
+				result.push_back(std::stoi(range));
+			} else {
+				int first = std::stoi(range.substr(0, dash));
+				int last = std::stoi(range.substr(dash + 1));
+				for(int cpu = first; cpu <= last; cpu++) {
+					result.push_back(cpu);
+				}
+			}
+		} catch(const std::invalid_argument&) {} // Trailing newlines and such
+		pos = end + 1;
+	}
+	return result;
+}
+
+static bool readFirstLine(const std::string& fileName, std::string& line) {
+	std::ifstream file(fileName);
+	return file.is_open() && std::getline(file, line) && !line.empty();
+}
+
+static std::vector<int> onlyOnline(const std::vector<int>& cpus, const std::vector<bool>& isOnline) {
+	std::vector<int> result;
+	for(int cpu : cpus) {
+		if(cpu >= 0 && cpu < int(isOnline.size()) && isOnline[cpu]) result.push_back(cpu);
+	}
+	return result;
+}
+
+// Groups the CPUs by the given key, groups are ordered by their lowest CPU
+template<typename Key, typename KeyOf>
+static std::vector<std::vector<int>> groupCPUs(const std::vector<int>& cpus, const KeyOf& keyOf) {
+	std::map<Key, std::vector<int>> groups;
+	for(int cpu : cpus) {
+		groups[keyOf(cpu)].push_back(cpu);
+	}
+	std::vector<std::vector<int>> result;
+	for(auto& group : groups) {
+		result.push_back(std::move(group.second));
+	}
+	std::sort(result.begin(), result.end(), [](const std::vector<int>& a, const std::vector<int>& b) {return a.front() < b.front();});
+	return result;
+}
+
+CPUTopology detectTopology(const std::string& sysDir) {
+	std::string cpuDir = sysDir + "/cpu/";
+
+	std::vector<int> cpus;
+	std::string line;
+	if(readFirstLine(cpuDir + "online", line)) cpus = parseCPUList(line);
+	if(cpus.empty()) {
+		for(int cpu = 0; cpu < int(std::max(1u, std::thread::hardware_concurrency())); cpu++) cpus.push_back(cpu);
+	}
+	std::sort(cpus.begin(), cpus.end());
+	std::vector<bool> isOnline(cpus.back() + 1, false);
+	for(int cpu : cpus) isOnline[cpu] = true;
+
+	std::map<int, int> packageOf;
+	std::map<int, std::vector<int>> l3Of;
+	std::map<int, std::vector<int>> siblingsOf;
+	for(int cpu : cpus) {
+		std::string dir = cpuDir + "cpu" + std::to_string(cpu) + "/";
+		packageOf[cpu] = readFirstLine(dir + "topology/physical_package_id", line) ? std::stoi(line) : 0;
+		siblingsOf[cpu] = readFirstLine(dir + "topology/thread_siblings_list", line) ? onlyOnline(parseCPUList(line), isOnline) : std::vector<int>{};
+		if(siblingsOf[cpu].empty()) siblingsOf[cpu] = {cpu};
+		for(int cacheI = 0; cacheI < 16; cacheI++) {
+			std::string cacheDir = dir + "cache/index" + std::to_string(cacheI) + "/";
+			if(readFirstLine(cacheDir + "level", line) && line == "3" && readFirstLine(cacheDir + "shared_cpu_list", line)) {
+				l3Of[cpu] = onlyOnline(parseCPUList(line), isOnline);
+			}
+		}
+	}
+
+	CPUTopology topology;
+	topology.sockets = groupCPUs<int>(cpus, [&](int cpu) {return packageOf[cpu];});
+	topology.physicalCores = groupCPUs<std::vector<int>>(cpus, [&](int cpu) {return siblingsOf[cpu];});
+	// Without an L3 cache the socket is the complex
+	topology.coreComplexes = groupCPUs<std::pair<int, std::vector<int>>>(cpus, [&](int cpu) {return std::make_pair(packageOf[cpu], l3Of[cpu]);});
+
+	std::map<int, int> socketOf;
+	for(size_t socket = 0; socket < topology.sockets.size(); socket++) {
+		for(int cpu : topology.sockets[socket]) socketOf[cpu] = socket;
+	}
+
+	std::vector<std::pair<int, std::vector<int>>> nodes;
+	std::error_code err;
+	for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(sysDir + "/node", err)) {
+		std::string name = entry.path().filename().string();
+		if(name.rfind("node", 0) != 0 || name.size() == 4 || !std::all_of(name.begin() + 4, name.end(), ::isdigit)) continue;
+		if(!readFirstLine(entry.path().string() + "/cpulist", line)) continue;
+		std::vector<int> nodeCPUs = onlyOnline(parseCPUList(line), isOnline);
+		if(!nodeCPUs.empty()) nodes.emplace_back(std::stoi(name.substr(4)), std::move(nodeCPUs)); // Memory-only nodes get no threads
+	}
+	if(nodes.empty()) nodes.emplace_back(0, cpus);
+	std::sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {return a.second.front() < b.second.front();});
+	for(auto& node : nodes) {
+		topology.numaNodeIds.push_back(node.first);
+		topology.numaNodeSocket.push_back(socketOf[node.second.front()]);
+		topology.numaNodes.push_back(std::move(node.second));
+	}
+	for(const std::vector<int>& complex : topology.coreComplexes) {
+		topology.coreComplexSocket.push_back(socketOf[complex.front()]);
+	}
+
+	for(const std::vector<int>& socket : topology.sockets) {
+		std::vector<std::pair<int, int>> rankedCPUs; // (position within the physical core, cpu)
+		for(int cpu : socket) {
+			const std::vector<int>& siblings = siblingsOf[cpu];
+			rankedCPUs.emplace_back(std::find(siblings.begin(), siblings.end(), cpu) - siblings.begin(), cpu);
+		}
+		std::sort(rankedCPUs.begin(), rankedCPUs.end());
+		for(std::pair<int, int> rankedCPU : rankedCPUs) topology.cpuOrder.push_back(rankedCPU.second);
+	}
+
+	return topology;
+}
+
+const CPUTopology& getTopology() {
+	static const CPUTopology topology = detectTopology("/sys/devices/system");
+	return topology;
+}
+
+std::vector<int> CPUTopology::getNUMANodesOfSocket(int socket) const {
+	std::vector<int> result;
+	for(size_t node = 0; node < numaNodes.size(); node++) {
+		if(numaNodeSocket[node] == socket) result.push_back(node);
+	}
+	return result;
+}
+
+std::string CPUTopology::getNUMANodeString(int socket) const {
+	std::string result;
+	for(int node : getNUMANodesOfSocket(socket)) {
+		if(!result.empty()) result += ",";
+		result += std::to_string(numaNodeIds[node]);
+	}
+	return result;
+}
+
+std::string CPUTopology::toString() const {
+	return std::to_string(sockets.size()) + " sockets, "
+		+ std::to_string(numaNodes.size()) + " NUMA nodes, "
+		+ std::to_string(coreComplexes.size()) + " core complexes, "
+		+ std::to_string(physicalCores.size()) + " cores, "
+		+ std::to_string(cpuOrder.size()) + " threads";
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+/*
+	Layout of the machine, read from /sys/devices/system on first use.
+	Every group lists the OS numbers of its logical CPUs, and groups are ordered by their lowest CPU.
+	Core complexes are the CPUs sharing an L3 cache, physical cores are the SMT siblings of one core.
+	Without sysfs everything falls back to one socket, NUMA node and complex holding all hardware_concurrency() CPUs.
+*/
+struct CPUTopology {
+	std::vector<std::vector<int>> sockets;
+	std::vector<std::vector<int>> numaNodes;
+	std::vector<std::vector<int>> coreComplexes;
+	std::vector<std::vector<int>> physicalCores;
+
+	std::vector<int> numaNodeIds; // OS id of each NUMA node, as libnuma expects it
+	std::vector<int> numaNodeSocket;
+	std::vector<int> coreComplexSocket;
+
+	// All logical CPUs socket by socket, within a socket the first SMT thread of every core comes first.
+	// So spreading fewer threads than CPUs over it fills the physical cores before their siblings.
+	std::vector<int> cpuOrder;
+
+	size_t getSocketCount() const {return sockets.size();}
+	size_t getNUMANodeCount() const {return numaNodes.size();}
+	size_t getCoreComplexCount() const {return coreComplexes.size();}
+	size_t getCPUCount() const {return cpuOrder.size();}
+
+	// Indices into numaNodes
+	std::vector<int> getNUMANodesOfSocket(int socket) const;
+	// OS node ids of the socket in numa_parse_nodestring format, like "0,1,2,3"
+	std::string getNUMANodeString(int socket) const;
+
+	std::string toString() const;
+};
+
+// Reads the topology below sysDir, which is normally "/sys/devices/system"
+CPUTopology detectTopology(const std::string& sysDir);
+
+// Detected once for the whole program
+const CPUTopology& getTopology();
+
+// Parses the "0-3,8,10-11" lists used by sysfs
+std::vector<int> parseCPUList(const std::string& list);
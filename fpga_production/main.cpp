@@ -132,7 +132,7 @@ static void pushJob(FPGAGlobalData& data, int deviceI, int slotI) {
 	cl_event kernelFinished = subKernel.launchWriteKernel(data.multiKernel.kernel, slotI, bufSize, jobBuf);
 
 	PCoeffProcessingContextEighth& jobQueue = data.context->getNUMAForBuf(jobBuf);
-	slot.totalJob.outputBuf = jobQueue.resultBufferAlloc.pop_wait().value();
+	slot.totalJob.outputBuf = jobQueue.allocResultBuffer(slot.totalJob.originalInputData);
 	cl_event readFinished = subKernel.launchRead(slotI, bufSize, slot.totalJob.outputBuf, kernelFinished);
 
 	checkError(clSetEventCallback(readFinished, CL_COMPLETE, [](cl_event, cl_int, void* voidSlot) {
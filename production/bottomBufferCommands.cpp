@@ -53,7 +53,7 @@ inline void benchmarkBottomBufferProduction(const std::vector<std::string>& args
 
 	loopBack.join();
 	
-	for(size_t i = 0; i < NUMA_SLICE_COUNT; i++) {
+	for(int i = 0; i < context.numaSliceCount; i++) {
 		context.numaQueues[i]->validationQueue.close(); // Don't use validation queue
 		context.numaQueues[i]->outputQueue.close(); 
 	}
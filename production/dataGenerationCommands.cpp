@@ -10,6 +10,8 @@
 #include "../dedelib/fileNames.h"
 
 #include "../dedelib/MBFDecomposition.h"
+#include "../dedelib/linkCompression.h"
+#include "../dedelib/dataManifest.h"
 
 #include <random>
 #include "../dedelib/generators.h"
@@ -24,14 +26,15 @@ void runGenAllMBFs() {
 	std::pair<BufferedSet<Monotonic<Variables>>, size_t> resultPair;
 	{
 		TimeTracker timer;
-		resultPair = generateAllMBFsFast<Variables>();
+		resultPair = generateAllMBFsSharded<Variables>();
 	}
 	BufferedSet<Monotonic<Variables>>& result = resultPair.first;
 	size_t numberOfLinks = resultPair.second;
-	{
+	auto sizeOrder = [](const Monotonic<Variables>& a, const Monotonic<Variables>& b) -> bool {return a.size() < b.size(); };
+	if(!std::is_sorted(result.begin(), result.end(), sizeOrder)) { // generateAllMBFsSharded already produces them by size
 		std::cout << "Sorting\n";
 		TimeTracker timer;
-		std::sort(result.begin(), result.end(), [](Monotonic<Variables>& a, Monotonic<Variables>& b) -> bool {return a.size() < b.size(); });
+		std::sort(result.begin(), result.end(), sizeOrder);
 	}
 
 
@@ -236,7 +239,7 @@ void randomizeMBF_LUT7() {
 		if(i % 100000 == 0) std::cout << i << "/" << mbfCounts[Variables] << std::endl;
 	}
 
-	writeFlatBuffer(mbfsUINT64, FileName::flatMBFsU64(Variables), FlatMBFStructure<Variables>::MBF_COUNT*2);
+	writeFlatBufferWithManifest(mbfsUINT64, FileName::flatMBFsU64(Variables), FlatMBFStructure<Variables>::MBF_COUNT*2);
 
 	aligned_free(mbfsUINT64);
 }
@@ -374,6 +377,14 @@ CommandSet dataGenCommands {"Data Generation", {
 	{"convertFlatMBFStructureToSourceMBFStructure6", []() {convertFlatMBFStructureToSourceMBFStructure(6); }},
 	{"convertFlatMBFStructureToSourceMBFStructure7", []() {convertFlatMBFStructureToSourceMBFStructure(7); }},
 
+	{"compressMBFStructure1", []() {compressMBFStructure(1); }},
+	{"compressMBFStructure2", []() {compressMBFStructure(2); }},
+	{"compressMBFStructure3", []() {compressMBFStructure(3); }},
+	{"compressMBFStructure4", []() {compressMBFStructure(4); }},
+	{"compressMBFStructure5", []() {compressMBFStructure(5); }},
+	{"compressMBFStructure6", []() {compressMBFStructure(6); }},
+	{"compressMBFStructure7", []() {compressMBFStructure(7); }},
+
 	{"randomizeMBF_LUT7", []() {randomizeMBF_LUT7();}},
 
 	{"preCompute1", []() {preComputeFiles<1>(); }},
@@ -384,10 +395,16 @@ CommandSet dataGenCommands {"Data Generation", {
 	{"preCompute6", []() {preComputeFiles<6>(); }},
 	{"preCompute7", []() {preComputeFiles<7>(); }},
 
+	{"verifyDataFiles", []() {if(verifyDataFiles(FileName::dataPath) != 0) exit(1);}},
+	{"createDataManifests", []() {createDataManifests(FileName::dataPath);}},
+
 
 	//{"pawelskiAllIntervalsToTop3", pawelskiAllIntervalsToTop<3>()},
 	//{"pawelskiAllIntervalsToTop4", pawelskiAllIntervalsToTop<4>()},
 	{"pawelskiAllIntervalsToTop5", pawelskiAllIntervalsToTop<5>},
 	{"pawelskiAllIntervalsToTop6", pawelskiAllIntervalsToTop<6>},
 	{"pawelskiAllIntervalsToTop7", pawelskiAllIntervalsToTop<7>},
-}, {}};
+}, {
+	{"verifyDataFiles", [](const std::vector<std::string>& args) {if(verifyDataFiles(args[0]) != 0) exit(1);}},
+	{"createDataManifests", [](const std::vector<std::string>& args) {createDataManifests(args[0]);}},
+}};
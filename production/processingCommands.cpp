@@ -47,6 +47,22 @@ CommandSet processingCommands {"Massively parallel Processing Commands", {
 	{"processDedekindNumber6_SMT", []() {processDedekindNumber(6, cpuProcessor_SuperMultiThread<6>); }},
 	{"processDedekindNumber7_SMT", []() {processDedekindNumber(7, cpuProcessor_SuperMultiThread<7>); }},
 
+	{"processDedekindNumber1_FMT_Memo", []() {processDedekindNumber(1, cpuProcessor_FineMultiThread<1, true>); }},
+	{"processDedekindNumber2_FMT_Memo", []() {processDedekindNumber(2, cpuProcessor_FineMultiThread<2, true>); }},
+	{"processDedekindNumber3_FMT_Memo", []() {processDedekindNumber(3, cpuProcessor_FineMultiThread<3, true>); }},
+	{"processDedekindNumber4_FMT_Memo", []() {processDedekindNumber(4, cpuProcessor_FineMultiThread<4, true>); }},
+	{"processDedekindNumber5_FMT_Memo", []() {processDedekindNumber(5, cpuProcessor_FineMultiThread<5, true>); }},
+	{"processDedekindNumber6_FMT_Memo", []() {processDedekindNumber(6, cpuProcessor_FineMultiThread<6, true>); }},
+	{"processDedekindNumber7_FMT_Memo", []() {processDedekindNumber(7, cpuProcessor_FineMultiThread<7, true>); }},
+
+	{"processDedekindNumber1_Fused", []() {processDedekindNumberFused<1>(); }},
+	{"processDedekindNumber2_Fused", []() {processDedekindNumberFused<2>(); }},
+	{"processDedekindNumber3_Fused", []() {processDedekindNumberFused<3>(); }},
+	{"processDedekindNumber4_Fused", []() {processDedekindNumberFused<4>(); }},
+	{"processDedekindNumber5_Fused", []() {processDedekindNumberFused<5>(); }},
+	{"processDedekindNumber6_Fused", []() {processDedekindNumberFused<6>(); }},
+	{"processDedekindNumber7_Fused", []() {processDedekindNumberFused<7>(); }},
+
 	{"processDedekindNumber1_FMT_BasicValidated", []() {processDedekindNumberWithBasicValidator<1>(cpuProcessor_FineMultiThread<1>); }},
 	{"processDedekindNumber2_FMT_BasicValidated", []() {processDedekindNumberWithBasicValidator<2>(cpuProcessor_FineMultiThread<2>); }},
 	{"processDedekindNumber3_FMT_BasicValidated", []() {processDedekindNumberWithBasicValidator<3>(cpuProcessor_FineMultiThread<3>); }},
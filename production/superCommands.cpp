@@ -3,10 +3,15 @@
 #include "../dedelib/supercomputerJobs.h"
 #include "../dedelib/pcoeffValidator.h"
 #include "../dedelib/singleTopVerification.h"
+#include "../dedelib/jobBroker.h"
+#include "../dedelib/sharedBufferCache.h"
 
 #include <sstream>
 #include <filesystem>
 #include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <signal.h>
 #include "../dedelib/threadPool.h"
 
 template<unsigned int Variables>
@@ -41,6 +46,99 @@ static void processSuperComputingJob_SMT(const std::vector<std::string>& args) {
 	processSuperComputingJob_FromArgs<Variables>(args, "cpuSMT", cpuProcessor_SuperMultiThread<Variables>);
 }
 
+template<unsigned int Variables>
+static void processSuperComputingJob_SMT_Memo(const std::vector<std::string>& args) {
+	processSuperComputingJob_FromArgs<Variables>(args, "cpuSMT_Memo", cpuProcessor_SuperMultiThread<Variables, true>);
+}
+
+template<unsigned int Variables>
+static void processSuperComputingJob_Fused(const std::vector<std::string>& args) {
+	bool success = processJob(Variables, args[0], args[1], "cpuFused", [](const std::function<std::vector<JobTopInfo>()>& topLoader, const std::function<void(const OutputBuffer&, const char*, bool)>&) {
+		return fusedCPUPipeline<Variables>(topLoader);
+	});
+
+	if(!success) std::abort();
+}
+
+// method is one of ST, FMT, SMT, SMT_Memo or Fused, methodName receives the name used in the job files
+// The returned pipeline keeps everything it loads for the first job resident for all later jobs
+template<unsigned int Variables>
+static JobPipeline getJobPipeline(const std::string& method, std::string& methodName) {
+	void (*processorFunc)(PCoeffProcessingContext&);
+	if(method == "ST") {
+		processorFunc = cpuProcessor_SingleThread<Variables>;
+	} else if(method == "FMT") {
+		processorFunc = cpuProcessor_FineMultiThread<Variables>;
+	} else if(method == "SMT") {
+		processorFunc = cpuProcessor_SuperMultiThread<Variables>;
+	} else if(method == "SMT_Memo") {
+		processorFunc = cpuProcessor_SuperMultiThread<Variables, true>;
+	} else if(method == "Fused") {
+		methodName = "cpuFused";
+		// Shared by the copies of the JobPipeline, loaded by the first job
+		std::shared_ptr<std::unique_ptr<FusedPipelineData<Variables>>> data = std::make_shared<std::unique_ptr<FusedPipelineData<Variables>>>();
+		return [data](const std::function<std::vector<JobTopInfo>()>& topLoader, const std::function<void(const OutputBuffer&, const char*, bool)>&) {
+			if(!*data) *data = std::make_unique<FusedPipelineData<Variables>>();
+			return fusedCPUPipeline<Variables>(**data, topLoader);
+		};
+	} else {
+		std::cerr << "Unknown processing method " + method + ", expected ST, FMT, SMT, SMT_Memo or Fused! Aborting!\n" << std::flush;
+		std::abort();
+	}
+	methodName = "cpu" + method;
+	return makeResidentPCoeffPipeline(Variables, processorFunc);
+}
+
+static std::atomic<JobBroker*> signalledBroker{nullptr};
+static void stopBrokerOnSignal(int) {
+	JobBroker* broker = signalledBroker.load();
+	if(broker != nullptr) broker->stop();
+}
+
+enum class JobSource {BROKER, LIST, FOLDER};
+
+// Runs a stream of jobs in this process, everything loaded for the first job stays resident for the next ones
+template<unsigned int Variables>
+static bool processJobsResident(JobSource source, const std::string& projectFolderPath, const std::string& method, const std::vector<std::string>& sourceArgs) {
+	std::string methodName;
+	JobPipeline pipeline = getJobPipeline<Variables>(method, methodName);
+	switch(source) {
+		case JobSource::LIST:
+			return processJobList(Variables, projectFolderPath, sourceArgs, methodName, pipeline);
+		case JobSource::FOLDER:
+			return processJobsFromFolder(Variables, projectFolderPath, sourceArgs.empty() ? 60.0 : std::stod(sourceArgs[0]), methodName, pipeline);
+		case JobSource::BROKER:
+			break;
+	}
+	const std::string& brokerAddress = sourceArgs[0];
+	if(brokerAddress != "local") {
+		return processJobsFromBroker(Variables, projectFolderPath, brokerAddress, methodName, pipeline);
+	}
+	// Local stand-in for a single machine: the broker serves on the project's unix socket from a thread of this process
+	std::string localAddress = "unix:" + getDefaultBrokerSocketPath(projectFolderPath);
+	JobBroker broker(projectFolderPath, BrokerAddress::parse(localAddress), 600.0);
+	std::thread brokerThread([&broker]() {broker.run();});
+	bool success = processJobsFromBroker(Variables, projectFolderPath, localAddress, methodName, pipeline);
+	broker.stop();
+	brokerThread.join();
+	return success;
+}
+
+static void processJobsResidentForTarget(const std::string& targetDedekindNumber, JobSource source, const std::string& projectFolderPath, const std::string& method, const std::vector<std::string>& sourceArgs) {
+	bool success;
+	switch(std::stoi(targetDedekindNumber)) {
+		case 3: success = processJobsResident<1>(source, projectFolderPath, method, sourceArgs); break;
+		case 4: success = processJobsResident<2>(source, projectFolderPath, method, sourceArgs); break;
+		case 5: success = processJobsResident<3>(source, projectFolderPath, method, sourceArgs); break;
+		case 6: success = processJobsResident<4>(source, projectFolderPath, method, sourceArgs); break;
+		case 7: success = processJobsResident<5>(source, projectFolderPath, method, sourceArgs); break;
+		case 8: success = processJobsResident<6>(source, projectFolderPath, method, sourceArgs); break;
+		case 9: success = processJobsResident<7>(source, projectFolderPath, method, sourceArgs); break;
+		default: std::cerr << "Unsupported Dedekind target D(" + targetDedekindNumber + ")! Aborting!\n" << std::flush; std::abort();
+	}
+	if(!success) std::abort();
+}
+
 template<unsigned int Variables>
 void checkErrorBuffer(const std::vector<std::string>& args) {
 	const std::string& fileName = args[0];
@@ -1590,7 +1688,10 @@ void checkAllDedupTerms(const std::vector<std::string>& args) {
 	});
 }
 
-CommandSet superCommands {"Supercomputing Commands", {}, {
+CommandSet superCommands {"Supercomputing Commands", {
+	{"listSharedBufferCache", [](){listSharedBufferCache(SHARED_BUFFER_CACHE_DIR.empty() ? "/dev/shm" : SHARED_BUFFER_CACHE_DIR);}},
+	{"clearSharedBufferCache", [](){clearSharedBufferCache(SHARED_BUFFER_CACHE_DIR.empty() ? "/dev/shm" : SHARED_BUFFER_CACHE_DIR);}},
+}, {
 	{"initializeSupercomputingProject", [](const std::vector<std::string>& args) {
 		std::string projectFolderPath = args[0];
 		unsigned int targetDedekindNumber = std::stoi(args[1]);
@@ -1602,6 +1703,37 @@ CommandSet superCommands {"Supercomputing Commands", {}, {
 		}
 		initializeComputeProject(targetDedekindNumber - 2, projectFolderPath, numberOfJobs, numberOfJobsToActuallyGenerate);
 	}},
+	{"initializeBalancedSupercomputingProject", [](const std::vector<std::string>& args) {
+		std::string projectFolderPath = args[0];
+		unsigned int targetDedekindNumber = std::stoi(args[1]);
+		size_t numberOfJobs = std::stoi(args[2]);
+		std::string timingsCSV = args.size() >= 4 ? args[3] : "";
+		initializeComputeProject(targetDedekindNumber - 2, projectFolderPath, numberOfJobs, numberOfJobs, JobSplitting::PREDICTED_WORK, timingsCSV);
+	}},
+
+	{"runJobBroker", [](const std::vector<std::string>& args) {
+		std::string projectFolderPath = args[0];
+		std::string address = args.size() >= 2 ? args[1] : "unix:" + getDefaultBrokerSocketPath(projectFolderPath);
+		double leaseSeconds = args.size() >= 3 ? std::stod(args[2]) : 600.0;
+		JobBroker broker(projectFolderPath, BrokerAddress::parse(address), leaseSeconds);
+		signalledBroker.store(&broker);
+		signal(SIGINT, stopBrokerOnSignal);
+		signal(SIGTERM, stopBrokerOnSignal);
+		broker.run();
+		signalledBroker.store(nullptr);
+	}},
+	{"processJobsFromBroker", [](const std::vector<std::string>& args) {
+		// folder,brokerAddress,target,method
+		processJobsResidentForTarget(args[2], JobSource::BROKER, args[0], args[3], {args[1]});
+	}},
+	{"processJobListResident", [](const std::vector<std::string>& args) {
+		// folder,target,method,jobID[,jobID...]
+		processJobsResidentForTarget(args[1], JobSource::LIST, args[0], args[2], std::vector<std::string>(args.begin() + 3, args.end()));
+	}},
+	{"watchJobsResident", [](const std::vector<std::string>& args) {
+		// folder,target,method[,idleExitSeconds]
+		processJobsResidentForTarget(args[1], JobSource::FOLDER, args[0], args[2], std::vector<std::string>(args.begin() + 3, args.end()));
+	}},
 
 	{"resetUnfinishedJobs", [](const std::vector<std::string>& args){
 		size_t lowerBound = 0;
@@ -1645,6 +1777,22 @@ CommandSet superCommands {"Supercomputing Commands", {}, {
 	{"processJobCPU6_SMT", processSuperComputingJob_SMT<6>},
 	{"processJobCPU7_SMT", processSuperComputingJob_SMT<7>},
 
+	{"processJobCPU1_SMT_Memo", processSuperComputingJob_SMT_Memo<1>},
+	{"processJobCPU2_SMT_Memo", processSuperComputingJob_SMT_Memo<2>},
+	{"processJobCPU3_SMT_Memo", processSuperComputingJob_SMT_Memo<3>},
+	{"processJobCPU4_SMT_Memo", processSuperComputingJob_SMT_Memo<4>},
+	{"processJobCPU5_SMT_Memo", processSuperComputingJob_SMT_Memo<5>},
+	{"processJobCPU6_SMT_Memo", processSuperComputingJob_SMT_Memo<6>},
+	{"processJobCPU7_SMT_Memo", processSuperComputingJob_SMT_Memo<7>},
+
+	{"processJobCPU1_Fused", processSuperComputingJob_Fused<1>},
+	{"processJobCPU2_Fused", processSuperComputingJob_Fused<2>},
+	{"processJobCPU3_Fused", processSuperComputingJob_Fused<3>},
+	{"processJobCPU4_Fused", processSuperComputingJob_Fused<4>},
+	{"processJobCPU5_Fused", processSuperComputingJob_Fused<5>},
+	{"processJobCPU6_Fused", processSuperComputingJob_Fused<6>},
+	{"processJobCPU7_Fused", processSuperComputingJob_Fused<7>},
+
 	{"checkErrorBuffer1", checkErrorBuffer<1>},
 	{"checkErrorBuffer2", checkErrorBuffer<2>},
 	{"checkErrorBuffer3", checkErrorBuffer<3>},
@@ -1,3 +1,5 @@
+// toString.h provides operator<< for u128, it must be visible before testsMain.h defines GEN
+#include "../dedelib/toString.h"
 #include "testsMain.h"
 
 #include "../dedelib/bigint/uint128_t.h"
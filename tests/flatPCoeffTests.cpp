@@ -0,0 +1,512 @@
+#include "testsMain.h"
+#include "testUtils.h"
+#include "../dedelib/generators.h"
+
+#include "../dedelib/connectGraph.h"
+#include "../dedelib/flatPCoeff.h"
+#include "../dedelib/linkCompression.h"
+#include "../dedelib/synchronizedQueue.h"
+#include "../dedelib/jobCheckpoint.h"
+#include "../dedelib/resultCollection.h"
+#include "../dedelib/topScheduling.h"
+#include "../dedelib/dataManifest.h"
+#include "../dedelib/MBFDecomposition.h"
+#include "../dedelib/topology.h"
+
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+template<unsigned int Variables>
+struct ConnectCountBatchedVsSingle {
+	static void run() {
+		constexpr size_t GRAPH_COUNT = 1000;
+		std::vector<BooleanFunction<Variables>> graphs;
+		for(size_t i = 0; i < GRAPH_COUNT; i++) {
+			Monotonic<Variables> top(generateMBF<Variables>());
+			Monotonic<Variables> bot(top.bf & generateMBF<Variables>());
+			if(bot == top) continue;
+			graphs.push_back(andnot(top.bf, bot.bf));
+		}
+
+		std::vector<uint64_t> foundCounts(graphs.size(), 0);
+		size_t reportedCount = 0;
+		forEachConnectCountBatched<Variables>(&graphs[0], &graphs[0] + graphs.size(), [&](size_t graphIndex, uint64_t connectCount) {
+			ASSERT(foundCounts[graphIndex] == 0);
+			foundCounts[graphIndex] = connectCount;
+			reportedCount++;
+		});
+
+		ASSERT(reportedCount == graphs.size());
+		for(size_t i = 0; i < graphs.size(); i++) {
+			ASSERT(foundCounts[i] == countConnectedVeryFast<Variables>(graphs[i]));
+		}
+	}
+};
+
+TEST_CASE(testConnectCountBatched) {
+	runFunctionRange<3, 7, ConnectCountBatchedVsSingle>();
+}
+
+template<unsigned int Variables>
+BooleanFunction<Variables> symmetrizeUp(BooleanFunction<Variables> bf, unsigned int symmetricVarCount) {
+	for(unsigned int v = 1; v < symmetricVarCount; v++) {
+		bf |= bf.swapped(0, v);
+	}
+	return bf;
+}
+
+template<unsigned int Variables>
+struct PCoeffSumSymmetricVsNaive {
+	static void run() {
+		for(int iter = 0; iter < SMALL_ITER; iter++) {
+			// Build tops and bots with nontrivial automorphism groups, as random MBFs rarely have any
+			unsigned int symmetricVarCount = generateInt(Variables + 1);
+			Monotonic<Variables> top(symmetrizeUp(generateMBF<Variables>(), symmetricVarCount));
+			Monotonic<Variables> bot(top.bf & generateMBF<Variables>());
+			if(genBool()) {
+				bot = Monotonic<Variables>(~symmetrizeUp(~bot.bf, symmetricVarCount));
+			}
+
+			TopSymmetries<Variables> topSymmetries(top);
+			BooleanFunction<Variables> graphsBuf[factorial(Variables)];
+			ASSERT(processPCoeffSumSymmetric<Variables>(top, bot, topSymmetries, graphsBuf) == processPCoeffSum<Variables>(top, bot));
+		}
+	}
+};
+
+TEST_CASE(testPCoeffSumSymmetric) {
+	runFunctionRange<1, 7, PCoeffSumSymmetricVsNaive>();
+}
+
+template<unsigned int Variables>
+struct PCoeffSumMemoizedVsNaive {
+	template<bool CanonicalKeys>
+	static void runWithCache() {
+		ConnectCountCache<Variables, CanonicalKeys>* cache = new ConnectCountCache<Variables, CanonicalKeys>();
+		BooleanFunction<Variables> graphsBuf[factorial(Variables)];
+		for(int iter = 0; iter < SMALL_ITER; iter++) {
+			Monotonic<Variables> top(generateMBF<Variables>());
+			Monotonic<Variables> bot(top.bf & generateMBF<Variables>());
+
+			// Run twice, the second time must be at least partly served from the cache
+			ProcessedPCoeffSum correct = processPCoeffSum<Variables>(top, bot);
+			ASSERT(processPCoeffSumMemoized<Variables>(top, bot, *cache, graphsBuf) == correct);
+			uint64_t hitsBefore = cache->hits;
+			ASSERT(processPCoeffSumMemoized<Variables>(top, bot, *cache, graphsBuf) == correct);
+			if(getPCoeffCount(correct) != 0) ASSERT(cache->hits > hitsBefore);
+		}
+		delete cache;
+	}
+	static void run() {
+		runWithCache<false>();
+		runWithCache<true>();
+	}
+};
+
+TEST_CASE(testPCoeffSumMemoized) {
+	runFunctionRange<1, 7, PCoeffSumMemoizedVsNaive>();
+}
+
+template<unsigned int Variables>
+struct PermutationsBelowVsFiltered {
+	static void run() {
+		for(int iter = 0; iter < SMALL_ITER; iter++) {
+			Monotonic<Variables> top(generateMBF<Variables>());
+			Monotonic<Variables> bot(generateMBF<Variables>());
+			if(genBool()) bot = Monotonic<Variables>(top.bf & bot.bf);
+
+			std::vector<BooleanFunction<Variables>> correct;
+			bot.forEachPermutation([&](const Monotonic<Variables>& permutedBot) {
+				if(permutedBot <= top) correct.push_back(permutedBot.bf);
+			});
+			std::vector<BooleanFunction<Variables>> found;
+			bot.forEachPermutationBelow(top, [&](const Monotonic<Variables>& permutedBot) {
+				found.push_back(permutedBot.bf);
+			});
+
+			auto cmp = [](const BooleanFunction<Variables>& a, const BooleanFunction<Variables>& b) {return a.bitset < b.bitset;};
+			std::sort(correct.begin(), correct.end(), cmp);
+			std::sort(found.begin(), found.end(), cmp);
+			ASSERT(found.size() == correct.size());
+			for(size_t i = 0; i < found.size(); i++) {
+				ASSERT(found[i] == correct[i]);
+			}
+		}
+	}
+};
+
+TEST_CASE(testForEachPermutationBelow) {
+	runFunctionRange<1, 7, PermutationsBelowVsFiltered>();
+}
+
+TEST_CASE(testLinkCompressionRoundtrip) {
+	for(int iter = 0; iter < SMALL_ITER; iter++) {
+		size_t linkCount = rand() % 300 + 1;
+		std::vector<uint32_t> links(linkCount);
+		uint32_t fromIdx = rand() % 1000;
+		for(size_t i = 0; i < linkCount; i++) {
+			// Mostly small ascending steps within a streak, with large jumps at streak starts
+			if(genBool()) {
+				fromIdx = rand() % (1 << 24);
+			} else {
+				fromIdx += rand() % 300;
+			}
+			links[i] = (fromIdx & uint32_t(0x7FFFFFFF)) | (genBool() || i == linkCount - 1 ? uint32_t(0x80000000) : 0);
+		}
+
+		std::vector<uint8_t> compressed(maxCompressedLinkBlockSize(linkCount) + COMPRESSED_LINKS_PADDING, 0);
+		size_t compressedSize = compressLinkBlock(&links[0], linkCount, &compressed[0]);
+		ASSERT(compressedSize <= maxCompressedLinkBlockSize(linkCount));
+
+		std::vector<uint32_t> decoded((linkCount + 3) / 4 * 4);
+		__m128i previousFromIdx = _mm_setzero_si128();
+		const uint8_t* end = decodeLinkGroups(&compressed[0], (linkCount + 3) / 4, previousFromIdx, &decoded[0]);
+		ASSERT(end == &compressed[0] + compressedSize);
+		for(size_t i = 0; i < linkCount; i++) {
+			ASSERT(decoded[i] == links[i]);
+		}
+	}
+}
+
+TEST_CASE(testLockFreeQueueMPMC) {
+	// Like the buffer circulation: a fixed set of items passes through a small queue from several producers to several consumers
+	constexpr int PRODUCER_COUNT = 4;
+	constexpr int CONSUMER_COUNT = 4;
+	constexpr uint64_t ITEMS_PER_PRODUCER = 20000;
+	LockFreeQueue<uint64_t> queue(16);
+	SynchronizedQueue<bool> slots(16); // Keeps the number of items in flight below the capacity
+	for(int i = 0; i < 16; i++) slots.push(true);
+
+	std::atomic<uint64_t> poppedSum(0);
+	std::atomic<uint64_t> poppedCount(0);
+	std::vector<std::thread> threads;
+	for(int c = 0; c < CONSUMER_COUNT; c++) {
+		threads.emplace_back([&]() {
+			for(std::optional<uint64_t> item; (item = queue.pop_wait()).has_value(); ) {
+				poppedSum.fetch_add(item.value());
+				poppedCount.fetch_add(1);
+				slots.push(true);
+			}
+		});
+	}
+	std::vector<std::thread> producers;
+	for(int p = 0; p < PRODUCER_COUNT; p++) {
+		producers.emplace_back([&, p]() {
+			for(uint64_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+				slots.pop_wait();
+				queue.push(p * ITEMS_PER_PRODUCER + i);
+			}
+		});
+	}
+	for(std::thread& t : producers) t.join();
+	queue.close();
+	for(std::thread& t : threads) t.join();
+	slots.close();
+
+	uint64_t totalItems = PRODUCER_COUNT * ITEMS_PER_PRODUCER;
+	ASSERT(poppedCount.load() == totalItems);
+	ASSERT(poppedSum.load() == totalItems * (totalItems - 1) / 2);
+	uint64_t item;
+	bool closedAndEmpty = queue.try_pop(item) == TryPopStatus::CLOSED;
+	ASSERT(closedAndEmpty);
+}
+
+TEST_CASE(testJobCheckpointResume) {
+	constexpr unsigned int Variables = 3;
+	size_t validationSize = VALIDATION_BUFFER_SIZE(Variables);
+	std::string filePath = (std::filesystem::temp_directory_path() / "testJobCheckpoint.checkpoint").string();
+	std::filesystem::remove(filePath);
+
+	std::vector<BetaResult> savedResults(2);
+	for(size_t i = 0; i < savedResults.size(); i++) {
+		savedResults[i].topIndex = 1 + 3 * i;
+		savedResults[i].dataForThisTop.betaSum = BetaSum{100 + i, 10 + i};
+		savedResults[i].dataForThisTop.betaSumDualDedup = BetaSum{200 + i, 20 + i};
+	}
+	std::vector<ValidationData> bufferA(validationSize);
+	std::vector<ValidationData> bufferB(validationSize);
+	for(size_t i = 0; i < validationSize; i++) {
+		bufferA[i].dualBetaSum = BetaSum{i, 1};
+		bufferB[i].dualBetaSum = BetaSum{1000 * i, 2};
+	}
+	{
+		JobCheckpoint checkpoint(Variables, filePath);
+		ASSERT(checkpoint.getLoadedResultCount() == 0);
+		ValidationData* buffers[2]{&bufferA[0], &bufferB[0]};
+		checkpoint.addToCheckpoint(&savedResults[0], savedResults.size(), buffers, 2);
+		checkpoint.writeToFile();
+	}
+	// The temporary file is renamed over the checkpoint, nothing is left next to it
+	for(const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(std::filesystem::temp_directory_path())) {
+		ASSERT(entry.path().filename().string().rfind("testJobCheckpoint.checkpoint.tmp", 0) != 0);
+	}
+	for(size_t i = 0; i < validationSize; i++) {
+		bool cleared = bufferA[i].dualBetaSum == BetaSum{0, 0} && bufferB[i].dualBetaSum == BetaSum{0, 0};
+		ASSERT(cleared);
+	}
+
+	// A new run skips the saved tops, and gets their results and validation terms back at the end
+	JobCheckpoint resumed(Variables, filePath);
+	ASSERT(resumed.getLoadedResultCount() == savedResults.size());
+	std::vector<JobTopInfo> jobTops;
+	for(uint32_t top = 0; top < 6; top++) jobTops.push_back(JobTopInfo{top, top});
+	std::vector<JobTopInfo> remainingTops = resumed.removeFinishedTops(jobTops);
+	ASSERT(remainingTops.size() == 4);
+	for(const JobTopInfo& top : remainingTops) {
+		bool wasNotSaved = top.top != 1 && top.top != 4;
+		ASSERT(wasNotSaved);
+	}
+
+	std::vector<ValidationData> outputBuffer(validationSize);
+	for(size_t i = 0; i < validationSize; i++) outputBuffer[i].dualBetaSum = BetaSum{0, 5};
+	ResultProcessorOutput output;
+	output.results.resize(1);
+	output.results[0].topIndex = 0;
+	output.validationBuffer = &outputBuffer[0];
+	resumed.addToOutput(output);
+	ASSERT(output.results.size() == 3);
+	bool resultsRestored = output.results[1] == savedResults[0] && output.results[2] == savedResults[1];
+	ASSERT(resultsRestored);
+	for(size_t i = 0; i < validationSize; i++) {
+		bool validationRestored = outputBuffer[i].dualBetaSum == BetaSum{1001 * i, 8};
+		ASSERT(validationRestored);
+	}
+
+	resumed.removeFile();
+	ASSERT(!std::filesystem::exists(filePath));
+}
+
+TEST_CASE(testPackIntoBinsLPT) {
+	std::vector<double> costs{7.0, 1.0, 5.0, 3.0, 2.0, 6.0, 4.0, 8.0};
+	std::vector<double> binTotals;
+	std::vector<size_t> binOfItem = packIntoBinsLPT(costs, 3, binTotals);
+
+	ASSERT(binTotals.size() == 3);
+	std::vector<double> recomputedTotals(3, 0.0);
+	for(size_t i = 0; i < costs.size(); i++) {
+		ASSERT(binOfItem[i] < 3);
+		recomputedTotals[binOfItem[i]] += costs[i];
+	}
+	for(size_t bin = 0; bin < 3; bin++) {
+		ASSERT(recomputedTotals[bin] == binTotals[bin]);
+	}
+	// Largest first into the lightest bin: {8,3,2} {7,4,1} {6,5}, within the 4/3 bound of the perfect split of 12
+	ASSERT(binTotals[0] == 13.0);
+	ASSERT(binTotals[1] == 12.0);
+	ASSERT(binTotals[2] == 11.0);
+}
+
+TEST_CASE(testDataManifestDetectsCorruption) {
+	// Reference values of XXH64 with seed 0
+	ASSERT(xxh64("", 0) == 0xEF46DB3751D8E999);
+	ASSERT(xxh64("abc", 3) == 0x44BC2CF5AD770999);
+
+	std::vector<uint32_t> data(10000);
+	for(size_t i = 0; i < data.size(); i++) data[i] = uint32_t(i * 2654435761u);
+	size_t byteSize = data.size() * sizeof(uint32_t);
+	DataManifest manifest = computeDataManifest(data.data(), byteSize, 4096);
+	ASSERT(manifest.getChunkCount() == 10);
+	ASSERT(manifest.getChunkSize(9) == byteSize - 9 * 4096);
+
+	std::string filePath = (std::filesystem::temp_directory_path() / "testDataManifest.bin").string();
+	writeDataManifest(filePath, manifest);
+	DataManifest readBack;
+	ASSERT(readDataManifest(filePath, readBack));
+	bool sameManifest = readBack.fileSize == byteSize && readBack.chunkSize == 4096 && readBack.chunkHashes == manifest.chunkHashes;
+	ASSERT(sameManifest);
+	std::filesystem::remove(getDataManifestPath(filePath));
+
+	const char* bytes = reinterpret_cast<const char*>(data.data());
+	for(size_t chunk = 0; chunk < manifest.getChunkCount(); chunk++) {
+		ASSERT(manifest.checkChunk(chunk, bytes + chunk * 4096));
+	}
+	data[4096 * 3 / sizeof(uint32_t) + 17] ^= 1 << 9; // A single bit flip in chunk 3
+	ASSERT(!manifest.checkChunk(3, bytes + 3 * 4096));
+	ASSERT(manifest.checkChunk(2, bytes + 2 * 4096));
+}
+
+template<unsigned int Variables>
+struct GenerateAllMBFsShardedVsFast {
+	static void run() {
+		std::pair<BufferedSet<Monotonic<Variables>>, size_t> fast = generateAllMBFsFast<Variables>();
+		std::pair<BufferedSet<Monotonic<Variables>>, size_t> sharded = generateAllMBFsSharded<Variables>(4);
+		ASSERT(sharded.first.size() == mbfCounts[Variables]);
+		ASSERT(sharded.first.size() == fast.first.size());
+		ASSERT(sharded.second == fast.second);
+		for(const Monotonic<Variables>& mbf : fast.first) {
+			ASSERT(sharded.first.contains(mbf));
+		}
+		for(size_t i = 1; i < sharded.first.size(); i++) {
+			ASSERT(sharded.first[i - 1].size() <= sharded.first[i].size());
+		}
+	}
+};
+TEST_CASE(testGenerateAllMBFsSharded) {
+	runFunctionRange<1, 6, GenerateAllMBFsShardedVsFast>();
+}
+
+TEST_CASE(testSlabAllocatorWrapsAround) {
+	SynchronizedSlabAllocator<uint32_t> slab(400, 16);
+	uint32_t* bufs[4];
+	size_t sizes[4]{100, 100, 100, 100};
+	slab.allocN_wait(bufs, sizes, 4); // Slab exactly full
+	for(int i = 0; i < 4; i++) {
+		ASSERT(bufs[i] == slab.get().slabStart + i * 100);
+	}
+	slab.free(bufs[0]);
+	uint32_t* wrapped = slab.alloc_wait(100);
+	ASSERT(wrapped == slab.get().slabStart);
+	// The gap up to the oldest buffer is exactly full now, allocating must not run over it
+	ASSERT(slab.get().alloc(1) == nullptr);
+
+	// A batch that doesn't fit must leave nothing behind
+	slab.free(bufs[1]);
+	slab.free(bufs[2]);
+	ASSERT(slab.getNumberOfChunksInUse() == 2);
+	ASSERT(slab.get().alloc(300) == nullptr);
+	ASSERT(slab.getNumberOfChunksInUse() == 2);
+
+	uint32_t* smallBuf = slab.alloc_wait(150);
+	ASSERT(smallBuf == slab.get().slabStart + 100);
+	ASSERT(slab.shrinkIfLastAllocation(smallBuf, 50));
+	ASSERT(!slab.shrinkIfLastAllocation(wrapped, 50)); // Not the newest buffer
+	ASSERT(slab.alloc_wait(150) == slab.get().slabStart + 150);
+}
+
+TEST_CASE(testSlabAllocatorFreeWrappedNewest) {
+	SlabAllocator<uint32_t> slab(250, 16);
+	uint32_t* a = slab.alloc(100);
+	uint32_t* b = slab.alloc(100);
+	ASSERT(b == slab.slabStart + 100);
+	slab.free(a);
+	uint32_t* c = slab.alloc(80);
+	ASSERT(c == slab.slabStart); // Wrapped
+	slab.free(c);
+	// Only b is left, but the allocator is still in the gap before it. 150 doesn't fit in front of b, nor after it
+	uint32_t* d = slab.alloc(150);
+	ASSERT(d == nullptr);
+	uint32_t* e = slab.alloc(20);
+	ASSERT(e == slab.slabStart + 80); // Exactly fills the gap before b
+	ASSERT(slab.alloc(1) == nullptr);
+	slab.free(b);
+	// e is the oldest chunk now, the allocator is back at the end
+	ASSERT(slab.alloc(150) == slab.slabStart + 100);
+}
+
+TEST_CASE(testSlabAllocatorFailedBatchAfterWrap) {
+	SynchronizedSlabAllocator<uint32_t> slab(250, 16);
+	uint32_t* a = slab.alloc_wait(100);
+	uint32_t* b = slab.alloc_wait(100);
+	slab.free(a);
+
+	// The first buffer of the batch wraps to the start of the slab, the second doesn't fit in front of b, so the batch is rolled back and waits
+	uint32_t* batch[2];
+	size_t batchSizes[2]{80, 80};
+	std::atomic<bool> batchStarted(false);
+	std::thread batchThread([&]() {
+		batchStarted.store(true);
+		slab.allocN_wait(batch, batchSizes, 2);
+	});
+	while(!batchStarted.load()) std::this_thread::yield();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	// The rollback must undo the wrap too, otherwise this would be put at the start of the slab, over b
+	ASSERT(slab.getNumberOfChunksInUse() == 1);
+	uint32_t* afterB = slab.alloc_wait(50);
+	ASSERT(afterB == slab.get().slabStart + 200);
+	slab.free(b);
+	slab.free(afterB);
+	batchThread.join();
+	ASSERT(batch[0] == slab.get().slabStart);
+	ASSERT(batch[1] == slab.get().slabStart + 80);
+}
+
+TEST_CASE(testWorkStealingRangesClaimEverythingOnce) {
+	constexpr uint32_t SIZE = 200000;
+	constexpr size_t THREAD_COUNT = 8;
+	WorkStealingRanges ranges(SIZE, THREAD_COUNT);
+	std::unique_ptr<std::atomic<uint8_t>[]> claimCounts(new std::atomic<uint8_t>[SIZE]);
+	for(uint32_t i = 0; i < SIZE; i++) claimCounts[i].store(0);
+
+	std::vector<std::thread> threads;
+	for(size_t t = 0; t < THREAD_COUNT; t++) {
+		threads.emplace_back([&, t]() {
+			uint32_t blockStart;
+			uint32_t blockEnd;
+			// Uneven block sizes so some threads run out early and have to steal
+			while(ranges.claimBlock(t, uint32_t(t * 5 + 1), blockStart, blockEnd)) {
+				for(uint32_t i = blockStart; i < blockEnd; i++) claimCounts[i].fetch_add(1);
+			}
+		});
+	}
+	for(std::thread& t : threads) t.join();
+
+	for(uint32_t i = 0; i < SIZE; i++) {
+		ASSERT(claimCounts[i].load() == 1);
+	}
+}
+
+TEST_CASE(testParseCPUList) {
+	bool rangesAndSingles = parseCPUList("0-3,8,10-11") == (std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+	ASSERT(rangesAndSingles);
+	bool single = parseCPUList("5") == std::vector<int>{5};
+	ASSERT(single);
+	bool trailingNewline = parseCPUList("2,4-5\n") == (std::vector<int>{2, 4, 5});
+	ASSERT(trailingNewline);
+	bool oneCPURange = parseCPUList("7-7") == std::vector<int>{7};
+	ASSERT(oneCPURange);
+	ASSERT(parseCPUList("").empty());
+}
+
+static void writeFakeSysFile(const std::filesystem::path& file, const std::string& content) {
+	std::filesystem::create_directories(file.parent_path());
+	std::ofstream(file) << content << "\n";
+}
+
+TEST_CASE(testDetectTopologyFromFakeSysfs) {
+	std::filesystem::path sysDir = std::filesystem::temp_directory_path() / "testDetectTopologySysfs";
+	std::filesystem::remove_all(sysDir);
+
+	// Two sockets of four CPUs, CPU 7 is offline. Socket 0 has one L3 and SMT pairs 0-1 and 2-3, socket 1 has two L3s and pairs 4,6 and 5,7
+	writeFakeSysFile(sysDir / "cpu/online", "0-6");
+	const char* siblings[8] = {"0-1", "0-1", "2-3", "2-3", "4,6", "5,7", "4,6", "5,7"};
+	const char* l3s[8] = {"0-3", "0-3", "0-3", "0-3", "4-5", "4-5", "6-7", "6-7"};
+	for(int cpu = 0; cpu < 8; cpu++) {
+		std::filesystem::path cpuDir = sysDir / "cpu" / ("cpu" + std::to_string(cpu));
+		writeFakeSysFile(cpuDir / "topology/physical_package_id", std::to_string(cpu / 4));
+		writeFakeSysFile(cpuDir / "topology/thread_siblings_list", siblings[cpu]);
+		writeFakeSysFile(cpuDir / "cache/index0/level", "1");
+		writeFakeSysFile(cpuDir / "cache/index0/shared_cpu_list", siblings[cpu]);
+		writeFakeSysFile(cpuDir / "cache/index3/level", "3");
+		writeFakeSysFile(cpuDir / "cache/index3/shared_cpu_list", l3s[cpu]);
+	}
+	// Node ids are not in CPU order, node 2 only has memory
+	writeFakeSysFile(sysDir / "node/node1/cpulist", "0-3");
+	writeFakeSysFile(sysDir / "node/node0/cpulist", "4-7");
+	writeFakeSysFile(sysDir / "node/node2/cpulist", "");
+	writeFakeSysFile(sysDir / "node/possible", "0-2");
+
+	CPUTopology topology = detectTopology(sysDir.string());
+	std::filesystem::remove_all(sysDir);
+
+	bool sameSockets = topology.sockets == (std::vector<std::vector<int>>{{0, 1, 2, 3}, {4, 5, 6}});
+	ASSERT(sameSockets);
+	bool samePhysicalCores = topology.physicalCores == (std::vector<std::vector<int>>{{0, 1}, {2, 3}, {4, 6}, {5}});
+	ASSERT(samePhysicalCores);
+	bool sameCoreComplexes = topology.coreComplexes == (std::vector<std::vector<int>>{{0, 1, 2, 3}, {4, 5}, {6}});
+	ASSERT(sameCoreComplexes);
+	bool sameCoreComplexSocket = topology.coreComplexSocket == (std::vector<int>{0, 1, 1});
+	ASSERT(sameCoreComplexSocket);
+	bool sameNumaNodes = topology.numaNodes == (std::vector<std::vector<int>>{{0, 1, 2, 3}, {4, 5, 6}});
+	ASSERT(sameNumaNodes);
+	bool sameNumaNodeIds = topology.numaNodeIds == (std::vector<int>{1, 0});
+	ASSERT(sameNumaNodeIds);
+	bool sameNumaNodeSocket = topology.numaNodeSocket == (std::vector<int>{0, 1});
+	ASSERT(sameNumaNodeSocket);
+	ASSERT(topology.getNUMANodeString(0) == "1");
+	// The first thread of every core comes before the second ones
+	bool sameCpuOrder = topology.cpuOrder == (std::vector<int>{0, 2, 1, 3, 4, 5, 6});
+	ASSERT(sameCpuOrder);
+}
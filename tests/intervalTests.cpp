@@ -9,6 +9,10 @@
 #include "../dedelib/intervalSizeFromBottom.h"
 #include "../dedelib/MBFDecomposition.h"
 
+#include <filesystem>
+#include <thread>
+#include <vector>
+
 template<unsigned int Variables>
 struct BotToTopIntervalSize {
 	static void run() {
@@ -88,6 +92,133 @@ TEST_CASE(testIntervalSizeCache) {
 	runFunctionRange<1, 4, IntervalSizeCacheTest>();
 }
 
+template<unsigned int Variables>
+struct IntervalSizeCacheSaveLoadTest {
+	static void run() {
+		using MBF = Monotonic<Variables>;
+		using INT = Interval<Variables>;
+		IntervalSizeCache<Variables> generated = IntervalSizeCache<Variables>::generate();
+		std::string filePath = (std::filesystem::temp_directory_path() / ("testIntervalSizeCache" + std::to_string(Variables) + ".isc")).string();
+		generated.save(filePath);
+		{
+			IntervalSizeCache<Variables> loaded = IntervalSizeCache<Variables>::load(filePath);
+			ASSERT(loaded.size() == generated.size());
+
+			MBF e = MBF::getBot();
+			MBF a = MBF::getTop();
+			INT(e, a).forEach([&](const MBF& top) {
+				INT(e, top).forEach([&](const MBF& bot) {
+					ASSERT(loaded.getIntervalSize(bot, top) == generated.getIntervalSize(bot, top));
+				});
+				ASSERT(loaded.getIntervalSizeFromBot(top) == generated.getIntervalSizeFromBot(top));
+			});
+		}
+		std::filesystem::remove(filePath);
+	}
+};
+
+TEST_CASE(testIntervalSizeCacheSaveLoad) {
+	runFunctionRange<1, 4, IntervalSizeCacheSaveLoadTest>();
+}
+
+static BooleanFunction<5> memoTestKey(uint32_t k) {
+	BooleanFunction<5> key;
+	key.bitset.data = k * 2654435761U + 1;
+	return key;
+}
+
+TEST_CASE(testConcurrentMemoTableInsertsOnce) {
+	constexpr uint32_t KEY_COUNT = 20000;
+	ConcurrentMemoTable<BooleanFunction<5>, uint64_t> table(KEY_COUNT);
+	std::atomic<uint64_t> addedCount(0);
+
+	// Every thread inserts all keys, starting at a different place, so each key is raced for
+	std::vector<std::thread> threads;
+	for(uint32_t t = 0; t < 4; t++) {
+		threads.emplace_back([&, t]() {
+			MemoFrontCache<BooleanFunction<5>, uint64_t> frontCache;
+			for(uint32_t i = 0; i < KEY_COUNT; i++) {
+				uint32_t k = (i + t * KEY_COUNT / 4) % KEY_COUNT;
+				uint64_t found;
+				if(findMemoized(table, &frontCache, memoTestKey(k), found)) {
+					ASSERT(found == k);
+				} else if(table.insertIfAbsent(memoTestKey(k), k)) {
+					addedCount.fetch_add(1);
+				}
+			}
+		});
+	}
+	for(std::thread& t : threads) t.join();
+
+	ASSERT(addedCount.load() == KEY_COUNT);
+	ASSERT(table.size() == KEY_COUNT);
+	for(uint32_t k = 0; k < KEY_COUNT; k++) {
+		uint64_t found;
+		ASSERT(table.find(memoTestKey(k), found));
+		ASSERT(found == k);
+	}
+}
+
+TEST_CASE(testConcurrentMemoTableEvictionStaysBounded) {
+	ConcurrentMemoTable<BooleanFunction<5>, uint64_t> table(64, true);
+	for(uint32_t k = 0; k < 10000; k++) {
+		table.insertIfAbsent(memoTestKey(k), k);
+	}
+	ASSERT(table.size() <= table.getSlotCount());
+	ASSERT(table.getEvictionCount() > 0);
+	size_t stillPresent = 0;
+	for(uint32_t k = 0; k < 10000; k++) {
+		uint64_t found;
+		if(table.find(memoTestKey(k), found)) {
+			ASSERT(found == k);
+			stillPresent++;
+		}
+	}
+	ASSERT(stillPresent > 0);
+	ASSERT(stillPresent <= table.getSlotCount());
+}
+
+// Half the keys get the same 7 bit tag and home group, the last one, so they fill it and probe on from group 0
+TEST_CASE(testSwissMapMatchesBufferedMap) {
+	constexpr size_t KEY_COUNT = 100;
+	SwissMap<BooleanFunction<5>, uint64_t> swiss(KEY_COUNT);
+	BufferedMap<BooleanFunction<5>, uint64_t> chained(KEY_COUNT);
+	size_t lastGroup = swiss.getSlotCount() / SwissMap<BooleanFunction<5>, uint64_t>::GROUP_SIZE - 1;
+	auto hashOf = [&](uint32_t k) -> uint64_t {
+		return k % 2 == 0 ? (uint64_t(0x2A) << 57) | lastGroup : swissHashOf(memoTestKey(k));
+	};
+
+	for(uint32_t k = 0; k < KEY_COUNT; k++) {
+		ASSERT(swiss.add(memoTestKey(k), k * 3, hashOf(k)));
+		ASSERT(chained.add(memoTestKey(k), k * 3));
+	}
+	ASSERT(swiss.size() == chained.size());
+	for(uint32_t k = 0; k < KEY_COUNT; k++) {
+		ASSERT(!swiss.add(memoTestKey(k), 0, hashOf(k)));
+		ASSERT(swiss.getOrAdd(memoTestKey(k), 0, hashOf(k)).value == chained.getOrAdd(memoTestKey(k), 0).value);
+	}
+
+	// Misses of the shared tag walk the same wrapped probe sequence as the hits
+	bool wrapped = false;
+	for(uint32_t k = 0; k < 2 * KEY_COUNT; k++) {
+		const KeyValue<BooleanFunction<5>, uint64_t>* swissFound = swiss.find(memoTestKey(k), hashOf(k));
+		const KeyValue<BooleanFunction<5>, uint64_t>* chainedFound = chained.find(memoTestKey(k));
+		ASSERT((swissFound == nullptr) == (chainedFound == nullptr));
+		if(swissFound != nullptr) {
+			ASSERT(swissFound->value == chainedFound->value);
+			if(k % 2 == 0 && size_t(swissFound - swiss.slots) < lastGroup * SwissMap<BooleanFunction<5>, uint64_t>::GROUP_SIZE) wrapped = true;
+		}
+	}
+	ASSERT(wrapped);
+
+	size_t visited = 0;
+	swiss.forEach([&](const KeyValue<BooleanFunction<5>, uint64_t>& item) {
+		visited++;
+		ASSERT(chained.get(item.key).value == item.value);
+	});
+	ASSERT(visited == chained.size());
+}
+
 
 
 
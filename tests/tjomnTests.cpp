@@ -9,6 +9,8 @@
 #include "../dedelib/tjomn.h"
 #include "../dedelib/collectionOperations.h"
 
+#include <filesystem>
+
 // destroys b
 template<typename AIter, typename BIter>
 bool unordered_contains_all(AIter aIter, AIter aEnd, BIter bStart, BIter bEnd) {
@@ -167,7 +169,14 @@ TEST_CASE(testRevolutionMemoized) {
 	constexpr unsigned int Degree = 4;
 	std::cout << "\n";
 
-	u192 d = revolutionMemoized<Degree>();
+	std::string cacheFile = (std::filesystem::temp_directory_path() / "testRevolutionMemoized.isc").string();
+	std::filesystem::remove(cacheFile);
+	u192 d = revolutionMemoized<Degree>(cacheFile); // Generates and saves the cache
+	u192 fromSavedCache = revolutionMemoized<Degree>(cacheFile); // Maps the saved cache
+	std::filesystem::remove(cacheFile);
+	ASSERT(d.low == dedekindNumbers[Degree + 3]);
+	ASSERT(fromSavedCache.low == d.low);
+	ASSERT(fromSavedCache.mid == d.mid);
 
 	std::cout << "D(" << (Degree + 3) << ") = " << d << "\n";
 }